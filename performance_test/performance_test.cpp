@@ -3,9 +3,19 @@
 #include <time.h>
 #include <algorithm>
 #include <sys/time.h>
+#include <math.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
 
 #include "../src/wat_array.hpp"
+#include "../src/wavelet_matrix.hpp"
+#include "../src/huffman_wat_array.hpp"
+#include "../src/multiary_wat_array.hpp"
+#include "../src/wat_array_executor.hpp"
+#include "../src/wat_array_thread_pool.hpp"
+#include "../src/geo_index.hpp"
 
 using namespace std;
 
@@ -58,7 +68,7 @@ void SortUniqCount(const vector<uint64_t>& array,
 
 
 struct QuerySet {
-  QuerySet(int iter_num, uint64_t length, uint64_t alphabet_num) : 
+  QuerySet(int iter_num, uint64_t length, uint64_t alphabet_num, bool skewed = false) : 
     iter_num(iter_num),
     length(length),
     alphabet_num(alphabet_num),
@@ -73,7 +83,13 @@ struct QuerySet {
     range_alpha_queries(iter_num, alphabet_num) {
 
     for (uint64_t i = 0; i < length; ++i){
-      array[i] = rand() % alphabet_num;
+      if (skewed){
+	// log-uniform, so that small values dominate as in Zipfian data
+	double r = (double)rand() / ((double)RAND_MAX + 1.0);
+	array[i] = (uint64_t)pow((double)alphabet_num, r) - 1;
+      } else {
+	array[i] = rand() % alphabet_num;
+      }
       freqs[array[i]]++;
     }
 
@@ -262,7 +278,8 @@ void TestBaseline(QuerySet& qs){
         << scientific<< list_max_range_one_time  * ratio_micro << "\t"
         << scientific<< list_max_range_ten_time  * ratio_micro << "\t"
         << scientific<< list_mode_range_one_time  * ratio_micro << "\t"
-        << scientific<< list_mode_range_ten_time * ratio_micro << endl;
+        << scientific<< list_mode_range_ten_time * ratio_micro << "\t"
+        << scientific<< (double)(sizeof(array[0]) * array.size()) << endl;
 
   if (dummy == 7777) {
     cerr << ""; // remove optimization
@@ -270,8 +287,8 @@ void TestBaseline(QuerySet& qs){
 }
 
 
-void TestWatArray(QuerySet& qs){
-  wat_array::WatArray ws;
+template <class Index>
+void TestIndex(QuerySet& qs, Index& ws){
   double begin_time = 0.0;
 
   begin_time = gettimeofday_sec();
@@ -389,7 +406,614 @@ void TestWatArray(QuerySet& qs){
         << scientific<< list_max_range_one_time  * ratio_micro << "\t"
         << scientific<< list_max_range_ten_time  * ratio_micro << "\t"
         << scientific<< list_mode_range_one_time  * ratio_micro << "\t"
-        << scientific<< list_mode_range_ten_time * ratio_micro<< endl;
+        << scientific<< list_mode_range_ten_time * ratio_micro << "\t"
+        << scientific<< (double)ws.GetUsageBytes() << endl;
+  if (dummy == 7777) cerr << "";
+}
+
+template <class Index = wat_array::WatArray>
+void TestWatArray(QuerySet& qs, wat_array::BitArray::Layout layout){
+  Index ws;
+  ws.set_layout(layout);
+  TestIndex(qs, ws);
+}
+
+void TestMultiaryWatArray(QuerySet& qs, uint64_t symbol_bit_num){
+  wat_array::MultiaryWatArray ws;
+  ws.set_symbol_bit_num(symbol_bit_num);
+  TestIndex(qs, ws);
+}
+
+void TestBitArraySelect(uint64_t length, uint64_t one_ratio, int iter_num){
+  wat_array::BitArray ba(length);
+  for (uint64_t i = 0; i < length; ++i){
+    if (rand() % one_ratio == 0) ba.SetBit(1, i);
+  }
+  ba.Build();
+
+  vector<uint64_t> ranks(iter_num);
+  for (int i = 0; i < iter_num; ++i){
+    ranks[i] = rand() % ba.one_num() + 1;
+  }
+
+  uint64_t dummy = 0;
+  double begin_time = gettimeofday_sec();
+  for (int i = 0; i < iter_num; ++i){
+    dummy += ba.Select(1, ranks[i]);
+  }
+  double select_time = gettimeofday_sec() - begin_time;
+
+  cerr  << scientific<< length  << "\t"
+        << one_ratio  << "\t"
+        << scientific<< select_time / iter_num * 1000000.0 << "\t"
+        << scientific<< (double)ba.GetUsageBytes() << "\t"
+        << fixed << 100.0 * ba.GetSelectIndexBytes() / ba.GetUsageBytes() << endl;
+  if (dummy == 7777) cerr << "";
+}
+
+void TestBitArrayKernels(uint64_t length, int iter_num){
+  wat_array::BitArray ba(length);
+  for (uint64_t i = 0; i < length; ++i){
+    ba.SetBit(rand() % 2, i);
+  }
+  ba.Build();
+
+  vector<uint64_t> poses(iter_num);
+  vector<uint64_t> ranks(iter_num);
+  for (int i = 0; i < iter_num; ++i){
+    poses[i] = rand() % (length + 1);
+    ranks[i] = rand() % ba.one_num() + 1;
+  }
+
+  uint64_t features = wat_array::BitArray::cpu_features();
+  uint64_t dummy = 0;
+  for (int hardware = 0; hardware < 2; ++hardware){
+    wat_array::BitArray::set_cpu_features(hardware ? features : 0);
+
+    double begin_time = gettimeofday_sec();
+    for (int i = 0; i < iter_num; ++i){
+      dummy += ba.Rank(1, poses[i]);
+    }
+    double rank_time = gettimeofday_sec() - begin_time;
+
+    begin_time = gettimeofday_sec();
+    for (int i = 0; i < iter_num; ++i){
+      dummy += ba.Select(1, ranks[i]);
+    }
+    double select_time = gettimeofday_sec() - begin_time;
+
+    cerr  << (hardware ? "hardware" : "portable") << "\t"
+	  << scientific<< length << "\t"
+	  << scientific<< rank_time / iter_num * 1000000.0 << "\t"
+	  << scientific<< select_time / iter_num * 1000000.0 << endl;
+  }
+  wat_array::BitArray::set_cpu_features(features);
+  if (dummy == 7777) cerr << "";
+}
+
+void TestBitArrayRankBatch(uint64_t length, uint64_t batch_num, uint64_t query_num){
+  wat_array::BitArray ba(length);
+  for (uint64_t i = 0; i < length; ++i){
+    ba.SetBit(rand() % 2, i);
+  }
+  ba.Build();
+
+  vector<uint64_t> poses(query_num);
+  vector<uint64_t> ranks(query_num);
+  for (uint64_t i = 0; i < query_num; ++i){
+    poses[i] = rand() % (length + 1);
+  }
+
+  uint64_t dummy = 0;
+  double begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    ranks[i] = ba.Rank(1, poses[i]);
+  }
+  dummy += ranks[query_num / 2];
+  double loop_time = gettimeofday_sec() - begin_time;
+
+  uint64_t features = wat_array::BitArray::cpu_features();
+  double batch_times[2];
+  for (int hardware = 0; hardware < 2; ++hardware){
+    wat_array::BitArray::set_cpu_features(hardware ? features : 0);
+    begin_time = gettimeofday_sec();
+    for (uint64_t i = 0; i < query_num; i += batch_num){
+      ba.RankBatch(1, &poses[i], min(batch_num, query_num - i), &ranks[i]);
+    }
+    dummy += ranks[query_num / 2];
+    batch_times[hardware] = gettimeofday_sec() - begin_time;
+  }
+  wat_array::BitArray::set_cpu_features(features);
+
+  cerr  << scientific << length << "\t"
+	<< batch_num << "\t"
+	<< scientific << loop_time / query_num * 1000000.0 << "\t"
+	<< scientific << batch_times[0] / query_num * 1000000.0 << "\t"
+	<< scientific << batch_times[1] / query_num * 1000000.0 << endl;
+  if (dummy == 7777) cerr << "";
+}
+
+void TestWatArrayBatch(uint64_t length, uint64_t alphabet_num, uint64_t query_num){
+  vector<uint64_t> array(length);
+  for (uint64_t i = 0; i < length; ++i){
+    array[i] = rand() % alphabet_num;
+  }
+  wat_array::WatArray wa;
+  wa.Init(array);
+
+  vector<uint64_t> poses(query_num), cs(query_num), min_cs(query_num);
+  vector<uint64_t> beg_poses(query_num), end_poses(query_num), ks(query_num);
+  for (uint64_t i = 0; i < query_num; ++i){
+    RandomQuery rq(length);
+    poses[i] = rand() % length;
+    cs[i] = rand() % alphabet_num;
+    min_cs[i] = cs[i] / 2;
+    beg_poses[i] = rq.beg;
+    end_poses[i] = rq.end;
+    ks[i] = (rq.end - rq.beg) / 2;
+  }
+  vector<uint64_t> results(query_num), quantile_poses(query_num);
+
+  uint64_t dummy = 0;
+  double times[8];
+  double begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    dummy += wa.Lookup(poses[i]);
+  }
+  times[0] = gettimeofday_sec() - begin_time;
+  begin_time = gettimeofday_sec();
+  wa.LookupBatch(&poses[0], query_num, &results[0]);
+  times[1] = gettimeofday_sec() - begin_time;
+
+  begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    dummy += wa.Rank(cs[i], poses[i]);
+  }
+  times[2] = gettimeofday_sec() - begin_time;
+  begin_time = gettimeofday_sec();
+  wa.RankBatch(&cs[0], &poses[0], query_num, &results[0]);
+  times[3] = gettimeofday_sec() - begin_time;
+
+  begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    uint64_t pos = 0;
+    uint64_t val = 0;
+    wa.QuantileRange(beg_poses[i], end_poses[i], ks[i], pos, val);
+    dummy += pos;
+  }
+  times[4] = gettimeofday_sec() - begin_time;
+  begin_time = gettimeofday_sec();
+  wa.QuantileRangeBatch(&beg_poses[0], &end_poses[0], &ks[0], query_num, 
+			&quantile_poses[0], &results[0]);
+  times[5] = gettimeofday_sec() - begin_time;
+
+  begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    dummy += wa.FreqRange(min_cs[i], cs[i], beg_poses[i], end_poses[i]);
+  }
+  times[6] = gettimeofday_sec() - begin_time;
+  begin_time = gettimeofday_sec();
+  wa.FreqRangeBatch(&min_cs[0], &cs[0], &beg_poses[0], &end_poses[0], query_num, &results[0]);
+  times[7] = gettimeofday_sec() - begin_time;
+  dummy += results[query_num / 2];
+
+  cerr << scientific << length << "\t"
+       << scientific << alphabet_num;
+  for (int i = 0; i < 8; ++i){
+    cerr << "\t" << scientific << times[i] / query_num * 1000000.0;
+  }
+  cerr << endl;
+  if (dummy == 7777) cerr << "";
+}
+
+void TestWatArrayExecutor(uint64_t length, uint64_t alphabet_num, uint64_t query_num){
+  vector<uint64_t> array(length);
+  for (uint64_t i = 0; i < length; ++i){
+    array[i] = rand() % alphabet_num;
+  }
+  wat_array::WatArray wa;
+  wa.Init(array);
+
+  vector<uint64_t> poses(query_num), cs(query_num), ranks(query_num);
+  vector<uint64_t> beg_poses(query_num), end_poses(query_num);
+  for (uint64_t i = 0; i < query_num; ++i){
+    RandomQuery rq(length);
+    poses[i] = rand() % length;
+    cs[i] = rand() % alphabet_num;
+    beg_poses[i] = rq.beg;
+    end_poses[i] = rq.end;
+  }
+  vector<uint64_t> results(5 * query_num);
+
+  // a mix of lookup, rank, quantile_range and freq_range queries
+  uint64_t dummy = 0;
+  double begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    uint64_t pos = 0;
+    uint64_t val = 0;
+    dummy += wa.Lookup(poses[i]);
+    dummy += wa.Rank(cs[i], poses[i]);
+    wa.QuantileRange(beg_poses[i], end_poses[i], (end_poses[i] - beg_poses[i]) / 2, pos, val);
+    dummy += wa.FreqRange(cs[i] / 2, cs[i], beg_poses[i], end_poses[i]) + pos;
+  }
+  double loop_time = gettimeofday_sec() - begin_time;
+
+  cerr << scientific << length << "\t"
+       << scientific << alphabet_num << "\t"
+       << scientific << loop_time / query_num * 1000000.0;
+  for (uint64_t interleave_num = 4; interleave_num <= 64; interleave_num *= 4){
+    wat_array::WatArrayExecutor executor(wa);
+    executor.set_interleave_num(interleave_num);
+    begin_time = gettimeofday_sec();
+    for (uint64_t i = 0; i < query_num; ++i){
+      uint64_t* result = &results[5 * i];
+      executor.Lookup(poses[i], result);
+      executor.Rank(cs[i], poses[i], result + 1);
+      executor.QuantileRange(beg_poses[i], end_poses[i], (end_poses[i] - beg_poses[i]) / 2, 
+			     result + 2, result + 3);
+      executor.FreqRange(cs[i] / 2, cs[i], beg_poses[i], end_poses[i], result + 4);
+    }
+    executor.Run();
+    dummy += results[query_num];
+    cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0;
+  }
+  cerr << endl;
+  if (dummy == 7777) cerr << "";
+}
+
+void TestWatArrayFreqRange(uint64_t length, uint64_t alphabet_num, uint64_t query_num){
+  vector<uint64_t> array(length);
+  for (uint64_t i = 0; i < length; ++i){
+    array[i] = rand() % alphabet_num;
+  }
+  wat_array::WatArray wa;
+  wa.Init(array);
+
+  vector<RandomQuery> rqs, arqs;
+  for (uint64_t i = 0; i < query_num; ++i){
+    rqs.push_back(RandomQuery(length));
+    arqs.push_back(RandomQuery(alphabet_num));
+  }
+  // FreqRange() as four RankLessThan() against the single descent
+  uint64_t dummy = 0;
+  double begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    dummy += 
+      + wa.RankLessThan(arqs[i].end, rqs[i].end) - wa.RankLessThan(arqs[i].beg, rqs[i].end)
+      - wa.RankLessThan(arqs[i].end, rqs[i].beg) + wa.RankLessThan(arqs[i].beg, rqs[i].beg);
+  }
+  double rank_time = gettimeofday_sec() - begin_time;
+  begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    dummy += wa.FreqRange(arqs[i].beg, arqs[i].end, rqs[i].beg, rqs[i].end);
+  }
+  double freq_time = gettimeofday_sec() - begin_time;
+  cerr << scientific << length << "\t"
+       << scientific << alphabet_num << "\t"
+       << scientific << rank_time / query_num * 1000000.0 << "\t"
+       << scientific << freq_time / query_num * 1000000.0 << endl;
+  if (dummy == 7777) cerr << "";
+}
+
+void TestWatArraySumRange(uint64_t length, uint64_t alphabet_num, uint64_t query_num){
+  vector<uint64_t> array(length);
+  for (uint64_t i = 0; i < length; ++i){
+    array[i] = rand() % alphabet_num;
+  }
+  wat_array::WatArray wa;
+  wa.set_moment_num(2);
+  wa.Init(array);
+
+  vector<RandomQuery> rqs, arqs;
+  for (uint64_t i = 0; i < query_num; ++i){
+    rqs.push_back(RandomQuery(length));
+    arqs.push_back(RandomQuery(alphabet_num));
+  }
+  cerr << scientific << length << "\t"
+       << scientific << alphabet_num;
+  uint64_t dummy = 0;
+  for (uint64_t moment = 0; moment <= 2; ++moment){
+    double begin_time = gettimeofday_sec();
+    for (uint64_t i = 0; i < query_num; ++i){
+      dummy += wa.MomentRange(arqs[i].beg, arqs[i].end, rqs[i].beg, rqs[i].end, moment);
+    }
+    cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0;
+  }
+  cerr << "\t" << (double)wa.GetMomentUsageBytes() * 8 / length << endl;
+  if (dummy == 7777) cerr << "";
+}
+
+void TestWatArrayNextValue(uint64_t length, uint64_t alphabet_num, uint64_t query_num){
+  vector<uint64_t> array(length);
+  for (uint64_t i = 0; i < length; ++i){
+    array[i] = rand() % alphabet_num;
+  }
+  wat_array::WatArray wa;
+  wa.Init(array);
+
+  vector<RandomQuery> rqs;
+  vector<uint64_t> xs;
+  for (uint64_t i = 0; i < query_num; ++i){
+    rqs.push_back(RandomQuery(length));
+    xs.push_back(rand() % alphabet_num);
+  }
+  cerr << scientific << length << "\t"
+       << scientific << alphabet_num;
+  // the smallest value >= x by a count and a quantile, by a list of 
+  // one, and by the successor query with and without the position
+  uint64_t dummy = 0;
+  double begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    uint64_t k = wa.FreqRange(0, xs[i], rqs[i].beg, rqs[i].end);
+    if (k == rqs[i].end - rqs[i].beg) continue;
+    uint64_t pos = 0;
+    uint64_t val = 0;
+    wa.QuantileRange(rqs[i].beg, rqs[i].end, k, pos, val);
+    dummy += pos + val;
+  }
+  cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0;
+  begin_time = gettimeofday_sec();
+  vector<wat_array::ListResult> lrs;
+  for (uint64_t i = 0; i < query_num; ++i){
+    wa.ListMinRange(xs[i], alphabet_num, rqs[i].beg, rqs[i].end, 1, lrs);
+    if (!lrs.empty()) dummy += lrs[0].c;
+  }
+  cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0;
+  begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    dummy += wa.RangeNextValue(rqs[i].beg, rqs[i].end, xs[i]);
+  }
+  cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0;
+  begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    uint64_t pos = 0;
+    uint64_t val = 0;
+    wa.RangeNextValue(rqs[i].beg, rqs[i].end, xs[i], pos, val);
+    dummy += pos + val;
+  }
+  cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0;
+  begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    dummy += wa.RangePrevValue(rqs[i].beg, rqs[i].end, xs[i]);
+  }
+  cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0 << endl;
+  if (dummy == 7777) cerr << "";
+}
+
+void TestWatArrayRangeMinMax(uint64_t length, uint64_t alphabet_num, uint64_t query_num){
+  vector<uint64_t> array(length);
+  for (uint64_t i = 0; i < length; ++i){
+    array[i] = rand() % alphabet_num;
+  }
+  wat_array::WatArray wa;
+  wa.Init(array);
+  wat_array::WatArray rmq_wa;
+  rmq_wa.set_range_min_max(true);
+  rmq_wa.Init(array);
+
+  vector<RandomQuery> rqs;
+  for (uint64_t i = 0; i < query_num; ++i){
+    rqs.push_back(RandomQuery(length));
+  }
+  cerr << scientific << length << "\t"
+       << scientific << alphabet_num;
+  uint64_t dummy = 0;
+  const wat_array::WatArray* was[] = {&wa, &rmq_wa};
+  for (int w = 0; w < 2; ++w){
+    double begin_time = gettimeofday_sec();
+    for (uint64_t i = 0; i < query_num; ++i){
+      uint64_t pos = 0;
+      uint64_t val = 0;
+      was[w]->MinRange(rqs[i].beg, rqs[i].end, pos, val);
+      dummy += pos + val;
+    }
+    cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0;
+    begin_time = gettimeofday_sec();
+    for (uint64_t i = 0; i < query_num; ++i){
+      uint64_t pos = 0;
+      uint64_t val = 0;
+      was[w]->MaxRange(rqs[i].beg, rqs[i].end, pos, val);
+      dummy += pos + val;
+    }
+    cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0;
+  }
+  cerr << "\t" << (double)(rmq_wa.GetUsageBytes() - wa.GetUsageBytes()) * 8 / length << endl;
+  if (dummy == 7777) cerr << "";
+}
+
+void TestGeoIndex(uint64_t length, uint64_t x_ratio, uint64_t y_ratio, uint64_t query_num){
+  // lat/lon in units of 1e-7 degrees
+  const uint64_t width  = 3600000000LLU;
+  const uint64_t height = 1800000000LLU;
+  vector<uint64_t> xs(length);
+  vector<uint64_t> ys(length);
+  vector<pair<uint64_t, uint64_t> > points(length);
+  for (uint64_t i = 0; i < length; ++i){
+    xs[i] = (((uint64_t)rand() << 31) | rand()) % width;
+    ys[i] = (((uint64_t)rand() << 31) | rand()) % height;
+    points[i] = make_pair(xs[i], ys[i]);
+  }
+  sort(points.begin(), points.end());
+  wat_array::GeoIndex gi;
+  gi.Init(xs, ys);
+
+  vector<uint64_t> min_xs;
+  vector<uint64_t> min_ys;
+  for (uint64_t i = 0; i < query_num; ++i){
+    min_xs.push_back(rand() % (width  - width  / x_ratio));
+    min_ys.push_back(rand() % (height - height / y_ratio));
+  }
+  cerr << scientific << length << "\t"
+       << scientific << x_ratio << "\t"
+       << scientific << y_ratio;
+  // the baseline scans the points sorted by x in the x range
+  uint64_t dummy = 0;
+  uint64_t occ = 0;
+  double begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    uint64_t max_x = min_xs[i] + width  / x_ratio;
+    uint64_t max_y = min_ys[i] + height / y_ratio;
+    vector<pair<uint64_t, uint64_t> >::const_iterator it = 
+      lower_bound(points.begin(), points.end(), make_pair(min_xs[i], (uint64_t)0));
+    for (; it != points.end() && it->first < max_x; ++it){
+      if (min_ys[i] <= it->second && it->second < max_y) ++dummy;
+    }
+  }
+  cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0;
+  begin_time = gettimeofday_sec();
+  for (uint64_t i = 0; i < query_num; ++i){
+    occ += gi.Count(min_xs[i], min_xs[i] + width / x_ratio, 
+		    min_ys[i], min_ys[i] + height / y_ratio);
+  }
+  cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0;
+  begin_time = gettimeofday_sec();
+  vector<pair<uint64_t, uint64_t> > scan_res;
+  for (uint64_t i = 0; i < query_num; ++i){
+    uint64_t max_x = min_xs[i] + width  / x_ratio;
+    uint64_t max_y = min_ys[i] + height / y_ratio;
+    vector<pair<uint64_t, uint64_t> >::const_iterator it = 
+      lower_bound(points.begin(), points.end(), make_pair(min_xs[i], (uint64_t)0));
+    scan_res.clear();
+    for (; it != points.end() && it->first < max_x; ++it){
+      if (min_ys[i] <= it->second && it->second < max_y) scan_res.push_back(*it);
+    }
+    dummy += scan_res.size();
+  }
+  cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0;
+  begin_time = gettimeofday_sec();
+  vector<wat_array::GeoPoint> res;
+  for (uint64_t i = 0; i < query_num; ++i){
+    gi.Report(min_xs[i], min_xs[i] + width / x_ratio, 
+	      min_ys[i], min_ys[i] + height / y_ratio, res);
+    dummy += res.size();
+  }
+  cerr << "\t" << scientific << (gettimeofday_sec() - begin_time) / query_num * 1000000.0
+       << "\t" << scientific << (double)occ / query_num
+       << "\t" << scientific << (double)gi.GetUsageBytes() * 8 / length << endl;
+  if (dummy == 7777) cerr << "";
+}
+
+void TestWatArrayThreadPool(uint64_t length, uint64_t alphabet_num, uint64_t query_num){
+  vector<uint64_t> array(length);
+  for (uint64_t i = 0; i < length; ++i){
+    array[i] = rand() % alphabet_num;
+  }
+  wat_array::WatArray wa;
+  wa.Init(array);
+
+  // a mix of freq_range, quantile_range and list_mode_range num = 10
+  vector<wat_array::RangeQuery> queries;
+  for (uint64_t i = 0; i < query_num; ++i){
+    RandomQuery rq(length);
+    RandomQuery arq(alphabet_num);
+    uint64_t k = (i % 3 == 2) ? 10 : (rq.end - rq.beg) / 2;
+    queries.push_back(wat_array::RangeQuery((wat_array::RangeQuery::Type)(i % 3), 
+					    arq.beg, arq.end, rq.beg, rq.end, k));
+  }
+
+  cerr << scientific << length << "\t"
+       << scientific << alphabet_num;
+  for (uint64_t thread_num = 1; thread_num <= 8; thread_num *= 2){
+    wat_array::WatArrayThreadPool pool(wa, thread_num);
+    vector<wat_array::RangeResult> results;
+    double begin_time = gettimeofday_sec();
+    pool.Run(queries, results);
+    cerr << "\t" << scientific << query_num / (gettimeofday_sec() - begin_time);
+  }
+  cerr << endl;
+}
+
+void TestBitArrayLoad(uint64_t length){
+  vector<uint64_t> blocks((length + 63) / 64);
+  wat_array::BitArray ba(length);
+  for (uint64_t i = 0; i < length; ++i){
+    if (rand() % 2){
+      blocks[i / 64] |= 1LLU << (i % 64);
+      ba.SetBit(1, i);
+    }
+  }
+  ba.Build();
+
+  // the raw blocks of older versions and the current format
+  ostringstream legacy_os;
+  legacy_os.write((const char*)(&length), sizeof(length));
+  legacy_os.write((const char*)(&blocks[0]), sizeof(blocks[0]) * blocks.size());
+  ostringstream os;
+  ba.Save(os);
+
+  istringstream legacy_is(legacy_os.str());
+  double begin_time = gettimeofday_sec();
+  wat_array::BitArray legacy_load;
+  legacy_load.Load(legacy_is);
+  double legacy_time = gettimeofday_sec() - begin_time;
+
+  istringstream is(os.str());
+  begin_time = gettimeofday_sec();
+  wat_array::BitArray load;
+  load.Load(is);
+  double load_time = gettimeofday_sec() - begin_time;
+
+  cerr  << "bit_array\t"
+	<< scientific << length << "\t"
+	<< scientific << legacy_time << "\t"
+	<< scientific << load_time << endl;
+  if (legacy_load.one_num() + load.one_num() == 7777) cerr << "";
+}
+
+void TestWatArrayBuild(uint64_t length, uint64_t alphabet_num){
+  vector<uint64_t> array(length);
+  for (uint64_t i = 0; i < length; ++i){
+    array[i] = rand() % alphabet_num;
+  }
+  cerr << scientific << length << "\t"
+       << scientific << alphabet_num;
+  for (uint64_t thread_num = 1; thread_num <= 8; thread_num *= 2){
+    double begin_time = gettimeofday_sec();
+    wat_array::WatArray wa;
+    wa.set_thread_num(thread_num);
+    wa.Init(array);
+    cerr << "\t" << scientific << gettimeofday_sec() - begin_time;
+  }
+  cerr << endl;
+}
+
+void TestWatArrayLoad(uint64_t length, uint64_t alphabet_num){
+  vector<uint64_t> array(length);
+  for (uint64_t i = 0; i < length; ++i){
+    array[i] = rand() % alphabet_num;
+  }
+  wat_array::WatArray wa;
+  wa.Init(array);
+
+  char filename[] = "/tmp/wat_array_perf_XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0) return;
+  close(fd);
+  {
+    ofstream ofs(filename, ios::binary);
+    wa.Save(ofs);
+  }
+
+  double begin_time = gettimeofday_sec();
+  wat_array::WatArray wa_load;
+  {
+    ifstream ifs(filename, ios::binary);
+    wa_load.Load(ifs);
+  }
+  double load_time = gettimeofday_sec() - begin_time;
+
+  begin_time = gettimeofday_sec();
+  wat_array::WatArray wa_map;
+  wa_map.Map(filename);
+  double map_time = gettimeofday_sec() - begin_time;
+
+  uint64_t dummy = wa_load.Rank(0, length / 2) + wa_map.Rank(0, length / 2);
+  remove(filename);
+
+  cerr  << "wat_array\t"
+	<< scientific << length << "\t"
+	<< scientific << load_time << "\t"
+	<< scientific << map_time << endl;
   if (dummy == 7777) cerr << "";
 }
 
@@ -408,12 +1032,29 @@ int main(int argc, char* argv[]){
         << "list_max_one"  << "\t"
         << "list_max_ten"  << "\t"
         << "list_mode_one"  << "\t"
-        << "list_mode_ten" << endl;
+        << "list_mode_ten" << "\t"
+        << "size(bytes)" << endl;
 
   for (uint64_t length = 1000; length <= 100000000; length *= 10){
     for (uint64_t alphabet_num = 10; alphabet_num <= length ; alphabet_num *= 100){
       QuerySet qs(100, length, alphabet_num);
-      cerr << "ws "; TestWatArray(qs);
+      cerr << "ws "; TestWatArray(qs, wat_array::BitArray::INTERLEAVED_LAYOUT);
+      cerr << "ws_sep "; TestWatArray(qs, wat_array::BitArray::SEPARATE_LAYOUT);
+      cerr << "wm "; TestWatArray<wat_array::WaveletMatrix>(qs, wat_array::BitArray::INTERLEAVED_LAYOUT);
+      cerr << "wk4 "; TestMultiaryWatArray(qs, 2);
+      cerr << "wk16 "; TestMultiaryWatArray(qs, 4);
+    }
+  }
+
+  cerr << "skewed (log-uniform) arrays" << endl;
+  for (uint64_t length = 1000; length <= 100000000; length *= 10){
+    for (uint64_t alphabet_num = 10; alphabet_num <= length ; alphabet_num *= 100){
+      QuerySet qs(100, length, alphabet_num, true);
+      cerr << "ws "; TestWatArray(qs, wat_array::BitArray::INTERLEAVED_LAYOUT);
+      cerr << "ws_rrr "; TestWatArray(qs, wat_array::BitArray::RRR_LAYOUT);
+      cerr << "ws_auto "; TestWatArray(qs, wat_array::BitArray::AUTO_LAYOUT);
+      cerr << "wm_rrr "; TestWatArray<wat_array::WaveletMatrix>(qs, wat_array::BitArray::RRR_LAYOUT);
+      cerr << "wh "; TestWatArray<wat_array::HuffmanWatArray>(qs, wat_array::BitArray::INTERLEAVED_LAYOUT);
     }
   }
 
@@ -425,6 +1066,110 @@ int main(int argc, char* argv[]){
   }
 
 
-      
+  cerr << "build: total_time(sec.) wat_array by threads" << endl;
+  cerr << "length\talnum\t1\t2\t4\t8" << endl;
+  for (uint64_t length = 1000000; length <= 100000000; length *= 10){
+    for (uint64_t alphabet_num = 1000; alphabet_num <= 1000000; alphabet_num *= 1000){
+      TestWatArrayBuild(length, alphabet_num);
+    }
+  }
+
+  cerr << "batch: avg_time(micro sec.) wat_array single calls/batch" << endl;
+  cerr << "length\talnum\tlookup\tlookup_batch\trank\trank_batch"
+       << "\tquan_range\tquan_range_batch\tfreq_range\tfreq_range_batch" << endl;
+  for (uint64_t length = 1000000; length <= 100000000; length *= 10){
+    for (uint64_t alphabet_num = 1000; alphabet_num <= 1000000; alphabet_num *= 1000){
+      TestWatArrayBatch(length, alphabet_num, 1000000);
+    }
+  }
+
+  cerr << "executor: avg_time(micro sec.) of lookup+rank+quan_range+freq_range" << endl;
+  cerr << "length\talnum\tsingle\tinterleave4\tinterleave16\tinterleave64" << endl;
+  for (uint64_t length = 1000000; length <= 100000000; length *= 10){
+    for (uint64_t alphabet_num = 1000; alphabet_num <= 1000000; alphabet_num *= 1000){
+      TestWatArrayExecutor(length, alphabet_num, 1000000);
+    }
+  }
+
+  cerr << "freq_range: avg_time(micro sec.) wat_array" << endl;
+  cerr << "length\talnum\tfour_rank_less_than\tfreq_range" << endl;
+  for (uint64_t length = 1000000; length <= 100000000; length *= 10){
+    for (uint64_t alphabet_num = 1000; alphabet_num <= 1000000; alphabet_num *= 1000){
+      TestWatArrayFreqRange(length, alphabet_num, 1000000);
+    }
+  }
+
+  cerr << "sum_range: avg_time(micro sec.) wat_array with set_moment_num(2)" << endl;
+  cerr << "length\talnum\tfreq_range\tsum_range\tmoment2_range\tmoment_bits_per_value" << endl;
+  for (uint64_t length = 1000000; length <= 10000000; length *= 10){
+    TestWatArraySumRange(length, 1000, 1000000);
+  }
+
+  cerr << "next value: avg_time(micro sec.) of the smallest value >= x in a range" << endl;
+  cerr << "length\talnum\tfreq+quan_range\tlist_min_one\tnext_value\tnext_value_pos\tprev_value" << endl;
+  for (uint64_t length = 1000000; length <= 100000000; length *= 10){
+    for (uint64_t alphabet_num = 1000; alphabet_num <= 1000000; alphabet_num *= 1000){
+      TestWatArrayNextValue(length, alphabet_num, 1000000);
+    }
+  }
+
+  cerr << "range min/max: avg_time(micro sec.) wat_array without/with set_range_min_max(true)" << endl;
+  cerr << "length\talnum\tmin_range\tmax_range\tmin_range_rmq\tmax_range_rmq\trmq_bits_per_value" << endl;
+  for (uint64_t length = 1000000; length <= 100000000; length *= 10){
+    for (uint64_t alphabet_num = 1000; alphabet_num <= 1000000; alphabet_num *= 1000){
+      TestWatArrayRangeMinMax(length, alphabet_num, 100000);
+    }
+  }
+
+  cerr << "geo_index: avg_time(micro sec.) of 2D range queries, sides 1/x_ratio and 1/y_ratio of the lon/lat extents" << endl;
+  cerr << "length\tx_ratio\ty_ratio\tcount_scan\tcount\treport_scan\treport\tavg_occ\tbits_per_point" << endl;
+  for (uint64_t length = 1000000; length <= 10000000; length *= 10){
+    for (uint64_t side_ratio = 10; side_ratio <= 1000; side_ratio *= 10){
+      TestGeoIndex(length, side_ratio, side_ratio, side_ratio * 10);
+    }
+    // thin latitude bands across a wide longitude range
+    for (uint64_t y_ratio = 1000; y_ratio <= 100000; y_ratio *= 10){
+      TestGeoIndex(length, 10, y_ratio, 1000);
+    }
+  }
+
+  cerr << "thread pool: queries/sec. of freq_range+quan_range+list_mode_ten by threads" << endl;
+  cerr << "length\talnum\t1\t2\t4\t8" << endl;
+  for (uint64_t length = 1000000; length <= 100000000; length *= 10){
+    for (uint64_t alphabet_num = 1000; alphabet_num <= 1000000; alphabet_num *= 1000){
+      TestWatArrayThreadPool(length, alphabet_num, 10000);
+    }
+  }
+
+  cerr << "load: total_time(sec.) wat_array alnum=1000" << endl;
+  cerr << "method\tlength\tload_legacy/load\tload/map" << endl;
+  for (uint64_t length = 1000000; length <= 100000000; length *= 10){
+    TestBitArrayLoad(length);
+    TestWatArrayLoad(length, 1000);
+  }
+
+  cerr << "BitArray select: avg_time(micro sec.) size(bytes) select_index(%)" << endl;
+  cerr << "length\t1/density\tselect\tsize\tselect_index" << endl;
+  for (uint64_t length = 1000000; length <= 100000000; length *= 10){
+    for (uint64_t one_ratio = 2; one_ratio <= 128; one_ratio *= 8){
+      TestBitArraySelect(length, one_ratio, 100000);
+    }
+  }
+
+  cerr << "BitArray kernels: cpu_features=" << wat_array::BitArray::cpu_features() 
+       << " avg_time(micro sec.)" << endl;
+  cerr << "kernel\tlength\trank\tselect" << endl;
+  for (uint64_t length = 1000000; length <= 100000000; length *= 10){
+    TestBitArrayKernels(length, 1000000);
+  }
+
+  cerr << "BitArray rank batch: avg_time(micro sec.) per position" << endl;
+  cerr << "length\tbatch\tloop\tbatch_portable\tbatch_hardware" << endl;
+  for (uint64_t length = 1000000; length <= 100000000; length *= 10){
+    for (uint64_t batch_num = 16; batch_num <= 4096; batch_num *= 16){
+      TestBitArrayRankBatch(length, batch_num, 1000000);
+    }
+  }
+
   return 0;
 }
@@ -18,14 +18,294 @@
  */
 
 #include <cassert>
+#include <algorithm>
 #include "bit_array.hpp"
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#define WAT_ARRAY_CPU_DISPATCH 1
+#include <immintrin.h>
+#endif
+
 namespace wat_array {
 
-BitArray::BitArray() : length_(0), one_num_(0){
+namespace {
+
+struct PortableOps {
+  static uint64_t PopCount(uint64_t x) {
+    x = (x & 0x5555555555555555ULL) +
+      ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) +
+      ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    x = x + (x >>  8);
+    x = x + (x >> 16);
+    x = x + (x >> 32);
+    return x & 0x7FLLU;
+  }
+
+  static uint64_t SelectInBlock(uint64_t x, uint64_t rank) {
+    uint64_t x1 = x - ((x & 0xAAAAAAAAAAAAAAAALLU) >> 1);
+    uint64_t x2 = (x1 & 0x3333333333333333LLU) + ((x1 >> 2) & 0x3333333333333333LLU);
+    uint64_t x3 = (x2 + (x2 >> 4)) & 0x0F0F0F0F0F0F0F0FLLU;
+    
+    uint64_t pos = 0;
+    for (;;  pos += 8){
+      uint64_t rank_next = (x3 >> pos) & 0xFFLLU;
+      if (rank <= rank_next) break;
+      rank -= rank_next;
+    }
+
+    uint64_t v2 = (x2 >> pos) & 0xFLLU;
+    if (rank > v2) {
+      rank -= v2;
+      pos += 4;
+    }
+
+    uint64_t v1 = (x1 >> pos) & 0x3LLU;
+    if (rank > v1){
+      rank -= v1;
+      pos += 2;
+    }
+
+    uint64_t v0  = (x >> pos) & 0x1LLU;
+    if (v0 < rank){
+      rank -= v0;
+      pos += 1;
+    }
+
+    return pos;
+  }
+};
+
+}
+
+/**
+ * The rank kernels are written once for an Ops policy and instantiated
+ * both for the portable routines and, on x86-64 with GCC compatible 
+ * compilers, inside a function compiled for POPCNT. Which one runs is 
+ * decided by cpu_features_ at startup, so the library never executes 
+ * an instruction the CPU lacks.
+ */
+struct BitArrayKernel {
+  enum {
+    PREFETCH_DISTANCE = 16
+  };
+
+  template <class Ops>
+  static inline __attribute__((always_inline)) uint64_t RankOne(const BitArray& ba, uint64_t pos) {
+    uint64_t block_ind = pos / BitArray::BLOCK_BITNUM;
+    uint64_t bit_offset = pos % BitArray::BLOCK_BITNUM;
+    if (ba.storage_ == BitArray::INTERLEAVED_LAYOUT){
+      const BitArray::RankLine& line = ba.rank_lines_[block_ind / BitArray::LINE_BLOCKNUM];
+      uint64_t offset = block_ind % BitArray::LINE_BLOCKNUM;
+      return line.abs_rank + BitArray::GetRelRank(line, offset) 
+	+ Ops::PopCount(line.blocks[offset] & ((1LLU << bit_offset) - 1));
+    }
+
+    uint64_t table_ind = block_ind / BitArray::TABLE_INTERVAL;
+    assert(table_ind < ba.rank_tables_.size());
+
+    uint64_t rank = ba.rank_tables_[table_ind];
+    for (uint64_t i = table_ind * BitArray::TABLE_INTERVAL; i < block_ind; ++i){
+      rank += Ops::PopCount(ba.bit_blocks_[i]);
+    }
+    if (bit_offset) {
+      rank += Ops::PopCount(ba.bit_blocks_[block_ind] & ((1LLU << bit_offset) - 1));
+    }
+    return rank;
+  }
+
+  // always inlined, since GCC finds a separate function of prefetches 
+  // free of side effects and removes its calls
+  static inline __attribute__((always_inline)) void Prefetch(const BitArray& ba, uint64_t pos) {
+    if (pos > ba.length_) return;
+    uint64_t block_ind = pos / BitArray::BLOCK_BITNUM;
+    if (ba.storage_ == BitArray::INTERLEAVED_LAYOUT){
+      __builtin_prefetch(ba.rank_lines_.data() + block_ind / BitArray::LINE_BLOCKNUM);
+    } else {
+      __builtin_prefetch(ba.rank_tables_.data() + block_ind / BitArray::TABLE_INTERVAL);
+      __builtin_prefetch(ba.bit_blocks_.data() + block_ind);
+    }
+  }
+
+  template <class Ops>
+  static inline __attribute__((always_inline)) void RankBatch(const BitArray& ba, const uint64_t* poses, 
+							      uint64_t num, uint64_t* ranks) {
+    for (uint64_t i = 0; i < num; ++i){
+      if (i + PREFETCH_DISTANCE < num) Prefetch(ba, poses[i + PREFETCH_DISTANCE]);
+      ranks[i] = (poses[i] > ba.length_) ? NOTFOUND : RankOne<Ops>(ba, poses[i]);
+    }
+  }
+
+  static void RankBatchPortable(const BitArray& ba, const uint64_t* poses, 
+				uint64_t num, uint64_t* ranks);
+
+#ifdef WAT_ARRAY_CPU_DISPATCH
+  static uint64_t RankOnePopcnt(const BitArray& ba, uint64_t pos);
+  static void RankBatchPopcnt(const BitArray& ba, const uint64_t* poses, 
+			      uint64_t num, uint64_t* ranks);
+  static void RankBatchAvx2(const BitArray& ba, const uint64_t* poses, 
+			    uint64_t num, uint64_t* ranks);
+#endif
+};
+
+void BitArrayKernel::RankBatchPortable(const BitArray& ba, const uint64_t* poses, 
+				       uint64_t num, uint64_t* ranks) {
+  RankBatch<PortableOps>(ba, poses, num, ranks);
+}
+
+#ifdef WAT_ARRAY_CPU_DISPATCH
+
+#pragma GCC push_options
+#pragma GCC target("popcnt")
+
+namespace {
+
+struct PopcntOps {
+  static uint64_t PopCount(uint64_t x) {
+    return __builtin_popcountll(x);
+  }
+};
+
+uint64_t PopCountPopcnt(uint64_t x) {
+  return PopcntOps::PopCount(x);
+}
+
+}
+
+uint64_t BitArrayKernel::RankOnePopcnt(const BitArray& ba, uint64_t pos) {
+  return RankOne<PopcntOps>(ba, pos);
+}
+
+void BitArrayKernel::RankBatchPopcnt(const BitArray& ba, const uint64_t* poses, 
+				     uint64_t num, uint64_t* ranks) {
+  RankBatch<PopcntOps>(ba, poses, num, ranks);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,popcnt")
+
+namespace {
+
+// popcount of each 64-bit lane by a nibble table lookup
+inline __m256i PopCount256(__m256i x) {
+  const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+					 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0F);
+  __m256i lo  = _mm256_and_si256(x, low_mask);
+  __m256i hi  = _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask);
+  __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(table, lo), 
+				_mm256_shuffle_epi8(table, hi));
+  return _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+}
+
+}
+
+void BitArrayKernel::RankBatchAvx2(const BitArray& ba, const uint64_t* poses, 
+				   uint64_t num, uint64_t* ranks) {
+  const uint64_t LINE_WORDNUM = sizeof(BitArray::RankLine) / sizeof(uint64_t);
+  const long long* base = reinterpret_cast<const long long*>(ba.rank_lines_.data());
+  const __m256i one = _mm256_set1_epi64x(1);
+  const __m256i rel_mask = _mm256_set1_epi64x(BitArray::REL_MASK);
+
+  uint64_t i = 0;
+  for ( ; i + 4 <= num; i += 4){
+    for (uint64_t j = 0; j < 4 && i + PREFETCH_DISTANCE + j < num; ++j){
+      Prefetch(ba, poses[i + PREFETCH_DISTANCE + j]);
+    }
+    if (poses[i]   > ba.length_ || poses[i+1] > ba.length_ ||
+	poses[i+2] > ba.length_ || poses[i+3] > ba.length_){
+      RankBatch<PopcntOps>(ba, poses + i, 4, ranks + i);
+      continue;
+    }
+
+    // the line and the block in the line are computed in scalar since 
+    // AVX2 has no 64-bit division
+    uint64_t block_ind0 = poses[i]   / BitArray::BLOCK_BITNUM;
+    uint64_t block_ind1 = poses[i+1] / BitArray::BLOCK_BITNUM;
+    uint64_t block_ind2 = poses[i+2] / BitArray::BLOCK_BITNUM;
+    uint64_t block_ind3 = poses[i+3] / BitArray::BLOCK_BITNUM;
+    __m256i line_word = _mm256_setr_epi64x((block_ind0 / BitArray::LINE_BLOCKNUM) * LINE_WORDNUM,
+					   (block_ind1 / BitArray::LINE_BLOCKNUM) * LINE_WORDNUM,
+					   (block_ind2 / BitArray::LINE_BLOCKNUM) * LINE_WORDNUM,
+					   (block_ind3 / BitArray::LINE_BLOCKNUM) * LINE_WORDNUM);
+    __m256i offset    = _mm256_setr_epi64x(block_ind0 % BitArray::LINE_BLOCKNUM,
+					   block_ind1 % BitArray::LINE_BLOCKNUM,
+					   block_ind2 % BitArray::LINE_BLOCKNUM,
+					   block_ind3 % BitArray::LINE_BLOCKNUM);
+    __m256i pos       = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(poses + i));
+
+    __m256i abs_rank  = _mm256_i64gather_epi64(base, line_word, 8);
+    __m256i rel_ranks = _mm256_i64gather_epi64(base + 1, line_word, 8);
+    __m256i block     = _mm256_i64gather_epi64(base + 2, _mm256_add_epi64(line_word, offset), 8);
+
+    __m256i rel_shift = _mm256_mul_epu32(offset, _mm256_set1_epi64x(BitArray::REL_BITNUM));
+    __m256i rel_rank  = _mm256_and_si256(_mm256_srlv_epi64(rel_ranks, rel_shift), rel_mask);
+    __m256i bit_offset = _mm256_and_si256(pos, _mm256_set1_epi64x(BitArray::BLOCK_BITNUM - 1));
+    __m256i mask      = _mm256_sub_epi64(_mm256_sllv_epi64(one, bit_offset), one);
+    __m256i rank      = _mm256_add_epi64(_mm256_add_epi64(abs_rank, rel_rank), 
+					 PopCount256(_mm256_and_si256(block, mask)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ranks + i), rank);
+  }
+  RankBatch<PopcntOps>(ba, poses + i, num - i, ranks + i);
 }
 
-BitArray::BitArray(uint64_t length){
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("bmi,bmi2")
+
+namespace {
+
+uint64_t SelectInBlockBmi2(uint64_t x, uint64_t rank) {
+  return _tzcnt_u64(_pdep_u64(1LLU << (rank - 1), x));
+}
+
+}
+
+#pragma GCC pop_options
+
+#endif // WAT_ARRAY_CPU_DISPATCH
+
+namespace {
+
+uint64_t DetectCpuFeatures() {
+  uint64_t features = 0;
+#ifdef WAT_ARRAY_CPU_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("popcnt")) {
+    features |= BitArray::CPU_POPCNT;
+  }
+  // the select kernel also needs TZCNT of BMI1, and PDEP is microcoded 
+  // and slower than the portable loop on AMD family 17h
+  if (__builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2") && 
+      !__builtin_cpu_is("amdfam17h")) {
+    features |= BitArray::CPU_BMI2;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+    features |= BitArray::CPU_AVX2;
+  }
+#endif
+  return features;
+}
+
+uint64_t cpu_features_ = DetectCpuFeatures();
+
+}
+
+BitArray::BitArray() : length_(0), one_num_(0), layout_(INTERLEAVED_LAYOUT), 
+		       storage_(INTERLEAVED_LAYOUT){
+}
+
+BitArray::BitArray(uint64_t length) : length_(0), one_num_(0), layout_(INTERLEAVED_LAYOUT), 
+				      storage_(INTERLEAVED_LAYOUT){
+  Init(length);
+}
+
+BitArray::BitArray(uint64_t length, Layout layout) : length_(0), one_num_(0), layout_(layout), 
+						     storage_(layout){
   Init(length);
 }
 
@@ -40,21 +320,104 @@ uint64_t BitArray::one_num() const{
   return one_num_;
 }
 
+BitArray::Layout BitArray::layout() const{
+  return layout_;
+}
+
 void BitArray::Init(uint64_t length){
+  // compressed layouts collect the bits in bit_blocks_ until Build()
+  Layout storage = (layout_ == RRR_LAYOUT || layout_ == AUTO_LAYOUT) ? 
+    SEPARATE_LAYOUT : layout_;
+  if (storage != storage_){
+    Clear();
+    storage_ = storage;
+  }
   length_    = length;
   one_num_ = 0;
   uint64_t block_num = (length + BLOCK_BITNUM - 1) / BLOCK_BITNUM;
-  bit_blocks_.resize(block_num);
+  if (storage_ == INTERLEAVED_LAYOUT){
+    // one extra line so that Rank(bit, length()) never reads past the end
+    rank_lines_.resize(block_num / LINE_BLOCKNUM + 1, RankLine());
+  } else {
+    bit_blocks_.resize(block_num);
+  }
+}
+
+void BitArray::Init(uint64_t length, Layout layout){
+  if (layout != layout_){
+    Clear();
+    layout_ = layout;
+  }
+  Init(length);
 }
 
 void BitArray::Clear(){
-  std::vector<uint64_t>().swap(bit_blocks_);
-  std::vector<uint64_t>().swap(rank_tables_);
+  bit_blocks_.Clear();
+  rank_tables_.Clear();
+  rank_lines_.Clear();
+  select_samples_[0].Clear();
+  select_samples_[1].Clear();
+  rrr_.Clear();
   length_ = 0;
   one_num_ = 0;
 }
 
 void BitArray::Build() {
+  if (storage_ == RRR_LAYOUT) return;
+  if ((layout_ == RRR_LAYOUT || layout_ == AUTO_LAYOUT) && 
+      storage_ == SEPARATE_LAYOUT){
+    BuildCompressed();
+    if (storage_ == RRR_LAYOUT) return;
+  }
+  if (storage_ == INTERLEAVED_LAYOUT){
+    BuildLines();
+  } else {
+    BuildTables();
+  }
+  BuildSelectSamples();
+}
+
+void BitArray::BuildCompressed() {
+  rrr_.Build(bit_blocks_.data(), length_);
+  uint64_t block_num = (length_ + BLOCK_BITNUM - 1) / BLOCK_BITNUM;
+  uint64_t line_num  = block_num / LINE_BLOCKNUM + 1;
+  if (layout_ == RRR_LAYOUT || 
+      rrr_.GetUsageBytes() * 2 < sizeof(RankLine) * line_num){
+    storage_ = RRR_LAYOUT;
+    one_num_ = rrr_.one_num();
+    bit_blocks_.Clear();
+    return;
+  }
+
+  // not compressible enough; move the bits into the interleaved lines
+  rrr_.Clear();
+  rank_lines_.resize(line_num, RankLine());
+  for (uint64_t i = 0; i < block_num; ++i){
+    rank_lines_[i / LINE_BLOCKNUM].blocks[i % LINE_BLOCKNUM] = bit_blocks_[i];
+  }
+  bit_blocks_.Clear();
+  storage_ = INTERLEAVED_LAYOUT;
+}
+
+void BitArray::BuildSelectSamples() {
+  // select_samples_[bit][i] is the block containing the (i * SELECT_INTERVAL + 1)-th bit
+  for (uint64_t bit = 0; bit < 2; ++bit){
+    MappedVector<uint64_t>& samples = select_samples_[bit];
+    samples.Clear();
+    uint64_t block_num = (length_ + BLOCK_BITNUM - 1) / BLOCK_BITNUM;
+    uint64_t num = 0;
+    for (uint64_t i = 0; i < block_num; ++i){
+      uint64_t block_len = std::min<uint64_t>(BLOCK_BITNUM, length_ - i * BLOCK_BITNUM);
+      num += GetBitNum(PopCount(GetBlock(i)), block_len, bit);
+      while (samples.size() * SELECT_INTERVAL < num){
+	samples.push_back(i);
+      }
+    }
+    samples.shrink_to_fit();
+  }
+}
+
+void BitArray::BuildTables() {
   one_num_ = 0;
   uint64_t table_num = ((bit_blocks_.size() + TABLE_INTERVAL - 1) / TABLE_INTERVAL) + 1; 
   rank_tables_.resize(table_num);
@@ -67,33 +430,98 @@ void BitArray::Build() {
   rank_tables_.back() = one_num_;
 }
 
+void BitArray::BuildLines() {
+  one_num_ = 0;
+  for (size_t i = 0; i < rank_lines_.size(); ++i){
+    RankLine& line = rank_lines_[i];
+    line.abs_rank  = one_num_;
+    line.rel_ranks = 0;
+    for (uint64_t j = 0; j < LINE_BLOCKNUM; ++j){
+      line.rel_ranks |= (one_num_ - line.abs_rank) << (j * REL_BITNUM);
+      one_num_ += PopCount(line.blocks[j]);
+    }
+  }
+}
+
 void BitArray::SetBit(uint64_t bit, uint64_t pos) {
   if (!bit) return;
-  bit_blocks_[pos / BLOCK_BITNUM] |= (1LLU << (pos % BLOCK_BITNUM));
+  uint64_t block_ind = pos / BLOCK_BITNUM;
+  if (storage_ == INTERLEAVED_LAYOUT){
+    rank_lines_[block_ind / LINE_BLOCKNUM].blocks[block_ind % LINE_BLOCKNUM] |= (1LLU << (pos % BLOCK_BITNUM));
+  } else {
+    bit_blocks_[block_ind] |= (1LLU << (pos % BLOCK_BITNUM));
+  }
+}
+
+void BitArray::SetBlock(uint64_t block_ind, uint64_t block) {
+  if (storage_ == INTERLEAVED_LAYOUT){
+    rank_lines_[block_ind / LINE_BLOCKNUM].blocks[block_ind % LINE_BLOCKNUM] |= block;
+  } else {
+    bit_blocks_[block_ind] |= block;
+  }
 }
 
 uint64_t BitArray::Rank(uint64_t bit, uint64_t pos) const {
+  if (storage_ == RRR_LAYOUT) return rrr_.Rank(bit, pos);
   if (pos > length_) return NOTFOUND;
   if (bit) return RankOne(pos);
   else return pos - RankOne(pos);
 }
 
 uint64_t BitArray::Select(uint64_t bit, uint64_t rank) const {
+  if (storage_ == RRR_LAYOUT) return rrr_.Select(bit, rank);
+  if (rank == 0) return NOTFOUND;
   if (bit){
     if (rank > one_num_) return NOTFOUND;
   } else {
     if (rank > length_ - one_num_) return NOTFOUND;
   } 
   
-  uint64_t block_pos = SelectOutBlock(bit, rank);
-  uint64_t block = (bit) ? bit_blocks_[block_pos] : ~bit_blocks_[block_pos];
+  uint64_t block_pos = (storage_ == INTERLEAVED_LAYOUT) ? 
+    SelectOutLine(bit, rank) : SelectOutBlock(bit, rank);
+  uint64_t block = (bit) ? GetBlock(block_pos) : ~GetBlock(block_pos);
   return block_pos * BLOCK_BITNUM + SelectInBlock(block, rank); 
 }
 
+void BitArray::Prefetch(uint64_t pos) const {
+  if (storage_ == RRR_LAYOUT) return;
+  BitArrayKernel::Prefetch(*this, pos);
+}
+
+void BitArray::RankBatch(uint64_t bit, const uint64_t* poses, uint64_t num, 
+			 uint64_t* ranks) const {
+  if (storage_ == RRR_LAYOUT){
+    for (uint64_t i = 0; i < num; ++i){
+      ranks[i] = rrr_.Rank(bit, poses[i]);
+    }
+    return;
+  }
+
+#ifdef WAT_ARRAY_CPU_DISPATCH
+  if ((cpu_features_ & CPU_AVX2) && storage_ == INTERLEAVED_LAYOUT && !rank_lines_.empty()){
+    BitArrayKernel::RankBatchAvx2(*this, poses, num, ranks);
+  } else if (cpu_features_ & CPU_POPCNT){
+    BitArrayKernel::RankBatchPopcnt(*this, poses, num, ranks);
+  } else 
+#endif
+  {
+    BitArrayKernel::RankBatchPortable(*this, poses, num, ranks);
+  }
+
+  if (!bit){
+    for (uint64_t i = 0; i < num; ++i){
+      if (ranks[i] != NOTFOUND) ranks[i] = poses[i] - ranks[i];
+    }
+  }
+}
+
 uint64_t BitArray::SelectOutBlock(uint64_t bit, uint64_t& rank) const {
-  // binary search over tables
-  uint64_t left = 0;
-  uint64_t right = rank_tables_.size();
+  // binary search over tables between the neighboring samples
+  const MappedVector<uint64_t>& samples = select_samples_[bit ? 1 : 0];
+  uint64_t sample_ind = (rank - 1) / SELECT_INTERVAL;
+  uint64_t left = samples[sample_ind] / TABLE_INTERVAL + 1;
+  uint64_t right = (sample_ind + 1 < samples.size()) ? 
+    samples[sample_ind + 1] / TABLE_INTERVAL + 1 : rank_tables_.size();
   while (left < right){
     uint64_t mid = (left + right) / 2;
     uint64_t length = BLOCK_BITNUM * TABLE_INTERVAL * mid;
@@ -104,7 +532,7 @@ uint64_t BitArray::SelectOutBlock(uint64_t bit, uint64_t& rank) const {
     }
   }
 
-  uint64_t table_ind   = (left != 0) ? left - 1: 0;
+  uint64_t table_ind   = left - 1;
   uint64_t block_pos   = table_ind * TABLE_INTERVAL;
   rank -= GetBitNum(rank_tables_[table_ind], 
 		    block_pos * BLOCK_BITNUM,
@@ -120,77 +548,107 @@ uint64_t BitArray::SelectOutBlock(uint64_t bit, uint64_t& rank) const {
   }
   return block_pos;
 }
-  
-uint64_t BitArray::SelectInBlock(uint64_t x, uint64_t rank) {
-  uint64_t x1 = x - ((x & 0xAAAAAAAAAAAAAAAALLU) >> 1);
-  uint64_t x2 = (x1 & 0x3333333333333333LLU) + ((x1 >> 2) & 0x3333333333333333LLU);
-  uint64_t x3 = (x2 + (x2 >> 4)) & 0x0F0F0F0F0F0F0F0FLLU;
-  
-  uint64_t pos = 0;
-  for (;;  pos += 8){
-    uint64_t rank_next = (x3 >> pos) & 0xFFLLU;
-    if (rank <= rank_next) break;
-    rank -= rank_next;
-  }
 
-  uint64_t v2 = (x2 >> pos) & 0xFLLU;
-  if (rank > v2) {
-    rank -= v2;
-    pos += 4;
+uint64_t BitArray::SelectOutLine(uint64_t bit, uint64_t& rank) const {
+  // binary search over lines between the neighboring samples
+  const MappedVector<uint64_t>& samples = select_samples_[bit ? 1 : 0];
+  uint64_t sample_ind = (rank - 1) / SELECT_INTERVAL;
+  uint64_t left = samples[sample_ind] / LINE_BLOCKNUM + 1;
+  uint64_t right = (sample_ind + 1 < samples.size()) ? 
+    samples[sample_ind + 1] / LINE_BLOCKNUM + 1 : rank_lines_.size();
+  while (left < right){
+    uint64_t mid = (left + right) / 2;
+    if (GetBitNum(rank_lines_[mid].abs_rank, LINE_BITNUM * mid, bit) < rank) {
+      left = mid+1;
+    } else {
+      right = mid;
+    }
   }
 
-  uint64_t v1 = (x1 >> pos) & 0x3LLU;
-  if (rank > v1){
-    rank -= v1;
-    pos += 2;
-  }
+  uint64_t line_ind = left - 1;
+  const RankLine& line = rank_lines_[line_ind];
+  rank -= GetBitNum(line.abs_rank, line_ind * LINE_BITNUM, bit);
 
-  uint64_t v0  = (x >> pos) & 0x1LLU;
-  if (v0 < rank){
-    rank -= v0;
-    pos += 1;
+  // search over the relative ranks in the line
+  uint64_t offset = 0;
+  for ( ; offset + 1 < LINE_BLOCKNUM; ++offset){
+    uint64_t rank_next = GetBitNum(GetRelRank(line, offset + 1), 
+				   (offset + 1) * BLOCK_BITNUM, bit);
+    if (rank <= rank_next){
+      break;
+    }
   }
-
-  return pos;
+  rank -= GetBitNum(GetRelRank(line, offset), offset * BLOCK_BITNUM, bit);
+  return line_ind * LINE_BLOCKNUM + offset;
+}
+  
+uint64_t BitArray::SelectInBlock(uint64_t x, uint64_t rank) {
+#ifdef WAT_ARRAY_CPU_DISPATCH
+  if (cpu_features_ & CPU_BMI2) return SelectInBlockBmi2(x, rank);
+#endif
+  return PortableOps::SelectInBlock(x, rank);
 }
 
 uint64_t BitArray::Lookup(uint64_t pos) const {
-  return (bit_blocks_[pos / BLOCK_BITNUM] >> (pos % BLOCK_BITNUM)) & 1LLU;
+  if (storage_ == RRR_LAYOUT) return rrr_.Lookup(pos);
+  return (GetBlock(pos / BLOCK_BITNUM) >> (pos % BLOCK_BITNUM)) & 1LLU;
 } 
 
+uint64_t BitArray::GetBits(uint64_t pos, uint64_t len) const {
+  if (len == 0) return 0;
+  uint64_t mask = (len < BLOCK_BITNUM) ? (1LLU << len) - 1 : ~0LLU;
+  if (storage_ == RRR_LAYOUT){
+    uint64_t bits = 0;
+    for (uint64_t i = 0; i < len; ++i){
+      bits |= rrr_.Lookup(pos + i) << i;
+    }
+    return bits;
+  }
+  uint64_t offset = pos % BLOCK_BITNUM;
+  uint64_t bits = GetBlock(pos / BLOCK_BITNUM) >> offset;
+  if (offset + len > BLOCK_BITNUM){
+    bits |= GetBlock(pos / BLOCK_BITNUM + 1) << (BLOCK_BITNUM - offset);
+  }
+  return bits & mask;
+}
 
-uint64_t BitArray::RankOne(uint64_t pos) const {
-  uint64_t block_ind = pos / BLOCK_BITNUM;
-  uint64_t table_ind = block_ind / TABLE_INTERVAL;
-  assert(table_ind < rank_tables_.size());
-
-  uint64_t rank = rank_tables_[table_ind];
-  for (uint64_t i = table_ind * TABLE_INTERVAL; i < block_ind; ++i){
-    rank += PopCount(bit_blocks_[i]);
+uint64_t BitArray::GetBlock(uint64_t block_ind) const {
+  if (storage_ == INTERLEAVED_LAYOUT){
+    return rank_lines_[block_ind / LINE_BLOCKNUM].blocks[block_ind % LINE_BLOCKNUM];
   }
-  rank += PopCountMask(bit_blocks_[block_ind], pos % BLOCK_BITNUM);
-  return rank;
+  return bit_blocks_[block_ind];
 }
 
+uint64_t BitArray::GetRelRank(const RankLine& line, uint64_t offset) {
+  return (line.rel_ranks >> (offset * REL_BITNUM)) & REL_MASK;
+}
 
+uint64_t BitArray::RankOne(uint64_t pos) const {
+#ifdef WAT_ARRAY_CPU_DISPATCH
+  if (cpu_features_ & CPU_POPCNT) return BitArrayKernel::RankOnePopcnt(*this, pos);
+#endif
+  return BitArrayKernel::RankOne<PortableOps>(*this, pos);
+}
 
 uint64_t BitArray::PopCount(uint64_t x) {
-  x = (x & 0x5555555555555555ULL) +
-    ((x >> 1) & 0x5555555555555555ULL);
-  x = (x & 0x3333333333333333ULL) +
-    ((x >> 2) & 0x3333333333333333ULL);
-  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
-  x = x + (x >>  8);
-  x = x + (x >> 16);
-  x = x + (x >> 32);
-  return x & 0x7FLLU;
+#ifdef WAT_ARRAY_CPU_DISPATCH
+  if (cpu_features_ & CPU_POPCNT) return PopCountPopcnt(x);
+#endif
+  return PortableOps::PopCount(x);
 }
 
 uint64_t BitArray::PopCountMask(uint64_t x, uint64_t offset) {
-  if (offset == 0) return 0;
   return PopCount(x & ((1LLU << offset) - 1));
 }
 
+uint64_t BitArray::cpu_features() {
+  return cpu_features_;
+}
+
+void BitArray::set_cpu_features(uint64_t features) {
+  cpu_features_ = features & DetectCpuFeatures();
+}
+
 uint64_t BitArray::GetBitNum(uint64_t one_num, uint64_t num, uint64_t bit) {
   if (bit) return one_num;
   else return num - one_num;
@@ -206,17 +664,105 @@ void BitArray::PrintForDebug(std::ostream& os) const {
   }
 }
 
+uint64_t BitArray::GetUsageBytes() const{
+  return sizeof(uint64_t) * (bit_blocks_.size() + rank_tables_.size())
+    + sizeof(RankLine) * rank_lines_.size()
+    + GetSelectIndexBytes()
+    + rrr_.GetUsageBytes();
+}
+
+uint64_t BitArray::GetSelectIndexBytes() const{
+  return sizeof(uint64_t) * (select_samples_[0].size() + select_samples_[1].size());
+}
+
 void BitArray::Save(std::ostream& os) const{
-  os.write((const char*)(&length_), sizeof(length_));
-  os.write((const char*)(&bit_blocks_[0]), sizeof(bit_blocks_[0]) * bit_blocks_.size());
+  uint64_t offset = 0;
+  WriteValue(os, FORMAT_MAGIC, offset);
+  WriteValue(os, FORMAT_VERSION, offset);
+  SaveAligned(os, offset);
 }
-  
+
 void BitArray::Load(std::istream& is){
+  Load(is, true);
+}
+
+void BitArray::Load(std::istream& is, bool build){
+  Clear();
+  uint64_t magic = 0;
+  is.read((char*)(&magic), sizeof(magic));
+  if (magic == FORMAT_MAGIC){
+    uint64_t offset = sizeof(magic);
+    uint64_t version = 0;
+    ReadValue(is, version, offset);
+    if (version != FORMAT_VERSION){
+      is.setstate(std::ios::failbit);
+      return;
+    }
+    LoadAligned(is, offset);
+    return;
+  }
+
+  // older versions write the length and the raw blocks
+  Init(magic);
+  if (storage_ == INTERLEAVED_LAYOUT){
+    uint64_t block_num = (length_ + BLOCK_BITNUM - 1) / BLOCK_BITNUM;
+    for (uint64_t i = 0; i * LINE_BLOCKNUM < block_num; ++i){
+      uint64_t num = std::min<uint64_t>(LINE_BLOCKNUM, block_num - i * LINE_BLOCKNUM);
+      is.read((char*)(rank_lines_[i].blocks), sizeof(uint64_t) * num);
+    }
+  } else if (!bit_blocks_.empty()){
+    is.read((char*)(&bit_blocks_[0]), sizeof(bit_blocks_[0]) * bit_blocks_.size());
+  }
+  if (build) Build();
+}
+
+void BitArray::SaveAligned(std::ostream& os, uint64_t& offset) const{
+  WriteValue(os, length_, offset);
+  WriteValue(os, one_num_, offset);
+  WriteValue(os, layout_, offset);
+  WriteValue(os, storage_, offset);
+  WriteArray(os, bit_blocks_.data(), bit_blocks_.size(), offset);
+  WriteArray(os, rank_tables_.data(), rank_tables_.size(), offset);
+  WriteArray(os, rank_lines_.data(), rank_lines_.size(), offset);
+  WriteArray(os, select_samples_[0].data(), select_samples_[0].size(), offset);
+  WriteArray(os, select_samples_[1].data(), select_samples_[1].size(), offset);
+  rrr_.SaveAligned(os, offset);
+}
+
+void BitArray::LoadAligned(std::istream& is, uint64_t& offset){
+  Clear();
+  uint64_t layout = 0;
+  uint64_t storage = 0;
+  ReadValue(is, length_, offset);
+  ReadValue(is, one_num_, offset);
+  ReadValue(is, layout, offset);
+  ReadValue(is, storage, offset);
+  layout_  = static_cast<Layout>(layout);
+  storage_ = static_cast<Layout>(storage);
+  ReadArray(is, bit_blocks_, offset);
+  ReadArray(is, rank_tables_, offset);
+  ReadArray(is, rank_lines_, offset);
+  ReadArray(is, select_samples_[0], offset);
+  ReadArray(is, select_samples_[1], offset);
+  rrr_.LoadAligned(is, offset);
+}
+
+void BitArray::Map(MapCursor& cursor){
   Clear();
-  is.read((char*)(&length_), sizeof(length_));
-  Init(length_);
-  is.read((char*)(&bit_blocks_[0]), sizeof(bit_blocks_[0]) * bit_blocks_.size());
-  Build();
+  uint64_t layout = 0;
+  uint64_t storage = 0;
+  MapValue(cursor, length_);
+  MapValue(cursor, one_num_);
+  MapValue(cursor, layout);
+  MapValue(cursor, storage);
+  layout_  = static_cast<Layout>(layout);
+  storage_ = static_cast<Layout>(storage);
+  MapArray(cursor, bit_blocks_);
+  MapArray(cursor, rank_tables_);
+  MapArray(cursor, rank_lines_);
+  MapArray(cursor, select_samples_[0]);
+  MapArray(cursor, select_samples_[1]);
+  rrr_.Map(cursor);
 }
 
 
@@ -23,6 +23,8 @@
 #include <stdint.h>
 #include <vector>
 #include <iostream>
+#include "rrr_bit_array.hpp"
+#include "mapped_vector.hpp"
 
 namespace wat_array {
 
@@ -36,42 +38,150 @@ private:
 enum {
   BLOCK_BITNUM = 64,
   TABLE_INTERVAL = 4,
+  LINE_BLOCKNUM = 6,
+  LINE_BITNUM = BLOCK_BITNUM * LINE_BLOCKNUM,
+  REL_BITNUM = 9,
+  REL_MASK = (1 << REL_BITNUM) - 1,
+  SELECT_INTERVAL = 4096
+};
+
+enum {
+  FORMAT_MAGIC   = 0x5941525241544942LLU, // "BITARRAY"
+  FORMAT_VERSION = 2
 };
 
 public:
+  /**
+   * SEPARATE_LAYOUT keeps a rank table for every TABLE_INTERVAL blocks 
+   * in its own vector. INTERLEAVED_LAYOUT stores an absolute rank, 
+   * packed relative ranks and LINE_BLOCKNUM blocks in one 64-byte line 
+   * so that a rank costs a single cache miss and no loop. 
+   * RRR_LAYOUT compresses the bits with RRRBitArray. AUTO_LAYOUT 
+   * decides at Build(): RRR_LAYOUT if it takes less than half the bytes 
+   * of INTERLEAVED_LAYOUT, INTERLEAVED_LAYOUT otherwise.
+   */
+  enum Layout {
+    SEPARATE_LAYOUT    = 0,
+    INTERLEAVED_LAYOUT = 1,
+    RRR_LAYOUT         = 2,
+    AUTO_LAYOUT        = 3
+  };
+
+  /**
+   * Instruction set extensions used by PopCount, SelectInBlock and Rank.
+   * They are detected at startup; the portable routines are used otherwise.
+   */
+  enum CpuFeature {
+    CPU_POPCNT = 1,
+    CPU_BMI2   = 2, // with BMI1
+    CPU_AVX2   = 4
+  };
+
   BitArray();
   ~BitArray();
   BitArray(uint64_t size);
+  BitArray(uint64_t size, Layout layout);
   uint64_t length() const;
   uint64_t one_num() const;
+  Layout layout() const;
 
   void Init(uint64_t size);
+  void Init(uint64_t size, Layout layout);
   void Clear();
   void SetBit(uint64_t bit, uint64_t pos);
 
+  /**
+   * Set the bits of block[i] at pos = block_ind * 64 + i for i < 64, 
+   * as SetBit(1, pos) for each bit of the block that is one. Only the 
+   * block is written, so different blocks can be set concurrently.
+   */
+  void SetBlock(uint64_t block_ind, uint64_t block);
+
   void Build();
   uint64_t Rank(uint64_t bit, uint64_t pos) const;
   uint64_t Select(uint64_t bit, uint64_t rank) const;
   uint64_t Lookup(uint64_t pos) const;
 
+  /**
+   * Return the len bits from pos as an integer whose lowest bit is 
+   * Lookup(pos), where len <= 64 and pos + len <= length()
+   */
+  uint64_t GetBits(uint64_t pos, uint64_t len) const;
+
+  /**
+   * Compute Rank(bit, poses[i]) for i < num into ranks. The lines of the
+   * following positions are prefetched, and on CPUs with AVX2 four ranks
+   * of INTERLEAVED_LAYOUT are computed at once with gathers.
+   */
+  void RankBatch(uint64_t bit, const uint64_t* poses, uint64_t num, 
+		 uint64_t* ranks) const;
+
+  /**
+   * Prefetch the lines that Rank(bit, pos) reads, so that a caller can 
+   * do other work while they are loaded. RRR_LAYOUT is not prefetched.
+   */
+  void Prefetch(uint64_t pos) const;
+
   static uint64_t PopCount(uint64_t x);
   static uint64_t PopCountMask(uint64_t x, uint64_t offset);
   static uint64_t SelectInBlock(uint64_t x, uint64_t rank);
   static uint64_t GetBitNum(uint64_t one_num, uint64_t num, uint64_t bit);
+  static uint64_t cpu_features();
+  static void set_cpu_features(uint64_t features);
   void PrintForDebug(std::ostream& os) const;
 
+  uint64_t GetUsageBytes() const;
+  uint64_t GetSelectIndexBytes() const;
+
+  /**
+   * Save writes the bits with the rank and select directories, so that
+   * Load does not call Build(). Load also reads the raw blocks written 
+   * by older versions; they are built unless build is false, in which 
+   * case Build() must be called before any query.
+   */
   void Save(std::ostream& os) const;
   void Load(std::istream& is);
+  void Load(std::istream& is, bool build);
+
+  /**
+   * Save and load the bits together with the rank and select 
+   * directories in the aligned format, so that nothing is rebuilt.
+   * Map() refers to a mapped record in place; the mapping must 
+   * outlive this array.
+   */
+  void SaveAligned(std::ostream& os, uint64_t& offset) const;
+  void LoadAligned(std::istream& is, uint64_t& offset);
+  void Map(MapCursor& cursor);
 
 private:
+  friend struct BitArrayKernel;
+
+  struct alignas(64) RankLine {
+    uint64_t abs_rank;
+    uint64_t rel_ranks;
+    uint64_t blocks[LINE_BLOCKNUM];
+  };
+
+  uint64_t GetBlock(uint64_t block_ind) const;
+  void BuildTables();
+  void BuildLines();
+  void BuildCompressed();
+  void BuildSelectSamples();
   uint64_t RankOne(uint64_t pos) const;
   uint64_t SelectOutBlock(uint64_t bit, uint64_t& rank) const;
+  uint64_t SelectOutLine(uint64_t bit, uint64_t& rank) const;
+  static uint64_t GetRelRank(const RankLine& line, uint64_t offset);
 
 private:
-  std::vector<uint64_t> bit_blocks_;
-  std::vector<uint64_t> rank_tables_;
+  MappedVector<uint64_t> bit_blocks_;
+  MappedVector<uint64_t> rank_tables_;
+  MappedVector<RankLine> rank_lines_;
+  MappedVector<uint64_t> select_samples_[2];
+  RRRBitArray rrr_;
   uint64_t length_;
   uint64_t one_num_;
+  Layout layout_;
+  Layout storage_;
 };
 
 }
@@ -0,0 +1,139 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include "elias_fano.hpp"
+
+namespace wat_array {
+
+EliasFano::EliasFano() : low_bitnum_(0), length_(0){
+}
+
+EliasFano::~EliasFano(){
+}
+
+uint64_t EliasFano::length() const {
+  return length_;
+}
+
+void EliasFano::Init(const std::vector<uint64_t>& vals){
+  Clear();
+  if (vals.empty()) return;
+  Init(vals.size(), vals.back());
+  for (uint64_t i = 0; i < length_; ++i){
+    Set(i, vals[i]);
+  }
+  Build();
+}
+
+void EliasFano::Init(uint64_t num, uint64_t max_val){
+  Clear();
+  length_ = num;
+  if (length_ == 0) return;
+  uint64_t universe = max_val + 1;
+  while ((length_ << low_bitnum_) < universe){
+    ++low_bitnum_;
+  }
+  if (low_bitnum_ > 0) --low_bitnum_;
+
+  high_bits_.Init(length_ + (max_val >> low_bitnum_) + 1);
+  low_bits_.resize((length_ * low_bitnum_ + 63) / 64);
+}
+
+void EliasFano::Set(uint64_t ind, uint64_t val){
+  high_bits_.SetBit(1, (val >> low_bitnum_) + ind);
+  if (low_bitnum_ == 0) return;
+  uint64_t low = val & ((1LLU << low_bitnum_) - 1);
+  uint64_t pos = ind * low_bitnum_;
+  low_bits_[pos / 64] |= low << (pos % 64);
+  if (pos % 64 + low_bitnum_ > 64){
+    low_bits_[pos / 64 + 1] |= low >> (64 - pos % 64);
+  }
+}
+
+void EliasFano::Build(){
+  if (length_ > 0) high_bits_.Build();
+}
+
+void EliasFano::Clear(){
+  high_bits_.Clear();
+  low_bits_.Clear();
+  low_bitnum_ = 0;
+  length_ = 0;
+}
+
+uint64_t EliasFano::Lookup(uint64_t ind) const {
+  if (ind >= length_) return NOTFOUND;
+  uint64_t high = high_bits_.Select(1, ind + 1) - ind;
+  if (low_bitnum_ == 0) return high;
+  uint64_t pos = ind * low_bitnum_;
+  uint64_t low = low_bits_[pos / 64] >> (pos % 64);
+  if (pos % 64 + low_bitnum_ > 64){
+    low |= low_bits_[pos / 64 + 1] << (64 - pos % 64);
+  }
+  return (high << low_bitnum_) | (low & ((1LLU << low_bitnum_) - 1));
+}
+
+uint64_t EliasFano::GetUsageBytes() const {
+  return high_bits_.GetUsageBytes() + sizeof(uint64_t) * low_bits_.size();
+}
+
+void EliasFano::Save(std::ostream& os) const{
+  os.write((const char*)(&length_), sizeof(length_));
+  os.write((const char*)(&low_bitnum_), sizeof(low_bitnum_));
+  high_bits_.Save(os);
+  if (!low_bits_.empty()){
+    os.write((const char*)(low_bits_.data()), sizeof(low_bits_[0]) * low_bits_.size());
+  }
+}
+
+void EliasFano::Load(std::istream& is){
+  Clear();
+  is.read((char*)(&length_), sizeof(length_));
+  is.read((char*)(&low_bitnum_), sizeof(low_bitnum_));
+  high_bits_.Load(is);
+  low_bits_.resize((length_ * low_bitnum_ + 63) / 64);
+  if (!low_bits_.empty()){
+    is.read((char*)(&low_bits_[0]), sizeof(low_bits_[0]) * low_bits_.size());
+  }
+}
+
+void EliasFano::SaveAligned(std::ostream& os, uint64_t& offset) const{
+  WriteValue(os, length_, offset);
+  WriteValue(os, low_bitnum_, offset);
+  high_bits_.SaveAligned(os, offset);
+  WriteArray(os, low_bits_.data(), low_bits_.size(), offset);
+}
+
+void EliasFano::LoadAligned(std::istream& is, uint64_t& offset){
+  Clear();
+  ReadValue(is, length_, offset);
+  ReadValue(is, low_bitnum_, offset);
+  high_bits_.LoadAligned(is, offset);
+  ReadArray(is, low_bits_, offset);
+}
+
+void EliasFano::Map(MapCursor& cursor){
+  Clear();
+  MapValue(cursor, length_);
+  MapValue(cursor, low_bitnum_);
+  high_bits_.Map(cursor);
+  MapArray(cursor, low_bits_);
+}
+
+}
@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#ifndef WAT_ARRAY_ELIAS_FANO_HPP_
+#define WAT_ARRAY_ELIAS_FANO_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include <iostream>
+#include "bit_array.hpp"
+#include "mapped_vector.hpp"
+
+namespace wat_array {
+
+/**
+ * Elias-Fano encoding of a non-decreasing sequence of integers.
+ *
+ * The lower low_bitnum bits of each value are packed into low_bits_,
+ * and the upper bits are stored in unary in high_bits_, so that
+ * num values below universe take num * (2 + log(universe / num)) bits.
+ * Lookup is a select on high_bits_ plus a read of the packed lower bits.
+ */
+class EliasFano {
+
+public:
+  EliasFano();
+  ~EliasFano();
+  uint64_t length() const;
+
+  void Init(const std::vector<uint64_t>& vals);
+
+  /**
+   * Start num values of at most max_val, to be given by Set() in 
+   * non-decreasing order and finished by Build()
+   */
+  void Init(uint64_t num, uint64_t max_val);
+  void Set(uint64_t ind, uint64_t val);
+  void Build();
+
+  void Clear();
+  uint64_t Lookup(uint64_t ind) const;
+
+  uint64_t GetUsageBytes() const;
+
+  void Save(std::ostream& os) const;
+  void Load(std::istream& is);
+
+  void SaveAligned(std::ostream& os, uint64_t& offset) const;
+  void LoadAligned(std::istream& is, uint64_t& offset);
+  void Map(MapCursor& cursor);
+
+private:
+  BitArray high_bits_;
+  MappedVector<uint64_t> low_bits_;
+  uint64_t low_bitnum_;
+  uint64_t length_;
+};
+
+}
+
+#endif // WAT_ARRAY_ELIAS_FANO_HPP_
@@ -0,0 +1,181 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <algorithm>
+#include "geo_index.hpp"
+
+using namespace std;
+
+namespace wat_array {
+
+namespace {
+
+class XLess {
+public:
+  XLess(const vector<uint64_t>& xs) : xs_(xs) {}
+  bool operator() (uint64_t i, uint64_t j) const {
+    if (xs_[i] != xs_[j]) return xs_[i] < xs_[j];
+    return i < j;
+  }
+private:
+  const vector<uint64_t>& xs_;
+};
+
+class YLess {
+public:
+  YLess(const vector<uint64_t>& ys) : ys_(ys) {}
+  bool operator() (uint64_t i, uint64_t j) const {
+    return ys_[i] < ys_[j];
+  }
+private:
+  const vector<uint64_t>& ys_;
+};
+
+}
+
+GeoIndex::GeoIndex(){
+}
+
+GeoIndex::~GeoIndex(){
+}
+
+uint64_t GeoIndex::length() const {
+  return xs_.size();
+}
+
+int GeoIndex::Init(const vector<uint64_t>& xs, const vector<uint64_t>& ys){
+  Clear();
+  if (xs.size() != ys.size()) return -1;
+
+  vector<uint64_t> ids(xs.size());
+  for (uint64_t i = 0; i < ids.size(); ++i){
+    ids[i] = i;
+  }
+  sort(ids.begin(), ids.end(), XLess(xs));
+
+  vector<uint64_t> sorted_ys(ids.size());
+  xs_.resize(ids.size());
+  ids_.resize(ids.size());
+  for (uint64_t i = 0; i < ids.size(); ++i){
+    xs_[i]       = xs[ids[i]];
+    ids_[i]      = ids[i];
+    sorted_ys[i] = ys[ids[i]];
+  }
+  wa_.set_compact_alphabet(true);
+  wa_.Init(sorted_ys);
+
+  // reuse ids for the positions in the order of the leaves
+  for (uint64_t i = 0; i < ids.size(); ++i){
+    ids[i] = i;
+  }
+  stable_sort(ids.begin(), ids.end(), YLess(sorted_ys));
+  uint64_t width = 1;
+  while ((1LLU << width) < ids.size()){
+    ++width;
+  }
+  leaf_poses_.Init(width, ids.size());
+  for (uint64_t i = 0; i < ids.size(); ++i){
+    leaf_poses_.Set(i, ids[i]);
+  }
+  return 0;
+}
+
+void GeoIndex::Clear(){
+  xs_.Clear();
+  ids_.Clear();
+  wa_.Clear();
+  leaf_poses_.Clear();
+}
+
+void GeoIndex::GetPosRange(uint64_t min_x, uint64_t max_x, 
+			   uint64_t& beg_pos, uint64_t& end_pos) const{
+  const uint64_t* xs = xs_.data();
+  beg_pos = lower_bound(xs, xs + xs_.size(), min_x) - xs;
+  end_pos = lower_bound(xs + beg_pos, xs + xs_.size(), max_x) - xs;
+}
+
+uint64_t GeoIndex::Count(uint64_t min_x, uint64_t max_x, 
+			 uint64_t min_y, uint64_t max_y) const{
+  if (min_x >= max_x || min_y >= max_y) return 0;
+  uint64_t beg_pos = 0;
+  uint64_t end_pos = 0;
+  GetPosRange(min_x, max_x, beg_pos, end_pos);
+  if (beg_pos >= end_pos) return 0;
+  return wa_.FreqRange(min_y, max_y, beg_pos, end_pos);
+}
+
+void GeoIndex::Report(uint64_t min_x, uint64_t max_x, uint64_t min_y, uint64_t max_y, 
+		      vector<GeoPoint>& res) const{
+  res.clear();
+  if (min_x >= max_x || min_y >= max_y) return;
+  uint64_t beg_pos = 0;
+  uint64_t end_pos = 0;
+  GetPosRange(min_x, max_x, beg_pos, end_pos);
+  if (beg_pos >= end_pos) return;
+
+  vector<ListResult> ys;
+  wa_.ListMinRange(min_y, max_y, beg_pos, end_pos, end_pos - beg_pos, ys);
+  for (size_t i = 0; i < ys.size(); ++i){
+    // the occurrences of ys[i].c in [beg_pos, end_pos) in the leaf order
+    uint64_t leaf = wa_.FreqSum(0, ys[i].c) + wa_.Rank(ys[i].c, beg_pos);
+    for (uint64_t j = 0; j < ys[i].freq; ++j){
+      uint64_t pos = leaf_poses_[leaf + j];
+      res.push_back(GeoPoint(xs_[pos], ys[i].c, ids_[pos]));
+    }
+  }
+}
+
+uint64_t GeoIndex::GetUsageBytes() const {
+  return (xs_.size() + ids_.size()) * sizeof(uint64_t) + wa_.GetUsageBytes() 
+    + leaf_poses_.GetUsageBytes();
+}
+
+void GeoIndex::Save(ostream& os) const{
+  uint64_t offset = 0;
+  WriteValue(os, FORMAT_MAGIC, offset);
+  WriteValue(os, FORMAT_VERSION, offset);
+  WriteArray(os, xs_.data(), xs_.size(), offset);
+  WriteArray(os, ids_.data(), ids_.size(), offset);
+  leaf_poses_.SaveAligned(os, offset);
+  wa_.Save(os);
+}
+
+void GeoIndex::Load(istream& is){
+  Clear();
+  uint64_t offset = 0;
+  uint64_t magic = 0;
+  uint64_t version = 0;
+  ReadValue(is, magic, offset);
+  ReadValue(is, version, offset);
+  if (!is || magic != FORMAT_MAGIC || version != FORMAT_VERSION){
+    is.setstate(ios::failbit);
+    return;
+  }
+  ReadArray(is, xs_, offset);
+  ReadArray(is, ids_, offset);
+  leaf_poses_.LoadAligned(is, offset);
+  wa_.Load(is);
+  if (!is || ids_.size() != xs_.size() || leaf_poses_.length() != xs_.size() ||
+      wa_.length() != xs_.size()){
+    Clear();
+    is.setstate(ios::failbit);
+  }
+}
+
+}
@@ -0,0 +1,125 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#ifndef WAT_ARRAY_GEO_INDEX_HPP_
+#define WAT_ARRAY_GEO_INDEX_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include <iostream>
+#include "wat_array.hpp"
+#include "int_vector.hpp"
+#include "mapped_vector.hpp"
+
+namespace wat_array {
+
+struct GeoPoint{
+  GeoPoint(uint64_t x, uint64_t y, uint64_t id) : x(x), y(y), id(id){}
+  uint64_t x;
+  uint64_t y;
+  uint64_t id;
+};
+
+/**
+ * Orthogonal range index of 2D points.
+ *
+ * The points are sorted by x, and their ys are stored in this order in
+ * a WatArray with the compact alphabet, so that the codes are the ranks
+ * of the distinct ys. A rectangle maps to a position range by binary 
+ * searches on the sorted xs, and to a code range by the value dictionary,
+ * so that Count() is one FreqRange(). 
+ *
+ * The positions are also kept in the order of the leaves, that is sorted
+ * by y and then by position, so that the occurrences of a y in a position
+ * range are consecutive there. Report() lists the distinct ys in the 
+ * rectangle and reads their occurrences without a select per point, in 
+ * O((1 + d) log k + occ) time for d distinct ys among occ reported points
+ * and k distinct ys in total, instead of scanning every point in the 
+ * x range.
+ */
+class GeoIndex {
+
+public:
+  GeoIndex();
+  ~GeoIndex();
+  uint64_t length() const;
+
+  /**
+   * Build the index of the points (xs[i], ys[i]). The point i is reported
+   * with the id i.
+   * @param xs The x coordinates of the points
+   * @param ys The y coordinates of the points
+   * @return 0 on success, or -1 if xs and ys differ in length
+   */
+  int Init(const std::vector<uint64_t>& xs, const std::vector<uint64_t>& ys);
+  void Clear();
+
+  /**
+   * Count the points in the rectangle [min_x, max_x) x [min_y, max_y)
+   * @param min_x The smallest x to be examined
+   * @param max_x The upper bound of x (not inclusive)
+   * @param min_y The smallest y to be examined
+   * @param max_y The upper bound of y (not inclusive)
+   * @return The number of points in the rectangle
+   */
+  uint64_t Count(uint64_t min_x, uint64_t max_x, uint64_t min_y, uint64_t max_y) const;
+
+  /**
+   * Report the points in the rectangle [min_x, max_x) x [min_y, max_y)
+   * @param min_x The smallest x to be examined
+   * @param max_x The upper bound of x (not inclusive)
+   * @param min_y The smallest y to be examined
+   * @param max_y The upper bound of y (not inclusive)
+   * @param res The points in the rectangle, ordered by y and then by x.
+   */
+  void Report(uint64_t min_x, uint64_t max_x, uint64_t min_y, uint64_t max_y, 
+	      std::vector<GeoPoint>& res) const;
+
+  uint64_t GetUsageBytes() const;
+
+  /**
+   * Save the current status to a stream
+   * @param os The output stream where the data is saved
+   */
+  void Save(std::ostream& os) const;
+
+  /**
+   * Load the current status from a stream. The failbit of is is set if
+   * the stream does not hold an index written by Save().
+   * @param is The input stream where the status is saved
+   */
+  void Load(std::istream& is);
+
+private:
+  enum {
+    FORMAT_MAGIC   = 0x5845444E494F4547LLU, // "GEOINDEX"
+    FORMAT_VERSION = 1
+  };
+
+  void GetPosRange(uint64_t min_x, uint64_t max_x, uint64_t& beg_pos, uint64_t& end_pos) const;
+
+  MappedVector<uint64_t> xs_;  // the xs in sorted order
+  MappedVector<uint64_t> ids_; // the ids of the points in the order of xs_
+  WatArray wa_;                // the ys in the order of xs_
+  IntVector leaf_poses_;       // the positions sorted by y and then by position
+};
+
+}
+
+#endif // WAT_ARRAY_GEO_INDEX_HPP_
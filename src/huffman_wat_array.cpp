@@ -0,0 +1,734 @@
+/* 
+ *  Copyright (c) 2010 Daisuke Okanohara
+ * 
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ * 
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include "huffman_wat_array.hpp"
+
+using namespace std;
+
+namespace wat_array {
+
+namespace {
+
+// the lengths of the Huffman codes of the weights, 
+// the code of a single weight is empty
+void GetHuffmanCodeLens(const vector<uint64_t>& weights, vector<uint64_t>& lens){
+  uint64_t num = weights.size();
+  lens.assign(num, 0);
+  if (num <= 1) return;
+
+  typedef pair<uint64_t, uint64_t> Node; // (weight, id)
+  priority_queue<Node, vector<Node>, greater<Node> > nodes;
+  for (uint64_t i = 0; i < num; ++i){
+    nodes.push(Node(weights[i], i));
+  }
+  // the parents are created after their children and have larger ids 
+  vector<uint64_t> parents(2 * num - 1);
+  uint64_t next_id = num;
+  while (nodes.size() > 1){
+    Node lhs = nodes.top(); nodes.pop();
+    Node rhs = nodes.top(); nodes.pop();
+    parents[lhs.second] = next_id;
+    parents[rhs.second] = next_id;
+    nodes.push(Node(lhs.first + rhs.first, next_id++));
+  }
+  vector<uint64_t> depths(next_id);
+  for (uint64_t id = next_id - 1; id > 0; --id){
+    depths[id - 1] = depths[parents[id - 1]] + 1;
+  }
+  for (uint64_t i = 0; i < num; ++i){
+    lens[i] = depths[i];
+  }
+}
+
+}
+
+HuffmanWatArray::HuffmanWatArray() : alphabet_num_(0), length_(0), 
+				     layout_(BitArray::INTERLEAVED_LAYOUT){
+}
+  
+HuffmanWatArray::~HuffmanWatArray() {
+}
+
+void HuffmanWatArray::Clear(){
+  vector<BitArray>().swap(bit_arrays_);
+  chars_.Clear();
+  char_lens_.Clear();
+  sorted_chars_.Clear();
+  len_begs_.Clear();
+  first_codes_.Clear();
+  mapped_file_.reset();
+  alphabet_num_ = 0;
+  length_ = 0;
+}
+
+void HuffmanWatArray::Init(const vector<uint64_t>& array){
+  Clear();
+  alphabet_num_ = GetAlphabetNum(array);
+  length_       = static_cast<uint64_t>(array.size());
+  vector<uint64_t> char_codes;
+  SetCodes(array, char_codes);
+  SetArray(array, char_codes);
+}
+
+uint64_t HuffmanWatArray::Lookup(uint64_t pos) const{
+  if (pos >= length_) return NOTFOUND;
+  uint64_t st = 0;
+  uint64_t en = length_;
+  uint64_t code = 0;
+  uint64_t depth = 0;
+  for (; !IsLeaf(code, depth); ++depth){
+    const BitArray& ba = bit_arrays_[depth];
+    uint64_t boundary  = st + ba.Rank(0, en) - ba.Rank(0, st);
+    uint64_t bit       = ba.Lookup(st + pos);
+    code <<= 1;
+    if (bit){
+      pos = ba.Rank(1, st + pos) - ba.Rank(1, st);
+      st = boundary;
+      code |= 1LLU;
+    } else {
+      pos = ba.Rank(0, st + pos) - ba.Rank(0, st);
+      en = boundary;
+    }
+  }
+  return Decode(code, depth);
+}
+
+uint64_t HuffmanWatArray::Rank(uint64_t c, uint64_t pos) const{
+  if (c >= alphabet_num_) return NOTFOUND;
+  uint64_t code = 0;
+  uint64_t len  = 0;
+  if (!GetCode(c, code, len)) return 0;
+  if (pos >= length_) {
+    pos = length_;
+  }
+  uint64_t rank           = 0;
+  uint64_t rank_less_than = 0;
+  RankCode(code, len, pos, rank, rank_less_than);
+  return rank;
+}
+
+uint64_t HuffmanWatArray::RankLessThan(uint64_t c, uint64_t pos) const{
+  if (c == alphabet_num_ && c > 0){
+    return (pos < length_) ? pos : length_;
+  }
+  if (c >= alphabet_num_) return NOTFOUND;
+  if (pos >= length_) {
+    pos = length_;
+  }
+  return CountLessThan(c, pos);
+}
+
+uint64_t HuffmanWatArray::RankMoreThan(uint64_t c, uint64_t pos) const{
+  uint64_t rank_less_than = 0;
+  uint64_t rank_more_than = 0;
+  uint64_t rank           = 0;
+  RankAll(c, pos, rank, rank_less_than, rank_more_than);
+  return rank_more_than;
+}
+
+void HuffmanWatArray::RankAll(uint64_t c, uint64_t pos,
+			      uint64_t& rank,  uint64_t& rank_less_than, uint64_t& rank_more_than) const{
+  if (c >= alphabet_num_) {
+    rank_less_than = NOTFOUND;
+    rank_more_than = NOTFOUND;
+    rank           = NOTFOUND;
+    return;
+  }
+  if (pos >= length_) {
+    pos = length_;
+  }
+  rank           = Rank(c, pos);
+  rank_less_than = CountLessThan(c, pos);
+  rank_more_than = pos - rank - rank_less_than;
+}
+
+uint64_t HuffmanWatArray::Select(uint64_t c, uint64_t rank) const{
+  uint64_t code = 0;
+  uint64_t len  = 0;
+  if (c >= alphabet_num_ || !GetCode(c, code, len)) {
+    return NOTFOUND;
+  }
+  uint64_t beg_nodes[MAX_CODE_LEN];
+  uint64_t before_ranks[MAX_CODE_LEN];
+  uint64_t beg_node = 0;
+  uint64_t end_node = length_;
+  for (uint64_t i = 0; i < len; ++i){
+    const BitArray& ba = bit_arrays_[i];
+    uint64_t beg_node_zero = ba.Rank(0, beg_node);
+    uint64_t end_node_zero = ba.Rank(0, end_node);
+    uint64_t boundary      = beg_node + end_node_zero - beg_node_zero;
+    beg_nodes[i] = beg_node;
+    if (GetMSB(code, i, len)){
+      before_ranks[i] = beg_node - beg_node_zero;
+      beg_node = boundary;
+    } else {
+      before_ranks[i] = beg_node_zero;
+      end_node = boundary;
+    }
+  }
+  if (rank == 0 || rank > end_node - beg_node){
+    return NOTFOUND;
+  }
+
+  uint64_t pos = rank - 1;
+  for (uint64_t i = len; i > 0; --i){
+    const BitArray& ba = bit_arrays_[i-1];
+    pos = ba.Select(GetMSB(code, i-1, len), before_ranks[i-1] + pos + 1) - beg_nodes[i-1];
+  }
+  return pos;
+}
+
+uint64_t HuffmanWatArray::FreqRange(uint64_t min_c, uint64_t max_c, uint64_t begin_pos, uint64_t end_pos) const{
+  if (min_c >= alphabet_num_) return 0;
+  if (max_c <= min_c) return 0;
+  if (end_pos > length_ || begin_pos > end_pos) return 0;
+  return 
+    + CountLessThan(max_c, end_pos)
+    - CountLessThan(min_c, end_pos)
+    - CountLessThan(max_c, begin_pos)
+    + CountLessThan(min_c, begin_pos);
+}
+
+void HuffmanWatArray::MaxRange(uint64_t begin_pos, uint64_t end_pos, uint64_t& pos, uint64_t& val) const {
+  QuantileRange(begin_pos, end_pos, end_pos - begin_pos - 1, pos, val);
+} 
+
+void HuffmanWatArray::MinRange(uint64_t begin_pos, uint64_t end_pos, uint64_t& pos, uint64_t& val) const {
+  QuantileRange(begin_pos, end_pos, 0,  pos, val);
+}
+
+void HuffmanWatArray::QuantileRange(uint64_t begin_pos, uint64_t end_pos, uint64_t k, uint64_t& pos, uint64_t& val) const {
+  if (end_pos > length_ || begin_pos >= end_pos || k >= end_pos - begin_pos) {
+    pos = NOTFOUND;
+    val = NOTFOUND;
+    return;
+  }
+
+  // the codes are not ordered as the values, so val is searched 
+  // by the number of values less than it in the range
+  uint64_t min_c = 0;
+  uint64_t max_c = alphabet_num_;
+  while (max_c - min_c > 1){
+    uint64_t mid_c = min_c + (max_c - min_c) / 2;
+    if (CountLessThan(mid_c, end_pos) - CountLessThan(mid_c, begin_pos) <= k){
+      min_c = mid_c;
+    } else {
+      max_c = mid_c;
+    }
+  }
+  val = min_c;
+  pos = Select(val, Rank(val, begin_pos) + 1);
+}
+
+class HuffmanWatArray::ListModeComparator{
+public:
+  ListModeComparator() {}
+  bool operator() (const QueryOnNode& lhs, 
+		   const QueryOnNode& rhs) const {
+    if (lhs.end_pos - lhs.beg_pos != rhs.end_pos - rhs.beg_pos) {
+      return lhs.end_pos - lhs.beg_pos < rhs.end_pos - rhs.beg_pos;
+    } else if (lhs.depth != rhs.depth) {
+      return lhs.depth < rhs.depth;
+    } else {
+      return lhs.beg_pos > rhs.beg_pos;
+    } 
+  }
+};
+
+void HuffmanWatArray::ListModeRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos,
+				    uint64_t num, vector<ListResult>& res) const {
+  res.clear();
+  if (end_pos > length_ || beg_pos >= end_pos) return;
+  vector<CodeRange> ranges;
+  GetCodeRanges(min_c, max_c, ranges);
+  if (!CheckPrefix(0, 0, ranges)) return;
+
+  priority_queue<QueryOnNode, vector<QueryOnNode>, ListModeComparator> qons;
+  qons.push(QueryOnNode(0, length_, beg_pos, end_pos, 0, 0));
+  while (res.size() < num && !qons.empty()){
+    QueryOnNode qon = qons.top();
+    qons.pop();
+    if (IsLeaf(qon.prefix_char, qon.depth)){
+      res.push_back(ListResult(Decode(qon.prefix_char, qon.depth), qon.end_pos - qon.beg_pos));
+    } else {
+      vector<QueryOnNode> next;
+      ExpandNode(qon, next);
+      for (size_t i = 0; i < next.size(); ++i){
+	if (CheckPrefix(next[i].prefix_char, next[i].depth, ranges)){
+	  qons.push(next[i]);
+	}
+      }
+    }
+  }
+}
+
+void HuffmanWatArray::ListMinRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos,
+				   uint64_t num, vector<ListResult>& res) const {
+  ListEndRange(min_c, max_c, beg_pos, end_pos, num, false, res);
+}
+
+void HuffmanWatArray::ListMaxRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos,
+				   uint64_t num, vector<ListResult>& res) const {
+  ListEndRange(min_c, max_c, beg_pos, end_pos, num, true, res);
+}
+
+void HuffmanWatArray::ListEndRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos, 
+				   uint64_t num, bool largest, vector<ListResult>& res) const {
+  res.clear();
+  if (end_pos > length_ || beg_pos >= end_pos) return;
+  vector<CodeRange> ranges;
+  GetCodeRanges(min_c, max_c, ranges);
+
+  // merge the smallest (or largest) codes of each length, 
+  // which are also the smallest (or largest) values of the length
+  const QueryOnNode root(0, length_, beg_pos, end_pos, 0, 0);
+  uint64_t max_len = max_code_len();
+  vector<uint64_t> codes(max_len + 1);
+  vector<uint64_t> freqs(max_len + 1);
+  vector<bool> founds(max_len + 1);
+  for (uint64_t len = 0; len <= max_len; ++len){
+    founds[len] = ranges[len].beg < ranges[len].end && 
+      FindCode(len, ranges[len], largest, root, codes[len], freqs[len]);
+  }
+  while (res.size() < num){
+    uint64_t best_len = NOTFOUND;
+    uint64_t best_c   = 0;
+    for (uint64_t len = 0; len <= max_len; ++len){
+      if (!founds[len]) continue;
+      uint64_t c = Decode(codes[len], len);
+      if (best_len == NOTFOUND || (largest ? c > best_c : c < best_c)){
+	best_len = len;
+	best_c   = c;
+      }
+    }
+    if (best_len == NOTFOUND) break;
+    res.push_back(ListResult(best_c, freqs[best_len]));
+
+    CodeRange& range = ranges[best_len];
+    if (largest) range.end = codes[best_len];
+    else         range.beg = codes[best_len] + 1;
+    founds[best_len] = range.beg < range.end && 
+      FindCode(best_len, range, largest, root, codes[best_len], freqs[best_len]);
+  }
+}
+
+uint64_t HuffmanWatArray::Freq(uint64_t c) const {
+  if (c >= alphabet_num_) return NOTFOUND;
+  return Rank(c, length_);
+}
+
+uint64_t HuffmanWatArray::FreqSum(uint64_t min_c, uint64_t max_c) const {
+  if (max_c > alphabet_num_ || min_c > max_c ) return NOTFOUND;
+  return CountLessThan(max_c, length_) - CountLessThan(min_c, length_);
+}
+
+uint64_t HuffmanWatArray::alphabet_num() const{
+  return alphabet_num_;
+}
+
+uint64_t HuffmanWatArray::length() const{
+  return length_;
+}
+
+uint64_t HuffmanWatArray::GetUsageBytes() const{
+  uint64_t bytes = sizeof(*this) 
+    + sizeof(uint64_t) * (chars_.size() + sorted_chars_.size() + len_begs_.size() + first_codes_.size())
+    + sizeof(uint8_t)  * char_lens_.size();
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    bytes += bit_arrays_[i].GetUsageBytes();
+  }
+  return bytes;
+}
+
+void HuffmanWatArray::set_layout(BitArray::Layout layout){
+  layout_ = layout;
+}
+
+BitArray::Layout HuffmanWatArray::layout() const{
+  return layout_;
+}
+
+uint64_t HuffmanWatArray::GetAlphabetNum(const std::vector<uint64_t>& array) const {
+  uint64_t alphabet_num = 0;
+  for (size_t i = 0; i < array.size(); ++i){
+    if (array[i] >= alphabet_num){
+      alphabet_num = array[i]+1;
+    }
+  }
+  return alphabet_num;
+}
+
+uint64_t HuffmanWatArray::GetMSB(uint64_t x, uint64_t pos, uint64_t len) {
+  return (x >> (len - (pos + 1))) & 1LLU;
+}
+
+void HuffmanWatArray::SetCodes(const vector<uint64_t>& array, vector<uint64_t>& char_codes){
+  // only the values that appear are counted, so that a sparse 
+  // alphabet takes memory of the distinct values
+  vector<uint64_t> sorted(array);
+  sort(sorted.begin(), sorted.end());
+  vector<uint64_t> chars;
+  vector<uint64_t> weights;
+  for (size_t i = 0; i < sorted.size(); ++i){
+    if (i == 0 || sorted[i] != sorted[i-1]){
+      chars.push_back(sorted[i]);
+      weights.push_back(0);
+    }
+    weights.back()++;
+  }
+  vector<uint64_t>().swap(sorted);
+
+  // flatten the weights until the codes fit in MAX_CODE_LEN bits
+  vector<uint64_t> lens;
+  for (;;){
+    GetHuffmanCodeLens(weights, lens);
+    if (lens.empty() || *max_element(lens.begin(), lens.end()) <= MAX_CODE_LEN) break;
+    for (size_t i = 0; i < weights.size(); ++i){
+      weights[i] = (weights[i] >> 1) | 1LLU;
+    }
+  }
+  uint64_t max_len = lens.empty() ? 0 : *max_element(lens.begin(), lens.end());
+
+  // the canonical codes in the order of (length, -value) are complemented, 
+  // so that the codes ending at a depth are larger than the prefixes of 
+  // the longer codes, and the codes of a length increase with the values
+  vector<uint64_t> order(chars.size());
+  for (size_t i = 0; i < order.size(); ++i){
+    order[i] = chars.size() - i - 1;
+  }
+  stable_sort(order.begin(), order.end(), 
+	      [&lens](uint64_t lhs, uint64_t rhs) { return lens[lhs] < lens[rhs]; });
+  char_codes.assign(chars.size(), 0);
+  uint64_t code = 0;
+  for (size_t i = 0; i < order.size(); ++i){
+    uint64_t len = lens[order[i]];
+    if (i > 0){
+      code = (code + 1) << (len - lens[order[i-1]]);
+    }
+    uint64_t mask = (len == 0) ? 0 : (~0LLU >> (64 - len));
+    char_codes[order[i]] = ~code & mask;
+  }
+  chars_.resize(chars.size());
+  char_lens_.resize(chars.size());
+  for (size_t i = 0; i < chars.size(); ++i){
+    chars_[i]     = chars[i];
+    char_lens_[i] = lens[i];
+  }
+
+  len_begs_.assign(max_len + 2, 0);
+  first_codes_.assign(max_len + 1, 0);
+  sorted_chars_.resize(chars.size());
+  for (size_t i = 0; i < chars.size(); ++i){
+    len_begs_[lens[i] + 1]++;
+  }
+  for (uint64_t len = 0; len <= max_len; ++len){
+    len_begs_[len + 1] += len_begs_[len];
+  }
+  vector<uint64_t> poses(len_begs_.data(), len_begs_.data() + max_len + 1);
+  for (size_t i = 0; i < chars.size(); ++i){
+    // the first value of a length has the first code of the length
+    if (poses[lens[i]] == len_begs_[lens[i]]) first_codes_[lens[i]] = char_codes[i];
+    sorted_chars_[poses[lens[i]]++] = chars[i];
+  }
+}
+
+void HuffmanWatArray::SetArray(const vector<uint64_t>& array, const vector<uint64_t>& char_codes) {
+  uint64_t max_len = max_code_len();
+  // cur is the indexes in chars_ of the values having the codes longer 
+  // than the depth, sorted by the prefixes of their codes
+  vector<uint64_t> cur;
+  for (size_t i = 0; i < array.size(); ++i){
+    uint64_t c = lower_bound(chars_.data(), chars_.data() + chars_.size(), array[i]) - chars_.data();
+    if (char_lens_[c] > 0) cur.push_back(c);
+  }
+  vector<uint64_t> next;
+  bit_arrays_.resize(max_len);
+  for (uint64_t depth = 0; depth < max_len; ++depth){
+    BitArray& ba = bit_arrays_[depth];
+    ba = BitArray(cur.size(), layout_);
+    next.resize(cur.size());
+    uint64_t next_num = 0;
+    for (size_t beg = 0; beg < cur.size(); ){
+      uint64_t prefix = char_codes[cur[beg]] >> (char_lens_[cur[beg]] - depth);
+      size_t end = beg;
+      while (end < cur.size() && char_codes[cur[end]] >> (char_lens_[cur[end]] - depth) == prefix){
+	++end;
+      }
+      // the node [beg, end) is stably split into zeros and ones
+      size_t pos = beg;
+      for (size_t i = beg; i < end; ++i){
+	uint64_t c = cur[i];
+	if (GetMSB(char_codes[c], depth, char_lens_[c])){
+	  ba.SetBit(1, i);
+	} else {
+	  next[pos++] = c;
+	}
+      }
+      for (size_t i = beg; i < end; ++i){
+	uint64_t c = cur[i];
+	if (GetMSB(char_codes[c], depth, char_lens_[c])){
+	  next[pos++] = c;
+	}
+	if (char_lens_[c] > depth + 1) ++next_num;
+      }
+      beg = end;
+    }
+    ba.Build();
+    // the values whose codes end here are at the end
+    next.resize(next_num);
+    cur.swap(next);
+  }
+}
+
+bool HuffmanWatArray::CheckChars() const{
+  if (char_lens_.size() != chars_.size() || sorted_chars_.size() != chars_.size()) return false;
+  return chars_.empty() ? (alphabet_num_ == 0) : (chars_[chars_.size() - 1] + 1 == alphabet_num_);
+}
+
+uint64_t HuffmanWatArray::max_code_len() const{
+  return len_begs_.empty() ? 0 : len_begs_.size() - 2;
+}
+
+bool HuffmanWatArray::IsLeaf(uint64_t prefix, uint64_t depth) const{
+  return len_begs_[depth] < len_begs_[depth + 1] && prefix >= first_codes_[depth];
+}
+
+uint64_t HuffmanWatArray::Decode(uint64_t code, uint64_t len) const{
+  return sorted_chars_[len_begs_[len] + code - first_codes_[len]];
+}
+
+bool HuffmanWatArray::GetCode(uint64_t c, uint64_t& code, uint64_t& len) const{
+  const uint64_t* beg = chars_.data();
+  const uint64_t* end = chars_.data() + chars_.size();
+  const uint64_t* it  = lower_bound(beg, end, c);
+  if (it == end || *it != c) return false;
+  len  = char_lens_[it - beg];
+  code = CodeBeg(c, len);
+  return true;
+}
+
+uint64_t HuffmanWatArray::CodeBeg(uint64_t c, uint64_t len) const{
+  const uint64_t* beg = sorted_chars_.data() + len_begs_[len];
+  const uint64_t* end = sorted_chars_.data() + len_begs_[len + 1];
+  return first_codes_[len] + (lower_bound(beg, end, c) - beg);
+}
+
+void HuffmanWatArray::GetCodeRanges(uint64_t min_c, uint64_t max_c, vector<CodeRange>& ranges) const{
+  uint64_t max_len = max_code_len();
+  ranges.assign(max_len + 1, CodeRange());
+  if (min_c >= max_c || len_begs_.empty()) return;
+  for (uint64_t len = 0; len <= max_len; ++len){
+    ranges[len].beg = CodeBeg(min_c, len);
+    ranges[len].end = CodeBeg(max_c, len);
+  }
+}
+
+void HuffmanWatArray::RankCode(uint64_t code, uint64_t len, uint64_t pos, 
+			       uint64_t& rank, uint64_t& rank_less_than) const{
+  // rank_less_than counts the codes lexicographically smaller than code
+  uint64_t beg_node = 0;
+  uint64_t end_node = length_;
+  rank_less_than = 0;
+  for (uint64_t i = 0; i < len && beg_node < end_node; ++i){
+    const BitArray& ba = bit_arrays_[i];
+    uint64_t beg_node_zero = ba.Rank(0, beg_node);
+    uint64_t end_node_zero = ba.Rank(0, end_node);
+    uint64_t boundary      = beg_node + end_node_zero - beg_node_zero;
+    uint64_t pos_zero      = ba.Rank(0, pos);
+    if (!GetMSB(code, i, len)){
+      pos      = beg_node + pos_zero - beg_node_zero;
+      end_node = boundary;
+    } else {
+      rank_less_than += pos_zero - beg_node_zero;
+      pos      = boundary + (pos - pos_zero) - (beg_node - beg_node_zero);
+      beg_node = boundary;
+    }
+  }
+  rank = pos - beg_node;
+}
+
+uint64_t HuffmanWatArray::CountLessThan(uint64_t c, uint64_t pos) const{
+  if (c >= alphabet_num_) return pos;
+  // the values less than c of each length have consecutive codes 
+  // from first_codes_[len], which are counted by their lexicographic ranks
+  uint64_t count = 0;
+  for (uint64_t len = 0; len <= max_code_len(); ++len){
+    uint64_t end_code = CodeBeg(c, len);
+    if (end_code == first_codes_[len]) continue;
+    uint64_t rank = 0;
+    uint64_t beg_less_than = 0;
+    uint64_t end_less_than = 0;
+    RankCode(first_codes_[len], len, pos, rank, beg_less_than);
+    RankCode(end_code - 1, len, pos, rank, end_less_than);
+    count += end_less_than + rank - beg_less_than;
+  }
+  return count;
+}
+
+bool HuffmanWatArray::CheckPrefix(uint64_t prefix, uint64_t depth, const vector<CodeRange>& ranges) const {
+  if (IsLeaf(prefix, depth)){
+    return ranges[depth].beg <= prefix && prefix < ranges[depth].end;
+  }
+  for (uint64_t len = depth + 1; len < ranges.size(); ++len){
+    const CodeRange& range = ranges[len];
+    if (range.beg >= range.end) continue;
+    if ((prefix << (len - depth)) < range.end && 
+	range.beg < ((prefix + 1) << (len - depth))) return true;
+  }
+  return false;
+}
+
+void HuffmanWatArray::ExpandNode(const QueryOnNode& qon, vector<QueryOnNode>& next) const{
+  const BitArray& ba = bit_arrays_[qon.depth];
+  
+  uint64_t beg_node_zero = ba.Rank(0, qon.beg_node);
+  uint64_t end_node_zero = ba.Rank(0, qon.end_node);
+  uint64_t beg_node_one  = qon.beg_node - beg_node_zero;
+  uint64_t beg_zero  = ba.Rank(0, qon.beg_pos);
+  uint64_t end_zero  = ba.Rank(0, qon.end_pos);
+  uint64_t beg_one   = qon.beg_pos - beg_zero;
+  uint64_t end_one   = qon.end_pos - end_zero;
+  uint64_t boundary  = qon.beg_node + end_node_zero - beg_node_zero;
+  if (end_zero - beg_zero > 0){ // child for zero 
+    next.push_back(QueryOnNode(qon.beg_node, 
+			       boundary, 
+			       qon.beg_node + beg_zero - beg_node_zero, 
+			       qon.beg_node + end_zero - beg_node_zero, 
+			       qon.depth+1,
+			       qon.prefix_char << 1));
+  }
+  if (end_one - beg_one > 0){ // child for one
+    next.push_back(QueryOnNode(boundary, 
+			       qon.end_node, 
+			       boundary + beg_one - beg_node_one, 
+			       boundary + end_one - beg_node_one, 
+			       qon.depth+1,
+			       (qon.prefix_char << 1) + 1));
+  } 
+}
+
+bool HuffmanWatArray::FindCode(uint64_t len, const CodeRange& range, bool largest, 
+			       const QueryOnNode& qon, uint64_t& code, uint64_t& freq) const{
+  if (qon.depth == len){
+    code = qon.prefix_char;
+    freq = qon.end_pos - qon.beg_pos;
+    return true;
+  }
+  if (IsLeaf(qon.prefix_char, qon.depth)) return false;
+  vector<QueryOnNode> next;
+  ExpandNode(qon, next);
+  if (largest) reverse(next.begin(), next.end());
+  for (size_t i = 0; i < next.size(); ++i){
+    uint64_t shift = len - next[i].depth;
+    if ((next[i].prefix_char << shift) < range.end && 
+	range.beg < ((next[i].prefix_char + 1) << shift) &&
+	FindCode(len, range, largest, next[i], code, freq)) return true;
+  }
+  return false;
+}
+
+void HuffmanWatArray::Save(ostream& os) const{
+  uint64_t offset = 0;
+  WriteValue(os, FORMAT_MAGIC, offset);
+  WriteValue(os, FORMAT_VERSION, offset);
+  WriteValue(os, alphabet_num_, offset);
+  WriteValue(os, length_, offset);
+  WriteValue(os, bit_arrays_.size(), offset);
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    bit_arrays_[i].SaveAligned(os, offset);
+  }
+  WriteArray(os, chars_.data(), chars_.size(), offset);
+  WriteArray(os, char_lens_.data(), char_lens_.size(), offset);
+  WriteArray(os, sorted_chars_.data(), sorted_chars_.size(), offset);
+  WriteArray(os, len_begs_.data(), len_begs_.size(), offset);
+  WriteArray(os, first_codes_.data(), first_codes_.size(), offset);
+}
+
+void HuffmanWatArray::Load(istream& is){
+  Clear();
+  uint64_t offset = 0;
+  uint64_t magic = 0;
+  uint64_t version = 0;
+  uint64_t level_num = 0;
+  ReadValue(is, magic, offset);
+  ReadValue(is, version, offset);
+  ReadValue(is, alphabet_num_, offset);
+  ReadValue(is, length_, offset);
+  ReadValue(is, level_num, offset);
+  if (!is || magic != FORMAT_MAGIC || version != FORMAT_VERSION || 
+      level_num > MAX_CODE_LEN){
+    Clear();
+    is.setstate(ios::failbit);
+    return;
+  }
+  bit_arrays_.resize(level_num);
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    bit_arrays_[i].LoadAligned(is, offset);
+  }
+  ReadArray(is, chars_, offset);
+  ReadArray(is, char_lens_, offset);
+  ReadArray(is, sorted_chars_, offset);
+  ReadArray(is, len_begs_, offset);
+  ReadArray(is, first_codes_, offset);
+  if (!is || !CheckChars() || max_code_len() != level_num){
+    Clear();
+    is.setstate(ios::failbit);
+  }
+}
+
+int HuffmanWatArray::Map(const char* filename){
+  Clear();
+  std::shared_ptr<MappedFile> mapped_file(new MappedFile);
+  if (mapped_file->Open(filename) != 0) return -1;
+
+  MapCursor cursor(mapped_file->data(), mapped_file->size());
+  uint64_t magic = 0;
+  uint64_t version = 0;
+  uint64_t level_num = 0;
+  MapValue(cursor, magic);
+  MapValue(cursor, version);
+  MapValue(cursor, alphabet_num_);
+  MapValue(cursor, length_);
+  MapValue(cursor, level_num);
+  if (magic != FORMAT_MAGIC || version != FORMAT_VERSION || 
+      level_num > MAX_CODE_LEN){
+    Clear();
+    return -1;
+  }
+  bit_arrays_.resize(level_num);
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    bit_arrays_[i].Map(cursor);
+  }
+  MapArray(cursor, chars_);
+  MapArray(cursor, char_lens_);
+  MapArray(cursor, sorted_chars_);
+  MapArray(cursor, len_begs_);
+  MapArray(cursor, first_codes_);
+  if (!cursor.ok || !CheckChars() || max_code_len() != level_num){
+    Clear();
+    return -1;
+  }
+  mapped_file_ = mapped_file;
+  return 0;
+}
+
+}
@@ -0,0 +1,335 @@
+/* 
+ *  Copyright (c) 2010 Daisuke Okanohara
+ * 
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ * 
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#ifndef WAT_ARRAY_HUFFMAN_WAT_ARRAY_HPP_
+#define WAT_ARRAY_HUFFMAN_WAT_ARRAY_HPP_
+
+#include <vector>
+#include <queue>
+#include <memory>
+#include <stdint.h>
+#include <iostream>
+#include "bit_array.hpp"
+#include "mapped_file.hpp"
+#include "wat_array.hpp"
+#include "mapped_vector.hpp"
+
+namespace wat_array {
+
+/**
+ Huffman-shaped Wavelet Tree Array for skewed arrays.
+
+ The same queries as WatArray. Each value is descended along its 
+ Huffman code, so Lookup, Rank and Select visit H0 levels on average
+ and the bit arrays use about n H0 bits instead of n log_2 k bits.
+
+ The codes are canonical, assigned so that at each depth the codes 
+ ending there are larger than the prefixes of the longer codes, and 
+ so that the codes of the same length are ordered as the values. Each 
+ level is then laid out as in WatArray, with the finished values 
+ dropped from its end. The queries by value range (RankLessThan, 
+ FreqRange, QuantileRange, List*Range) are answered per code length, 
+ and are slower than in WatArray.
+ */
+class HuffmanWatArray{
+public:
+  /**
+   * Constructor
+   */
+  HuffmanWatArray();
+
+  /**
+   * Destructor 
+   */
+  ~HuffmanWatArray();
+
+  /**
+   * Initialize an index from an array
+   * @param An array to be initialized
+   */
+  void Init(const std::vector<uint64_t>& array);
+
+  /**
+   * Clear and release the resouces
+   */
+  void Clear();
+
+  /**
+   * Lookup A[pos]
+   * @param pos the position
+   * @return return A[pos] if found, or return NOT_FOUND if pos >= length 
+   */
+  uint64_t Lookup(uint64_t pos) const;
+
+  /**
+   * Compute the rank = the frequency of a character 'c' in the prefix of the array A[0...pos)
+   * @param c Character to be examined
+   * @param pos The position of the prefix (not inclusive)
+   * @return The frequency of a character 'c' in the prefix of the array A[0...pos)
+   *         or NOT_FOUND if c >= alphabet_num or pos > length
+   */
+  uint64_t Rank(uint64_t c, uint64_t pos) const;
+
+  /**
+   * Compute the select = the position of the (rank+1)-th occurence of 'c' in the array.
+   * @param c Character to be examined
+   * @param rank The rank of the character
+   * @return The position of the (rank+1)-th occurence of 'c' in the array. 
+   *         or NOT_FOUND if c >= alphabet_num or rank > Freq(c)
+   */
+  uint64_t Select(uint64_t c, uint64_t rank) const;
+
+  /**
+   * Compute the frequency of characters c' < c in the subarray A[0...pos)
+   * @param c The upper bound of the characters
+   * @param pos The position of the end of the prefix (not inclusive)
+   * @return The frequency of characters c' < c in the prefix of the array A[0...pos)
+             or NOTFOUND if c > alphabet_num or pos > length
+   */
+  uint64_t RankLessThan(uint64_t c, uint64_t pos) const;
+
+  /**
+   * Compute the frequency of characters c' > c in the subarray A[0...pos)
+   * @param c The lower bound of the characters
+   * @param pos The position of the end of the prefix (not inclusive)
+   * @return The frequency of characters c' < c in the prefix of the array A[0...pos)
+             or NOTFOUND if c > alphabet_num or pos > length
+   */
+  uint64_t RankMoreThan(uint64_t c, uint64_t pos) const;
+
+  /**
+   * Compute the frequency of characters c' < c, c'=c, and c' > c, in the subarray A[0...pos)
+   * @param c The character
+   * @param pos The position of the end of the prefix (not inclusive)
+   * @param rank The frefquency of c in A[0...pos)
+   * @param rank_less_than The frequency of c' < c in A[0...pos)
+   * @param rank_more_than The frequency of c' > c in A[0...pos)
+    */
+  void RankAll(uint64_t c, uint64_t pos, uint64_t& rank, 
+	       uint64_t& rank_less_than, uint64_t& rank_more_than) const; 
+
+  /**
+   * Compute the frequency of characters min_c <= c' < max_c in the subarray A[beg_pos ... end_pos)
+   * @param min_c The smallerest character to be examined
+   * @param max_c The uppker bound of the character to be examined
+   * @param beg_pos The beginning position of the array (inclusive)
+   * @param end_pos The ending position of the array (not inclusive)
+   * @return The frequency of characters min_c <= c < max_c in the subarray A[beg_pos .. end_pos)
+             or NOTFOUND if max_c > alphabet_num or end_pos > length
+   */
+  uint64_t FreqRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos) const;
+
+  /**
+   * Range Max Query
+   * @param beg_pos The beginning position
+   * @param end_pos The ending position
+   * @param pos The position where the largest value appeared in the subarray A[beg_pos .. end_pos)
+                If there are many items having the largest values, the smallest pos will be reporeted
+   * @param val The largest value appeared in the subarray A[beg_pos ... end_pos)
+   */
+  void MaxRange(uint64_t beg_pos, uint64_t end_pos, uint64_t& pos, uint64_t& val) const; 
+
+  /**
+   * Range Min Query
+   * @param beg_pos The beginning position
+   * @param end_pos The ending position
+   * @param pos The position where the smallest value appeared in the subarray A[beg_pos .. end_pos)
+                If there are many items having the smalles values, the smallest pos will be reporeted
+   * @param val The smallest value appeared in the subarray A[beg_pos ... end_pos)
+   */
+  void MinRange(uint64_t beg_pos, uint64_t end_pos, uint64_t& pos, uint64_t& val) const; 
+
+  /**
+   * Range Quantile Query, Return the K-th smallest value in the subarray
+   * @param beg_pos The beginning position
+   * @param end_pos The ending position
+   * @param k The order (should be smaller than end_pos - beg_pos).
+   * @param pos The position where the k-th largest value appeared in the subarray A[beg_pos .. end_pos)
+                If there are many items having the k-th largest values, the smallest pos will be reporeted
+   * @param val The k-th largest value appeared in the subarray A[beg_pos ... end_pos)
+   */
+  void QuantileRange(uint64_t beg_pos, uint64_t end_pos, uint64_t k, uint64_t& pos, uint64_t& val) const; 
+
+  /**
+   * List the distinct characters appeared in A[beg_pos ... end_pos) from most frequent ones
+   */
+  void ListModeRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos, uint64_t num, std::vector<ListResult>& res) const;
+
+  /**
+   * List the distinct characters in A[beg_pos ... end_pos) min_c <= c < max_c  from smallest ones 
+   * @param min_c The smallerest character to be examined
+   * @param max_c The uppker bound of the character to be examined
+   * @param beg_pos The beginning position of the array (inclusive)
+   * @param end_pos The ending positin of the array (not inclusive)
+   * @param num The maximum number of reporting results.
+   * @param res The distinct chracters in the A[beg_pos ... end_pos) from smallest ones. 
+   *            Each item consists of c:character and freq: frequency of c. 
+   */
+  void ListMinRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos, uint64_t num, std::vector<ListResult>& res) const;
+
+  /**
+   * List the distinct characters appeared in A[beg_pos ... end_pos) from largest ones 
+   * @param min_c The smallerest character to be examined
+   * @param max_c The uppker bound of the character to be examined
+   * @param beg_pos The beginning position of the array (inclusive)
+   * @param end_pos The ending positin of the array (not inclusive)
+   * @param num The maximum number of reporting results.
+   * @param res The distinct chracters in the A[beg_pos ... end_pos) from largestx ones. 
+   *            Each item consists of c:character and freq: frequency of c. 
+   */
+  void ListMaxRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos, uint64_t num, std::vector<ListResult>& res) const;
+
+  /**
+   * Compute the frequency of the character c
+   * @param c The character to be examined
+   * param Return the frequency of c in the array.
+   */
+  uint64_t Freq(uint64_t c) const;
+
+  /**
+   * Compute the frequency of the characters 
+   * @param min_c The minimum character
+   * @param max_c The maximum character
+   * param Return the frequency of min_c <= c < max_c in the array.
+   */
+  uint64_t FreqSum(uint64_t min_c, uint64_t max_c) const;
+
+  /**
+   * Return the number of alphabets in the array
+   * @return The number of alphabet in the array
+   */
+  uint64_t alphabet_num() const;
+
+  /**
+   * Return the length of the array
+   * @return The length of the array
+   */
+  uint64_t length() const;
+
+  /**
+   * Return the memory usage of the index
+   * @return The number of bytes used by the index
+   */
+  uint64_t GetUsageBytes() const;
+
+  /**
+   * Set the layout of the bit arrays used by the following Init().
+   * The default is BitArray::INTERLEAVED_LAYOUT.
+   * @param layout The layout of the bit arrays
+   */
+  void set_layout(BitArray::Layout layout);
+
+  /**
+   * Return the layout of the bit arrays
+   * @return The layout of the bit arrays
+   */
+  BitArray::Layout layout() const;
+
+  /**
+   * Save the current status to a stream in the aligned format
+   * @param os The output stream where the data is saved
+   */
+  void Save(std::ostream& os) const;
+
+  /**
+   * Load the current status from a stream
+   * @param is The input stream where the status is saved
+   */
+  void Load(std::istream& is);
+
+  /**
+   * Map a file written by Save() and answer the queries from the mapping
+   * @param filename The name of the file
+   * @return 0 on success, -1 if the file cannot be mapped or is not 
+   *         in the current format
+   */
+  int Map(const char* filename);
+
+private:
+  enum {
+    FORMAT_MAGIC   = 0x5941525248574157LLU, // "WAWHRRAY"
+    FORMAT_VERSION = 2, // version 1 has the codes of every value below alphabet_num
+    MAX_CODE_LEN   = 63
+  };
+
+  struct QueryOnNode{
+    QueryOnNode(uint64_t beg_node, uint64_t end_node, uint64_t beg_pos, uint64_t end_pos, 
+		uint64_t depth, uint64_t prefix_char) :
+      beg_node(beg_node), end_node(end_node), beg_pos(beg_pos), end_pos(end_pos), 
+      depth(depth), prefix_char(prefix_char) {}
+    uint64_t beg_node;
+    uint64_t end_node;
+    uint64_t beg_pos;
+    uint64_t end_pos;
+    uint64_t depth;
+    uint64_t prefix_char;
+  };
+
+  // [beg, end) of the codes of each length whose values are in a range
+  struct CodeRange{
+    CodeRange() : beg(0), end(0) {}
+    uint64_t beg;
+    uint64_t end;
+  };
+
+  class ListModeComparator;
+
+  uint64_t GetAlphabetNum(const std::vector<uint64_t>& array) const;
+  static uint64_t GetMSB(uint64_t x, uint64_t pos, uint64_t len);
+  void SetCodes(const std::vector<uint64_t>& array, std::vector<uint64_t>& char_codes);
+  void SetArray(const std::vector<uint64_t>& array, const std::vector<uint64_t>& char_codes);
+  bool CheckChars() const;
+  uint64_t max_code_len() const;
+  bool IsLeaf(uint64_t prefix, uint64_t depth) const;
+  uint64_t Decode(uint64_t code, uint64_t len) const;
+  bool GetCode(uint64_t c, uint64_t& code, uint64_t& len) const;
+  uint64_t CodeBeg(uint64_t c, uint64_t len) const;
+  void GetCodeRanges(uint64_t min_c, uint64_t max_c, std::vector<CodeRange>& ranges) const;
+  void RankCode(uint64_t code, uint64_t len, uint64_t pos, 
+		uint64_t& rank, uint64_t& rank_less_than) const;
+  uint64_t CountLessThan(uint64_t c, uint64_t pos) const;
+  bool CheckPrefix(uint64_t prefix, uint64_t depth, const std::vector<CodeRange>& ranges) const;
+  void ExpandNode(const QueryOnNode& qon, std::vector<QueryOnNode>& next) const;
+  bool FindCode(uint64_t len, const CodeRange& range, bool largest, 
+		const QueryOnNode& qon, uint64_t& code, uint64_t& freq) const;
+  void ListEndRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos, 
+		    uint64_t num, bool largest, std::vector<ListResult>& res) const;
+
+  std::vector<BitArray> bit_arrays_;
+
+  // the values that appear in increasing order, and the lengths of 
+  // their codes; the code of chars_[i] is CodeBeg(chars_[i], char_lens_[i])
+  MappedVector<uint64_t> chars_;
+  MappedVector<uint8_t>  char_lens_;
+  // the values ordered by their code lengths, then by their codes; the 
+  // values of length l are sorted_chars_[len_begs_[l] ... len_begs_[l+1])
+  // and have the codes first_codes_[l], first_codes_[l]+1, ...
+  MappedVector<uint64_t> sorted_chars_;
+  MappedVector<uint64_t> len_begs_;
+  MappedVector<uint64_t> first_codes_;
+  std::shared_ptr<MappedFile> mapped_file_;
+
+  uint64_t alphabet_num_;
+  uint64_t length_;
+  BitArray::Layout layout_;
+};
+
+}
+
+#endif // WAT_ARRAY_HUFFMAN_WAT_ARRAY_HPP_
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <cassert>
+#include <algorithm>
+#include "int_vector.hpp"
+
+namespace wat_array {
+
+IntVector::IntVector() : width_(0), length_(0), mask_(0){
+}
+
+IntVector::IntVector(uint64_t width, uint64_t length) : width_(0), length_(0), mask_(0){
+  Init(width, length);
+}
+
+IntVector::~IntVector(){
+}
+
+uint64_t IntVector::width() const {
+  return width_;
+}
+
+uint64_t IntVector::length() const {
+  return length_;
+}
+
+void IntVector::Init(uint64_t width, uint64_t length){
+  assert(width <= 64);
+  width_  = width;
+  length_ = length;
+  mask_   = (width_ < 64) ? (1LLU << width_) - 1 : ~0LLU;
+  // the words already allocated are reused
+  words_.assign(GetWordNum(width_, length_), 0);
+}
+
+void IntVector::Clear(){
+  words_.Clear();
+  width_  = 0;
+  length_ = 0;
+  mask_   = 0;
+}
+
+void IntVector::SetConcurrent(uint64_t ind, uint64_t val){
+  assert(ind < length_);
+  val &= mask_;
+  uint64_t pos    = ind * width_;
+  uint64_t offset = pos % 64;
+  __atomic_fetch_or(&words_[pos / 64], val << offset, __ATOMIC_RELAXED);
+  if (offset + width_ > 64){
+    __atomic_fetch_or(&words_[pos / 64 + 1], val >> (64 - offset), __ATOMIC_RELAXED);
+  }
+}
+
+uint64_t IntVector::GetWordNum(uint64_t width, uint64_t length){
+  // one extra word, so that Get() and Set() never touch past the end; 
+  // they touch the second word even when width is 0
+  return std::max<uint64_t>((width * length + 63) / 64 + 1, 2);
+}
+
+uint64_t IntVector::GetUsageBytes() const {
+  return sizeof(*this) + sizeof(uint64_t) * words_.size();
+}
+
+void IntVector::SaveAligned(std::ostream& os, uint64_t& offset) const{
+  WriteValue(os, width_, offset);
+  WriteValue(os, length_, offset);
+  WriteArray(os, words_.data(), words_.size(), offset);
+}
+
+void IntVector::LoadAligned(std::istream& is, uint64_t& offset){
+  Clear();
+  ReadValue(is, width_, offset);
+  ReadValue(is, length_, offset);
+  ReadArray(is, words_, offset);
+  mask_ = (width_ < 64) ? (1LLU << width_) - 1 : ~0LLU;
+  if (width_ > 64 || (length_ > 0 && words_.size() != GetWordNum(width_, length_))){
+    Clear();
+    is.setstate(std::ios::failbit);
+  }
+}
+
+void IntVector::Map(MapCursor& cursor){
+  Clear();
+  MapValue(cursor, width_);
+  MapValue(cursor, length_);
+  MapArray(cursor, words_);
+  mask_ = (width_ < 64) ? (1LLU << width_) - 1 : ~0LLU;
+  if (width_ > 64 || (length_ > 0 && words_.size() != GetWordNum(width_, length_))){
+    Clear();
+    cursor.ok = false;
+  }
+}
+
+}
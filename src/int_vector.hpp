@@ -0,0 +1,116 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#ifndef WAT_ARRAY_INT_VECTOR_HPP_
+#define WAT_ARRAY_INT_VECTOR_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include <iostream>
+#include "mapped_vector.hpp"
+
+namespace wat_array {
+
+/**
+ * A vector of length integers of width bits each, packed into 64-bit 
+ * words from the lowest bit, so that the i-th integer occupies the bits
+ * [i * width, (i+1) * width). It takes width bits per integer instead 
+ * of 64, and is accepted by WatArray::Init().
+ */
+class IntVector {
+
+public:
+  IntVector();
+  IntVector(uint64_t width, uint64_t length);
+  ~IntVector();
+  uint64_t width() const;
+  uint64_t length() const;
+
+  /**
+   * Initialize length integers of width bits, all zero
+   * @param width The number of bits of an integer (at most 64)
+   * @param length The number of integers
+   */
+  void Init(uint64_t width, uint64_t length);
+  void Clear();
+
+  /**
+   * Set the ind-th integer to the lower width bits of val
+   */
+  void Set(uint64_t ind, uint64_t val) {
+    // the next word always exists, and is written without a branch; 
+    // its mask is empty unless the integer spans it
+    val &= mask_;
+    uint64_t pos    = ind * width_;
+    uint64_t offset = pos % 64;
+    uint64_t& word  = words_[pos / 64];
+    uint64_t& next_word = words_[pos / 64 + 1];
+    word = (word & ~(mask_ << offset)) | (val << offset);
+    next_word = (next_word & ~((mask_ >> 1) >> (63 - offset))) | ((val >> 1) >> (63 - offset));
+  }
+
+  /**
+   * Set the ind-th integer, which must be zero, to the lower width bits 
+   * of val. The bits are or-ed in, without clearing them as Set() does.
+   */
+  void SetZeroed(uint64_t ind, uint64_t val) {
+    val &= mask_;
+    uint64_t pos    = ind * width_;
+    uint64_t offset = pos % 64;
+    uint64_t* words = &words_[pos / 64];
+    words[0] |= val << offset;
+    words[1] |= (val >> 1) >> (63 - offset);
+  }
+
+  /**
+   * Set the ind-th integer, which must be zero, to the lower width bits 
+   * of val. The words are updated atomically, so that different 
+   * integers can be set concurrently even when they share a word.
+   */
+  void SetConcurrent(uint64_t ind, uint64_t val);
+
+  uint64_t Get(uint64_t ind) const {
+    uint64_t pos    = ind * width_;
+    uint64_t offset = pos % 64;
+    const uint64_t* words = words_.data() + pos / 64;
+    return ((words[0] >> offset) | ((words[1] << 1) << (63 - offset))) & mask_;
+  }
+
+  uint64_t operator[](uint64_t ind) const {
+    return Get(ind);
+  }
+
+  uint64_t GetUsageBytes() const;
+
+  void SaveAligned(std::ostream& os, uint64_t& offset) const;
+  void LoadAligned(std::istream& is, uint64_t& offset);
+  void Map(MapCursor& cursor);
+
+private:
+  static uint64_t GetWordNum(uint64_t width, uint64_t length);
+
+  MappedVector<uint64_t> words_;
+  uint64_t width_;
+  uint64_t length_;
+  uint64_t mask_;
+};
+
+}
+
+#endif // WAT_ARRAY_INT_VECTOR_HPP_
@@ -0,0 +1,67 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mapped_file.hpp"
+
+namespace wat_array {
+
+MappedFile::MappedFile() : data_(NULL), size_(0){
+}
+
+MappedFile::~MappedFile(){
+  Close();
+}
+
+int MappedFile::Open(const char* filename){
+  Close();
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0){
+    close(fd);
+    return -1;
+  }
+  void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) return -1;
+  data_ = static_cast<const char*>(addr);
+  size_ = st.st_size;
+  return 0;
+}
+
+void MappedFile::Close(){
+  if (data_ == NULL) return;
+  munmap(const_cast<char*>(data_), size_);
+  data_ = NULL;
+  size_ = 0;
+}
+
+const char* MappedFile::data() const {
+  return data_;
+}
+
+uint64_t MappedFile::size() const {
+  return size_;
+}
+
+}
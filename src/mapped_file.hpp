@@ -0,0 +1,57 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#ifndef WAT_ARRAY_MAPPED_FILE_HPP_
+#define WAT_ARRAY_MAPPED_FILE_HPP_
+
+#include <stdint.h>
+
+namespace wat_array {
+
+/**
+ * A file mapped read-only into memory. The pages are shared by all 
+ * the processes which map the same file.
+ */
+class MappedFile {
+public:
+  MappedFile();
+  ~MappedFile();
+
+  /**
+   * Map a file
+   * @param filename The name of the file
+   * @return 0 on success, -1 if the file cannot be opened or mapped
+   */
+  int Open(const char* filename);
+  void Close();
+
+  const char* data() const;
+  uint64_t size() const;
+
+private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const char* data_;
+  uint64_t size_;
+};
+
+}
+
+#endif // WAT_ARRAY_MAPPED_FILE_HPP_
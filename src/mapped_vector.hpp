@@ -0,0 +1,208 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#ifndef WAT_ARRAY_MAPPED_VECTOR_HPP_
+#define WAT_ARRAY_MAPPED_VECTOR_HPP_
+
+#include <stdint.h>
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include <iostream>
+
+namespace wat_array {
+
+/**
+ * A vector which either owns its elements or refers to a read-only 
+ * region of a mapped file. Only the owned form can be modified; 
+ * every modification drops the mapping.
+ */
+template <class T>
+class MappedVector {
+public:
+  MappedVector() : mapped_data_(NULL), mapped_size_(0) {}
+
+  uint64_t size() const {
+    return mapped_data_ ? mapped_size_ : vec_.size();
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  const T* data() const {
+    return mapped_data_ ? mapped_data_ : vec_.data();
+  }
+
+  const T& operator[](uint64_t ind) const {
+    return data()[ind];
+  }
+
+  T& operator[](uint64_t ind) {
+    assert(mapped_data_ == NULL);
+    return vec_[ind];
+  }
+
+  const T& back() const {
+    return data()[size() - 1];
+  }
+
+  T& back() {
+    assert(mapped_data_ == NULL);
+    return vec_.back();
+  }
+
+  void resize(uint64_t size, const T& val = T()) {
+    Unmap();
+    vec_.resize(size, val);
+  }
+
+  void assign(uint64_t size, const T& val) {
+    Unmap();
+    vec_.assign(size, val);
+  }
+
+  void push_back(const T& val) {
+    Unmap();
+    vec_.push_back(val);
+  }
+
+  void shrink_to_fit() {
+    std::vector<T>(vec_).swap(vec_);
+  }
+
+  void Clear() {
+    std::vector<T>().swap(vec_);
+    mapped_data_ = NULL;
+    mapped_size_ = 0;
+  }
+
+  void Map(const T* data, uint64_t size) {
+    Clear();
+    mapped_data_ = data;
+    mapped_size_ = size;
+  }
+
+  bool mapped() const {
+    return mapped_data_ != NULL;
+  }
+
+private:
+  void Unmap() {
+    if (mapped_data_ == NULL) return;
+    vec_.assign(mapped_data_, mapped_data_ + mapped_size_);
+    mapped_data_ = NULL;
+    mapped_size_ = 0;
+  }
+
+  std::vector<T> vec_;
+  const T* mapped_data_;
+  uint64_t mapped_size_;
+};
+
+/**
+ * The aligned format. Each value is a uint64_t, and each array is its
+ * size followed by its elements starting at a multiple of ALIGN_BYTES
+ * from the beginning of the record, so that a mapped record can be 
+ * used in place. offset counts the bytes written or read so far.
+ */
+enum {
+  ALIGN_BYTES = 64
+};
+
+struct MapCursor {
+  MapCursor(const char* base, uint64_t size) : base(base), size(size), offset(0), ok(true) {}
+  const char* base;
+  uint64_t size;
+  uint64_t offset;
+  bool ok;
+};
+
+inline void WriteValue(std::ostream& os, uint64_t val, uint64_t& offset) {
+  os.write((const char*)(&val), sizeof(val));
+  offset += sizeof(val);
+}
+
+inline void ReadValue(std::istream& is, uint64_t& val, uint64_t& offset) {
+  val = 0;
+  is.read((char*)(&val), sizeof(val));
+  offset += sizeof(val);
+}
+
+inline void MapValue(MapCursor& cursor, uint64_t& val) {
+  val = 0;
+  if (!cursor.ok || cursor.offset + sizeof(val) > cursor.size){
+    cursor.ok = false;
+    return;
+  }
+  memcpy(&val, cursor.base + cursor.offset, sizeof(val));
+  cursor.offset += sizeof(val);
+}
+
+inline uint64_t GetPaddingBytes(uint64_t offset) {
+  return (ALIGN_BYTES - offset % ALIGN_BYTES) % ALIGN_BYTES;
+}
+
+template <class T>
+void WriteArray(std::ostream& os, const T* data, uint64_t num, uint64_t& offset) {
+  WriteValue(os, num, offset);
+  static const char padding[ALIGN_BYTES] = {0};
+  uint64_t padding_bytes = GetPaddingBytes(offset);
+  os.write(padding, padding_bytes);
+  offset += padding_bytes;
+  if (num > 0){
+    os.write((const char*)(data), sizeof(T) * num);
+    offset += sizeof(T) * num;
+  }
+}
+
+template <class T>
+void ReadArray(std::istream& is, MappedVector<T>& vec, uint64_t& offset) {
+  uint64_t num = 0;
+  ReadValue(is, num, offset);
+  uint64_t padding_bytes = GetPaddingBytes(offset);
+  is.ignore(padding_bytes);
+  offset += padding_bytes;
+  vec.Clear();
+  if (!is || num == 0) return;
+  vec.resize(num);
+  is.read((char*)(&vec[0]), sizeof(T) * num);
+  offset += sizeof(T) * num;
+}
+
+template <class T>
+void MapArray(MapCursor& cursor, MappedVector<T>& vec) {
+  uint64_t num = 0;
+  MapValue(cursor, num);
+  vec.Clear();
+  if (!cursor.ok) return;
+  cursor.offset += GetPaddingBytes(cursor.offset);
+  if (cursor.offset > cursor.size || num > (cursor.size - cursor.offset) / sizeof(T)){
+    cursor.ok = false;
+    return;
+  }
+  if (num > 0){
+    vec.Map(reinterpret_cast<const T*>(cursor.base + cursor.offset), num);
+  }
+  cursor.offset += sizeof(T) * num;
+}
+
+}
+
+#endif // WAT_ARRAY_MAPPED_VECTOR_HPP_
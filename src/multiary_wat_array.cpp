@@ -0,0 +1,492 @@
+/* 
+ *  Copyright (c) 2010 Daisuke Okanohara
+ * 
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ * 
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <queue>
+#include <algorithm>
+#include "multiary_wat_array.hpp"
+
+using namespace std;
+
+namespace wat_array {
+
+MultiaryWatArray::MultiaryWatArray() : alphabet_num_(0), length_(0), symbol_bit_num_(2){
+}
+  
+MultiaryWatArray::~MultiaryWatArray() {
+}
+
+void MultiaryWatArray::Clear(){
+  vector<SymbolArray>().swap(symbol_arrays_);
+  mapped_file_.reset();
+  alphabet_num_ = 0;
+  length_ = 0;
+}
+
+void MultiaryWatArray::Init(const vector<uint64_t>& array){
+  Clear();
+  alphabet_num_ = GetAlphabetNum(array);
+  length_       = static_cast<uint64_t>(array.size());
+  SetArray(array);
+}
+
+uint64_t MultiaryWatArray::Lookup(uint64_t pos) const{
+  if (pos >= length_) return NOTFOUND;
+  uint64_t st = 0;
+  uint64_t en = length_;
+  uint64_t c = 0;
+  for (size_t i = 0; i < symbol_arrays_.size(); ++i){
+    const SymbolArray& sa = symbol_arrays_[i];
+    uint64_t sym = sa.Lookup(st + pos);
+    uint64_t st_rank, st_less, en_rank, en_less;
+    sa.RankAll(sym, st, st_rank, st_less);
+    sa.RankAll(sym, en, en_rank, en_less);
+    pos = sa.Rank(sym, st + pos) - st_rank;
+    st  = st + en_less - st_less;
+    en  = st + en_rank - st_rank;
+    c = (c << symbol_bit_num_) | sym;
+  }
+  return c;	 
+}
+
+uint64_t MultiaryWatArray::Rank(uint64_t c, uint64_t pos) const{
+  uint64_t rank_less_than = 0;
+  uint64_t rank_more_than = 0;
+  uint64_t rank           = 0;
+  RankAll(c, pos, rank, rank_less_than, rank_more_than);
+  return rank;
+}
+
+uint64_t MultiaryWatArray::RankLessThan(uint64_t c, uint64_t pos) const{
+  if (c == alphabet_num_ && c > 0){
+    return (pos < length_) ? pos : length_;
+  }
+  uint64_t rank_less_than = 0;
+  uint64_t rank_more_than = 0;
+  uint64_t rank           = 0;
+  RankAll(c, pos, rank, rank_less_than, rank_more_than);
+  return rank_less_than;
+}
+
+uint64_t MultiaryWatArray::RankMoreThan(uint64_t c, uint64_t pos) const{
+  uint64_t rank_less_than = 0;
+  uint64_t rank_more_than = 0;
+  uint64_t rank           = 0;
+  RankAll(c, pos, rank, rank_less_than, rank_more_than);
+  return rank_more_than;
+}
+
+void MultiaryWatArray::RankAll(uint64_t c, uint64_t pos,
+			       uint64_t& rank,  uint64_t& rank_less_than, uint64_t& rank_more_than) const{
+  if (c >= alphabet_num_) {
+    rank_less_than = NOTFOUND;
+    rank_more_than = NOTFOUND;
+    rank           = NOTFOUND;
+    return;
+  }
+  if (pos >= length_) {
+    pos = length_;
+  }
+  uint64_t beg_node = 0;
+  uint64_t end_node = length_;
+  rank_less_than = 0;
+  rank_more_than = 0;
+
+  for (size_t i = 0; i < symbol_arrays_.size() && beg_node < end_node; ++i){
+    const SymbolArray& sa = symbol_arrays_[i];
+    uint64_t sym = GetDigit(c, i);
+    uint64_t beg_node_rank, beg_node_less, end_node_rank, end_node_less, pos_rank, pos_less;
+    sa.RankAll(sym, beg_node, beg_node_rank, beg_node_less);
+    sa.RankAll(sym, end_node, end_node_rank, end_node_less);
+    sa.RankAll(sym, pos,      pos_rank,      pos_less);
+    rank_less_than += pos_less - beg_node_less;
+    rank_more_than += (pos - beg_node) - (pos_less - beg_node_less) - (pos_rank - beg_node_rank);
+    beg_node = beg_node + end_node_less - beg_node_less;
+    end_node = beg_node + end_node_rank - beg_node_rank;
+    pos      = beg_node + pos_rank - beg_node_rank;
+  }
+  rank = pos - beg_node;
+}
+
+uint64_t MultiaryWatArray::Select(uint64_t c, uint64_t rank) const{
+  if (c >= alphabet_num_) {
+    return NOTFOUND;
+  }
+  uint64_t beg_nodes[64];
+  uint64_t before_ranks[64];
+  uint64_t beg_node = 0;
+  uint64_t end_node = length_;
+  for (size_t i = 0; i < symbol_arrays_.size(); ++i){
+    const SymbolArray& sa = symbol_arrays_[i];
+    uint64_t sym = GetDigit(c, i);
+    uint64_t beg_node_rank, beg_node_less, end_node_rank, end_node_less;
+    sa.RankAll(sym, beg_node, beg_node_rank, beg_node_less);
+    sa.RankAll(sym, end_node, end_node_rank, end_node_less);
+    beg_nodes[i]    = beg_node;
+    before_ranks[i] = beg_node_rank;
+    beg_node = beg_node + end_node_less - beg_node_less;
+    end_node = beg_node + end_node_rank - beg_node_rank;
+  }
+  if (rank == 0 || rank > end_node - beg_node){
+    return NOTFOUND;
+  }
+
+  uint64_t pos = rank - 1;
+  for (size_t i = symbol_arrays_.size(); i > 0; --i){
+    const SymbolArray& sa = symbol_arrays_[i-1];
+    pos = sa.Select(GetDigit(c, i-1), before_ranks[i-1] + pos + 1) - beg_nodes[i-1];
+  }
+  return pos;
+}
+
+uint64_t MultiaryWatArray::FreqRange(uint64_t min_c, uint64_t max_c, uint64_t begin_pos, uint64_t end_pos) const{
+  if (min_c >= alphabet_num_) return 0;
+  if (max_c <= min_c) return 0;
+  if (end_pos > length_ || begin_pos > end_pos) return 0;
+  if (max_c > alphabet_num_) max_c = alphabet_num_;
+  return 
+    + RankLessThan(max_c, end_pos)
+    - RankLessThan(min_c, end_pos)
+    - RankLessThan(max_c, begin_pos)
+    + RankLessThan(min_c, begin_pos);
+}
+
+void MultiaryWatArray::MaxRange(uint64_t begin_pos, uint64_t end_pos, uint64_t& pos, uint64_t& val) const {
+  QuantileRange(begin_pos, end_pos, end_pos - begin_pos - 1, pos, val);
+} 
+
+void MultiaryWatArray::MinRange(uint64_t begin_pos, uint64_t end_pos, uint64_t& pos, uint64_t& val) const {
+  QuantileRange(begin_pos, end_pos, 0,  pos, val);
+}
+
+void MultiaryWatArray::QuantileRange(uint64_t begin_pos, uint64_t end_pos, uint64_t k, uint64_t& pos, uint64_t& val) const {
+  if (end_pos > length_ || begin_pos >= end_pos) {
+    pos = NOTFOUND;
+    val = NOTFOUND;
+    return;
+  }
+  
+  val = 0;
+  uint64_t beg_node = 0;
+  uint64_t end_node = length_;
+  for (size_t i = 0; i < symbol_arrays_.size(); ++i){
+    const SymbolArray& sa = symbol_arrays_[i];
+    // the largest digit having at most k smaller digits in the range
+    uint64_t min_sym = 0;
+    uint64_t max_sym = sa.symbol_num();
+    while (max_sym - min_sym > 1){
+      uint64_t mid_sym = (min_sym + max_sym) / 2;
+      if (sa.RankLessThan(mid_sym, end_pos) - sa.RankLessThan(mid_sym, begin_pos) <= k){
+	min_sym = mid_sym;
+      } else {
+	max_sym = mid_sym;
+      }
+    }
+    uint64_t sym = min_sym;
+    uint64_t beg_node_rank, beg_node_less, end_node_rank, end_node_less;
+    uint64_t beg_rank, beg_less, end_rank, end_less;
+    sa.RankAll(sym, beg_node,  beg_node_rank, beg_node_less);
+    sa.RankAll(sym, end_node,  end_node_rank, end_node_less);
+    sa.RankAll(sym, begin_pos, beg_rank,      beg_less);
+    sa.RankAll(sym, end_pos,   end_rank,      end_less);
+    k -= end_less - beg_less;
+    beg_node  = beg_node + end_node_less - beg_node_less;
+    end_node  = beg_node + end_node_rank - beg_node_rank;
+    begin_pos = beg_node + beg_rank - beg_node_rank;
+    end_pos   = beg_node + end_rank - beg_node_rank;
+    val = (val << symbol_bit_num_) | sym;
+  }
+
+  uint64_t rank = begin_pos - beg_node;
+  pos = Select(val, rank+1);
+}
+
+class MultiaryWatArray::ListModeComparator{
+public:
+  ListModeComparator() {}
+  bool operator() (const QueryOnNode& lhs, 
+		   const QueryOnNode& rhs) const {
+    if (lhs.end_pos - lhs.beg_pos != rhs.end_pos - rhs.beg_pos) {
+      return lhs.end_pos - lhs.beg_pos < rhs.end_pos - rhs.beg_pos;
+    } else if (lhs.depth != rhs.depth) {
+      return lhs.depth < rhs.depth;
+    } else {
+      return lhs.beg_pos > rhs.beg_pos;
+    } 
+  }
+};
+
+class MultiaryWatArray::ListMinComparator{
+public:
+  ListMinComparator() {}
+  bool operator() (const QueryOnNode& lhs, 
+		   const QueryOnNode& rhs) const {
+    if (lhs.depth != rhs.depth) 
+      return lhs.depth < rhs.depth;
+    else return lhs.beg_node > rhs.beg_node;
+  }
+};
+
+class MultiaryWatArray::ListMaxComparator{
+public:
+  ListMaxComparator() {}
+  bool operator() (const QueryOnNode& lhs, 
+		   const QueryOnNode& rhs) const {
+    if (lhs.depth != rhs.depth) 
+      return lhs.depth < rhs.depth;
+    else return lhs.beg_node < rhs.beg_node;
+  }
+};
+
+void MultiaryWatArray::ListModeRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos,
+				     uint64_t num, vector<ListResult>& res) const {
+  ListRange<ListModeComparator>(min_c, max_c, beg_pos, end_pos, num, res);
+}
+
+void MultiaryWatArray::ListMinRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos,
+				    uint64_t num, vector<ListResult>& res) const {
+  ListRange<ListMinComparator>(min_c, max_c, beg_pos, end_pos, num, res);
+}
+
+void MultiaryWatArray::ListMaxRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos,
+				    uint64_t num, vector<ListResult>& res) const {
+  ListRange<ListMaxComparator>(min_c, max_c, beg_pos, end_pos, num, res);
+}
+
+bool MultiaryWatArray::CheckPrefix(uint64_t prefix, uint64_t depth, uint64_t min_c, uint64_t max_c) const {
+  if (PrefixCode(min_c,   depth) <= prefix &&
+      PrefixCode(max_c-1, depth) >= prefix) return true;
+  else return false;
+}
+
+void MultiaryWatArray::ExpandNode(uint64_t min_c, uint64_t max_c, 
+				  const QueryOnNode& qon, vector<QueryOnNode>& next) const{
+  const SymbolArray& sa = symbol_arrays_[qon.depth];
+  uint64_t symbol_num = sa.symbol_num();
+  // the children are ordered by their digits; the less ranks of 
+  // a digit are the beginning of its child
+  uint64_t beg_node_less = 0;
+  uint64_t end_node_less = 0;
+  uint64_t beg_less      = 0;
+  uint64_t end_less      = 0;
+  for (uint64_t sym = 0; sym < symbol_num; ++sym){
+    uint64_t beg_node_next = sa.RankLessThan(sym + 1, qon.beg_node);
+    uint64_t end_node_next = sa.RankLessThan(sym + 1, qon.end_node);
+    uint64_t beg_next      = sa.RankLessThan(sym + 1, qon.beg_pos);
+    uint64_t end_next      = sa.RankLessThan(sym + 1, qon.end_pos);
+    uint64_t next_prefix   = (qon.prefix_char << symbol_bit_num_) | sym;
+    if (end_next - end_less > beg_next - beg_less && 
+	CheckPrefix(next_prefix, qon.depth+1, min_c, max_c)) {
+      uint64_t child = qon.beg_node + end_node_less - beg_node_less;
+      uint64_t beg_node_rank = beg_node_next - beg_node_less;
+      next.push_back(QueryOnNode(child, 
+				 child + (end_node_next - end_node_less) - beg_node_rank,
+				 child + (beg_next - beg_less) - beg_node_rank,
+				 child + (end_next - end_less) - beg_node_rank,
+				 qon.depth+1,
+				 next_prefix));
+    }
+    beg_node_less = beg_node_next;
+    end_node_less = end_node_next;
+    beg_less      = beg_next;
+    end_less      = end_next;
+  }
+}
+
+uint64_t MultiaryWatArray::Freq(uint64_t c) const {
+  if (c >= alphabet_num_) return NOTFOUND;
+  return Rank(c, length_);
+}
+
+uint64_t MultiaryWatArray::FreqSum(uint64_t min_c, uint64_t max_c) const {
+  if (max_c > alphabet_num_ || min_c > max_c ) return NOTFOUND;
+  if (min_c == max_c) return 0;
+  return RankLessThan(max_c, length_) - RankLessThan(min_c, length_);
+}
+
+uint64_t MultiaryWatArray::alphabet_num() const{
+  return alphabet_num_;
+}
+
+uint64_t MultiaryWatArray::length() const{
+  return length_;
+}
+
+uint64_t MultiaryWatArray::GetUsageBytes() const{
+  uint64_t bytes = sizeof(*this);
+  for (size_t i = 0; i < symbol_arrays_.size(); ++i){
+    bytes += symbol_arrays_[i].GetUsageBytes();
+  }
+  return bytes;
+}
+
+void MultiaryWatArray::set_symbol_bit_num(uint64_t bit_num){
+  symbol_bit_num_ = (bit_num == 4) ? 4 : 2;
+}
+
+uint64_t MultiaryWatArray::symbol_bit_num() const{
+  return symbol_bit_num_;
+}
+
+uint64_t MultiaryWatArray::GetAlphabetNum(const std::vector<uint64_t>& array) const {
+  uint64_t alphabet_num = 0;
+  for (size_t i = 0; i < array.size(); ++i){
+    if (array[i] >= alphabet_num){
+      alphabet_num = array[i]+1;
+    }
+  }
+  return alphabet_num;
+}
+
+uint64_t MultiaryWatArray::Log2(uint64_t x) const{
+  if (x == 0) return 0;
+  x--;
+  uint64_t bit_num = 0;
+  while (x >> bit_num){
+    ++bit_num;
+  }
+  return bit_num;
+}
+
+uint64_t MultiaryWatArray::PrefixCode(uint64_t x, uint64_t depth) const{
+  uint64_t shift = symbol_bit_num_ * (symbol_arrays_.size() - depth);
+  return (shift < 64) ? (x >> shift) : 0;
+}
+
+uint64_t MultiaryWatArray::GetDigit(uint64_t x, uint64_t depth) const{
+  uint64_t shift = symbol_bit_num_ * (symbol_arrays_.size() - depth - 1);
+  return (x >> shift) & ((1LLU << symbol_bit_num_) - 1);
+}
+
+void MultiaryWatArray::SetArray(const vector<uint64_t>& array) {
+  uint64_t level_num = (Log2(alphabet_num_) + symbol_bit_num_ - 1) / symbol_bit_num_;
+  symbol_arrays_.resize(level_num, SymbolArray(length_, symbol_bit_num_));
+
+  // cur is the order of the level, where each node is a run of the 
+  // values of the same prefix; each node is stably partitioned by the 
+  // digits of the level for the next level, which takes O(n) words 
+  // whatever the alphabet
+  vector<uint64_t> cur(array);
+  vector<uint64_t> next(length_);
+  vector<uint64_t> digit_poses(1LLU << symbol_bit_num_);
+  for (uint64_t i = 0; i < level_num; ++i){
+    SymbolArray& sa = symbol_arrays_[i];
+    for (size_t j = 0; j < cur.size(); ++j){
+      sa.SetSymbol(GetDigit(cur[j], i), j);
+    }
+    sa.Build();
+    if (i + 1 == level_num) break;
+
+    for (size_t beg = 0; beg < cur.size(); ){
+      uint64_t prefix = PrefixCode(cur[beg], i);
+      size_t end = beg;
+      fill(digit_poses.begin(), digit_poses.end(), 0);
+      for (; end < cur.size() && PrefixCode(cur[end], i) == prefix; ++end){
+	digit_poses[GetDigit(cur[end], i)]++;
+      }
+      uint64_t sum = beg;
+      for (size_t d = 0; d < digit_poses.size(); ++d){
+	uint64_t num = digit_poses[d];
+	digit_poses[d] = sum;
+	sum += num;
+      }
+      for (size_t j = beg; j < end; ++j){
+	next[digit_poses[GetDigit(cur[j], i)]++] = cur[j];
+      }
+      beg = end;
+    }
+    cur.swap(next);
+  }
+}
+
+void MultiaryWatArray::Save(ostream& os) const{
+  uint64_t offset = 0;
+  WriteValue(os, FORMAT_MAGIC, offset);
+  WriteValue(os, FORMAT_VERSION, offset);
+  WriteValue(os, alphabet_num_, offset);
+  WriteValue(os, length_, offset);
+  WriteValue(os, symbol_bit_num_, offset);
+  WriteValue(os, symbol_arrays_.size(), offset);
+  for (size_t i = 0; i < symbol_arrays_.size(); ++i){
+    symbol_arrays_[i].SaveAligned(os, offset);
+  }
+}
+
+void MultiaryWatArray::Load(istream& is){
+  Clear();
+  uint64_t offset = 0;
+  uint64_t magic = 0;
+  uint64_t version = 0;
+  uint64_t bit_num = 0;
+  uint64_t level_num = 0;
+  ReadValue(is, magic, offset);
+  ReadValue(is, version, offset);
+  ReadValue(is, alphabet_num_, offset);
+  ReadValue(is, length_, offset);
+  ReadValue(is, bit_num, offset);
+  ReadValue(is, level_num, offset);
+  if (!is || magic != FORMAT_MAGIC || version != FORMAT_VERSION || 
+      (bit_num != 2 && bit_num != 4) ||
+      level_num != (Log2(alphabet_num_) + bit_num - 1) / bit_num){
+    Clear();
+    is.setstate(ios::failbit);
+    return;
+  }
+  symbol_bit_num_ = bit_num;
+  symbol_arrays_.resize(level_num);
+  for (size_t i = 0; i < symbol_arrays_.size(); ++i){
+    symbol_arrays_[i].LoadAligned(is, offset);
+  }
+}
+
+int MultiaryWatArray::Map(const char* filename){
+  Clear();
+  std::shared_ptr<MappedFile> mapped_file(new MappedFile);
+  if (mapped_file->Open(filename) != 0) return -1;
+
+  MapCursor cursor(mapped_file->data(), mapped_file->size());
+  uint64_t magic = 0;
+  uint64_t version = 0;
+  uint64_t bit_num = 0;
+  uint64_t level_num = 0;
+  MapValue(cursor, magic);
+  MapValue(cursor, version);
+  MapValue(cursor, alphabet_num_);
+  MapValue(cursor, length_);
+  MapValue(cursor, bit_num);
+  MapValue(cursor, level_num);
+  if (magic != FORMAT_MAGIC || version != FORMAT_VERSION || 
+      (bit_num != 2 && bit_num != 4) ||
+      level_num != (Log2(alphabet_num_) + bit_num - 1) / bit_num){
+    Clear();
+    return -1;
+  }
+  symbol_bit_num_ = bit_num;
+  symbol_arrays_.resize(level_num);
+  for (size_t i = 0; i < symbol_arrays_.size(); ++i){
+    symbol_arrays_[i].Map(cursor);
+  }
+  if (!cursor.ok){
+    Clear();
+    return -1;
+  }
+  mapped_file_ = mapped_file;
+  return 0;
+}
+
+}
@@ -0,0 +1,289 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <algorithm>
+#include "range_min_index.hpp"
+
+namespace wat_array {
+
+namespace {
+
+/**
+ * The excess after each bit of a byte, from the lowest bit
+ */
+struct ByteExcessTable {
+  ByteExcessTable() {
+    for (int byte = 0; byte < 256; ++byte){
+      int excess = 0;
+      mins[byte] = 8;
+      for (int i = 0; i < 8; ++i){
+	excess += ((byte >> i) & 1) ? 1 : -1;
+	if (excess <= mins[byte]){
+	  mins[byte]     = excess;
+	  min_poses[byte] = i;
+	}
+      }
+      totals[byte] = excess;
+    }
+  }
+  int8_t mins[256];      // the lowest excess
+  uint8_t min_poses[256]; // the last bit of the lowest excess
+  int8_t totals[256];    // the excess after the byte
+};
+
+const ByteExcessTable& GetByteExcessTable(){
+  static const ByteExcessTable table;
+  return table;
+}
+
+}
+
+RangeMinIndex::RangeMinIndex() : length_(0){
+}
+
+RangeMinIndex::~RangeMinIndex(){
+}
+
+uint64_t RangeMinIndex::length() const{
+  return length_;
+}
+
+void RangeMinIndex::Clear(){
+  bits_.Clear();
+  block_mins_.Clear();
+  superblock_excesses_.Clear();
+  superblock_mins_.Clear();
+  sparse_table_.Clear();
+  length_ = 0;
+}
+
+void RangeMinIndex::Build(const std::vector<uint64_t>& words, uint64_t bit_num){
+  bits_.Init(bit_num);
+  for (size_t i = 0; i < words.size(); ++i){
+    bits_.SetBlock(i, words[i]);
+  }
+  bits_.Build();
+  if (bit_num == 0) return;
+
+  uint64_t block_num      = (bit_num + BLOCK_BITNUM - 1) / BLOCK_BITNUM;
+  uint64_t superblock_num = (block_num + SUPERBLOCK_BLOCKNUM - 1) / SUPERBLOCK_BLOCKNUM;
+  block_mins_.resize(block_num);
+  superblock_excesses_.resize(superblock_num);
+  superblock_mins_.resize(superblock_num);
+  uint64_t excess = 0;
+  for (uint64_t block = 0; block < block_num; ++block){
+    uint64_t superblock = block / SUPERBLOCK_BLOCKNUM;
+    if (block % SUPERBLOCK_BLOCKNUM == 0){
+      superblock_excesses_[superblock] = excess;
+      superblock_mins_[superblock] = NOTFOUND;
+    }
+    uint64_t min_excess = NOTFOUND;
+    for (uint64_t pos = block * BLOCK_BITNUM; pos < bit_num && pos < (block + 1) * BLOCK_BITNUM; ++pos){
+      if ((words[pos / 64] >> (pos % 64)) & 1LLU){
+	++excess;
+      } else {
+	--excess;
+      }
+      if (excess < min_excess) min_excess = excess;
+    }
+    block_mins_[block] = static_cast<int16_t>(min_excess - superblock_excesses_[superblock]);
+    if (min_excess <= superblock_mins_[superblock]) superblock_mins_[superblock] = min_excess;
+  }
+
+  // the level k keeps the last lowest superblock of each 2^k superblocks
+  uint64_t level_num = 0;
+  while ((2LLU << level_num) <= superblock_num) ++level_num;
+  sparse_table_.resize(level_num * superblock_num);
+  for (uint64_t k = 1; k <= level_num; ++k){
+    uint64_t half = 1LLU << (k - 1);
+    for (uint64_t s = 0; s + (1LLU << k) <= superblock_num; ++s){
+      uint64_t left  = (k == 1) ? s : sparse_table_[(k - 2) * superblock_num + s];
+      uint64_t right = (k == 1) ? s + half : sparse_table_[(k - 2) * superblock_num + s + half];
+      sparse_table_[(k - 1) * superblock_num + s] = 
+	static_cast<uint32_t>((superblock_mins_[right] <= superblock_mins_[left]) ? right : left);
+    }
+  }
+}
+
+uint64_t RangeMinIndex::Find(uint64_t beg_pos, uint64_t end_pos) const{
+  if (end_pos > length_ || beg_pos >= end_pos) return NOTFOUND;
+  if (beg_pos + 1 == end_pos) return beg_pos;
+
+  // the lowest excess after the 1 of beg_pos up to the 1 of end_pos - 1
+  uint64_t beg = bits_.Select(1, beg_pos + 1) + 1;
+  uint64_t end = bits_.Select(1, end_pos) + 1;
+  uint64_t beg_excess = 2 * (beg_pos + 1) - beg;
+  uint64_t beg_block = beg / BLOCK_BITNUM;
+  uint64_t end_block = (end - 1) / BLOCK_BITNUM;
+  uint64_t min_excess = 0;
+  uint64_t min_pos = 0;
+  if (beg_block == end_block){
+    ScanMin(beg, end, beg_excess, min_excess, min_pos);
+  } else {
+    ScanMin(beg, (beg_block + 1) * BLOCK_BITNUM, beg_excess, min_excess, min_pos);
+    if (beg_block + 1 < end_block){
+      uint64_t block_excess = 0;
+      uint64_t block = 0;
+      FindMinBlock(beg_block + 1, end_block, block_excess, block);
+      if (block_excess <= min_excess){
+	uint64_t block_beg = block * BLOCK_BITNUM;
+	ScanMin(block_beg, block_beg + BLOCK_BITNUM, Excess(block_beg), min_excess, min_pos);
+      }
+    }
+    uint64_t end_beg = end_block * BLOCK_BITNUM;
+    uint64_t end_min_excess = 0;
+    uint64_t end_min_pos = 0;
+    ScanMin(end_beg, end, Excess(end_beg), end_min_excess, end_min_pos);
+    if (end_min_excess <= min_excess){
+      min_excess = end_min_excess;
+      min_pos = end_min_pos;
+    }
+  }
+  // beg_pos wins unless a later value pops below it; otherwise the 
+  // lowest excess is the last pop of the smallest value
+  if (min_excess >= beg_excess) return beg_pos;
+  return bits_.Rank(1, min_pos + 1);
+}
+
+uint64_t RangeMinIndex::Excess(uint64_t pos) const{
+  return 2 * bits_.Rank(1, pos) - pos;
+}
+
+void RangeMinIndex::ScanMin(uint64_t beg, uint64_t end, uint64_t excess, 
+			    uint64_t& min_excess, uint64_t& min_pos) const{
+  const ByteExcessTable& table = GetByteExcessTable();
+  min_excess = NOTFOUND;
+  min_pos = NOTFOUND;
+  for (uint64_t pos = beg; pos < end; ){
+    uint64_t len = std::min<uint64_t>(64, end - pos);
+    uint64_t bits = bits_.GetBits(pos, len);
+    uint64_t i = 0;
+    for (; i + 8 <= len; i += 8){
+      uint64_t byte = (bits >> i) & 0xFF;
+      if (excess + table.mins[byte] <= min_excess){
+	min_excess = excess + table.mins[byte];
+	min_pos = pos + i + table.min_poses[byte];
+      }
+      excess += table.totals[byte];
+    }
+    for (; i < len; ++i){
+      if ((bits >> i) & 1LLU){
+	++excess;
+      } else {
+	--excess;
+      }
+      if (excess <= min_excess){
+	min_excess = excess;
+	min_pos = pos + i;
+      }
+    }
+    pos += len;
+  }
+}
+
+void RangeMinIndex::FindMinBlock(uint64_t beg_block, uint64_t end_block, 
+				 uint64_t& min_excess, uint64_t& min_block) const{
+  uint64_t beg_superblock = beg_block / SUPERBLOCK_BLOCKNUM;
+  uint64_t end_superblock = (end_block - 1) / SUPERBLOCK_BLOCKNUM;
+  if (beg_superblock == end_superblock){
+    ScanMinBlock(beg_block, end_block, min_excess, min_block);
+    return;
+  }
+  ScanMinBlock(beg_block, (beg_superblock + 1) * SUPERBLOCK_BLOCKNUM, min_excess, min_block);
+  if (beg_superblock + 1 < end_superblock){
+    // two overlapping ranges of the sparse table cover the superblocks
+    uint64_t beg = beg_superblock + 1;
+    uint64_t num = end_superblock - beg;
+    uint64_t k = 0;
+    while ((2LLU << k) <= num) ++k;
+    uint64_t superblock = beg;
+    if (k > 0){
+      uint64_t superblock_num = superblock_mins_.size();
+      uint64_t left  = sparse_table_[(k - 1) * superblock_num + beg];
+      uint64_t right = sparse_table_[(k - 1) * superblock_num + end_superblock - (1LLU << k)];
+      superblock = (superblock_mins_[right] <= superblock_mins_[left]) ? right : left;
+    }
+    if (superblock_mins_[superblock] <= min_excess){
+      ScanMinBlock(superblock * SUPERBLOCK_BLOCKNUM, (superblock + 1) * SUPERBLOCK_BLOCKNUM,
+		   min_excess, min_block);
+    }
+  }
+  uint64_t end_min_excess = 0;
+  uint64_t end_min_block = 0;
+  ScanMinBlock(end_superblock * SUPERBLOCK_BLOCKNUM, end_block, end_min_excess, end_min_block);
+  if (end_min_excess <= min_excess){
+    min_excess = end_min_excess;
+    min_block = end_min_block;
+  }
+}
+
+void RangeMinIndex::ScanMinBlock(uint64_t beg_block, uint64_t end_block, 
+				 uint64_t& min_excess, uint64_t& min_block) const{
+  min_excess = NOTFOUND;
+  min_block = NOTFOUND;
+  for (uint64_t block = beg_block; block < end_block; ++block){
+    uint64_t excess = GetBlockMin(block);
+    if (excess <= min_excess){
+      min_excess = excess;
+      min_block = block;
+    }
+  }
+}
+
+uint64_t RangeMinIndex::GetBlockMin(uint64_t block) const{
+  return superblock_excesses_[block / SUPERBLOCK_BLOCKNUM] + block_mins_[block];
+}
+
+uint64_t RangeMinIndex::GetUsageBytes() const{
+  return sizeof(*this) + bits_.GetUsageBytes()
+    + sizeof(int16_t) * block_mins_.size() 
+    + sizeof(uint64_t) * (superblock_excesses_.size() + superblock_mins_.size())
+    + sizeof(uint32_t) * sparse_table_.size();
+}
+
+void RangeMinIndex::SaveAligned(std::ostream& os, uint64_t& offset) const{
+  WriteValue(os, length_, offset);
+  bits_.SaveAligned(os, offset);
+  WriteArray(os, block_mins_.data(), block_mins_.size(), offset);
+  WriteArray(os, superblock_excesses_.data(), superblock_excesses_.size(), offset);
+  WriteArray(os, superblock_mins_.data(), superblock_mins_.size(), offset);
+  WriteArray(os, sparse_table_.data(), sparse_table_.size(), offset);
+}
+
+void RangeMinIndex::LoadAligned(std::istream& is, uint64_t& offset){
+  Clear();
+  ReadValue(is, length_, offset);
+  bits_.LoadAligned(is, offset);
+  ReadArray(is, block_mins_, offset);
+  ReadArray(is, superblock_excesses_, offset);
+  ReadArray(is, superblock_mins_, offset);
+  ReadArray(is, sparse_table_, offset);
+}
+
+void RangeMinIndex::Map(MapCursor& cursor){
+  Clear();
+  MapValue(cursor, length_);
+  bits_.Map(cursor);
+  MapArray(cursor, block_mins_);
+  MapArray(cursor, superblock_excesses_);
+  MapArray(cursor, superblock_mins_);
+  MapArray(cursor, sparse_table_);
+}
+
+}
@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#ifndef WAT_ARRAY_RANGE_MIN_INDEX_HPP_
+#define WAT_ARRAY_RANGE_MIN_INDEX_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include <iostream>
+#include "bit_array.hpp"
+#include "mapped_vector.hpp"
+
+namespace wat_array {
+
+/**
+ * Range minimum (or maximum) query over an array of integers, answering 
+ * the leftmost position of the smallest value of a subarray without 
+ * the values themselves.
+ *
+ * The array is scanned with a stack of increasing values; each value 
+ * writes a 0 for every value it pops, and a 1 for itself. The smallest 
+ * value of A[i .. j] is the last one whose 1 is preceded by the lowest 
+ * excess (ones minus zeros) between the 1s of i and j. The 2n bits are 
+ * divided into blocks whose lowest excess is kept, and a sparse table 
+ * over superblocks of blocks finds the lowest one of a range, so that a 
+ * query is two selects, a few ranks and scans of at most three blocks.
+ */
+class RangeMinIndex {
+
+public:
+  RangeMinIndex();
+  ~RangeMinIndex();
+  uint64_t length() const;
+
+  /**
+   * Initialize the index of vals[0 .. length)
+   * @param vals The array, where vals[i] is the i-th value
+   * @param length The number of values
+   * @param max_query Whether the largest value is queried instead
+   */
+  template <class Array>
+  void Init(const Array& vals, uint64_t length, bool max_query);
+  void Clear();
+
+  /**
+   * Return the position of the smallest (or largest) value in 
+   * A[beg_pos .. end_pos); if many values are the smallest, the 
+   * smallest position is returned.
+   * @param beg_pos The beginning position of the array (inclusive)
+   * @param end_pos The ending position of the array (not inclusive)
+   * @return The position, or NOTFOUND if end_pos > length or 
+   *         beg_pos >= end_pos
+   */
+  uint64_t Find(uint64_t beg_pos, uint64_t end_pos) const;
+
+  uint64_t GetUsageBytes() const;
+
+  void SaveAligned(std::ostream& os, uint64_t& offset) const;
+  void LoadAligned(std::istream& is, uint64_t& offset);
+  void Map(MapCursor& cursor);
+
+private:
+  enum {
+    BLOCK_BITNUM = 256,
+    SUPERBLOCK_BLOCKNUM = 32,
+    SUPERBLOCK_BITNUM = BLOCK_BITNUM * SUPERBLOCK_BLOCKNUM
+  };
+
+  void Build(const std::vector<uint64_t>& words, uint64_t bit_num);
+  uint64_t Excess(uint64_t pos) const;
+  void ScanMin(uint64_t beg, uint64_t end, uint64_t excess, 
+	       uint64_t& min_excess, uint64_t& min_pos) const;
+  void FindMinBlock(uint64_t beg_block, uint64_t end_block, 
+		    uint64_t& min_excess, uint64_t& min_block) const;
+  void ScanMinBlock(uint64_t beg_block, uint64_t end_block, 
+		    uint64_t& min_excess, uint64_t& min_block) const;
+  uint64_t GetBlockMin(uint64_t block) const;
+
+  // bits_ is the sequence of pops (0) and pushes (1); a block's lowest
+  // excess is block_mins_ above the excess before its superblock, 
+  // and sparse_table_[(k-1) * superblock_num + s] is the last superblock
+  // of the lowest excess among s .. s + 2^k
+  BitArray bits_;
+  MappedVector<int16_t> block_mins_;
+  MappedVector<uint64_t> superblock_excesses_;
+  MappedVector<uint64_t> superblock_mins_;
+  MappedVector<uint32_t> sparse_table_;
+  uint64_t length_;
+};
+
+template <class Array>
+void RangeMinIndex::Init(const Array& vals, uint64_t length, bool max_query){
+  Clear();
+  length_ = length;
+  // a value pops the larger ones (the smaller ones for max_query), 
+  // and stays above the equal ones so that the first of them wins
+  std::vector<uint64_t> words;
+  std::vector<uint64_t> stack;
+  uint64_t bit_num = 0;
+  for (uint64_t i = 0; i < length; ++i){
+    uint64_t val = vals[i];
+    while (!stack.empty() && (max_query ? stack.back() < val : stack.back() > val)){
+      stack.pop_back();
+      if (bit_num % 64 == 0) words.push_back(0);
+      ++bit_num;
+    }
+    stack.push_back(val);
+    if (bit_num % 64 == 0) words.push_back(0);
+    words.back() |= 1LLU << (bit_num % 64);
+    ++bit_num;
+  }
+  Build(words, bit_num);
+}
+
+}
+
+#endif // WAT_ARRAY_RANGE_MIN_INDEX_HPP_
@@ -0,0 +1,347 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <algorithm>
+#include "rrr_bit_array.hpp"
+#include "bit_array.hpp"
+
+namespace wat_array {
+
+namespace {
+
+/**
+ * Enumeration of all 15-bit blocks ordered by (class, value).
+ * offsets[v] is the offset of v within its class and
+ * blocks[class_begs[c] + offset] gives back the block.
+ */
+struct RRRTable {
+  enum {
+    BLOCK_BITNUM = 15,
+    BLOCK_NUM = 1 << BLOCK_BITNUM
+  };
+
+  RRRTable() {
+    uint64_t counts[BLOCK_BITNUM + 1] = {0};
+    for (uint64_t v = 0; v < BLOCK_NUM; ++v){
+      counts[BitArray::PopCount(v)]++;
+    }
+    class_begs[0] = 0;
+    for (uint64_t c = 0; c <= BLOCK_BITNUM; ++c){
+      class_begs[c+1] = class_begs[c] + counts[c];
+      offset_bitnum[c] = 0;
+      while ((1LLU << offset_bitnum[c]) < counts[c]){
+	++offset_bitnum[c];
+      }
+      counts[c] = 0;
+    }
+    for (uint64_t v = 0; v < BLOCK_NUM; ++v){
+      uint64_t c = BitArray::PopCount(v);
+      offsets[v] = counts[c]++;
+      blocks[class_begs[c] + offsets[v]] = v;
+    }
+  }
+
+  uint64_t offset_bitnum[BLOCK_BITNUM + 1];
+  uint64_t class_begs[BLOCK_BITNUM + 2];
+  uint16_t offsets[BLOCK_NUM];
+  uint16_t blocks[BLOCK_NUM];
+};
+
+const RRRTable& GetTable() {
+  static const RRRTable table;
+  return table;
+}
+
+}
+
+RRRBitArray::RRRBitArray() : length_(0), one_num_(0){
+}
+
+RRRBitArray::RRRBitArray(uint64_t length) : length_(0), one_num_(0){
+  Init(length);
+}
+
+RRRBitArray::~RRRBitArray(){
+}
+
+uint64_t RRRBitArray::length() const {
+  return length_;
+}
+
+uint64_t RRRBitArray::one_num() const{
+  return one_num_;
+}
+
+void RRRBitArray::Init(uint64_t length){
+  Clear();
+  length_ = length;
+  bit_blocks_.resize((length + 63) / 64);
+}
+
+void RRRBitArray::Clear(){
+  std::vector<uint64_t>().swap(bit_blocks_);
+  classes_.Clear();
+  offsets_.Clear();
+  rank_samples_.Clear();
+  ptr_samples_.Clear();
+  length_ = 0;
+  one_num_ = 0;
+}
+
+void RRRBitArray::SetBit(uint64_t bit, uint64_t pos) {
+  if (!bit) return;
+  bit_blocks_[pos / 64] |= (1LLU << (pos % 64));
+}
+
+void RRRBitArray::Build() {
+  Build(bit_blocks_.data(), length_);
+  std::vector<uint64_t>().swap(bit_blocks_);
+}
+
+void RRRBitArray::Build(const uint64_t* blocks, uint64_t length) {
+  const RRRTable& table = GetTable();
+  length_  = length;
+  one_num_ = 0;
+  uint64_t block_num = (length + BLOCK_BITNUM - 1) / BLOCK_BITNUM;
+  classes_.assign((block_num + CLASS_PER_WORD - 1) / CLASS_PER_WORD, 0);
+  rank_samples_.assign(block_num / SUPERBLOCK_BLOCKNUM + 1, 0);
+  ptr_samples_.assign(block_num / SUPERBLOCK_BLOCKNUM + 1, 0);
+  offsets_.Clear();
+
+  uint64_t ptr = 0;
+  for (uint64_t i = 0; i < block_num; ++i){
+    if ((i % SUPERBLOCK_BLOCKNUM) == 0){
+      rank_samples_[i / SUPERBLOCK_BLOCKNUM] = one_num_;
+      ptr_samples_[i / SUPERBLOCK_BLOCKNUM]  = ptr;
+    }
+    uint64_t width = std::min<uint64_t>(BLOCK_BITNUM, length - i * BLOCK_BITNUM);
+    uint64_t block = GetBits(blocks, i * BLOCK_BITNUM, width);
+    uint64_t c     = BitArray::PopCount(block);
+    classes_[i / CLASS_PER_WORD] |= c << ((i % CLASS_PER_WORD) * CLASS_BITNUM);
+    uint64_t offset_bitnum = table.offset_bitnum[c];
+    if (offset_bitnum > 0){
+      while (offsets_.size() * 64 < ptr + offset_bitnum){
+	offsets_.push_back(0);
+      }
+      SetBits(&offsets_[0], ptr, offset_bitnum, table.offsets[block]);
+    }
+    ptr      += offset_bitnum;
+    one_num_ += c;
+  }
+  if ((block_num % SUPERBLOCK_BLOCKNUM) == 0){
+    rank_samples_.back() = one_num_;
+    ptr_samples_.back()  = ptr;
+  }
+  offsets_.shrink_to_fit();
+}
+
+uint64_t RRRBitArray::Rank(uint64_t bit, uint64_t pos) const {
+  if (pos > length_) return NOTFOUND;
+  if (bit) return RankOne(pos);
+  else return pos - RankOne(pos);
+}
+
+uint64_t RRRBitArray::RankOne(uint64_t pos) const {
+  const RRRTable& table = GetTable();
+  uint64_t block_ind = pos / BLOCK_BITNUM;
+  uint64_t sb_ind    = block_ind / SUPERBLOCK_BLOCKNUM;
+  uint64_t rank = rank_samples_[sb_ind];
+  uint64_t ptr  = ptr_samples_[sb_ind];
+  for (uint64_t i = sb_ind * SUPERBLOCK_BLOCKNUM; i < block_ind; ++i){
+    uint64_t c = GetClass(i);
+    rank += c;
+    ptr  += table.offset_bitnum[c];
+  }
+  uint64_t offset = pos % BLOCK_BITNUM;
+  if (offset){
+    rank += BitArray::PopCount(GetBlock(block_ind, ptr) & ((1LLU << offset) - 1));
+  }
+  return rank;
+}
+
+uint64_t RRRBitArray::Select(uint64_t bit, uint64_t rank) const {
+  if (rank == 0) return NOTFOUND;
+  if (bit){
+    if (rank > one_num_) return NOTFOUND;
+  } else {
+    if (rank > length_ - one_num_) return NOTFOUND;
+  }
+
+  // binary search over superblocks
+  const uint64_t sb_bitnum = BLOCK_BITNUM * SUPERBLOCK_BLOCKNUM;
+  uint64_t left  = 0;
+  uint64_t right = rank_samples_.size();
+  while (left < right){
+    uint64_t mid = (left + right) / 2;
+    if (BitArray::GetBitNum(rank_samples_[mid], sb_bitnum * mid, bit) < rank){
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  uint64_t sb_ind = left - 1;
+  rank -= BitArray::GetBitNum(rank_samples_[sb_ind], sb_bitnum * sb_ind, bit);
+
+  // sequential search over blocks
+  const RRRTable& table = GetTable();
+  uint64_t ptr = ptr_samples_[sb_ind];
+  for (uint64_t i = sb_ind * SUPERBLOCK_BLOCKNUM; ; ++i){
+    uint64_t c = GetClass(i);
+    uint64_t num = BitArray::GetBitNum(c, BLOCK_BITNUM, bit);
+    if (rank <= num){
+      uint64_t block = GetBlock(i, ptr);
+      if (!bit) block = ~block & ((1LLU << BLOCK_BITNUM) - 1);
+      return i * BLOCK_BITNUM + BitArray::SelectInBlock(block, rank);
+    }
+    rank -= num;
+    ptr  += table.offset_bitnum[c];
+  }
+}
+
+uint64_t RRRBitArray::Lookup(uint64_t pos) const {
+  const RRRTable& table = GetTable();
+  uint64_t block_ind = pos / BLOCK_BITNUM;
+  uint64_t sb_ind    = block_ind / SUPERBLOCK_BLOCKNUM;
+  uint64_t ptr  = ptr_samples_[sb_ind];
+  for (uint64_t i = sb_ind * SUPERBLOCK_BLOCKNUM; i < block_ind; ++i){
+    ptr += table.offset_bitnum[GetClass(i)];
+  }
+  return (GetBlock(block_ind, ptr) >> (pos % BLOCK_BITNUM)) & 1LLU;
+}
+
+void RRRBitArray::Decode(std::vector<uint64_t>& blocks) const {
+  const RRRTable& table = GetTable();
+  blocks.assign((length_ + 63) / 64, 0);
+  uint64_t block_num = (length_ + BLOCK_BITNUM - 1) / BLOCK_BITNUM;
+  uint64_t ptr = 0;
+  for (uint64_t i = 0; i < block_num; ++i){
+    uint64_t width = std::min<uint64_t>(BLOCK_BITNUM, length_ - i * BLOCK_BITNUM);
+    SetBits(&blocks[0], i * BLOCK_BITNUM, width, GetBlock(i, ptr));
+    ptr += table.offset_bitnum[GetClass(i)];
+  }
+}
+
+uint64_t RRRBitArray::GetUsageBytes() const {
+  return sizeof(uint64_t) * (bit_blocks_.size() + classes_.size() + offsets_.size()
+			     + rank_samples_.size() + ptr_samples_.size());
+}
+
+uint64_t RRRBitArray::GetClass(uint64_t block_ind) const {
+  return (classes_[block_ind / CLASS_PER_WORD] >> ((block_ind % CLASS_PER_WORD) * CLASS_BITNUM))
+    & ((1LLU << CLASS_BITNUM) - 1);
+}
+
+uint64_t RRRBitArray::GetBlock(uint64_t block_ind, uint64_t& ptr) const {
+  const RRRTable& table = GetTable();
+  uint64_t c = GetClass(block_ind);
+  uint64_t offset_bitnum = table.offset_bitnum[c];
+  uint64_t offset = (offset_bitnum > 0) ? GetBits(offsets_.data(), ptr, offset_bitnum) : 0;
+  return table.blocks[table.class_begs[c] + offset];
+}
+
+uint64_t RRRBitArray::GetBits(const uint64_t* blocks, uint64_t pos, uint64_t width) {
+  uint64_t block_ind = pos / 64;
+  uint64_t offset    = pos % 64;
+  uint64_t mask      = (width == 64) ? ~0LLU : (1LLU << width) - 1;
+  uint64_t val       = blocks[block_ind] >> offset;
+  if (offset + width > 64){
+    val |= blocks[block_ind + 1] << (64 - offset);
+  }
+  return val & mask;
+}
+
+void RRRBitArray::SetBits(uint64_t* blocks, uint64_t pos, uint64_t width, uint64_t val) {
+  uint64_t block_ind = pos / 64;
+  uint64_t offset    = pos % 64;
+  blocks[block_ind] |= val << offset;
+  if (offset + width > 64){
+    blocks[block_ind + 1] |= val >> (64 - offset);
+  }
+}
+
+namespace {
+
+void SaveVector(std::ostream& os, const MappedVector<uint64_t>& v){
+  uint64_t size = v.size();
+  os.write((const char*)(&size), sizeof(size));
+  if (size > 0){
+    os.write((const char*)(v.data()), sizeof(v[0]) * size);
+  }
+}
+
+void LoadVector(std::istream& is, MappedVector<uint64_t>& v){
+  uint64_t size = 0;
+  is.read((char*)(&size), sizeof(size));
+  v.resize(size);
+  if (size > 0){
+    is.read((char*)(&v[0]), sizeof(v[0]) * size);
+  }
+}
+
+}
+
+void RRRBitArray::Save(std::ostream& os) const{
+  os.write((const char*)(&length_), sizeof(length_));
+  os.write((const char*)(&one_num_), sizeof(one_num_));
+  SaveVector(os, classes_);
+  SaveVector(os, offsets_);
+  SaveVector(os, rank_samples_);
+  SaveVector(os, ptr_samples_);
+}
+
+void RRRBitArray::Load(std::istream& is){
+  Clear();
+  is.read((char*)(&length_), sizeof(length_));
+  is.read((char*)(&one_num_), sizeof(one_num_));
+  LoadVector(is, classes_);
+  LoadVector(is, offsets_);
+  LoadVector(is, rank_samples_);
+  LoadVector(is, ptr_samples_);
+}
+
+void RRRBitArray::SaveAligned(std::ostream& os, uint64_t& offset) const{
+  WriteValue(os, length_, offset);
+  WriteValue(os, one_num_, offset);
+  WriteArray(os, classes_.data(), classes_.size(), offset);
+  WriteArray(os, offsets_.data(), offsets_.size(), offset);
+  WriteArray(os, rank_samples_.data(), rank_samples_.size(), offset);
+  WriteArray(os, ptr_samples_.data(), ptr_samples_.size(), offset);
+}
+
+void RRRBitArray::LoadAligned(std::istream& is, uint64_t& offset){
+  Clear();
+  ReadValue(is, length_, offset);
+  ReadValue(is, one_num_, offset);
+  ReadArray(is, classes_, offset);
+  ReadArray(is, offsets_, offset);
+  ReadArray(is, rank_samples_, offset);
+  ReadArray(is, ptr_samples_, offset);
+}
+
+void RRRBitArray::Map(MapCursor& cursor){
+  Clear();
+  MapValue(cursor, length_);
+  MapValue(cursor, one_num_);
+  MapArray(cursor, classes_);
+  MapArray(cursor, offsets_);
+  MapArray(cursor, rank_samples_);
+  MapArray(cursor, ptr_samples_);
+}
+
+}
@@ -0,0 +1,94 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#ifndef WAT_ARRAY_RRR_BIT_ARRAY_HPP_
+#define WAT_ARRAY_RRR_BIT_ARRAY_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include <iostream>
+#include "mapped_vector.hpp"
+
+namespace wat_array {
+
+/**
+ * H0-compressed bit array (Raman, Raman and Rao).
+ *
+ * Bits are split into blocks of BLOCK_BITNUM bits. Each block is stored as
+ * its class (the number of ones) and its offset among the blocks of the
+ * same class, so that blocks which are nearly all zeros or all ones take
+ * only a few bits. Supports the same Rank/Select/Lookup as BitArray.
+ */
+class RRRBitArray {
+
+private:
+enum {
+  BLOCK_BITNUM = 15,
+  CLASS_BITNUM = 4,
+  CLASS_PER_WORD = 64 / CLASS_BITNUM,
+  SUPERBLOCK_BLOCKNUM = 32
+};
+
+public:
+  RRRBitArray();
+  ~RRRBitArray();
+  RRRBitArray(uint64_t size);
+  uint64_t length() const;
+  uint64_t one_num() const;
+
+  void Init(uint64_t size);
+  void Clear();
+  void SetBit(uint64_t bit, uint64_t pos);
+
+  void Build();
+  void Build(const uint64_t* blocks, uint64_t length);
+  uint64_t Rank(uint64_t bit, uint64_t pos) const;
+  uint64_t Select(uint64_t bit, uint64_t rank) const;
+  uint64_t Lookup(uint64_t pos) const;
+
+  void Decode(std::vector<uint64_t>& blocks) const;
+  uint64_t GetUsageBytes() const;
+
+  void Save(std::ostream& os) const;
+  void Load(std::istream& is);
+
+  void SaveAligned(std::ostream& os, uint64_t& offset) const;
+  void LoadAligned(std::istream& is, uint64_t& offset);
+  void Map(MapCursor& cursor);
+
+private:
+  uint64_t RankOne(uint64_t pos) const;
+  uint64_t GetClass(uint64_t block_ind) const;
+  uint64_t GetBlock(uint64_t block_ind, uint64_t& ptr) const;
+  static uint64_t GetBits(const uint64_t* blocks, uint64_t pos, uint64_t width);
+  static void SetBits(uint64_t* blocks, uint64_t pos, uint64_t width, uint64_t val);
+
+private:
+  std::vector<uint64_t> bit_blocks_;
+  MappedVector<uint64_t> classes_;
+  MappedVector<uint64_t> offsets_;
+  MappedVector<uint64_t> rank_samples_;
+  MappedVector<uint64_t> ptr_samples_;
+  uint64_t length_;
+  uint64_t one_num_;
+};
+
+}
+
+#endif // WAT_ARRAY_RRR_BIT_ARRAY_HPP_
@@ -0,0 +1,279 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <cassert>
+#include "symbol_array.hpp"
+#include "bit_array.hpp"
+
+using namespace std;
+
+namespace wat_array {
+
+SymbolArray::SymbolArray() : length_(0), bit_num_(2){
+}
+
+SymbolArray::~SymbolArray(){
+}
+
+SymbolArray::SymbolArray(uint64_t size, uint64_t bit_num) : length_(0), bit_num_(2){
+  Init(size, bit_num);
+}
+
+uint64_t SymbolArray::length() const{
+  return length_;
+}
+
+uint64_t SymbolArray::bit_num() const{
+  return bit_num_;
+}
+
+uint64_t SymbolArray::symbol_num() const{
+  return 1LLU << bit_num_;
+}
+
+uint64_t SymbolArray::symbol_per_word() const{
+  return 64 / bit_num_;
+}
+
+void SymbolArray::Init(uint64_t size, uint64_t bit_num){
+  assert(bit_num == 2 || bit_num == 4);
+  Clear();
+  length_  = size;
+  bit_num_ = bit_num;
+  words_.resize((size + symbol_per_word() - 1) / symbol_per_word());
+}
+
+void SymbolArray::Clear(){
+  words_.Clear();
+  less_supers_.Clear();
+  less_blocks_.Clear();
+  length_ = 0;
+}
+
+void SymbolArray::SetSymbol(uint64_t sym, uint64_t pos){
+  assert(sym < symbol_num() && pos < length_);
+  uint64_t shift = (pos % symbol_per_word()) * bit_num_;
+  uint64_t& word = words_[pos / symbol_per_word()];
+  word = (word & ~((symbol_num() - 1) << shift)) | (sym << shift);
+}
+
+void SymbolArray::Build(){
+  uint64_t symbol_num = this->symbol_num();
+  uint64_t block_num = (length_ >> BLOCK_SHIFT) + 1;
+  less_supers_.assign(((length_ >> SUPERBLOCK_SHIFT) + 1) * symbol_num, 0);
+  less_blocks_.assign(block_num * symbol_num, 0);
+
+  vector<uint64_t> counts(symbol_num);
+  vector<uint64_t> super_counts(symbol_num);
+  for (uint64_t i = 0; i < block_num; ++i){
+    uint64_t beg = i << BLOCK_SHIFT;
+    if ((beg & (SUPERBLOCK_SYMBOLNUM - 1)) == 0){
+      super_counts = counts;
+      uint64_t less = 0;
+      for (uint64_t s = 0; s < symbol_num; ++s){
+	less_supers_[(beg >> SUPERBLOCK_SHIFT) * symbol_num + s] = less;
+	less += counts[s];
+      }
+    }
+    uint64_t less = 0;
+    for (uint64_t s = 0; s < symbol_num; ++s){
+      less_blocks_[i * symbol_num + s] = static_cast<uint16_t>(less);
+      less += counts[s] - super_counts[s];
+    }
+    uint64_t end = min(beg + BLOCK_SYMBOLNUM, length_);
+    for (uint64_t pos = beg; pos < end; ++pos){
+      counts[Lookup(pos)]++;
+    }
+  }
+}
+
+uint64_t SymbolArray::Lookup(uint64_t pos) const{
+  if (pos >= length_) return NOTFOUND;
+  return (words_[pos / symbol_per_word()] >> ((pos % symbol_per_word()) * bit_num_)) & (symbol_num() - 1);
+}
+
+uint64_t SymbolArray::GetBlockLess(uint64_t sym, uint64_t block_ind) const{
+  // the number of the symbols less than sym before the block
+  if (sym >= symbol_num()) return block_ind << BLOCK_SHIFT;
+  uint64_t super_ind = block_ind >> (SUPERBLOCK_SHIFT - BLOCK_SHIFT);
+  return less_supers_[super_ind * symbol_num() + sym] 
+    + less_blocks_[block_ind * symbol_num() + sym];
+}
+
+uint64_t SymbolArray::GetBlockRank(uint64_t sym, uint64_t block_ind) const{
+  return GetBlockLess(sym + 1, block_ind) - GetBlockLess(sym, block_ind);
+}
+
+uint64_t SymbolArray::EqualMask(uint64_t word, uint64_t sym) const{
+  // the lowest bit of each symbol equal to sym
+  uint64_t ones = ~0LLU / (symbol_num() - 1);
+  uint64_t x = word ^ (sym * ones);
+  for (uint64_t shift = 1; shift < bit_num_; shift <<= 1){
+    x |= x >> shift;
+  }
+  return ~x & ones;
+}
+
+uint64_t SymbolArray::LessNum(uint64_t word, uint64_t sym) const{
+  // the even and the odd symbols are compared in lanes of 2 * bit_num_ 
+  // bits, where subtracting sym from the symbol with the highest bit 
+  // of the lane set leaves the highest bit iff the symbol >= sym
+  uint64_t lane_ones = ~0LLU / ((1LLU << (2 * bit_num_)) - 1);
+  uint64_t lane_mask = lane_ones * (symbol_num() - 1);
+  uint64_t lane_high = lane_ones << (2 * bit_num_ - 1);
+  uint64_t evens = word & lane_mask;
+  uint64_t odds  = (word >> bit_num_) & lane_mask;
+  uint64_t greater_equal_num = 
+    BitArray::PopCount(((evens | lane_high) - sym * lane_ones) & lane_high) + 
+    BitArray::PopCount(((odds  | lane_high) - sym * lane_ones) & lane_high);
+  return symbol_per_word() - greater_equal_num;
+}
+
+uint64_t SymbolArray::Rank(uint64_t sym, uint64_t pos) const{
+  assert(pos <= length_);
+  uint64_t block_ind = pos >> BLOCK_SHIFT;
+  uint64_t rank = GetBlockRank(sym, block_ind);
+  uint64_t word_ind = (block_ind << BLOCK_SHIFT) / symbol_per_word();
+  uint64_t word_end = pos / symbol_per_word();
+  for (; word_ind < word_end; ++word_ind){
+    rank += BitArray::PopCount(EqualMask(words_[word_ind], sym));
+  }
+  uint64_t rest = pos % symbol_per_word();
+  if (rest > 0){
+    uint64_t mask = (1LLU << (rest * bit_num_)) - 1;
+    rank += BitArray::PopCount(EqualMask(words_[word_end], sym) & mask);
+  }
+  return rank;
+}
+
+uint64_t SymbolArray::RankLessThan(uint64_t sym, uint64_t pos) const{
+  assert(pos <= length_);
+  if (sym >= symbol_num()) return pos;
+  uint64_t block_ind = pos >> BLOCK_SHIFT;
+  uint64_t rank_less_than = GetBlockLess(sym, block_ind);
+  uint64_t word_ind = (block_ind << BLOCK_SHIFT) / symbol_per_word();
+  uint64_t word_end = pos / symbol_per_word();
+  for (; word_ind < word_end; ++word_ind){
+    rank_less_than += LessNum(words_[word_ind], sym);
+  }
+  uint64_t rest = pos % symbol_per_word();
+  if (rest > 0){
+    // the symbols after pos are replaced by the largest symbol
+    uint64_t mask = (1LLU << (rest * bit_num_)) - 1;
+    rank_less_than += LessNum(words_[word_end] | ~mask, sym);
+  }
+  return rank_less_than;
+}
+
+void SymbolArray::RankAll(uint64_t sym, uint64_t pos, uint64_t& rank, uint64_t& rank_less_than) const{
+  assert(sym < symbol_num() && pos <= length_);
+  uint64_t block_ind = pos >> BLOCK_SHIFT;
+  rank_less_than = GetBlockLess(sym, block_ind);
+  rank = GetBlockLess(sym + 1, block_ind) - rank_less_than;
+  uint64_t word_ind = (block_ind << BLOCK_SHIFT) / symbol_per_word();
+  uint64_t word_end = pos / symbol_per_word();
+  for (; word_ind < word_end; ++word_ind){
+    uint64_t word = words_[word_ind];
+    rank += BitArray::PopCount(EqualMask(word, sym));
+    rank_less_than += LessNum(word, sym);
+  }
+  uint64_t rest = pos % symbol_per_word();
+  if (rest > 0){
+    uint64_t mask = (1LLU << (rest * bit_num_)) - 1;
+    uint64_t word = words_[word_end];
+    rank += BitArray::PopCount(EqualMask(word, sym) & mask);
+    rank_less_than += LessNum(word | ~mask, sym);
+  }
+}
+
+uint64_t SymbolArray::Select(uint64_t sym, uint64_t rank) const{
+  if (sym >= symbol_num() || rank == 0 || rank > Rank(sym, length_)) return NOTFOUND;
+
+  // the last block having less than rank sym before it
+  uint64_t block_per_super = 1LLU << (SUPERBLOCK_SHIFT - BLOCK_SHIFT);
+  uint64_t super_num = (length_ >> SUPERBLOCK_SHIFT) + 1;
+  uint64_t lo = 0;
+  uint64_t hi = super_num;
+  while (hi - lo > 1){
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (GetBlockRank(sym, mid * block_per_super) < rank) lo = mid;
+    else hi = mid;
+  }
+  uint64_t block_num = (length_ >> BLOCK_SHIFT) + 1;
+  hi = min(block_num, (lo + 1) * block_per_super);
+  lo = lo * block_per_super;
+  while (hi - lo > 1){
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (GetBlockRank(sym, mid) < rank) lo = mid;
+    else hi = mid;
+  }
+  rank -= GetBlockRank(sym, lo);
+
+  for (uint64_t word_ind = (lo << BLOCK_SHIFT) / symbol_per_word(); ; ++word_ind){
+    uint64_t mask = EqualMask(words_[word_ind], sym);
+    uint64_t num  = BitArray::PopCount(mask);
+    if (rank <= num){
+      return word_ind * symbol_per_word() + BitArray::SelectInBlock(mask, rank) / bit_num_;
+    }
+    rank -= num;
+  }
+}
+
+uint64_t SymbolArray::GetUsageBytes() const{
+  return sizeof(*this) + sizeof(uint64_t) * (words_.size() + less_supers_.size()) 
+    + sizeof(uint16_t) * less_blocks_.size();
+}
+
+void SymbolArray::SaveAligned(std::ostream& os, uint64_t& offset) const{
+  WriteValue(os, length_, offset);
+  WriteValue(os, bit_num_, offset);
+  WriteArray(os, words_.data(), words_.size(), offset);
+  WriteArray(os, less_supers_.data(), less_supers_.size(), offset);
+  WriteArray(os, less_blocks_.data(), less_blocks_.size(), offset);
+}
+
+void SymbolArray::LoadAligned(std::istream& is, uint64_t& offset){
+  Clear();
+  ReadValue(is, length_, offset);
+  ReadValue(is, bit_num_, offset);
+  ReadArray(is, words_, offset);
+  ReadArray(is, less_supers_, offset);
+  ReadArray(is, less_blocks_, offset);
+  if (bit_num_ != 2 && bit_num_ != 4){
+    Clear();
+    bit_num_ = 2;
+    is.setstate(std::ios::failbit);
+  }
+}
+
+void SymbolArray::Map(MapCursor& cursor){
+  Clear();
+  MapValue(cursor, length_);
+  MapValue(cursor, bit_num_);
+  MapArray(cursor, words_);
+  MapArray(cursor, less_supers_);
+  MapArray(cursor, less_blocks_);
+  if (bit_num_ != 2 && bit_num_ != 4){
+    Clear();
+    bit_num_ = 2;
+    cursor.ok = false;
+  }
+}
+
+}
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#ifndef WAT_ARRAY_SYMBOL_ARRAY_HPP_
+#define WAT_ARRAY_SYMBOL_ARRAY_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include <iostream>
+#include "mapped_vector.hpp"
+
+namespace wat_array {
+
+/**
+ * An array of 2-bit or 4-bit symbols supporting Rank/Select/Lookup, 
+ * used as a level of MultiaryWatArray.
+ *
+ * For every superblock of SUPERBLOCK_SYMBOLNUM symbols and every block 
+ * of BLOCK_SYMBOLNUM symbols, the number of symbols less than each 
+ * symbol is kept (absolute and relative to the superblock), so that 
+ * Rank and RankLessThan scan at most one block of packed symbols, 
+ * comparing all the symbols of a word at once.
+ */
+class SymbolArray {
+
+private:
+enum {
+  BLOCK_SHIFT = 8,
+  BLOCK_SYMBOLNUM = 1 << BLOCK_SHIFT,
+  SUPERBLOCK_SHIFT = 16,
+  SUPERBLOCK_SYMBOLNUM = 1 << SUPERBLOCK_SHIFT
+};
+
+public:
+  SymbolArray();
+  ~SymbolArray();
+  SymbolArray(uint64_t size, uint64_t bit_num);
+  uint64_t length() const;
+  uint64_t bit_num() const;
+  uint64_t symbol_num() const;
+
+  /**
+   * Initialize an array of size symbols of bit_num (2 or 4) bits, all 0
+   */
+  void Init(uint64_t size, uint64_t bit_num);
+  void Clear();
+  void SetSymbol(uint64_t sym, uint64_t pos);
+
+  void Build();
+  uint64_t Lookup(uint64_t pos) const;
+
+  /**
+   * The number of sym in the prefix [0...pos)
+   */
+  uint64_t Rank(uint64_t sym, uint64_t pos) const;
+
+  /**
+   * The number of symbols less than sym in the prefix [0...pos); 
+   * pos if sym >= symbol_num()
+   */
+  uint64_t RankLessThan(uint64_t sym, uint64_t pos) const;
+
+  /**
+   * Rank and RankLessThan at once
+   */
+  void RankAll(uint64_t sym, uint64_t pos, uint64_t& rank, uint64_t& rank_less_than) const;
+
+  /**
+   * The position of the rank-th sym (rank >= 1), or NOTFOUND
+   */
+  uint64_t Select(uint64_t sym, uint64_t rank) const;
+
+  uint64_t GetUsageBytes() const;
+
+  void SaveAligned(std::ostream& os, uint64_t& offset) const;
+  void LoadAligned(std::istream& is, uint64_t& offset);
+  void Map(MapCursor& cursor);
+
+private:
+  uint64_t symbol_per_word() const;
+  uint64_t GetBlockLess(uint64_t sym, uint64_t block_ind) const;
+  uint64_t GetBlockRank(uint64_t sym, uint64_t block_ind) const;
+  uint64_t EqualMask(uint64_t word, uint64_t sym) const;
+  uint64_t LessNum(uint64_t word, uint64_t sym) const;
+
+private:
+  MappedVector<uint64_t> words_;
+  // less_supers_[i * symbol_num() + s] is the number of the symbols 
+  // less than s before the i-th superblock, and less_blocks_ is 
+  // the same for the blocks relative to their superblocks
+  MappedVector<uint64_t> less_supers_;
+  MappedVector<uint16_t> less_blocks_;
+  uint64_t length_;
+  uint64_t bit_num_;
+};
+
+}
+
+#endif // WAT_ARRAY_SYMBOL_ARRAY_HPP_
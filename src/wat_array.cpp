@@ -19,13 +19,58 @@
 
 #include <queue>
 #include <algorithm>
+#include <iterator>
+#include <thread>
+#include <atomic>
 #include "wat_array.hpp"
 
 using namespace std;
 
 namespace wat_array {
 
-WatArray::WatArray() : alphabet_num_(0), alphabet_bit_num_(0), length_(0){
+namespace {
+
+// the values packed into a bit array, as given to WatArray::Init()
+class PackedBits {
+public:
+  PackedBits(const BitArray& ba, uint64_t width) : ba_(ba), width_(width) {}
+  uint64_t operator[](uint64_t ind) const {
+    return ba_.GetBits(ind * width_, width_);
+  }
+private:
+  const BitArray& ba_;
+  uint64_t width_;
+};
+
+// the working arrays of the build; a plain one ignores the width, and
+// when several threads write a packed one, two of them may write the 
+// same word
+void InitWorkArray(vector<uint64_t>& array, uint64_t /* width */, uint64_t length){
+  array.resize(length);
+}
+
+void InitWorkArray(IntVector& array, uint64_t width, uint64_t length){
+  array.Init(width, length);
+}
+
+inline void SetValue(vector<uint64_t>& array, uint64_t ind, uint64_t val, bool /* concurrent */){
+  array[ind] = val;
+}
+
+inline void SetValue(IntVector& array, uint64_t ind, uint64_t val, bool concurrent){
+  if (concurrent){
+    array.SetConcurrent(ind, val);
+  } else {
+    array.SetZeroed(ind, val);
+  }
+}
+
+}
+
+WatArray::WatArray() : alphabet_num_(0), alphabet_bit_num_(0), length_(0), 
+		       layout_(BitArray::INTERLEAVED_LAYOUT), compact_alphabet_(false),
+		       range_min_max_(false), moment_num_(0), thread_num_(0), node_cache_level_num_(0), 
+		       node_cache_bytes_(DEFAULT_NODE_CACHE_BYTES){
 }
   
 WatArray::~WatArray() {
@@ -33,7 +78,16 @@ WatArray::~WatArray() {
 
 void WatArray::Clear(){
   vector<BitArray>().swap(bit_arrays_);
-  occs_.Clear();
+  occ_sums_.Clear();
+  occ_sums_ef_.Clear();
+  values_.Clear();
+  mapped_file_.reset();
+  range_min_index_.Clear();
+  range_max_index_.Clear();
+  vector<IntVector>().swap(moment_sums_);
+  vector<uint64_t>().swap(node_begs_);
+  vector<uint64_t>().swap(node_zeros_);
+  node_cache_level_num_ = 0;
   alphabet_num_ = 0;
   alphabet_bit_num_ = 0;
   length_ = 0;
@@ -41,12 +95,54 @@ void WatArray::Clear(){
 
 void WatArray::Init(const vector<uint64_t>& array){
   Clear();
-  alphabet_num_     = GetAlphabetNum(array);
+  length_ = static_cast<uint64_t>(array.size());
+  if (compact_alphabet_){
+    InitCompact<vector<uint64_t>, vector<uint64_t> >(array);
+  } else {
+    alphabet_num_     = GetAlphabetNum(array, length_);
+    alphabet_bit_num_ = Log2(alphabet_num_);
+    SetArray<vector<uint64_t>, vector<uint64_t> >(array);
+  }
+  SetRangeMinMax(array);
+}
+
+void WatArray::Init(const IntVector& array){
+  InitPacked(array, array.length());
+}
+
+void WatArray::Init(const BitArray& ba, uint64_t width, uint64_t length){
+  InitPacked(PackedBits(ba, width), length);
+}
+
+template <class Array>
+void WatArray::InitPacked(const Array& array, uint64_t length){
+  Clear();
+  length_ = length;
+  if (compact_alphabet_){
+    InitCompact<Array, IntVector>(array);
+  } else {
+    alphabet_num_     = GetAlphabetNum(array, length_);
+    alphabet_bit_num_ = Log2(alphabet_num_);
+    SetArray<Array, IntVector>(array);
+  }
+  SetRangeMinMax(array);
+}
+
+template <class Array, class CodeArray>
+void WatArray::InitCompact(const Array& array){
+  // the codes are as packed as the input, and also the working arrays
+  CodeArray codes;
+  SetValues(array, codes);
+  alphabet_num_     = GetAlphabetNum(codes, length_);
   alphabet_bit_num_ = Log2(alphabet_num_);
+  SetArray<CodeArray, CodeArray>(codes);
+}
 
-  length_           = static_cast<uint64_t>(array.size());
-  SetArray(array);
-  SetOccs(array);
+template <class Array>
+void WatArray::SetRangeMinMax(const Array& array){
+  if (!range_min_max_) return;
+  range_min_index_.Init(array, length_, false);
+  range_max_index_.Init(array, length_, true);
 }
 
 uint64_t WatArray::Lookup(uint64_t pos) const{
@@ -56,20 +152,23 @@ uint64_t WatArray::Lookup(uint64_t pos) const{
   uint64_t c = 0;
   for (size_t i = 0; i < bit_arrays_.size(); ++i){
     const BitArray& ba = bit_arrays_[i];
-    uint64_t boundary  = st + ba.Rank(0, en) - ba.Rank(0, st);
+    uint64_t st_zero = 0;
+    uint64_t en_zero = 0;
+    GetNodeZeros(i, c, st, en, st_zero, en_zero);
+    uint64_t boundary  = st + en_zero - st_zero;
     uint64_t bit       = ba.Lookup(st + pos);
     c <<= 1;
     if (bit){
-      pos = ba.Rank(1, st + pos) - ba.Rank(1, st);
+      pos = ba.Rank(1, st + pos) - (st - st_zero);
       st = boundary;
       c |= 1LLU;
     } else {
-      pos = ba.Rank(0, st+ pos) - ba.Rank(0, st);
+      pos = ba.Rank(0, st+ pos) - st_zero;
       en = boundary;
     }
     
   }
-  return c;	 
+  return Decode(c);	 
 }
 
 uint64_t WatArray::Rank(uint64_t c, uint64_t pos) const{
@@ -81,10 +180,18 @@ uint64_t WatArray::Rank(uint64_t c, uint64_t pos) const{
 }
 
 uint64_t WatArray::RankLessThan(uint64_t c, uint64_t pos) const{
+  if (c > alphabet_num()) return NOTFOUND;
+  return RankLessThanCode(LowerCode(c), pos);
+}
+
+uint64_t WatArray::RankLessThanCode(uint64_t code, uint64_t pos) const{
+  if (code == alphabet_num_ && code > 0){
+    return (pos < length_) ? pos : length_;
+  }
   uint64_t rank_less_than = 0;
   uint64_t rank_more_than = 0;
   uint64_t rank           = 0;
-  RankAll(c, pos, rank, rank_less_than, rank_more_than);
+  RankAllCode(code, pos, rank, rank_less_than, rank_more_than);
   return rank_less_than;
 }
 
@@ -98,6 +205,21 @@ uint64_t WatArray::RankMoreThan(uint64_t c, uint64_t pos) const{
 
 void WatArray::RankAll(uint64_t c, uint64_t pos,
 		       uint64_t& rank,  uint64_t& rank_less_than, uint64_t& rank_more_than) const{
+  if (values_.empty() || c >= alphabet_num()){
+    RankAllCode(c, pos, rank, rank_less_than, rank_more_than);
+    return;
+  }
+  uint64_t code = LowerCode(c);
+  RankAllCode(code, pos, rank, rank_less_than, rank_more_than);
+  if (values_[code] != c){
+    // c does not appear, and the value of code is larger than c
+    rank_more_than += rank;
+    rank = 0;
+  }
+}
+
+void WatArray::RankAllCode(uint64_t c, uint64_t pos,
+			   uint64_t& rank,  uint64_t& rank_less_than, uint64_t& rank_more_than) const{
   if (c >= alphabet_num_) {
     rank_less_than = NOTFOUND;
     rank_more_than = NOTFOUND;
@@ -114,9 +236,11 @@ void WatArray::RankAll(uint64_t c, uint64_t pos,
 
   for (size_t i = 0; i < bit_arrays_.size() && beg_node < end_node; ++i){
     const BitArray& ba = bit_arrays_[i];
-    uint64_t beg_node_zero = ba.Rank(0, beg_node);
+    uint64_t beg_node_zero = 0;
+    uint64_t end_node_zero = 0;
+    GetNodeZeros(i, PrefixCode(c, i, bit_arrays_.size()), beg_node, end_node, 
+		 beg_node_zero, end_node_zero);
     uint64_t beg_node_one  = beg_node - beg_node_zero;
-    uint64_t end_node_zero = ba.Rank(0, end_node);
     uint64_t boundary      = beg_node + end_node_zero - beg_node_zero;
     uint64_t bit           = GetMSB(c, i, bit_arrays_.size());
     if (!bit){
@@ -134,40 +258,180 @@ void WatArray::RankAll(uint64_t c, uint64_t pos,
 			   
 
 uint64_t WatArray::Select(uint64_t c, uint64_t rank) const{
+  if (values_.empty()) return SelectCode(c, rank);
+  if (c >= alphabet_num()) return NOTFOUND;
+  uint64_t code = LowerCode(c);
+  if (values_[code] != c) return NOTFOUND;
+  return SelectCode(code, rank);
+}
+
+uint64_t WatArray::SelectCode(uint64_t c, uint64_t rank) const{
   if (c >= alphabet_num_) {
     return NOTFOUND;
   }
-  if (rank > Freq(c)){
+  if (rank == 0 || rank > OccSum(c+1) - OccSum(c)){
     return NOTFOUND;
   }
 
   for (size_t i = 0; i < bit_arrays_.size(); ++i){
-    uint64_t lower_c = c & ~((1LLU << (i+1)) - 1);
-    uint64_t beg_node = occs_.Select(1, lower_c  + 1) - lower_c;
-    const BitArray& ba = bit_arrays_[alphabet_bit_num_ - i - 1];
+    uint64_t level = alphabet_bit_num_ - i - 1;
+    const BitArray& ba = bit_arrays_[level];
     uint64_t bit = GetLSB(c, i);
-    uint64_t before_rank = ba.Rank(bit, beg_node);
+    uint64_t beg_node = 0;
+    uint64_t before_rank = 0;
+    if (level < node_cache_level_num_){
+      uint64_t ind = GetNodeCacheOffset(level) + PrefixCode(c, level, alphabet_bit_num_);
+      beg_node = node_begs_[ind];
+      before_rank = bit ? beg_node - node_zeros_[ind] : node_zeros_[ind];
+    } else {
+      uint64_t lower_c = (i + 1 < 64) ? c & ~((1LLU << (i+1)) - 1) : 0;
+      beg_node = OccSum(lower_c);
+      before_rank = ba.Rank(bit, beg_node);
+    }
     rank = ba.Select(bit, before_rank + rank) - beg_node + 1;
   }
   return rank - 1;
 }
 
 uint64_t WatArray::FreqRange(uint64_t min_c, uint64_t max_c, uint64_t begin_pos, uint64_t end_pos) const{
-  if (min_c >= alphabet_num_) return 0;
+  return MomentRange(min_c, max_c, begin_pos, end_pos, 0);
+}
+
+uint64_t WatArray::SumRange(uint64_t min_c, uint64_t max_c, uint64_t begin_pos, uint64_t end_pos) const{
+  return MomentRange(min_c, max_c, begin_pos, end_pos, 1);
+}
+
+uint64_t WatArray::MomentRange(uint64_t min_c, uint64_t max_c, uint64_t begin_pos, uint64_t end_pos, 
+			       uint64_t moment) const{
+  if (moment > moment_sums_.size()) return NOTFOUND;
+  if (min_c >= alphabet_num()) return 0;
   if (max_c <= min_c) return 0;
   if (end_pos > length_ || begin_pos > end_pos) return 0;
-  return 
-    + RankLessThan(max_c, end_pos)
-    - RankLessThan(min_c, end_pos)
-    - RankLessThan(max_c, begin_pos)
-    + RankLessThan(min_c, begin_pos);
+  if (max_c > alphabet_num()) max_c = alphabet_num();
+  min_c = LowerCode(min_c);
+  max_c = LowerCode(max_c);
+  if (min_c >= max_c || begin_pos == end_pos) return 0;
+  return MomentRangeCode(min_c, max_c, begin_pos, end_pos, moment);
+}
+
+uint64_t WatArray::MomentRangeCode(uint64_t min_code, uint64_t max_code, 
+				   uint64_t begin_pos, uint64_t end_pos, uint64_t moment) const{
+  // the two codes share the nodes down to the level where they diverge, 
+  // where the zero child counts the values from min_code and the one 
+  // child the values below max_code. A level of a path ranks the two 
+  // ends of the range, where four RankLessThanCode() would descend 
+  // four times and rank the nodes again in each
+  if (max_code == alphabet_num_){
+    return MomentRangeInNode(min_code, false, 0, 0, length_, begin_pos, end_pos, moment);
+  }
+  uint64_t beg_node = 0;
+  uint64_t end_node = length_;
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    const BitArray& ba = bit_arrays_[i];
+    uint64_t beg_node_zero = 0;
+    uint64_t end_node_zero = 0;
+    GetNodeZeros(i, PrefixCode(min_code, i, bit_arrays_.size()), beg_node, end_node, 
+		 beg_node_zero, end_node_zero);
+    uint64_t beg_node_one = beg_node - beg_node_zero;
+    uint64_t boundary     = beg_node + end_node_zero - beg_node_zero;
+    uint64_t beg_zero     = ba.Rank(0, begin_pos);
+    uint64_t end_zero     = ba.Rank(0, end_pos);
+    uint64_t zero_beg_pos = beg_node + beg_zero - beg_node_zero;
+    uint64_t zero_end_pos = beg_node + end_zero - beg_node_zero;
+    uint64_t one_beg_pos  = boundary + (begin_pos - beg_zero) - beg_node_one;
+    uint64_t one_end_pos  = boundary + (end_pos - end_zero) - beg_node_one;
+    uint64_t bit = GetMSB(min_code, i, bit_arrays_.size());
+    if (bit != GetMSB(max_code, i, bit_arrays_.size())){
+      return 
+	+ MomentRangeInNode(min_code, false, i + 1, beg_node, boundary, 
+			    zero_beg_pos, zero_end_pos, moment)
+	+ MomentRangeInNode(max_code, true,  i + 1, boundary, end_node, 
+			    one_beg_pos, one_end_pos, moment);
+    }
+    if (!bit){
+      begin_pos = zero_beg_pos;
+      end_pos   = zero_end_pos;
+      end_node  = boundary;
+    } else {
+      begin_pos = one_beg_pos;
+      end_pos   = one_end_pos;
+      beg_node  = boundary;
+    }
+    if (begin_pos == end_pos) return 0;
+  }
+  return 0;
+}
+
+uint64_t WatArray::MomentRangeInNode(uint64_t code, bool less_than, uint64_t level, 
+				     uint64_t beg_node, uint64_t end_node, 
+				     uint64_t begin_pos, uint64_t end_pos, uint64_t moment) const{
+  // the values of the range in the node below code if less_than, 
+  // and the values from code otherwise; the other child of each 
+  // level is taken whole
+  uint64_t sum = 0;
+  for (size_t i = level; i < bit_arrays_.size() && begin_pos < end_pos; ++i){
+    const BitArray& ba = bit_arrays_[i];
+    uint64_t prefix = PrefixCode(code, i, bit_arrays_.size());
+    uint64_t beg_node_zero = 0;
+    uint64_t end_node_zero = 0;
+    GetNodeZeros(i, prefix, beg_node, end_node, beg_node_zero, end_node_zero);
+    uint64_t beg_node_one = beg_node - beg_node_zero;
+    uint64_t boundary     = beg_node + end_node_zero - beg_node_zero;
+    uint64_t beg_zero     = ba.Rank(0, begin_pos);
+    uint64_t end_zero     = ba.Rank(0, end_pos);
+    uint64_t zero_beg_pos = beg_node + beg_zero - beg_node_zero;
+    uint64_t zero_end_pos = beg_node + end_zero - beg_node_zero;
+    uint64_t one_beg_pos  = boundary + (begin_pos - beg_zero) - beg_node_one;
+    uint64_t one_end_pos  = boundary + (end_pos - end_zero) - beg_node_one;
+    if (!GetMSB(code, i, bit_arrays_.size())){
+      if (!less_than) sum += MomentSum(i + 1, (prefix << 1) | 1LLU, one_beg_pos, one_end_pos, moment);
+      begin_pos = zero_beg_pos;
+      end_pos   = zero_end_pos;
+      end_node  = boundary;
+    } else {
+      if (less_than) sum += MomentSum(i + 1, prefix << 1, zero_beg_pos, zero_end_pos, moment);
+      begin_pos = one_beg_pos;
+      end_pos   = one_end_pos;
+      beg_node  = boundary;
+    }
+  }
+  if (!less_than) sum += MomentSum(bit_arrays_.size(), code, begin_pos, end_pos, moment);
+  return sum;
+}
+
+uint64_t WatArray::MomentSum(uint64_t level, uint64_t prefix, uint64_t begin_pos, uint64_t end_pos, 
+			     uint64_t moment) const{
+  // the sum of the range in the order of level, where a leaf has one value
+  if (moment == 0) return end_pos - begin_pos;
+  if (level == bit_arrays_.size()) return (end_pos - begin_pos) * Power(Decode(prefix), moment);
+  const IntVector& sums = moment_sums_[moment - 1];
+  uint64_t offset = (level - 1) * (length_ + 1);
+  return sums[offset + end_pos] - sums[offset + begin_pos];
+}
+
+uint64_t WatArray::Power(uint64_t x, uint64_t moment){
+  uint64_t power = 1;
+  for (uint64_t i = 0; i < moment; ++i){
+    power *= x;
+  }
+  return power;
 }
 
 void WatArray::MaxRange(uint64_t begin_pos, uint64_t end_pos, uint64_t& pos, uint64_t& val) const {
+  if (range_max_index_.length() > 0){
+    pos = range_max_index_.Find(begin_pos, end_pos);
+    val = Lookup(pos);
+    return;
+  }
   QuantileRange(begin_pos, end_pos, end_pos - begin_pos - 1, pos, val);
 } 
 
 void WatArray::MinRange(uint64_t begin_pos, uint64_t end_pos, uint64_t& pos, uint64_t& val) const {
+  if (range_min_index_.length() > 0){
+    pos = range_min_index_.Find(begin_pos, end_pos);
+    val = Lookup(pos);
+    return;
+  }
   QuantileRange(begin_pos, end_pos, 0,  pos, val);
 }
 
@@ -183,8 +447,9 @@ void WatArray::QuantileRange(uint64_t begin_pos, uint64_t end_pos, uint64_t k, u
   uint64_t end_node = length_;
   for (size_t i = 0; i < bit_arrays_.size(); ++i){
     const BitArray& ba = bit_arrays_[i];
-    uint64_t beg_node_zero = ba.Rank(0, beg_node);
-    uint64_t end_node_zero = ba.Rank(0, end_node);
+    uint64_t beg_node_zero = 0;
+    uint64_t end_node_zero = 0;
+    GetNodeZeros(i, val, beg_node, end_node, beg_node_zero, end_node_zero);
     uint64_t beg_node_one  = beg_node - beg_node_zero;
     uint64_t beg_zero  = ba.Rank(0, begin_pos);
     uint64_t end_zero  = ba.Rank(0, end_pos);
@@ -207,7 +472,355 @@ void WatArray::QuantileRange(uint64_t begin_pos, uint64_t end_pos, uint64_t k, u
   }
 
   uint64_t rank = begin_pos - beg_node;
-  pos = Select(val, rank+1);
+  pos = SelectCode(val, rank+1);
+  val = Decode(val);
+}
+
+void WatArray::RangeNextValue(uint64_t begin_pos, uint64_t end_pos, uint64_t x, 
+			      uint64_t& pos, uint64_t& val) const {
+  QueryOnNode leaf(0, 0, 0, 0, 0, 0);
+  if (!RangeNextCode(begin_pos, end_pos, LowerCode(x), leaf)){
+    pos = NOTFOUND;
+    val = NOTFOUND;
+    return;
+  }
+  pos = SelectCode(leaf.prefix_char, leaf.beg_pos - leaf.beg_node + 1);
+  val = Decode(leaf.prefix_char);
+}
+
+uint64_t WatArray::RangeNextValue(uint64_t begin_pos, uint64_t end_pos, uint64_t x) const {
+  QueryOnNode leaf(0, 0, 0, 0, 0, 0);
+  if (!RangeNextCode(begin_pos, end_pos, LowerCode(x), leaf)) return NOTFOUND;
+  return Decode(leaf.prefix_char);
+}
+
+void WatArray::RangePrevValue(uint64_t begin_pos, uint64_t end_pos, uint64_t x, 
+			      uint64_t& pos, uint64_t& val) const {
+  QueryOnNode leaf(0, 0, 0, 0, 0, 0);
+  if (!RangePrevCode(begin_pos, end_pos, LowerCode(x), leaf)){
+    pos = NOTFOUND;
+    val = NOTFOUND;
+    return;
+  }
+  pos = SelectCode(leaf.prefix_char, leaf.beg_pos - leaf.beg_node + 1);
+  val = Decode(leaf.prefix_char);
+}
+
+uint64_t WatArray::RangePrevValue(uint64_t begin_pos, uint64_t end_pos, uint64_t x) const {
+  QueryOnNode leaf(0, 0, 0, 0, 0, 0);
+  if (!RangePrevCode(begin_pos, end_pos, LowerCode(x), leaf)) return NOTFOUND;
+  return Decode(leaf.prefix_char);
+}
+
+bool WatArray::RangeNextCode(uint64_t begin_pos, uint64_t end_pos, uint64_t code, 
+			     QueryOnNode& leaf) const {
+  // follow code while the range is not empty, keeping the deepest one
+  // child off the path, whose smallest value is the next one above code
+  if (end_pos > length_ || begin_pos >= end_pos || code >= alphabet_num_) return false;
+  QueryOnNode qon(0, length_, begin_pos, end_pos, 0, 0);
+  QueryOnNode next(0, 0, 0, 0, 0, 0);
+  QueryOnNode zero(0, 0, 0, 0, 0, 0);
+  QueryOnNode one(0, 0, 0, 0, 0, 0);
+  bool has_next = false;
+  while (qon.depth < bit_arrays_.size() && qon.beg_pos < qon.end_pos){
+    SplitNode(qon, zero, one);
+    if (GetMSB(code, qon.depth, bit_arrays_.size())){
+      qon = one;
+    } else {
+      if (one.beg_pos < one.end_pos){
+	next = one;
+	has_next = true;
+      }
+      qon = zero;
+    }
+  }
+  if (qon.beg_pos < qon.end_pos){
+    leaf = qon;
+    return true;
+  }
+  if (!has_next) return false;
+  DescendExtreme(false, next);
+  leaf = next;
+  return true;
+}
+
+bool WatArray::RangePrevCode(uint64_t begin_pos, uint64_t end_pos, uint64_t code, 
+			     QueryOnNode& leaf) const {
+  // follow code as RangeNextCode() keeping the deepest zero child off
+  // the path; code itself is not less than code, and a code beyond 
+  // the alphabet takes the largest value of the range
+  if (end_pos > length_ || begin_pos >= end_pos || code == 0) return false;
+  QueryOnNode qon(0, length_, begin_pos, end_pos, 0, 0);
+  if (code >= alphabet_num_){
+    DescendExtreme(true, qon);
+    leaf = qon;
+    return true;
+  }
+  QueryOnNode prev(0, 0, 0, 0, 0, 0);
+  QueryOnNode zero(0, 0, 0, 0, 0, 0);
+  QueryOnNode one(0, 0, 0, 0, 0, 0);
+  bool has_prev = false;
+  while (qon.depth < bit_arrays_.size() && qon.beg_pos < qon.end_pos){
+    SplitNode(qon, zero, one);
+    if (GetMSB(code, qon.depth, bit_arrays_.size())){
+      if (zero.beg_pos < zero.end_pos){
+	prev = zero;
+	has_prev = true;
+      }
+      qon = one;
+    } else {
+      qon = zero;
+    }
+  }
+  if (!has_prev) return false;
+  DescendExtreme(true, prev);
+  leaf = prev;
+  return true;
+}
+
+void WatArray::SplitNode(const QueryOnNode& qon, QueryOnNode& zero, QueryOnNode& one) const {
+  const BitArray& ba = bit_arrays_[qon.depth];
+  uint64_t beg_node_zero = 0;
+  uint64_t end_node_zero = 0;
+  GetNodeZeros(qon.depth, qon.prefix_char, qon.beg_node, qon.end_node, 
+	       beg_node_zero, end_node_zero);
+  uint64_t beg_node_one  = qon.beg_node - beg_node_zero;
+  uint64_t beg_zero  = ba.Rank(0, qon.beg_pos);
+  uint64_t end_zero  = ba.Rank(0, qon.end_pos);
+  uint64_t boundary  = qon.beg_node + end_node_zero - beg_node_zero;
+  zero = QueryOnNode(qon.beg_node, boundary, 
+		     qon.beg_node + beg_zero - beg_node_zero, 
+		     qon.beg_node + end_zero - beg_node_zero, 
+		     qon.depth + 1, qon.prefix_char << 1);
+  one  = QueryOnNode(boundary, qon.end_node, 
+		     boundary + (qon.beg_pos - beg_zero) - beg_node_one, 
+		     boundary + (qon.end_pos - end_zero) - beg_node_one, 
+		     qon.depth + 1, (qon.prefix_char << 1) + 1);
+}
+
+void WatArray::DescendExtreme(bool largest, QueryOnNode& qon) const {
+  // down to the leaf of the smallest (or the largest) value of a 
+  // node whose range is not empty
+  QueryOnNode zero(0, 0, 0, 0, 0, 0);
+  QueryOnNode one(0, 0, 0, 0, 0, 0);
+  while (qon.depth < bit_arrays_.size()){
+    SplitNode(qon, zero, one);
+    if (largest){
+      qon = (one.beg_pos < one.end_pos) ? one : zero;
+    } else {
+      qon = (zero.beg_pos < zero.end_pos) ? zero : one;
+    }
+  }
+}
+
+void WatArray::LookupBatch(const uint64_t* poses, uint64_t num, uint64_t* vals) const{
+  uint64_t sts[QUERY_BATCH_SIZE];
+  uint64_t ens[QUERY_BATCH_SIZE];
+  uint64_t offsets[QUERY_BATCH_SIZE];
+  uint64_t codes[QUERY_BATCH_SIZE];
+  uint64_t rank_poses[3 * QUERY_BATCH_SIZE];
+  uint64_t ranks[3 * QUERY_BATCH_SIZE];
+  for (uint64_t beg = 0; beg < num; beg += QUERY_BATCH_SIZE){
+    uint64_t batch_num = min<uint64_t>(num - beg, QUERY_BATCH_SIZE);
+    for (uint64_t i = 0; i < batch_num; ++i){
+      // out of range queries descend from 0 and are discarded at the end
+      sts[i]     = 0;
+      ens[i]     = length_;
+      offsets[i] = (poses[beg + i] < length_) ? poses[beg + i] : 0;
+      codes[i]   = 0;
+    }
+    for (size_t level = 0; level < bit_arrays_.size(); ++level){
+      const BitArray& ba = bit_arrays_[level];
+      for (uint64_t i = 0; i < batch_num; ++i){
+	rank_poses[3*i]   = sts[i];
+	rank_poses[3*i+1] = ens[i];
+	rank_poses[3*i+2] = sts[i] + offsets[i];
+      }
+      ba.RankBatch(0, rank_poses, 3 * batch_num, ranks);
+      for (uint64_t i = 0; i < batch_num; ++i){
+	// the line of the bit has just been read by its rank
+	const uint64_t* r = ranks + 3 * i;
+	uint64_t boundary = sts[i] + r[1] - r[0];
+	uint64_t bit      = ba.Lookup(sts[i] + offsets[i]);
+	if (bit){
+	  offsets[i] = offsets[i] - (r[2] - r[0]);
+	  sts[i]     = boundary;
+	} else {
+	  offsets[i] = r[2] - r[0];
+	  ens[i]     = boundary;
+	}
+	codes[i] = (codes[i] << 1) | bit;
+      }
+    }
+    for (uint64_t i = 0; i < batch_num; ++i){
+      vals[beg + i] = (poses[beg + i] < length_) ? Decode(codes[i]) : NOTFOUND;
+    }
+  }
+}
+
+void WatArray::RankBatch(const uint64_t* cs, const uint64_t* poses, uint64_t num, 
+			 uint64_t* ranks) const{
+  uint64_t codes[QUERY_BATCH_SIZE];
+  uint64_t rank_less_thans[QUERY_BATCH_SIZE];
+  for (uint64_t beg = 0; beg < num; beg += QUERY_BATCH_SIZE){
+    uint64_t batch_num = min<uint64_t>(num - beg, QUERY_BATCH_SIZE);
+    for (uint64_t i = 0; i < batch_num; ++i){
+      uint64_t c = cs[beg + i];
+      codes[i] = (c < alphabet_num()) ? LowerCode(c) : 0;
+    }
+    RankAllCodeBatch(codes, poses + beg, batch_num, ranks + beg, rank_less_thans);
+    for (uint64_t i = 0; i < batch_num; ++i){
+      uint64_t c = cs[beg + i];
+      if (c >= alphabet_num()){
+	ranks[beg + i] = NOTFOUND;
+      } else if (!values_.empty() && values_[codes[i]] != c){
+	ranks[beg + i] = 0;
+      }
+    }
+  }
+}
+
+void WatArray::FreqRangeBatch(const uint64_t* min_cs, const uint64_t* max_cs, 
+			      const uint64_t* beg_poses, const uint64_t* end_poses, 
+			      uint64_t num, uint64_t* freqs) const{
+  // each query is the four ranks of FreqRange()
+  const uint64_t query_num = QUERY_BATCH_SIZE / 4;
+  uint64_t codes[QUERY_BATCH_SIZE];
+  uint64_t rank_poses[QUERY_BATCH_SIZE];
+  uint64_t ranks[QUERY_BATCH_SIZE];
+  uint64_t rank_less_thans[QUERY_BATCH_SIZE];
+  for (uint64_t beg = 0; beg < num; beg += query_num){
+    uint64_t batch_num = min<uint64_t>(num - beg, query_num);
+    for (uint64_t i = 0; i < batch_num; ++i){
+      uint64_t min_c = min_cs[beg + i];
+      uint64_t max_c = max_cs[beg + i];
+      bool valid = min_c < alphabet_num() && min_c < max_c && 
+	end_poses[beg + i] <= length_ && beg_poses[beg + i] <= end_poses[beg + i];
+      if (max_c > alphabet_num()) max_c = alphabet_num();
+      codes[4*i]      = valid ? LowerCode(max_c) : 0;
+      codes[4*i+1]    = valid ? LowerCode(min_c) : 0;
+      codes[4*i+2]    = codes[4*i];
+      codes[4*i+3]    = codes[4*i+1];
+      rank_poses[4*i]   = valid ? end_poses[beg + i] : 0;
+      rank_poses[4*i+1] = rank_poses[4*i];
+      rank_poses[4*i+2] = valid ? beg_poses[beg + i] : 0;
+      rank_poses[4*i+3] = rank_poses[4*i+2];
+    }
+    RankAllCodeBatch(codes, rank_poses, 4 * batch_num, ranks, rank_less_thans);
+    for (uint64_t i = 0; i < batch_num; ++i){
+      const uint64_t* r = rank_less_thans + 4 * i;
+      freqs[beg + i] = r[0] - r[1] - r[2] + r[3];
+    }
+  }
+}
+
+void WatArray::QuantileRangeBatch(const uint64_t* beg_poses, const uint64_t* end_poses, 
+				  const uint64_t* ks, uint64_t num, 
+				  uint64_t* poses, uint64_t* vals) const{
+  uint64_t beg_nodes[QUERY_BATCH_SIZE];
+  uint64_t end_nodes[QUERY_BATCH_SIZE];
+  uint64_t begs[QUERY_BATCH_SIZE];
+  uint64_t ends[QUERY_BATCH_SIZE];
+  uint64_t rests[QUERY_BATCH_SIZE];
+  uint64_t codes[QUERY_BATCH_SIZE];
+  uint64_t rank_poses[4 * QUERY_BATCH_SIZE];
+  uint64_t ranks[4 * QUERY_BATCH_SIZE];
+  for (uint64_t beg = 0; beg < num; beg += QUERY_BATCH_SIZE){
+    uint64_t batch_num = min<uint64_t>(num - beg, QUERY_BATCH_SIZE);
+    for (uint64_t i = 0; i < batch_num; ++i){
+      bool valid = end_poses[beg + i] <= length_ && beg_poses[beg + i] < end_poses[beg + i];
+      beg_nodes[i] = 0;
+      end_nodes[i] = length_;
+      begs[i]      = valid ? beg_poses[beg + i] : 0;
+      ends[i]      = valid ? end_poses[beg + i] : 0;
+      rests[i]     = ks[beg + i];
+      codes[i]     = 0;
+    }
+    for (size_t level = 0; level < bit_arrays_.size(); ++level){
+      const BitArray& ba = bit_arrays_[level];
+      for (uint64_t i = 0; i < batch_num; ++i){
+	rank_poses[4*i]   = beg_nodes[i];
+	rank_poses[4*i+1] = end_nodes[i];
+	rank_poses[4*i+2] = begs[i];
+	rank_poses[4*i+3] = ends[i];
+      }
+      ba.RankBatch(0, rank_poses, 4 * batch_num, ranks);
+      for (uint64_t i = 0; i < batch_num; ++i){
+	const uint64_t* r = ranks + 4 * i;
+	uint64_t boundary  = beg_nodes[i] + r[1] - r[0];
+	uint64_t zero_num  = r[3] - r[2];
+	if (zero_num > rests[i]){
+	  begs[i]      = beg_nodes[i] + r[2] - r[0];
+	  ends[i]      = beg_nodes[i] + r[3] - r[0];
+	  end_nodes[i] = boundary;
+	  codes[i]     = codes[i] << 1;
+	} else {
+	  uint64_t beg_node_one = beg_nodes[i] - r[0];
+	  begs[i]      = boundary + (begs[i] - r[2]) - beg_node_one;
+	  ends[i]      = boundary + (ends[i] - r[3]) - beg_node_one;
+	  beg_nodes[i] = boundary;
+	  codes[i]     = (codes[i] << 1) + 1;
+	  rests[i]    -= zero_num;
+	}
+      }
+    }
+    for (uint64_t i = 0; i < batch_num; ++i){
+      if (end_poses[beg + i] > length_ || beg_poses[beg + i] >= end_poses[beg + i]){
+	poses[beg + i] = NOTFOUND;
+	vals[beg + i]  = NOTFOUND;
+	continue;
+      }
+      poses[beg + i] = SelectCode(codes[i], begs[i] - beg_nodes[i] + 1);
+      vals[beg + i]  = Decode(codes[i]);
+    }
+  }
+}
+
+void WatArray::RankAllCodeBatch(const uint64_t* codes, const uint64_t* poses, uint64_t num,
+				uint64_t* ranks, uint64_t* rank_less_thans) const{
+  // at most QUERY_BATCH_SIZE queries of codes <= alphabet_num_, 
+  // where code == alphabet_num_ counts every value as in RankLessThanCode()
+  assert(num <= QUERY_BATCH_SIZE);
+  uint64_t beg_nodes[QUERY_BATCH_SIZE];
+  uint64_t end_nodes[QUERY_BATCH_SIZE];
+  uint64_t cur_poses[QUERY_BATCH_SIZE];
+  uint64_t rank_poses[3 * QUERY_BATCH_SIZE];
+  uint64_t level_ranks[3 * QUERY_BATCH_SIZE];
+  for (uint64_t i = 0; i < num; ++i){
+    beg_nodes[i]       = 0;
+    end_nodes[i]       = length_;
+    cur_poses[i]       = (poses[i] < length_) ? poses[i] : length_;
+    rank_less_thans[i] = 0;
+  }
+  for (size_t level = 0; level < bit_arrays_.size(); ++level){
+    const BitArray& ba = bit_arrays_[level];
+    for (uint64_t i = 0; i < num; ++i){
+      rank_poses[3*i]   = beg_nodes[i];
+      rank_poses[3*i+1] = end_nodes[i];
+      rank_poses[3*i+2] = cur_poses[i];
+    }
+    ba.RankBatch(0, rank_poses, 3 * num, level_ranks);
+    for (uint64_t i = 0; i < num; ++i){
+      // an empty node stays empty with no rank, as RankAllCode() stops there
+      const uint64_t* r = level_ranks + 3 * i;
+      uint64_t boundary = beg_nodes[i] + r[1] - r[0];
+      if (!GetMSB(codes[i], level, bit_arrays_.size())){
+	cur_poses[i] = beg_nodes[i] + r[2] - r[0];
+	end_nodes[i] = boundary;
+      } else {
+	rank_less_thans[i] += r[2] - r[0];
+	cur_poses[i] = boundary + (cur_poses[i] - r[2]) - (beg_nodes[i] - r[0]);
+	beg_nodes[i] = boundary;
+      }
+    }
+  }
+  for (uint64_t i = 0; i < num; ++i){
+    ranks[i] = cur_poses[i] - beg_nodes[i];
+    if (codes[i] == alphabet_num_ && codes[i] > 0){
+      ranks[i] = 0;
+      rank_less_thans[i] = (poses[i] < length_) ? poses[i] : length_;
+    }
+  }
 }
 
 class WatArray::ListModeComparator{
@@ -275,8 +888,10 @@ void WatArray::ExpandNode(uint64_t min_c, uint64_t max_c,
 			  const QueryOnNode& qon, vector<QueryOnNode>& next) const{
   const BitArray& ba = bit_arrays_[qon.depth];
   
-  uint64_t beg_node_zero = ba.Rank(0, qon.beg_node);
-  uint64_t end_node_zero = ba.Rank(0, qon.end_node);
+  uint64_t beg_node_zero = 0;
+  uint64_t end_node_zero = 0;
+  GetNodeZeros(qon.depth, qon.prefix_char, qon.beg_node, qon.end_node, 
+	       beg_node_zero, end_node_zero);
   uint64_t beg_node_one  = qon.beg_node - beg_node_zero;
   uint64_t beg_zero  = ba.Rank(0, qon.beg_pos);
   uint64_t end_zero  = ba.Rank(0, qon.end_pos);
@@ -308,16 +923,19 @@ void WatArray::ExpandNode(uint64_t min_c, uint64_t max_c,
 }
 
 uint64_t WatArray::Freq(uint64_t c) const {
-  if (c >= alphabet_num_) return NOTFOUND;
-  return occs_.Select(1, c+2) - occs_.Select(1, c+1) - 1;  
+  if (c >= alphabet_num()) return NOTFOUND;
+  uint64_t code = LowerCode(c);
+  if (Decode(code) != c) return 0;
+  return OccSum(code+1) - OccSum(code);
 }
 
 uint64_t WatArray::FreqSum(uint64_t min_c, uint64_t max_c) const {
-  if (max_c > alphabet_num_ || min_c > max_c ) return NOTFOUND;
-    return occs_.Select(1, max_c+1) - occs_.Select(1, min_c+1) - (max_c - min_c);  
+  if (max_c > alphabet_num() || min_c > max_c ) return NOTFOUND;
+  return OccSum(LowerCode(max_c)) - OccSum(LowerCode(min_c));
 }
 
 uint64_t WatArray::alphabet_num() const{
+  if (!values_.empty()) return values_.back() + 1;
   return alphabet_num_;
 }
 
@@ -325,9 +943,179 @@ uint64_t WatArray::length() const{
   return length_;
 }
 
-uint64_t WatArray::GetAlphabetNum(const std::vector<uint64_t>& array) const {
+uint64_t WatArray::GetUsageBytes() const{
+  uint64_t bytes = sizeof(*this) + sizeof(uint64_t) * occ_sums_.size() 
+    + occ_sums_ef_.GetUsageBytes() + sizeof(uint64_t) * values_.size()
+    + sizeof(uint64_t) * (node_begs_.size() + node_zeros_.size())
+    + range_min_index_.GetUsageBytes() + range_max_index_.GetUsageBytes()
+    + GetMomentUsageBytes();
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    bytes += bit_arrays_[i].GetUsageBytes();
+  }
+  return bytes;
+}
+
+uint64_t WatArray::GetMomentUsageBytes() const{
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < moment_sums_.size(); ++i){
+    bytes += moment_sums_[i].GetUsageBytes();
+  }
+  return bytes;
+}
+
+void WatArray::set_layout(BitArray::Layout layout){
+  layout_ = layout;
+}
+
+BitArray::Layout WatArray::layout() const{
+  return layout_;
+}
+
+void WatArray::set_compact_alphabet(bool compact_alphabet){
+  compact_alphabet_ = compact_alphabet;
+}
+
+bool WatArray::compact_alphabet() const{
+  return compact_alphabet_;
+}
+
+void WatArray::set_range_min_max(bool range_min_max){
+  range_min_max_ = range_min_max;
+}
+
+bool WatArray::range_min_max() const{
+  return range_min_max_;
+}
+
+void WatArray::set_moment_num(uint64_t moment_num){
+  moment_num_ = moment_num;
+}
+
+uint64_t WatArray::moment_num() const{
+  return moment_num_;
+}
+
+void WatArray::set_thread_num(uint64_t thread_num){
+  thread_num_ = thread_num;
+}
+
+uint64_t WatArray::thread_num() const{
+  return thread_num_;
+}
+
+void WatArray::set_node_cache_bytes(uint64_t bytes){
+  node_cache_bytes_ = bytes;
+  SetNodeCache();
+}
+
+uint64_t WatArray::node_cache_bytes() const{
+  return node_cache_bytes_;
+}
+
+uint64_t WatArray::GetNodeCacheOffset(uint64_t level){
+  // the levels above have 2^l + 1 entries each
+  return (1LLU << level) - 1 + level;
+}
+
+void WatArray::SetNodeCache(){
+  vector<uint64_t>().swap(node_begs_);
+  vector<uint64_t>().swap(node_zeros_);
+  node_cache_level_num_ = 0;
+  uint64_t level_num = 0;
+  while (level_num < alphabet_bit_num_ && level_num < MAX_NODE_CACHE_LEVEL_NUM &&
+	 2 * sizeof(uint64_t) * GetNodeCacheOffset(level_num + 1) <= node_cache_bytes_){
+    ++level_num;
+  }
+  if (level_num == 0) return;
+
+  // the children of a node begin at its beginning and at its boundary
+  node_begs_.resize(GetNodeCacheOffset(level_num));
+  node_zeros_.resize(GetNodeCacheOffset(level_num));
+  for (uint64_t level = 0; level < level_num; ++level){
+    uint64_t offset = GetNodeCacheOffset(level);
+    uint64_t node_num = 1LLU << level;
+    if (level == 0){
+      node_begs_[offset] = 0;
+    } else {
+      uint64_t parent_offset = GetNodeCacheOffset(level - 1);
+      for (uint64_t p = 0; p < node_num / 2; ++p){
+	uint64_t beg_node = node_begs_[parent_offset + p];
+	node_begs_[offset + 2 * p]     = beg_node;
+	node_begs_[offset + 2 * p + 1] = beg_node + node_zeros_[parent_offset + p + 1] 
+	  - node_zeros_[parent_offset + p];
+      }
+    }
+    node_begs_[offset + node_num] = length_;
+    const BitArray& ba = bit_arrays_[level];
+    for (uint64_t p = 0; p <= node_num; ++p){
+      node_zeros_[offset + p] = ba.Rank(0, node_begs_[offset + p]);
+    }
+  }
+  node_cache_level_num_ = level_num;
+}
+
+void WatArray::GetNodeZeros(uint64_t level, uint64_t prefix, uint64_t beg_node, uint64_t end_node, 
+			    uint64_t& beg_node_zero, uint64_t& end_node_zero) const{
+  if (level < node_cache_level_num_){
+    const uint64_t* zeros = &node_zeros_[GetNodeCacheOffset(level) + prefix];
+    beg_node_zero = zeros[0];
+    end_node_zero = zeros[1];
+    return;
+  }
+  const BitArray& ba = bit_arrays_[level];
+  beg_node_zero = ba.Rank(0, beg_node);
+  end_node_zero = ba.Rank(0, end_node);
+}
+
+template <class Array, class CodeArray>
+void WatArray::SetValues(const Array& array, CodeArray& codes){
+  // the distinct values are merged from batches of the array, each at 
+  // most as large as the values so far or a build chunk, so that the 
+  // working space is linear in the number of the distinct values, not 
+  // in the length, and each value is merged O(log length) times
+  vector<uint64_t> values;
+  vector<uint64_t> batch;
+  vector<uint64_t> merged;
+  for (uint64_t i = 0; ; ++i){
+    if (i == length_ || batch.size() >= max<uint64_t>(values.size(), BUILD_CHUNK_SIZE)){
+      sort(batch.begin(), batch.end());
+      batch.erase(unique(batch.begin(), batch.end()), batch.end());
+      merged.clear();
+      merged.reserve(values.size() + batch.size());
+      set_union(values.begin(), values.end(), batch.begin(), batch.end(), back_inserter(merged));
+      values.swap(merged);
+      batch.clear();
+      if (i == length_) break;
+    }
+    batch.push_back(array[i]);
+  }
+  vector<uint64_t>().swap(batch);
+  vector<uint64_t>().swap(merged);
+
+  InitWorkArray(codes, Log2(values.size()), length_);
+  for (uint64_t i = 0; i < length_; ++i){
+    SetValue(codes, i, lower_bound(values.begin(), values.end(), array[i]) - values.begin(), false);
+  }
+  if (values.empty()) return;
+  values_.resize(values.size());
+  copy(values.begin(), values.end(), &values_[0]);
+}
+
+uint64_t WatArray::LowerCode(uint64_t c) const{
+  // the number of the distinct values less than c
+  if (values_.empty()) return c;
+  return lower_bound(values_.data(), values_.data() + values_.size(), c) - values_.data();
+}
+
+uint64_t WatArray::Decode(uint64_t code) const{
+  if (values_.empty() || code >= values_.size()) return code;
+  return values_[code];
+}
+
+template <class Array>
+uint64_t WatArray::GetAlphabetNum(const Array& array, uint64_t length) const {
   uint64_t alphabet_num = 0;
-  for (size_t i = 0; i < array.size(); ++i){
+  for (uint64_t i = 0; i < length; ++i){
     if (array[i] >= alphabet_num){
       alphabet_num = array[i]+1;
     }
@@ -339,13 +1127,14 @@ uint64_t WatArray::Log2(uint64_t x) const{
   if (x == 0) return 0;
   x--;
   uint64_t bit_num = 0;
-  while (x >> bit_num){
+  while (bit_num < 64 && (x >> bit_num)){
     ++bit_num;
   }
   return bit_num;
 }
 
 uint64_t WatArray::PrefixCode(uint64_t x, uint64_t len, uint64_t bit_num) const{
+  if (len == 0) return 0;
   return x >> (bit_num - len);
 }
 
@@ -357,91 +1146,439 @@ uint64_t WatArray::GetLSB(uint64_t x, uint64_t pos) {
   return (x >> pos) & 1LLU;
 }
 
-void WatArray::SetArray(const vector<uint64_t>& array) {
-  if (alphabet_num_ == 0) return;
-  bit_arrays_.resize(alphabet_bit_num_, length_);
+template <class Array, class WorkArray>
+void WatArray::SetArray(const Array& array) {
+  bit_arrays_.resize(alphabet_bit_num_, BitArray(length_, layout_));
 
-  vector<vector<uint64_t> > beg_poses;
-  GetBegPoses(array, alphabet_bit_num_, beg_poses);
-  
-  for (size_t i = 0; i < array.size(); ++i){
-    uint64_t c = array[i];
-    for (uint64_t j = 0; j < alphabet_bit_num_; ++j){
-      uint64_t prefix_code = PrefixCode(c, j, alphabet_bit_num_);
-      uint64_t bit_pos     = beg_poses[j][prefix_code]++;
-      bit_arrays_[j].SetBit(GetMSB(c, j, alphabet_bit_num_), bit_pos);
+  // the array is stably partitioned level by level; in the order of 
+  // a level the nodes are the runs of the same prefix, so each level 
+  // is read and written sequentially, and the working space is two 
+  // arrays whatever the alphabet is. The last order is sorted.
+  InitMoments(array);
+  if (alphabet_bit_num_ == 0){
+    SetOccs(array);
+    return;
+  }
+  // the order of level + 1 is in work_arrays[level % 2]
+  WorkArray work_arrays[2];
+  InitWorkArray(work_arrays[0], alphabet_bit_num_, length_);
+  SetLevel(array, 0, work_arrays[0]);
+  for (uint64_t level = 1; level < alphabet_bit_num_; ++level){
+    SetMomentLevel(work_arrays[(level + 1) % 2], level);
+    WorkArray& next_array = work_arrays[level % 2];
+    InitWorkArray(next_array, alphabet_bit_num_, length_);
+    SetLevel(work_arrays[(level + 1) % 2], level, next_array);
+  }
+  SetOccs(work_arrays[(alphabet_bit_num_ + 1) % 2]);
+  SetNodeCache();
+}
+
+template <class Array>
+void WatArray::InitMoments(const Array& array){
+  // the prefix sums take the bits of the total, or wrap around as the 
+  // results do when it overflows
+  moment_sums_.resize(moment_num_);
+  for (uint64_t moment = 1; moment <= moment_num_; ++moment){
+    uint64_t total = 0;
+    bool overflow = false;
+    for (uint64_t i = 0; i < length_; ++i){
+      uint64_t power = 1;
+      for (uint64_t j = 0; j < moment; ++j){
+	overflow |= __builtin_mul_overflow(power, Decode(array[i]), &power);
+      }
+      overflow |= __builtin_add_overflow(total, power, &total);
     }
+    uint64_t width = 64;
+    if (!overflow){
+      width = 0;
+      while (width < 64 && (total >> width)) ++width;
+    }
+    uint64_t level_num = (alphabet_bit_num_ > 1) ? alphabet_bit_num_ - 1 : 0;
+    moment_sums_[moment - 1].Init(width, level_num * (length_ + 1));
   }
- 
-  for (size_t i = 0; i < bit_arrays_.size(); ++i){
-    bit_arrays_[i].Build();
+}
+
+template <class Array>
+void WatArray::SetMomentLevel(const Array& array, uint64_t level){
+  for (uint64_t moment = 1; moment <= moment_sums_.size(); ++moment){
+    IntVector& sums = moment_sums_[moment - 1];
+    uint64_t offset = (level - 1) * (length_ + 1);
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < length_; ++i){
+      sum += Power(Decode(array[i]), moment);
+      sums.Set(offset + i + 1, sum);
+    }
   }
 }
 
-void WatArray::SetOccs(const vector<uint64_t>& array){
-  vector<uint64_t> counts(alphabet_num_);
-  for (size_t i = 0; i < array.size(); ++i){
-    counts[array[i]]++;
+template <class Array, class WorkArray>
+void WatArray::SetLevel(const Array& array, uint64_t level, WorkArray& next_array) {
+  BitArray& ba = bit_arrays_[level];
+  uint64_t chunk_num = (length_ + BUILD_CHUNK_SIZE - 1) / BUILD_CHUNK_SIZE;
+  RunTasks(chunk_num, [this, &array, &ba, level](uint64_t chunk) {
+      uint64_t end = std::min<uint64_t>(length_, (chunk + 1) * BUILD_CHUNK_SIZE);
+      uint64_t shift = alphabet_bit_num_ - level - 1;
+      for (uint64_t i = chunk * BUILD_CHUNK_SIZE; i < end; i += 64){
+	uint64_t block = 0;
+	uint64_t block_end = std::min<uint64_t>(end, i + 64);
+	for (uint64_t j = i; j < block_end; ++j){
+	  block |= ((array[j] >> shift) & 1LLU) << (j - i);
+	}
+	ba.SetBlock(i / 64, block);
+      }
+    });
+  ba.Build();
+
+  bool concurrent = GetThreadNum(chunk_num) > 1;
+  RunTasks(chunk_num, [this, &array, level, concurrent, &next_array](uint64_t chunk) {
+      uint64_t end = std::min<uint64_t>(length_, (chunk + 1) * BUILD_CHUNK_SIZE);
+      PartitionChunk(array, level, chunk * BUILD_CHUNK_SIZE, end, concurrent, next_array);
+    });
+}
+
+template <class Array, class WorkArray>
+void WatArray::PartitionChunk(const Array& array, uint64_t level, uint64_t beg, uint64_t end, 
+			      bool concurrent, WorkArray& next_array) const{
+  // the zeros of a node go to its beginning and the ones after them,
+  // both in the order of the array. The zeros of a short node are 
+  // counted directly, and the ranks of the level give them for a long 
+  // one, which may also begin before the chunk
+  const BitArray& ba = bit_arrays_[level];
+  for (uint64_t i = beg; i < end; ){
+    uint64_t node_beg = (i == beg) ? GetNodeBeg(array, level, i) : i;
+    uint64_t node_end = GetNodeEnd(array, level, i);
+    uint64_t zero_pos = node_beg;
+    uint64_t one_pos  = node_beg;
+    if (node_beg == i && node_end - i <= SHORT_NODE_SIZE){
+      for (uint64_t j = i; j < node_end; ++j){
+	one_pos += GetMSB(array[j], level, alphabet_bit_num_) ^ 1LLU;
+      }
+    } else {
+      uint64_t node_beg_zero = ba.Rank(0, node_beg);
+      uint64_t zero = ba.Rank(0, i) - node_beg_zero;
+      zero_pos += zero;
+      one_pos  += ba.Rank(0, node_end) - node_beg_zero + (i - node_beg) - zero;
+    }
+    uint64_t run_end = std::min(node_end, end);
+    for (; i < run_end; ++i){
+      // without a branch, since the bits are as random as the data
+      uint64_t c = array[i];
+      uint64_t bit = GetMSB(c, level, alphabet_bit_num_);
+      SetValue(next_array, bit ? one_pos : zero_pos, c, concurrent);
+      one_pos  += bit;
+      zero_pos += bit ^ 1LLU;
+    }
   }
+}
 
-  occs_.Init(array.size() + alphabet_num_ + 1);
-  uint64_t sum = 0;
-  for (size_t i = 0; i < counts.size(); ++i){
-    occs_.SetBit(1, sum);
-    sum += counts[i] + 1;
+template <class Array>
+uint64_t WatArray::GetNodeBeg(const Array& array, uint64_t level, uint64_t pos) const{
+  uint64_t prefix = PrefixCode(array[pos], level, alphabet_bit_num_);
+  uint64_t lo = 0;
+  uint64_t hi = pos;
+  while (lo < hi){
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (PrefixCode(array[mid], level, alphabet_bit_num_) < prefix){
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
   }
-  occs_.SetBit(1, sum);
-  occs_.Build();
+  return lo;
 }
 
-void WatArray::GetBegPoses(const vector<uint64_t>& array, 
-			   uint64_t alpha_bit_num, 
-			   vector< vector<uint64_t> >& beg_poses) const{
-  beg_poses.resize(alpha_bit_num);
-  for (uint64_t i = 0; i < beg_poses.size(); ++i){
-    beg_poses[i].resize(1 << i);
+template <class Array>
+uint64_t WatArray::GetNodeEnd(const Array& array, uint64_t level, uint64_t pos) const{
+  // galloping, so that finding the end costs the log of the node size
+  uint64_t prefix = PrefixCode(array[pos], level, alphabet_bit_num_);
+  uint64_t step = 1;
+  while (step < length_ - pos && PrefixCode(array[pos + step], level, alphabet_bit_num_) == prefix){
+    pos += step;
+    step *= 2;
   }
-  
-  for (size_t i = 0; i < array.size(); ++i){
-    uint64_t c = array[i];
-    for (uint64_t j = 0; j < alpha_bit_num; ++j){
-      beg_poses[j][PrefixCode(c, j, alpha_bit_num)]++;
+  uint64_t lo = pos + 1;
+  uint64_t hi = std::min<uint64_t>(length_, pos + step);
+  while (lo < hi){
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (PrefixCode(array[mid], level, alphabet_bit_num_) == prefix){
+      lo = mid + 1;
+    } else {
+      hi = mid;
     }
   }
+  return lo;
+}
 
-  for (size_t i = 0; i < beg_poses.size(); ++i){
-    uint64_t sum = 0;
-    vector<uint64_t>& beg_poses_level = beg_poses[i];
-    for (size_t j = 0; j < beg_poses_level.size(); ++j){
-      uint64_t num = beg_poses_level[j];
-      beg_poses_level[j] = sum;
-      sum += num;
+template <class Array>
+void WatArray::SetOccs(const Array& sorted_array){
+  // occ_sums[c] is the position of the first value not less than c
+  uint64_t c = 0;
+  uint64_t i = 0;
+  SetOccSums([&](){
+      for (; i < length_ && sorted_array[i] < c; ++i){}
+      ++c;
+      return i;
+    });
+}
+
+int WatArray::SetSizes(uint64_t alphabet_num, uint64_t length, uint64_t& level_num){
+  Clear();
+  // as given by Init(), only an empty array has no alphabet
+  if ((alphabet_num == 0) != (length == 0)) return -1;
+  alphabet_num_     = alphabet_num;
+  alphabet_bit_num_ = Log2(alphabet_num_);
+  length_           = length;
+  level_num = alphabet_bit_num_;
+  return 0;
+}
+
+int WatArray::SetOccSums(const function<uint64_t()>& next_occ_sum){
+  // the table would be larger than the array, and OccSum counts with 
+  // the tree instead
+  if (alphabet_num_ > length_) return 0;
+
+  // keep the plain table unless it is larger than the unary 
+  // representation of n + alphabet_num + 1 bits
+  uint64_t num = alphabet_num_ + 1;
+  bool plain = 64 * num <= length_ + num;
+  if (plain){
+    occ_sums_.resize(num);
+  } else {
+    occ_sums_ef_.Init(num, length_);
+  }
+  uint64_t prev = 0;
+  for (uint64_t c = 0; c < num; ++c){
+    uint64_t occ_sum = next_occ_sum();
+    if (occ_sum < prev || occ_sum > length_ || (c == 0 && occ_sum != 0) || 
+	(c + 1 == num && occ_sum != length_)){
+      occ_sums_.Clear();
+      occ_sums_ef_.Clear();
+      return -1;
     }
+    if (plain){
+      occ_sums_[c] = occ_sum;
+    } else {
+      occ_sums_ef_.Set(c, occ_sum);
+    }
+    prev = occ_sum;
   }
+  if (!plain) occ_sums_ef_.Build();
+  return 0;
+}
+
+bool WatArray::CheckMoments() const{
+  uint64_t level_num = (alphabet_bit_num_ > 1) ? alphabet_bit_num_ - 1 : 0;
+  for (size_t i = 0; i < moment_sums_.size(); ++i){
+    if (moment_sums_[i].length() != level_num * (length_ + 1)) return false;
+  }
+  return true;
+}
+
+uint64_t WatArray::OccSum(uint64_t c) const{
+  if (!occ_sums_.empty()) return occ_sums_[c];
+  if (occ_sums_ef_.length() > 0) return occ_sums_ef_.Lookup(c);
+  return RankLessThanCode(c, length_);
 }
 
 void WatArray::Save(ostream& os) const{
-  os.write((const char*)(&alphabet_num_), sizeof(alphabet_num_));
-  os.write((const char*)(&length_), sizeof(length_));
+  uint64_t offset = 0;
+  SaveHeader(os, bit_arrays_.size(), offset);
   for (size_t i = 0; i < bit_arrays_.size(); ++i){
-    bit_arrays_[i].Save(os);
+    bit_arrays_[i].SaveAligned(os, offset);
+  }
+  SaveOccs(os, offset);
+}
+
+void WatArray::SaveHeader(ostream& os, uint64_t level_num, uint64_t& offset) const{
+  WriteValue(os, FORMAT_MAGIC, offset);
+  WriteValue(os, FORMAT_VERSION, offset);
+  WriteValue(os, alphabet_num_, offset);
+  WriteValue(os, length_, offset);
+  WriteValue(os, level_num, offset);
+}
+
+void WatArray::SaveOccs(ostream& os, uint64_t& offset) const{
+  WriteArray(os, occ_sums_.data(), occ_sums_.size(), offset);
+  occ_sums_ef_.SaveAligned(os, offset);
+  WriteArray(os, values_.data(), values_.size(), offset);
+  range_min_index_.SaveAligned(os, offset);
+  range_max_index_.SaveAligned(os, offset);
+  WriteValue(os, moment_sums_.size(), offset);
+  for (size_t i = 0; i < moment_sums_.size(); ++i){
+    moment_sums_[i].SaveAligned(os, offset);
   }
-  occs_.Save(os);
 }
 
 void WatArray::Load(istream& is){
   Clear();
-  is.read((char*)(&alphabet_num_), sizeof(alphabet_num_));
+  uint64_t magic = 0;
+  is.read((char*)(&magic), sizeof(magic));
+  if (magic != FORMAT_MAGIC){
+    // older versions start with alphabet_num
+    LoadLegacy(is, magic);
+    if (is) SetNodeCache();
+    return;
+  }
+
+  uint64_t offset = sizeof(magic);
+  uint64_t version = 0;
+  ReadValue(is, version, offset);
+  if (version < 2 || version > FORMAT_VERSION){
+    is.setstate(ios::failbit);
+    return;
+  }
+  uint64_t level_num = 0;
+  ReadValue(is, alphabet_num_, offset);
+  ReadValue(is, length_, offset);
+  ReadValue(is, level_num, offset);
+  alphabet_bit_num_ = Log2(alphabet_num_);
+  if (!is || level_num != alphabet_bit_num_){
+    Clear();
+    is.setstate(ios::failbit);
+    return;
+  }
+  bit_arrays_.resize(level_num);
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    bit_arrays_[i].LoadAligned(is, offset);
+  }
+  ReadArray(is, occ_sums_, offset);
+  occ_sums_ef_.LoadAligned(is, offset);
+  if (version >= 3){
+    ReadArray(is, values_, offset);
+  }
+  if (version >= 4){
+    range_min_index_.LoadAligned(is, offset);
+    range_max_index_.LoadAligned(is, offset);
+  }
+  if (version >= 5){
+    uint64_t moment_num = 0;
+    ReadValue(is, moment_num, offset);
+    for (uint64_t i = 0; i < moment_num && is; ++i){
+      moment_sums_.push_back(IntVector());
+      moment_sums_.back().LoadAligned(is, offset);
+    }
+  }
+  if (is && !CheckMoments()){
+    Clear();
+    is.setstate(ios::failbit);
+    return;
+  }
+  if (is) SetNodeCache();
+}
+
+int WatArray::Map(const char* filename){
+  Clear();
+  std::shared_ptr<MappedFile> mapped_file(new MappedFile);
+  if (mapped_file->Open(filename) != 0) return -1;
+
+  MapCursor cursor(mapped_file->data(), mapped_file->size());
+  uint64_t magic = 0;
+  uint64_t version = 0;
+  uint64_t level_num = 0;
+  MapValue(cursor, magic);
+  MapValue(cursor, version);
+  MapValue(cursor, alphabet_num_);
+  MapValue(cursor, length_);
+  MapValue(cursor, level_num);
+  alphabet_bit_num_ = Log2(alphabet_num_);
+  if (magic != FORMAT_MAGIC || version < 2 || version > FORMAT_VERSION || 
+      level_num != alphabet_bit_num_){
+    Clear();
+    return -1;
+  }
+  bit_arrays_.resize(level_num);
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    bit_arrays_[i].Map(cursor);
+  }
+  MapArray(cursor, occ_sums_);
+  occ_sums_ef_.Map(cursor);
+  if (version >= 3){
+    MapArray(cursor, values_);
+  }
+  if (version >= 4){
+    range_min_index_.Map(cursor);
+    range_max_index_.Map(cursor);
+  }
+  if (version >= 5){
+    uint64_t moment_num = 0;
+    MapValue(cursor, moment_num);
+    for (uint64_t i = 0; i < moment_num && cursor.ok; ++i){
+      moment_sums_.push_back(IntVector());
+      moment_sums_.back().Map(cursor);
+    }
+  }
+  if (cursor.ok && !CheckMoments()) cursor.ok = false;
+  if (!cursor.ok){
+    Clear();
+    return -1;
+  }
+  mapped_file_ = mapped_file;
+  SetNodeCache();
+  return 0;
+}
+
+void WatArray::BuildLevels(){
+  // older files have no directories; the levels are independent,
+  // so they are built in parallel
+  RunTasks(bit_arrays_.size(), [this](uint64_t level) {
+      bit_arrays_[level].Build();
+    });
+}
+
+uint64_t WatArray::GetThreadNum(uint64_t task_num) const{
+  uint64_t thread_num = thread_num_;
+  if (thread_num == 0){
+    thread_num = std::max<uint64_t>(1, thread::hardware_concurrency());
+  }
+  return std::min<uint64_t>(thread_num, task_num);
+}
+
+void WatArray::RunTasks(uint64_t task_num, const function<void(uint64_t)>& task) const{
+  // the threads take the tasks in order, so the longest ones 
+  // should come first
+  uint64_t thread_num = GetThreadNum(task_num);
+  if (thread_num <= 1){
+    for (uint64_t i = 0; i < task_num; ++i){
+      task(i);
+    }
+    return;
+  }
+  atomic<uint64_t> next_task(0);
+  vector<thread> threads;
+  for (uint64_t t = 0; t < thread_num; ++t){
+    threads.push_back(thread([&next_task, task_num, &task]() {
+	  for (uint64_t i = next_task++; i < task_num; i = next_task++){
+	    task(i);
+	  }
+	}));
+  }
+  for (size_t t = 0; t < threads.size(); ++t){
+    threads[t].join();
+  }
+}
+
+void WatArray::LoadLegacy(istream& is, uint64_t alphabet_num){
+  alphabet_num_     = alphabet_num;
   alphabet_bit_num_ = Log2(alphabet_num_);
   is.read((char*)(&length_), sizeof(length_));
 
-  bit_arrays_.resize(alphabet_bit_num_);
+  bit_arrays_.resize(alphabet_bit_num_, BitArray(0, layout_));
   for (size_t i = 0; i < bit_arrays_.size(); ++i){
-    bit_arrays_[i].Load(is);
-    bit_arrays_[i].Build();
+    bit_arrays_[i].Load(is, false);
+  }
+  BuildLevels();
+
+  BitArray occs;
+  occs.Load(is);
+  if (occs.length() == 0) return;
+  uint64_t c = 0;
+  if (SetOccSums([&](){
+	uint64_t occ_sum = occs.Select(1, c+1) - c;
+	++c;
+	return occ_sum;
+      }) != 0){
+    is.setstate(ios::failbit);
   }
-  occs_.Load(is);
-  occs_.Build();
 }
 
 }
@@ -25,7 +25,13 @@
 #include <stdint.h>
 #include <iostream>
 #include <cassert>
+#include <memory>
+#include <functional>
 #include "bit_array.hpp"
+#include "elias_fano.hpp"
+#include "int_vector.hpp"
+#include "range_min_index.hpp"
+#include "mapped_file.hpp"
 
 namespace wat_array {
 
@@ -36,6 +42,11 @@ namespace wat_array {
  Space: n log_2 k bits 
 
  Support many queries in O(log k) time and constant for n.
+
+ Thread safety: once Init(), Load() or Map() has returned, the const 
+ methods only read the array and may be called concurrently from any 
+ number of threads. The non-const methods, and BitArray::set_cpu_features(), 
+ must not run concurrently with any other call.
  */
 
 struct ListResult{
@@ -62,11 +73,28 @@ public:
   ~WatArray();
 
   /**
-   * Initialize an index from an array
+   * Initialize an index from an array. The values can take all 64 bits 
+   * except NOTFOUND; the working space is two copies of the array 
+   * whatever the alphabet is.
    * @param An array to be initialized
    */
   void Init(const std::vector<uint64_t>& array);
 
+  /**
+   * Initialize an index from a packed array. The working space is two 
+   * packed copies of alphabet_bit_num() bits per value instead of 64, 
+   * unless the alphabet is compacted, which unpacks the array.
+   * @param array An array to be initialized
+   */
+  void Init(const IntVector& array);
+
+  /**
+   * Initialize an index from an array packed into a bit array, 
+   * where the i-th value is ba.GetBits(i * width, width)
+   * @param ba The bit array holding the values
+   * @param width The number of bits of a value
+   * @param length The number of values
+   */
   void Init(const BitArray& ba, uint64_t width, uint64_t length);
 
   /**
@@ -135,12 +163,38 @@ public:
    * @param beg_pos The beginning position of the array (inclusive)
    * @param end_pos The ending position of the array (not inclusive)
    * @return The frequency of characters min_c <= c < max_c in the subarray A[beg_pos .. end_pos)
-             or NOTFOUND if max_c > alphabet_num or end_pos > length
+             or 0 if end_pos > length. max_c larger than alphabet_num counts as alphabet_num.
    */
   uint64_t FreqRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos) const;
 
   /**
-   * Range Max Query
+   * Compute the sum of characters min_c <= c' < max_c in the subarray 
+   * A[beg_pos ... end_pos) in O(log alphabet_num), when the index is 
+   * built with set_moment_num(1) or more. 
+   * @param min_c The smallest character to be examined
+   * @param max_c The upper bound of the character to be examined
+   * @param beg_pos The beginning position of the array (inclusive)
+   * @param end_pos The ending position of the array (not inclusive)
+   * @return The sum modulo 2^64, 0 if end_pos > length, or NOTFOUND if 
+   *         the sums are not built
+   */
+  uint64_t SumRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos) const;
+
+  /**
+   * Compute the sum of the moment-th powers of characters min_c <= c' < max_c 
+   * in the subarray A[beg_pos ... end_pos), as SumRange(). The moment 0 is 
+   * FreqRange(), and the moment 2 gives the variance with the moments 0 and 1.
+   * @param moment The power, at most moment_num() of the index
+   * @return The sum modulo 2^64, 0 if end_pos > length, or NOTFOUND if 
+   *         the moment is not built
+   */
+  uint64_t MomentRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos, 
+		       uint64_t moment) const;
+
+  /**
+   * Range Max Query. It takes constant time and a Lookup() when the 
+   * index is built with set_range_min_max(true), and O(log alphabet_num) 
+   * levels of quantile and select otherwise.
    * @param beg_pos The beginning position
    * @param end_pos The ending position
    * @param pos The position where the largest value appeared in the subarray A[beg_pos .. end_pos)
@@ -150,7 +204,8 @@ public:
   void MaxRange(uint64_t beg_pos, uint64_t end_pos, uint64_t& pos, uint64_t& val) const; 
 
   /**
-   * Range Min Query
+   * Range Min Query, which takes constant time and a Lookup() with 
+   * set_range_min_max(true) as MaxRange()
    * @param beg_pos The beginning position
    * @param end_pos The ending position
    * @param pos The position where the smallest value appeared in the subarray A[beg_pos .. end_pos)
@@ -170,6 +225,64 @@ public:
    */
   void QuantileRange(uint64_t beg_pos, uint64_t end_pos, uint64_t k, uint64_t& pos, uint64_t& val) const; 
 
+  /**
+   * Range Successor Query, Return the smallest value at least x in the subarray
+   * in O(log alphabet_num) with at most one backtrack
+   * @param beg_pos The beginning position
+   * @param end_pos The ending position
+   * @param x The lower bound of the value
+   * @param pos The position where the value appeared in the subarray A[beg_pos .. end_pos)
+                If there are many items having the value, the smallest pos will be reported
+   * @param val The smallest value c >= x in the subarray A[beg_pos ... end_pos),
+                or NOTFOUND (with pos) if there is none or end_pos > length
+   */
+  void RangeNextValue(uint64_t beg_pos, uint64_t end_pos, uint64_t x, uint64_t& pos, uint64_t& val) const;
+
+  /**
+   * Return the smallest value at least x in the subarray as RangeNextValue(), 
+   * without the selects that find its position
+   * @return The smallest value c >= x in the subarray A[beg_pos ... end_pos), or NOTFOUND
+   */
+  uint64_t RangeNextValue(uint64_t beg_pos, uint64_t end_pos, uint64_t x) const;
+
+  /**
+   * Range Predecessor Query, Return the largest value less than x in the subarray
+   * in O(log alphabet_num) with at most one backtrack
+   * @param beg_pos The beginning position
+   * @param end_pos The ending position
+   * @param x The upper bound of the value (not inclusive)
+   * @param pos The position where the value appeared in the subarray A[beg_pos .. end_pos)
+                If there are many items having the value, the smallest pos will be reported
+   * @param val The largest value c < x in the subarray A[beg_pos ... end_pos),
+                or NOTFOUND (with pos) if there is none or end_pos > length
+   */
+  void RangePrevValue(uint64_t beg_pos, uint64_t end_pos, uint64_t x, uint64_t& pos, uint64_t& val) const;
+
+  /**
+   * Return the largest value less than x in the subarray as RangePrevValue(), 
+   * without the selects that find its position
+   * @return The largest value c < x in the subarray A[beg_pos ... end_pos), or NOTFOUND
+   */
+  uint64_t RangePrevValue(uint64_t beg_pos, uint64_t end_pos, uint64_t x) const;
+
+  /**
+   * Batch queries. The i-th result is that of the single query with the
+   * i-th arguments, for i < num. The queries are advanced together one 
+   * level at a time in groups of QUERY_BATCH_SIZE, and the ranks of a 
+   * level are computed by BitArray::RankBatch(), which prefetches the 
+   * lines of the following queries, so that the cache misses of the 
+   * queries overlap instead of waiting for each other.
+   */
+  void LookupBatch(const uint64_t* poses, uint64_t num, uint64_t* vals) const;
+  void RankBatch(const uint64_t* cs, const uint64_t* poses, uint64_t num, 
+		 uint64_t* ranks) const;
+  void FreqRangeBatch(const uint64_t* min_cs, const uint64_t* max_cs, 
+		      const uint64_t* beg_poses, const uint64_t* end_poses, 
+		      uint64_t num, uint64_t* freqs) const;
+  void QuantileRangeBatch(const uint64_t* beg_poses, const uint64_t* end_poses, 
+			  const uint64_t* ks, uint64_t num, 
+			  uint64_t* poses, uint64_t* vals) const;
+
   /**
    * List the distinct characters appeared in A[beg_pos ... end_pos) from most frequent ones
    */
@@ -215,7 +328,8 @@ public:
   uint64_t FreqSum(uint64_t min_c, uint64_t max_c) const;
 
   /**
-   * Return the number of alphabets in the array
+   * Return the number of alphabets in the array, that is the largest 
+   * value + 1 also when the alphabet is compacted
    * @return The number of alphabet in the array
    */
   uint64_t alphabet_num() const;
@@ -227,27 +341,227 @@ public:
   uint64_t length() const;
 
   /**
-   * Save the current status to a stream
+   * Return the memory usage of the index
+   * @return The number of bytes used by the index
+   */
+  uint64_t GetUsageBytes() const;
+
+  /**
+   * Compute the part of GetUsageBytes() taken by the moments 
+   * @return The memory usage of the moments in bytes
+   */
+  uint64_t GetMomentUsageBytes() const;
+
+  /**
+   * Set the layout of the bit arrays used by the following Init() or Load().
+   * The default is BitArray::INTERLEAVED_LAYOUT. BitArray::AUTO_LAYOUT 
+   * compresses only the levels that are nearly all zeros or all ones.
+   * @param layout The layout of the bit arrays
+   */
+  void set_layout(BitArray::Layout layout);
+
+  /**
+   * Return the layout of the bit arrays
+   * @return The layout of the bit arrays
+   */
+  BitArray::Layout layout() const;
+
+  /**
+   * Set whether the following Init() replaces each value by its rank 
+   * among the distinct values, so that the tree has 
+   * log_2(the number of distinct values) levels instead of 
+   * log_2(the largest value). The sorted distinct values are kept in a
+   * dictionary, and every query translates its characters through it, 
+   * so that the results are the same as without compaction. The default 
+   * is false. Loaded or mapped indexes keep the setting they were saved with.
+   * @param compact_alphabet Whether the alphabet is compacted
+   */
+  void set_compact_alphabet(bool compact_alphabet);
+
+  /**
+   * Return whether the following Init() compacts the alphabet
+   * @return Whether the alphabet is compacted
+   */
+  bool compact_alphabet() const;
+
+  /**
+   * Set whether the following Init() builds the indexes of range min and 
+   * max queries, which take about 2.3 bits per value each. MinRange() 
+   * and MaxRange() then find the position in constant time and look up 
+   * its value, instead of descending the levels twice. The default is 
+   * false. Loaded or mapped indexes keep the setting they were saved with.
+   * @param range_min_max Whether the range min and max indexes are built
+   */
+  void set_range_min_max(bool range_min_max);
+
+  /**
+   * Return whether the following Init() builds the range min and max indexes
+   * @return Whether the range min and max indexes are built
+   */
+  bool range_min_max() const;
+
+  /**
+   * Set the number of moments that the following Init() builds for 
+   * SumRange() and MomentRange(). Each moment keeps the prefix sums of 
+   * its powers in the order of every level below the first, packed to 
+   * the w bits of their total, which takes (log_2(alphabet_num) - 1) * w
+   * bits per value as reported by GetMomentUsageBytes(). The default is 
+   * 0. Loaded or mapped indexes 
+   * keep the moments they were saved with.
+   * @param moment_num The number of moments (1 for sums, 2 with squares)
+   */
+  void set_moment_num(uint64_t moment_num);
+
+  /**
+   * Return the number of moments built by the following Init()
+   * @return The number of moments
+   */
+  uint64_t moment_num() const;
+
+  /**
+   * Set the number of threads used by the following Init() and by Load() 
+   * of older files. Each level is built by the threads in parallel over 
+   * chunks of the array, and the index is identical to the one built by 
+   * a single thread. The default is 0, which uses as many threads as the
+   * hardware supports.
+   * @param thread_num The number of threads, or 0 
+   */
+  void set_thread_num(uint64_t thread_num);
+
+  /**
+   * Return the number of threads used to build the index
+   * @return The number of threads, or 0 if it follows the hardware
+   */
+  uint64_t thread_num() const;
+
+  /**
+   * Set the memory budget of the node cache. The cache keeps, for every 
+   * node of the top levels, its beginning and the zeros of its level 
+   * before it, so that the queries there neither rank the boundaries of 
+   * the nodes nor look up the occurrences. As many levels are cached 
+   * as fit in the budget; the default is DEFAULT_NODE_CACHE_BYTES (64KB), 
+   * which covers 11 levels, and 0 disables the cache. The cache is not 
+   * saved; it is rebuilt by Init(), Load(), Map() and this method.
+   * @param bytes The largest size of the cache in bytes
+   */
+  void set_node_cache_bytes(uint64_t bytes);
+
+  /**
+   * Return the memory budget of the node cache
+   * @return The largest size of the cache in bytes
+   */
+  uint64_t node_cache_bytes() const;
+
+  /**
+   * Save the current status to a stream. The bit arrays are saved with 
+   * their rank and select directories in a versioned format where every 
+   * array is aligned to 64 bytes, so that the file can be used by Map().
    * @param os The output stream where the data is saved
    */
   void Save(std::ostream& os) const;
 
   /**
-   * Load the current status from a stream
+   * Load the current status from a stream. Both the current format and 
+   * the format of older versions are accepted. Layouts saved in the 
+   * current format are kept; older files use the layout set by set_layout().
    * @param is The input stream where the status is saved
    */
   void Load(std::istream& is);
 
+  /**
+   * Map a file written by Save() and answer the queries directly from 
+   * the mapping. Nothing is copied or rebuilt, and the pages are shared
+   * among the processes mapping the same file. The mapping is released 
+   * by Clear() or the destructor.
+   * @param filename The name of the file
+   * @return 0 on success, -1 if the file cannot be mapped or is not 
+   *         in the current format
+   */
+  int Map(const char* filename);
+
 private:
-  uint64_t GetAlphabetNum(const std::vector<uint64_t>& array) const;
+  // the builder writes the levels itself, and uses only SetSizes(), 
+  // SaveHeader(), SetOccSums() and SaveOccs()
+  friend class WatArrayBuilder;
+  friend class WatArrayExecutor;
+
+  enum {
+    FORMAT_MAGIC   = 0x5941525241544157LLU, // "WATARRAY"
+    FORMAT_VERSION = 5 // version 2 has no value dictionary, version 3 no range min index, 
+                       // and version 4 no moments
+  };
+
+  enum {
+    BUILD_CHUNK_SIZE = 1 << 20, // a multiple of 64, so that chunks never share a word
+    SHORT_NODE_SIZE  = 64,
+    QUERY_BATCH_SIZE = 256
+  };
+
+  enum {
+    DEFAULT_NODE_CACHE_BYTES = 1 << 16,
+    MAX_NODE_CACHE_LEVEL_NUM = 32
+  };
+
+  int SetSizes(uint64_t alphabet_num, uint64_t length, uint64_t& level_num);
+  void SaveHeader(std::ostream& os, uint64_t level_num, uint64_t& offset) const;
+  void SaveOccs(std::ostream& os, uint64_t& offset) const;
+  void LoadLegacy(std::istream& is, uint64_t alphabet_num);
+  uint64_t LowerCode(uint64_t c) const;
+  uint64_t Decode(uint64_t code) const;
+  void RankAllCode(uint64_t code, uint64_t pos, uint64_t& rank, 
+		   uint64_t& rank_less_than, uint64_t& rank_more_than) const; 
+  uint64_t RankLessThanCode(uint64_t code, uint64_t pos) const;
+  uint64_t MomentRangeCode(uint64_t min_code, uint64_t max_code, uint64_t beg_pos, uint64_t end_pos, 
+			   uint64_t moment) const;
+  uint64_t MomentRangeInNode(uint64_t code, bool less_than, uint64_t level, uint64_t beg_node, 
+			     uint64_t end_node, uint64_t beg_pos, uint64_t end_pos, uint64_t moment) const;
+  uint64_t MomentSum(uint64_t level, uint64_t prefix, uint64_t beg_pos, uint64_t end_pos, 
+		     uint64_t moment) const;
+  static uint64_t Power(uint64_t x, uint64_t moment);
+  bool CheckMoments() const;
+  uint64_t SelectCode(uint64_t code, uint64_t rank) const;
+  void RankAllCodeBatch(const uint64_t* codes, const uint64_t* poses, uint64_t num,
+			uint64_t* ranks, uint64_t* rank_less_thans) const;
+  void BuildLevels();
+  void RunTasks(uint64_t task_num, const std::function<void(uint64_t)>& task) const;
+  uint64_t GetThreadNum(uint64_t task_num) const;
+  template <class Array>
+  void InitPacked(const Array& array, uint64_t length);
+  template <class Array, class CodeArray>
+  void InitCompact(const Array& array);
+  template <class Array, class CodeArray>
+  void SetValues(const Array& array, CodeArray& codes);
+  template <class Array>
+  void SetRangeMinMax(const Array& array);
+  template <class Array>
+  void InitMoments(const Array& array);
+  template <class Array>
+  void SetMomentLevel(const Array& array, uint64_t level);
+  template <class Array>
+  uint64_t GetAlphabetNum(const Array& array, uint64_t length) const;
   uint64_t Log2(uint64_t x) const;
   uint64_t PrefixCode(uint64_t x, uint64_t len, uint64_t total_len) const;
   static uint64_t GetMSB(uint64_t x, uint64_t pos, uint64_t len);
   static uint64_t GetLSB(uint64_t x, uint64_t pos);
-  void SetArray(const std::vector<uint64_t>& array);
-  void SetOccs(const std::vector<uint64_t>& array);
-  void GetBegPoses(const std::vector<uint64_t>& array, uint64_t alpha_bit_num,
-		   std::vector<std::vector<uint64_t> >& beg_poses) const;
+  template <class Array, class WorkArray>
+  void SetArray(const Array& array);
+  template <class Array, class WorkArray>
+  void SetLevel(const Array& array, uint64_t level, WorkArray& next_array);
+  template <class Array, class WorkArray>
+  void PartitionChunk(const Array& array, uint64_t level, uint64_t beg, uint64_t end, 
+		      bool concurrent, WorkArray& next_array) const;
+  template <class Array>
+  uint64_t GetNodeBeg(const Array& array, uint64_t level, uint64_t pos) const;
+  template <class Array>
+  uint64_t GetNodeEnd(const Array& array, uint64_t level, uint64_t pos) const;
+  template <class Array>
+  void SetOccs(const Array& sorted_array);
+  int SetOccSums(const std::function<uint64_t()>& next_occ_sum);
+  uint64_t OccSum(uint64_t c) const;
+  void SetNodeCache();
+  static uint64_t GetNodeCacheOffset(uint64_t level);
+  void GetNodeZeros(uint64_t level, uint64_t prefix, uint64_t beg_node, uint64_t end_node, 
+		    uint64_t& beg_node_zero, uint64_t& end_node_zero) const;
 
   struct QueryOnNode{
     QueryOnNode(uint64_t beg_node, uint64_t end_node, uint64_t beg_pos, uint64_t end_pos, 
@@ -281,6 +595,9 @@ private:
 		 uint64_t num, std::vector<ListResult>& res) const {
     res.clear();
     if (end_pos > length_ || beg_pos >= end_pos) return;
+    min_c = LowerCode(min_c);
+    max_c = LowerCode(max_c);
+    if (min_c >= max_c) return;
     
     std::priority_queue<QueryOnNode, std::vector<QueryOnNode>, Comparator> qons;
     qons.push(QueryOnNode(0, length_, beg_pos, end_pos, 0, 0));
@@ -289,7 +606,7 @@ private:
       QueryOnNode qon = qons.top();
       qons.pop();
       if (qon.depth >= alphabet_bit_num_){
-	res.push_back(ListResult(qon.prefix_char, qon.end_pos - qon.beg_pos));
+	res.push_back(ListResult(Decode(qon.prefix_char), qon.end_pos - qon.beg_pos));
       } else {
 	std::vector<QueryOnNode> next;
 	ExpandNode(min_c, max_c, qon, next);
@@ -301,15 +618,51 @@ private:
   }
  
   bool CheckPrefix(uint64_t prefix, uint64_t depth, uint64_t min_c, uint64_t max_c) const;
+  bool RangeNextCode(uint64_t beg_pos, uint64_t end_pos, uint64_t code, QueryOnNode& leaf) const;
+  bool RangePrevCode(uint64_t beg_pos, uint64_t end_pos, uint64_t code, QueryOnNode& leaf) const;
+  void SplitNode(const QueryOnNode& qon, QueryOnNode& zero, QueryOnNode& one) const;
+  void DescendExtreme(bool largest, QueryOnNode& qon) const;
   void ExpandNode(uint64_t min_c, uint64_t max_c, 
 		  const QueryOnNode& qon, std::vector<QueryOnNode>& next) const;
 
   std::vector<BitArray> bit_arrays_;
-  BitArray occs_;
+
+  // occ_sums_[c] is the number of characters less than c; it is replaced
+  // by occ_sums_ef_ when the alphabet is too large for a plain table, 
+  // and both are empty when the alphabet is larger than the array
+  MappedVector<uint64_t> occ_sums_;
+  EliasFano occ_sums_ef_;
+
+  // the sorted distinct values when the alphabet is compacted, where 
+  // the character of the tree is the index of its value; empty otherwise
+  MappedVector<uint64_t> values_;
+  std::shared_ptr<MappedFile> mapped_file_;
+
+  // the positions of the smallest and the largest values of ranges; 
+  // empty unless range_min_max_ was set at Init()
+  RangeMinIndex range_min_index_;
+  RangeMinIndex range_max_index_;
+
+  // moment_sums_[m-1] is the prefix sums of the m-th powers of the 
+  // values in the order of each level from 1, (length + 1) per level
+  std::vector<IntVector> moment_sums_;
 
   uint64_t alphabet_num_;
   uint64_t alphabet_bit_num_;
   uint64_t length_;
+  BitArray::Layout layout_;
+  bool compact_alphabet_;
+  bool range_min_max_;
+  uint64_t moment_num_;
+  uint64_t thread_num_;
+
+  // the node of prefix p at a cached level begins at node_begs_[o + p], 
+  // and the level has node_zeros_[o + p] zeros before it, where 
+  // o = GetNodeCacheOffset(level); the entry o + 2^level is the end
+  std::vector<uint64_t> node_begs_;
+  std::vector<uint64_t> node_zeros_;
+  uint64_t node_cache_level_num_;
+  uint64_t node_cache_bytes_;
 };
 
 
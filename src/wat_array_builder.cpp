@@ -0,0 +1,373 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <cctype>
+#include <cstdio>
+#include <vector>
+#include <unistd.h>
+#include "wat_array.hpp"
+#include "wat_array_builder.hpp"
+
+using namespace std;
+
+namespace wat_array {
+
+namespace {
+
+/**
+ * Return the bits of val above shift, as WatArray::PrefixCode()
+ */
+uint64_t Prefix(uint64_t val, uint64_t shift){
+  return (shift < 64) ? val >> shift : 0;
+}
+
+}
+
+/**
+ * A temporary file of width-bit values, written and then read 
+ * sequentially through a buffer of BUFFER_WORDNUM words.
+ */
+class WatArrayBuilder::SpillFile {
+public:
+  enum {
+    BUFFER_WORDNUM = 1 << 16
+  };
+
+  SpillFile() : fp_(NULL), width_(64), num_(0), read_num_(0), word_(0), 
+		bit_pos_(0), buffer_pos_(0), failed_(false) {}
+
+  ~SpillFile(){
+    if (fp_ != NULL) fclose(fp_);
+  }
+
+  int Open(const string& dir){
+    string name = dir + "/wat_array_XXXXXX";
+    vector<char> path(name.begin(), name.end());
+    path.push_back('\0');
+    int fd = mkstemp(&path[0]);
+    if (fd < 0) return -1;
+    unlink(&path[0]);
+    fp_ = fdopen(fd, "w+b");
+    if (fp_ == NULL){
+      close(fd);
+      return -1;
+    }
+    return 0;
+  }
+
+  // start writing values of width bits from the beginning
+  void Reset(uint64_t width){
+    if (fp_ != NULL){
+      rewind(fp_);
+      failed_ |= ftruncate(fileno(fp_), 0) != 0;
+    }
+    width_ = width;
+    num_ = 0;
+    read_num_ = 0;
+    word_ = 0;
+    bit_pos_ = 0;
+    buffer_.clear();
+    buffer_pos_ = 0;
+  }
+
+  void Write(uint64_t val){
+    word_ |= val << bit_pos_;
+    if (bit_pos_ + width_ >= 64){
+      PutWord(word_);
+      word_ = (bit_pos_ + width_ > 64) ? val >> (64 - bit_pos_) : 0;
+      bit_pos_ = bit_pos_ + width_ - 64;
+    } else {
+      bit_pos_ += width_;
+    }
+    ++num_;
+  }
+
+  // flush the values written and start reading them
+  int Finish(){
+    if (bit_pos_ > 0) PutWord(word_);
+    FlushBuffer();
+    if (fp_ != NULL){
+      failed_ |= fflush(fp_) != 0;
+      rewind(fp_);
+    }
+    word_ = 0;
+    bit_pos_ = 0;
+    buffer_.clear();
+    buffer_pos_ = 0;
+    return failed_ ? -1 : 0;
+  }
+
+  bool Read(uint64_t& val){
+    if (read_num_ == num_) return false;
+    ++read_num_;
+    if (width_ == 0){
+      val = 0;
+      return true;
+    }
+    if (bit_pos_ == 0) word_ = GetWord();
+    val = word_ >> bit_pos_;
+    if (bit_pos_ + width_ >= 64){
+      uint64_t rest = bit_pos_ + width_ - 64;
+      if (rest > 0){
+	word_ = GetWord();
+	val |= word_ << (64 - bit_pos_);
+      }
+      bit_pos_ = rest;
+    } else {
+      bit_pos_ += width_;
+    }
+    if (width_ < 64) val &= (1LLU << width_) - 1;
+    return true;
+  }
+
+  bool failed() const {
+    return failed_;
+  }
+
+private:
+  void PutWord(uint64_t word){
+    buffer_.push_back(word);
+    if (buffer_.size() == BUFFER_WORDNUM) FlushBuffer();
+  }
+
+  void FlushBuffer(){
+    if (buffer_.empty()) return;
+    if (fp_ == NULL || fwrite(&buffer_[0], sizeof(uint64_t), buffer_.size(), fp_) != buffer_.size()){
+      failed_ = true;
+    }
+    buffer_.clear();
+  }
+
+  uint64_t GetWord(){
+    if (buffer_pos_ == buffer_.size()){
+      buffer_.resize(BUFFER_WORDNUM);
+      size_t num = (fp_ != NULL) ? fread(&buffer_[0], sizeof(uint64_t), BUFFER_WORDNUM, fp_) : 0;
+      buffer_.resize(num);
+      buffer_pos_ = 0;
+      if (num == 0){
+	failed_ = true;
+	return 0;
+      }
+    }
+    return buffer_[buffer_pos_++];
+  }
+
+  FILE* fp_;
+  uint64_t width_;
+  uint64_t num_;
+  uint64_t read_num_;
+  uint64_t word_;
+  uint64_t bit_pos_;
+  vector<uint64_t> buffer_;
+  size_t buffer_pos_;
+  bool failed_;
+};
+
+WatArrayBuilder::WatArrayBuilder() : alphabet_num_(0), length_(0), 
+				     layout_(BitArray::INTERLEAVED_LAYOUT), temp_dir_("/tmp"){
+}
+
+WatArrayBuilder::~WatArrayBuilder(){
+}
+
+void WatArrayBuilder::Reset(){
+  input_.reset();
+  alphabet_num_ = 0;
+  length_ = 0;
+}
+
+int WatArrayBuilder::Add(uint64_t val){
+  if (val == NOTFOUND) return -1;
+  if (!input_){
+    input_.reset(new SpillFile);
+    if (input_->Open(temp_dir_) != 0){
+      input_.reset();
+      return -1;
+    }
+  }
+  input_->Write(val);
+  if (val >= alphabet_num_) alphabet_num_ = val + 1;
+  ++length_;
+  return 0;
+}
+
+int WatArrayBuilder::Build(ostream& os){
+  SpillFile empty;
+  SpillFile& input = input_ ? *input_ : empty;
+  if (input.Finish() != 0){
+    Reset();
+    return -1;
+  }
+
+  // wa holds the sizes and the occurrence table of the index, 
+  // and the levels are written one by one
+  WatArray wa;
+  wa.set_layout(layout_);
+  uint64_t bit_num = 0;
+  if (wa.SetSizes(alphabet_num_, length_, bit_num) != 0){
+    Reset();
+    return -1;
+  }
+  uint64_t offset = 0;
+  wa.SaveHeader(os, bit_num, offset);
+
+  // the zeros and the ones of a level are in level_files[level % 2], 
+  // and those of level 0 are read from the input
+  SpillFile level_files[2][2];
+  for (int i = 0; i < 2; ++i){
+    for (int j = 0; j < 2; ++j){
+      if (bit_num > 0 && level_files[i][j].Open(temp_dir_) != 0){
+	Reset();
+	return -1;
+      }
+    }
+  }
+  SpillFile* zeros = &input;
+  SpillFile* ones  = &empty;
+  BitArray ba;
+  for (uint64_t level = 0; level <= bit_num; ++level){
+    // the order of the level merges the zeros and the ones of 
+    // the previous level by their prefixes, the bits above shift
+    uint64_t shift = bit_num - level;
+    uint64_t zero_val = 0;
+    uint64_t one_val  = 0;
+    bool has_zero = zeros->Read(zero_val);
+    bool has_one  = ones->Read(one_val);
+    auto next_val = [&](uint64_t& val) -> bool {
+      if (has_zero && (!has_one || Prefix(zero_val, shift) < Prefix(one_val, shift))){
+	val = zero_val;
+	has_zero = zeros->Read(zero_val);
+      } else if (has_one){
+	val = one_val;
+	has_one = ones->Read(one_val);
+      } else {
+	return false;
+      }
+      return true;
+    };
+
+    if (level == bit_num){
+      // the last order is sorted, and the occurrence table is 
+      // streamed from it without a vector of alphabet_num + 1 sums
+      uint64_t val = 0;
+      bool has_val = next_val(val);
+      uint64_t c = 0;
+      uint64_t i = 0;
+      int ret = wa.SetOccSums([&](){
+	  for (; has_val && val < c; ++i){
+	    has_val = next_val(val);
+	  }
+	  ++c;
+	  return i;
+	});
+      if (ret != 0 || zeros->failed() || ones->failed()){
+	Reset();
+	return -1;
+      }
+      break;
+    }
+
+    SpillFile* next_files = level_files[level % 2];
+    next_files[0].Reset(bit_num);
+    next_files[1].Reset(bit_num);
+    ba.Init(length_, layout_);
+    for (uint64_t i = 0; i < length_; ++i){
+      uint64_t val = 0;
+      next_val(val);
+      uint64_t bit = (val >> (shift - 1)) & 1LLU;
+      ba.SetBit(bit, i);
+      next_files[bit].Write(val);
+    }
+    if (zeros->failed() || ones->failed()){
+      Reset();
+      return -1;
+    }
+    ba.Build();
+    ba.SaveAligned(os, offset);
+    ba.Clear();
+    if (next_files[0].Finish() != 0 || next_files[1].Finish() != 0){
+      Reset();
+      return -1;
+    }
+    zeros = &next_files[0];
+    ones  = &next_files[1];
+  }
+  wa.SaveOccs(os, offset);
+  Reset();
+  return os ? 0 : -1;
+}
+
+int WatArrayBuilder::Build(istream& is, ostream& os){
+  vector<char> buffer(1 << 20);
+  uint64_t val = 0;
+  bool in_val = false;
+  while (is){
+    is.read(&buffer[0], buffer.size());
+    streamsize num = is.gcount();
+    for (streamsize i = 0; i < num; ++i){
+      char ch = buffer[i];
+      if ('0' <= ch && ch <= '9'){
+	uint64_t d = ch - '0';
+	if (val > (NOTFOUND - d) / 10){
+	  Reset();
+	  return -1;
+	}
+	val = val * 10 + d;
+	in_val = true;
+      } else if (!isspace((unsigned char)ch)){
+	Reset();
+	return -1;
+      } else if (in_val){
+	if (Add(val) != 0){
+	  Reset();
+	  return -1;
+	}
+	val = 0;
+	in_val = false;
+      }
+    }
+  }
+  if (in_val && Add(val) != 0){
+    Reset();
+    return -1;
+  }
+  return Build(os);
+}
+
+uint64_t WatArrayBuilder::length() const {
+  return length_;
+}
+
+void WatArrayBuilder::set_layout(BitArray::Layout layout){
+  layout_ = layout;
+}
+
+BitArray::Layout WatArrayBuilder::layout() const {
+  return layout_;
+}
+
+void WatArrayBuilder::set_temp_dir(const string& temp_dir){
+  temp_dir_ = temp_dir;
+}
+
+const string& WatArrayBuilder::temp_dir() const {
+  return temp_dir_;
+}
+
+}
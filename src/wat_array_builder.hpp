@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#ifndef WAT_ARRAY_WAT_ARRAY_BUILDER_HPP_
+#define WAT_ARRAY_WAT_ARRAY_BUILDER_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <iostream>
+#include <memory>
+#include "bit_array.hpp"
+
+namespace wat_array {
+
+/**
+ * Build the file of a WatArray from an array larger than the memory.
+ *
+ * The values are added one by one and spilled to a temporary file.
+ * Build() then makes one sequential pass per level: the order of a level 
+ * is read by merging the zeros and the ones of the previous level, which 
+ * were written to two temporary files of alphabet_bit_num bits per value. 
+ * Each level is written to the output as soon as it is built, and the 
+ * occurrence table is encoded while the sorted last order is read, so 
+ * that the memory holds a single level or the encoded table, and the 
+ * buffers of the files. 
+ * The output is the same as WatArray::Save() of the same array.
+ */
+class WatArrayBuilder {
+public:
+  WatArrayBuilder();
+  ~WatArrayBuilder();
+
+  /**
+   * Add a value at the end of the array
+   * @param val The value, which must not be NOTFOUND
+   * @return 0 on success, -1 if the value or the temporary file is bad
+   */
+  int Add(uint64_t val);
+
+  /**
+   * Write the index of the values added so far, and start a new array
+   * @param os The output stream where the index is written
+   * @return 0 on success, -1 if a temporary file or the output fails
+   */
+  int Build(std::ostream& os);
+
+  /**
+   * Add the decimal values separated by whitespaces in is, and Build()
+   * @param is The input stream of the values
+   * @param os The output stream where the index is written
+   * @return 0 on success, -1 on failure, on any other character in is, 
+   *         or on a value larger than 2^64-1
+   */
+  int Build(std::istream& is, std::ostream& os);
+
+  /**
+   * Return the number of the values added so far
+   */
+  uint64_t length() const;
+
+  /**
+   * Set the layout of the bit arrays; see WatArray::set_layout()
+   */
+  void set_layout(BitArray::Layout layout);
+  BitArray::Layout layout() const;
+
+  /**
+   * Set the directory of the temporary files. The default is /tmp.
+   * The files are removed as soon as they are created, and take 
+   * 8 bytes per value plus two levels of alphabet_bit_num bits per value.
+   */
+  void set_temp_dir(const std::string& temp_dir);
+  const std::string& temp_dir() const;
+
+private:
+  class SpillFile;
+
+  void Reset();
+
+  std::shared_ptr<SpillFile> input_;
+  uint64_t alphabet_num_;
+  uint64_t length_;
+  BitArray::Layout layout_;
+  std::string temp_dir_;
+};
+
+}
+
+#endif // WAT_ARRAY_WAT_ARRAY_BUILDER_HPP_
@@ -0,0 +1,247 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <algorithm>
+#include "wat_array_executor.hpp"
+
+using namespace std;
+
+namespace wat_array {
+
+WatArrayExecutor::WatArrayExecutor(const WatArray& wa) : wa_(wa), interleave_num_(16){
+}
+
+WatArrayExecutor::~WatArrayExecutor(){
+}
+
+void WatArrayExecutor::Lookup(uint64_t pos, uint64_t* val){
+  if (pos >= wa_.length_){
+    *val = NOTFOUND;
+    return;
+  }
+  Add(LOOKUP, 0, pos, 0, 0, false, val, NULL);
+}
+
+void WatArrayExecutor::Rank(uint64_t c, uint64_t pos, uint64_t* rank){
+  if (c >= wa_.alphabet_num()){
+    *rank = NOTFOUND;
+    return;
+  }
+  uint64_t code = wa_.LowerCode(c);
+  if (!wa_.values_.empty() && wa_.values_[code] != c){
+    // c does not appear
+    *rank = 0;
+    return;
+  }
+  Add(RANK, code, min(pos, wa_.length_), 0, 0, false, rank, NULL);
+}
+
+void WatArrayExecutor::FreqRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos, 
+				 uint64_t* freq){
+  *freq = 0;
+  if (min_c >= wa_.alphabet_num() || max_c <= min_c) return;
+  if (end_pos > wa_.length_ || beg_pos > end_pos) return;
+  if (max_c > wa_.alphabet_num()) max_c = wa_.alphabet_num();
+  uint64_t min_code = wa_.LowerCode(min_c);
+  uint64_t max_code = wa_.LowerCode(max_c);
+  if (max_code == wa_.alphabet_num_){
+    // every value is less than max_code
+    *freq = end_pos - beg_pos;
+  } else {
+    Add(RANK_LESS_THAN, max_code, end_pos, 0, 0, false, freq, NULL);
+    Add(RANK_LESS_THAN, max_code, beg_pos, 0, 0, true,  freq, NULL);
+  }
+  Add(RANK_LESS_THAN, min_code, end_pos, 0, 0, true,  freq, NULL);
+  Add(RANK_LESS_THAN, min_code, beg_pos, 0, 0, false, freq, NULL);
+}
+
+void WatArrayExecutor::QuantileRange(uint64_t beg_pos, uint64_t end_pos, uint64_t k, 
+				     uint64_t* pos, uint64_t* val){
+  if (end_pos > wa_.length_ || beg_pos >= end_pos){
+    *pos = NOTFOUND;
+    *val = NOTFOUND;
+    return;
+  }
+  Add(QUANTILE_RANGE, 0, beg_pos, end_pos, k, false, pos, val);
+}
+
+void WatArrayExecutor::Add(QueryType type, uint64_t code, uint64_t pos, uint64_t end_pos, uint64_t k, 
+			   bool negative, uint64_t* result, uint64_t* val){
+  Query query;
+  query.type     = type;
+  query.negative = negative;
+  query.level    = 0;
+  query.beg_node = 0;
+  query.end_node = wa_.length_;
+  query.pos      = pos;
+  query.end_pos  = end_pos;
+  query.code     = code;
+  query.k        = k;
+  query.rank     = 0;
+  query.result   = result;
+  query.val      = val;
+  queries_.push_back(query);
+}
+
+void WatArrayExecutor::Run(){
+  uint64_t level_num = wa_.bit_arrays_.size();
+  uint64_t next = 0;
+  vector<Query*> active;
+  for (; next < queries_.size() && active.size() < max<uint64_t>(interleave_num_, 1); ++next){
+    if (level_num > 0) Prefetch(queries_[next]);
+    active.push_back(&queries_[next]);
+  }
+
+  while (!active.empty()){
+    for (size_t i = 0; i < active.size(); ){
+      if (level_num > 0 && Step(*active[i])){
+	++i;
+	continue;
+      }
+      // the query has finished, and the next one takes its place
+      Finish(*active[i]);
+      if (next < queries_.size()){
+	active[i] = &queries_[next++];
+	if (level_num > 0) Prefetch(*active[i]);
+	++i;
+      } else {
+	active[i] = active.back();
+	active.pop_back();
+      }
+    }
+  }
+  queries_.clear();
+}
+
+void WatArrayExecutor::Prefetch(const Query& query) const{
+  const BitArray& ba = wa_.bit_arrays_[query.level];
+  ba.Prefetch(query.beg_node);
+  ba.Prefetch(query.end_node);
+  if (query.type == LOOKUP){
+    ba.Prefetch(query.beg_node + query.pos);
+  } else {
+    ba.Prefetch(query.pos);
+  }
+  if (query.type == QUANTILE_RANGE){
+    ba.Prefetch(query.end_pos);
+  }
+}
+
+bool WatArrayExecutor::Step(Query& query) const{
+  // one level of WatArray::Lookup(), RankAllCode() or QuantileRange(), 
+  // with the four ranks of the level computed at once
+  uint64_t level_num = wa_.bit_arrays_.size();
+  const BitArray& ba = wa_.bit_arrays_[query.level];
+  uint64_t poses[4];
+  uint64_t ranks[4];
+  poses[0] = query.beg_node;
+  poses[1] = query.end_node;
+  if (query.type == LOOKUP){
+    poses[2] = query.beg_node + query.pos;
+    poses[3] = poses[2] + 1;
+  } else {
+    poses[2] = query.pos;
+    poses[3] = (query.type == QUANTILE_RANGE) ? query.end_pos : query.pos;
+  }
+  ba.RankBatch(0, poses, 4, ranks);
+  uint64_t beg_node_zero = ranks[0];
+  uint64_t beg_node_one  = query.beg_node - beg_node_zero;
+  uint64_t boundary      = query.beg_node + ranks[1] - beg_node_zero;
+
+  switch (query.type){
+  case LOOKUP: {
+    uint64_t bit = 1 - (ranks[3] - ranks[2]);
+    if (bit){
+      query.pos      = (poses[2] - ranks[2]) - beg_node_one;
+      query.beg_node = boundary;
+    } else {
+      query.pos      = ranks[2] - beg_node_zero;
+      query.end_node = boundary;
+    }
+    query.code = (query.code << 1) | bit;
+    break;
+  }
+  case RANK:
+  case RANK_LESS_THAN: {
+    uint64_t pos_zero = ranks[2];
+    if (!WatArray::GetMSB(query.code, query.level, level_num)){
+      query.pos      = query.beg_node + pos_zero - beg_node_zero;
+      query.end_node = boundary;
+    } else {
+      query.rank    += pos_zero - beg_node_zero;
+      query.pos      = boundary + (query.pos - pos_zero) - beg_node_one;
+      query.beg_node = boundary;
+    }
+    break;
+  }
+  case QUANTILE_RANGE: {
+    uint64_t beg_zero = ranks[2];
+    uint64_t end_zero = ranks[3];
+    if (end_zero - beg_zero > query.k){
+      query.pos      = query.beg_node + beg_zero - beg_node_zero;
+      query.end_pos  = query.beg_node + end_zero - beg_node_zero;
+      query.end_node = boundary;
+      query.code     = query.code << 1;
+    } else {
+      query.pos      = boundary + (query.pos - beg_zero) - beg_node_one;
+      query.end_pos  = boundary + (query.end_pos - end_zero) - beg_node_one;
+      query.beg_node = boundary;
+      query.code     = (query.code << 1) + 1;
+      query.k       -= end_zero - beg_zero;
+    }
+    break;
+  }
+  }
+
+  if (++query.level == level_num) return false;
+  Prefetch(query);
+  return true;
+}
+
+void WatArrayExecutor::Finish(Query& query) const{
+  switch (query.type){
+  case LOOKUP:
+    *query.result = wa_.Decode(query.code);
+    break;
+  case RANK:
+    *query.result = query.pos - query.beg_node;
+    break;
+  case RANK_LESS_THAN:
+    *query.result += query.negative ? -query.rank : query.rank;
+    break;
+  case QUANTILE_RANGE:
+    *query.result = wa_.SelectCode(query.code, query.pos - query.beg_node + 1);
+    *query.val    = wa_.Decode(query.code);
+    break;
+  }
+}
+
+uint64_t WatArrayExecutor::query_num() const{
+  return queries_.size();
+}
+
+void WatArrayExecutor::set_interleave_num(uint64_t interleave_num){
+  interleave_num_ = interleave_num;
+}
+
+uint64_t WatArrayExecutor::interleave_num() const{
+  return interleave_num_;
+}
+
+}
@@ -0,0 +1,120 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#ifndef WAT_ARRAY_WAT_ARRAY_EXECUTOR_HPP_
+#define WAT_ARRAY_WAT_ARRAY_EXECUTOR_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include "wat_array.hpp"
+
+namespace wat_array {
+
+/**
+ * Run independent WatArray queries interleaved with each other.
+ *
+ * The queries are added one by one with the arguments and the places 
+ * of the results of the single-query methods, and Run() executes them. 
+ * Each query is a small state machine that descends one level per step: 
+ * after a step it prefetches the lines that the ranks of the next level 
+ * will read, and the executor switches to the next of interleave_num 
+ * queries in flight, so that the cache misses of the queries overlap 
+ * (asynchronous memory access chaining). The results are the same as 
+ * those of the single-query methods. Queries of different kinds can be 
+ * mixed, and a finished query is replaced by the next one added.
+ *
+ * The WatArray must not change until Run() returns, and the places of 
+ * the results must stay valid until then.
+ */
+class WatArrayExecutor {
+public:
+  explicit WatArrayExecutor(const WatArray& wa);
+  ~WatArrayExecutor();
+
+  /**
+   * Add a query; the result is written to *val (or *rank, ...) by Run()
+   */
+  void Lookup(uint64_t pos, uint64_t* val);
+  void Rank(uint64_t c, uint64_t pos, uint64_t* rank);
+  void FreqRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos, 
+		 uint64_t* freq);
+  void QuantileRange(uint64_t beg_pos, uint64_t end_pos, uint64_t k, 
+		     uint64_t* pos, uint64_t* val);
+
+  /**
+   * Execute the queries added so far, and clear them
+   */
+  void Run();
+
+  /**
+   * Return the number of the queries added and not run yet
+   */
+  uint64_t query_num() const;
+
+  /**
+   * Set the number of the queries in flight. The default is 16; 
+   * a larger number hides more latency until the lines of the queries 
+   * in flight no longer fit in the cache.
+   */
+  void set_interleave_num(uint64_t interleave_num);
+  uint64_t interleave_num() const;
+
+private:
+  enum QueryType {
+    LOOKUP,
+    RANK,
+    RANK_LESS_THAN,
+    QUANTILE_RANGE
+  };
+
+  /**
+   * The state of a query between the levels. LOOKUP descends with pos, 
+   * RANK and RANK_LESS_THAN with pos to code, and QUANTILE_RANGE with 
+   * [pos, end_pos) to the k-th value. RANK_LESS_THAN adds its rank to 
+   * *result, or subtracts it if negative, as FreqRange() sums four ranks.
+   */
+  struct Query {
+    QueryType type;
+    bool negative;
+    uint64_t level;
+    uint64_t beg_node;
+    uint64_t end_node;
+    uint64_t pos;
+    uint64_t end_pos;
+    uint64_t code;
+    uint64_t k;
+    uint64_t rank;
+    uint64_t* result;
+    uint64_t* val;
+  };
+
+  void Add(QueryType type, uint64_t code, uint64_t pos, uint64_t end_pos, uint64_t k, 
+	   bool negative, uint64_t* result, uint64_t* val);
+  void Prefetch(const Query& query) const;
+  bool Step(Query& query) const;
+  void Finish(Query& query) const;
+
+  const WatArray& wa_;
+  std::vector<Query> queries_;
+  uint64_t interleave_num_;
+};
+
+}
+
+#endif // WAT_ARRAY_WAT_ARRAY_EXECUTOR_HPP_
@@ -0,0 +1,159 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <algorithm>
+#include "wat_array_thread_pool.hpp"
+
+using namespace std;
+
+namespace wat_array {
+
+WatArrayThreadPool::WatArrayThreadPool(const WatArray& wa, uint64_t thread_num) : 
+  wa_(wa), generation_(0), pending_task_num_(0), stop_(false), queries_(NULL), results_(NULL){
+  if (thread_num == 0){
+    thread_num = max<uint64_t>(1, thread::hardware_concurrency());
+  }
+  for (uint64_t i = 0; i < thread_num; ++i){
+    workers_.push_back(shared_ptr<Worker>(new Worker(wa)));
+  }
+  for (uint64_t i = 0; i < thread_num; ++i){
+    workers_[i]->thread = thread(&WatArrayThreadPool::Work, this, i);
+  }
+}
+
+WatArrayThreadPool::~WatArrayThreadPool(){
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_cond_.notify_all();
+  for (size_t i = 0; i < workers_.size(); ++i){
+    workers_[i]->thread.join();
+  }
+}
+
+void WatArrayThreadPool::Run(const vector<RangeQuery>& queries, vector<RangeResult>& results){
+  lock_guard<mutex> run_lock(run_mutex_);
+  results.resize(queries.size());
+  if (queries.empty()) return;
+
+  uint64_t task_num = (queries.size() + TASK_QUERY_NUM - 1) / TASK_QUERY_NUM;
+  {
+    lock_guard<mutex> lock(mutex_);
+    queries_ = &queries;
+    results_ = &results;
+    pending_task_num_ = task_num;
+  }
+  // consecutive tasks go to different threads, so that a slow part of 
+  // the batch is shared from the start
+  for (uint64_t i = 0; i < task_num; ++i){
+    Worker& worker = *workers_[i % workers_.size()];
+    uint64_t end = min<uint64_t>(queries.size(), (i + 1) * TASK_QUERY_NUM);
+    lock_guard<mutex> lock(worker.mutex);
+    worker.tasks.push_back(make_pair(i * TASK_QUERY_NUM, end));
+  }
+  {
+    lock_guard<mutex> lock(mutex_);
+    ++generation_;
+  }
+  start_cond_.notify_all();
+
+  unique_lock<mutex> lock(mutex_);
+  while (pending_task_num_ > 0){
+    done_cond_.wait(lock);
+  }
+  queries_ = NULL;
+  results_ = NULL;
+}
+
+uint64_t WatArrayThreadPool::thread_num() const{
+  return workers_.size();
+}
+
+void WatArrayThreadPool::Work(uint64_t worker_ind){
+  uint64_t generation = 0;
+  for (;;){
+    {
+      unique_lock<mutex> lock(mutex_);
+      while (!stop_ && generation == generation_){
+	start_cond_.wait(lock);
+      }
+      if (stop_) return;
+      generation = generation_;
+    }
+
+    pair<uint64_t, uint64_t> task;
+    while (TakeTask(worker_ind, task)){
+      RunTask(*workers_[worker_ind], task.first, task.second);
+      lock_guard<mutex> lock(mutex_);
+      if (--pending_task_num_ == 0){
+	done_cond_.notify_all();
+      }
+    }
+  }
+}
+
+bool WatArrayThreadPool::TakeTask(uint64_t worker_ind, pair<uint64_t, uint64_t>& task){
+  {
+    Worker& worker = *workers_[worker_ind];
+    lock_guard<mutex> lock(worker.mutex);
+    if (!worker.tasks.empty()){
+      task = worker.tasks.back();
+      worker.tasks.pop_back();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < workers_.size(); ++i){
+    Worker& victim = *workers_[(worker_ind + i) % workers_.size()];
+    lock_guard<mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()){
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WatArrayThreadPool::RunTask(Worker& worker, uint64_t beg, uint64_t end){
+  const vector<RangeQuery>& queries = *queries_;
+  vector<RangeResult>& results = *results_;
+  for (uint64_t i = beg; i < end; ++i){
+    const RangeQuery& query = queries[i];
+    RangeResult& result = results[i];
+    result.list.clear();
+    switch (query.type){
+    case RangeQuery::FREQ_RANGE:
+      result.pos = 0;
+      worker.executor.FreqRange(query.min_c, query.max_c, query.beg_pos, query.end_pos, &result.val);
+      break;
+    case RangeQuery::QUANTILE_RANGE:
+      worker.executor.QuantileRange(query.beg_pos, query.end_pos, query.k, &result.pos, &result.val);
+      break;
+    case RangeQuery::LIST_MODE_RANGE:
+      result.pos = 0;
+      result.val = 0;
+      wa_.ListModeRange(query.min_c, query.max_c, query.beg_pos, query.end_pos, query.k, result.list);
+      break;
+    }
+  }
+  worker.executor.Run();
+}
+
+}
@@ -0,0 +1,138 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#ifndef WAT_ARRAY_WAT_ARRAY_THREAD_POOL_HPP_
+#define WAT_ARRAY_WAT_ARRAY_THREAD_POOL_HPP_
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include "wat_array.hpp"
+#include "wat_array_executor.hpp"
+
+namespace wat_array {
+
+/**
+ * A range query of WatArrayThreadPool. k is the order of QUANTILE_RANGE 
+ * and the number of the results of LIST_MODE_RANGE; min_c and max_c are 
+ * not used by QUANTILE_RANGE.
+ */
+struct RangeQuery {
+  enum Type {
+    FREQ_RANGE,
+    QUANTILE_RANGE,
+    LIST_MODE_RANGE
+  };
+
+  RangeQuery() : type(FREQ_RANGE), min_c(0), max_c(0), beg_pos(0), end_pos(0), k(0) {}
+  RangeQuery(Type type, uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos, uint64_t k) :
+    type(type), min_c(min_c), max_c(max_c), beg_pos(beg_pos), end_pos(end_pos), k(k) {}
+
+  Type type;
+  uint64_t min_c;
+  uint64_t max_c;
+  uint64_t beg_pos;
+  uint64_t end_pos;
+  uint64_t k;
+};
+
+/**
+ * The result of a RangeQuery: the frequency of FREQ_RANGE in val, 
+ * the position and the value of QUANTILE_RANGE in pos and val, 
+ * and the list of LIST_MODE_RANGE in list.
+ */
+struct RangeResult {
+  RangeResult() : pos(0), val(0) {}
+  uint64_t pos;
+  uint64_t val;
+  std::vector<ListResult> list;
+};
+
+/**
+ * Run batches of range queries on a WatArray with a pool of threads.
+ *
+ * Run() splits a batch into tasks of TASK_QUERY_NUM queries and deals 
+ * them to the deques of the threads. A thread takes its own tasks from 
+ * the back and steals those of the others from the front when it has 
+ * none left, so that the threads stay busy when the queries differ in 
+ * cost. Each thread keeps a WatArrayExecutor as its scratch buffer, and 
+ * interleaves the FREQ_RANGE and QUANTILE_RANGE queries of a task with it. 
+ * The results are in the order of the queries.
+ *
+ * The threads only call the const methods of the WatArray, which must 
+ * not change while the pool exists. Run() may be called from several 
+ * threads; the batches are run one after another.
+ */
+class WatArrayThreadPool {
+public:
+  /**
+   * Start the threads
+   * @param wa The array of the queries
+   * @param thread_num The number of the threads, or 0 for the number of the cores
+   */
+  explicit WatArrayThreadPool(const WatArray& wa, uint64_t thread_num = 0);
+  ~WatArrayThreadPool();
+
+  /**
+   * Run the queries and store the result of queries[i] to results[i]
+   */
+  void Run(const std::vector<RangeQuery>& queries, std::vector<RangeResult>& results);
+
+  uint64_t thread_num() const;
+
+private:
+  enum {
+    TASK_QUERY_NUM = 64
+  };
+
+  struct Worker {
+    explicit Worker(const WatArray& wa) : executor(wa) {}
+    std::mutex mutex;
+    std::deque<std::pair<uint64_t, uint64_t> > tasks;
+    WatArrayExecutor executor;
+    std::thread thread;
+  };
+
+  WatArrayThreadPool(const WatArrayThreadPool&);
+  WatArrayThreadPool& operator=(const WatArrayThreadPool&);
+
+  void Work(uint64_t worker_ind);
+  bool TakeTask(uint64_t worker_ind, std::pair<uint64_t, uint64_t>& task);
+  void RunTask(Worker& worker, uint64_t beg, uint64_t end);
+
+  const WatArray& wa_;
+  std::vector<std::shared_ptr<Worker> > workers_;
+  std::mutex run_mutex_;
+  std::mutex mutex_;
+  std::condition_variable start_cond_;
+  std::condition_variable done_cond_;
+  uint64_t generation_;
+  uint64_t pending_task_num_;
+  bool stop_;
+  const std::vector<RangeQuery>* queries_;
+  std::vector<RangeResult>* results_;
+};
+
+}
+
+#endif // WAT_ARRAY_WAT_ARRAY_THREAD_POOL_HPP_
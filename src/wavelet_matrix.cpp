@@ -0,0 +1,482 @@
+/* 
+ *  Copyright (c) 2010 Daisuke Okanohara
+ * 
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ * 
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <queue>
+#include <algorithm>
+#include "wavelet_matrix.hpp"
+
+using namespace std;
+
+namespace wat_array {
+
+WaveletMatrix::WaveletMatrix() : alphabet_num_(0), alphabet_bit_num_(0), length_(0), 
+				 layout_(BitArray::INTERLEAVED_LAYOUT){
+}
+  
+WaveletMatrix::~WaveletMatrix() {
+}
+
+void WaveletMatrix::Clear(){
+  vector<BitArray>().swap(bit_arrays_);
+  zero_nums_.Clear();
+  mapped_file_.reset();
+  alphabet_num_ = 0;
+  alphabet_bit_num_ = 0;
+  length_ = 0;
+}
+
+void WaveletMatrix::Init(const vector<uint64_t>& array){
+  Clear();
+  alphabet_num_     = GetAlphabetNum(array);
+  alphabet_bit_num_ = Log2(alphabet_num_);
+
+  length_           = static_cast<uint64_t>(array.size());
+  SetArray(array);
+}
+
+uint64_t WaveletMatrix::Lookup(uint64_t pos) const{
+  if (pos >= length_) return NOTFOUND;
+  uint64_t c = 0;
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    const BitArray& ba = bit_arrays_[i];
+    uint64_t bit = ba.Lookup(pos);
+    c <<= 1;
+    if (bit){
+      pos = zero_nums_[i] + ba.Rank(1, pos);
+      c |= 1LLU;
+    } else {
+      pos = ba.Rank(0, pos);
+    }
+  }
+  return c;	 
+}
+
+uint64_t WaveletMatrix::Rank(uint64_t c, uint64_t pos) const{
+  uint64_t rank_less_than = 0;
+  uint64_t rank_more_than = 0;
+  uint64_t rank           = 0;
+  RankAll(c, pos, rank, rank_less_than, rank_more_than);
+  return rank;
+}
+
+uint64_t WaveletMatrix::RankLessThan(uint64_t c, uint64_t pos) const{
+  if (c == alphabet_num_ && c > 0){
+    return (pos < length_) ? pos : length_;
+  }
+  uint64_t rank_less_than = 0;
+  uint64_t rank_more_than = 0;
+  uint64_t rank           = 0;
+  RankAll(c, pos, rank, rank_less_than, rank_more_than);
+  return rank_less_than;
+}
+
+uint64_t WaveletMatrix::RankMoreThan(uint64_t c, uint64_t pos) const{
+  uint64_t rank_less_than = 0;
+  uint64_t rank_more_than = 0;
+  uint64_t rank           = 0;
+  RankAll(c, pos, rank, rank_less_than, rank_more_than);
+  return rank_more_than;
+}
+
+void WaveletMatrix::RankAll(uint64_t c, uint64_t pos,
+			    uint64_t& rank,  uint64_t& rank_less_than, uint64_t& rank_more_than) const{
+  if (c >= alphabet_num_) {
+    rank_less_than = NOTFOUND;
+    rank_more_than = NOTFOUND;
+    rank           = NOTFOUND;
+    return;
+  }
+  if (pos >= length_) {
+    pos = length_;
+  }
+  // [beg_pos, pos) is the range of A[0...pos) having the same prefix as c
+  uint64_t beg_pos = 0;
+  rank_less_than = 0;
+  rank_more_than = 0;
+
+  for (size_t i = 0; i < bit_arrays_.size() && beg_pos < pos; ++i){
+    const BitArray& ba = bit_arrays_[i];
+    uint64_t beg_zero = ba.Rank(0, beg_pos);
+    uint64_t end_zero = ba.Rank(0, pos);
+    uint64_t beg_one  = beg_pos - beg_zero;
+    uint64_t end_one  = pos - end_zero;
+    if (!GetMSB(c, i, bit_arrays_.size())){
+      rank_more_than += end_one - beg_one;
+      beg_pos = beg_zero;
+      pos     = end_zero;
+    } else {
+      rank_less_than += end_zero - beg_zero;
+      beg_pos = zero_nums_[i] + beg_one;
+      pos     = zero_nums_[i] + end_one;
+    }
+  }
+  rank = pos - beg_pos;
+}
+
+uint64_t WaveletMatrix::Select(uint64_t c, uint64_t rank) const{
+  if (c >= alphabet_num_) {
+    return NOTFOUND;
+  }
+  uint64_t beg_pos = 0;
+  uint64_t end_pos = length_;
+  Descend(c, beg_pos, end_pos);
+  if (rank == 0 || rank > end_pos - beg_pos){
+    return NOTFOUND;
+  }
+  return Ascend(c, beg_pos + rank - 1);
+}
+
+uint64_t WaveletMatrix::FreqRange(uint64_t min_c, uint64_t max_c, uint64_t begin_pos, uint64_t end_pos) const{
+  if (min_c >= alphabet_num_) return 0;
+  if (max_c <= min_c) return 0;
+  if (end_pos > length_ || begin_pos > end_pos) return 0;
+  if (max_c > alphabet_num_) max_c = alphabet_num_;
+  return 
+    + RankLessThan(max_c, end_pos)
+    - RankLessThan(min_c, end_pos)
+    - RankLessThan(max_c, begin_pos)
+    + RankLessThan(min_c, begin_pos);
+}
+
+void WaveletMatrix::MaxRange(uint64_t begin_pos, uint64_t end_pos, uint64_t& pos, uint64_t& val) const {
+  QuantileRange(begin_pos, end_pos, end_pos - begin_pos - 1, pos, val);
+} 
+
+void WaveletMatrix::MinRange(uint64_t begin_pos, uint64_t end_pos, uint64_t& pos, uint64_t& val) const {
+  QuantileRange(begin_pos, end_pos, 0,  pos, val);
+}
+
+void WaveletMatrix::QuantileRange(uint64_t begin_pos, uint64_t end_pos, uint64_t k, uint64_t& pos, uint64_t& val) const {
+  if (end_pos > length_ || begin_pos >= end_pos) {
+    pos = NOTFOUND;
+    val = NOTFOUND;
+    return;
+  }
+  
+  val = 0;
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    const BitArray& ba = bit_arrays_[i];
+    uint64_t beg_zero  = ba.Rank(0, begin_pos);
+    uint64_t end_zero  = ba.Rank(0, end_pos);
+    
+    if (end_zero - beg_zero > k){ 
+      begin_pos = beg_zero;
+      end_pos   = end_zero;
+      val       = val << 1;
+    } else {
+      k -= end_zero - beg_zero;
+      begin_pos = zero_nums_[i] + begin_pos - beg_zero;
+      end_pos   = zero_nums_[i] + end_pos   - end_zero;
+      val       = (val << 1) + 1;
+    }
+  }
+
+  // the occurrences of val are kept in the original order at the 
+  // last level, so begin_pos is the first one in the range
+  pos = Ascend(val, begin_pos);
+}
+
+class WaveletMatrix::ListModeComparator{
+public:
+  ListModeComparator() {}
+  bool operator() (const QueryOnNode& lhs, 
+		   const QueryOnNode& rhs) const {
+    if (lhs.end_pos - lhs.beg_pos != rhs.end_pos - rhs.beg_pos) {
+      return lhs.end_pos - lhs.beg_pos < rhs.end_pos - rhs.beg_pos;
+    } else if (lhs.depth != rhs.depth) {
+      return lhs.depth < rhs.depth;
+    } else {
+      return lhs.prefix_char > rhs.prefix_char;
+    } 
+  }
+};
+
+class WaveletMatrix::ListMinComparator{
+public:
+  ListMinComparator() {}
+  bool operator() (const QueryOnNode& lhs, 
+		   const QueryOnNode& rhs) const {
+    if (lhs.depth != rhs.depth) 
+      return lhs.depth < rhs.depth;
+    else return lhs.prefix_char > rhs.prefix_char;
+  }
+};
+
+class WaveletMatrix::ListMaxComparator{
+public:
+  ListMaxComparator() {}
+  bool operator() (const QueryOnNode& lhs, 
+		   const QueryOnNode& rhs) const {
+    if (lhs.depth != rhs.depth) 
+      return lhs.depth < rhs.depth;
+    else return lhs.prefix_char < rhs.prefix_char;
+  }
+};
+
+void WaveletMatrix::ListModeRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos,
+				  uint64_t num, vector<ListResult>& res) const {
+  ListRange<ListModeComparator>(min_c, max_c, beg_pos, end_pos, num, res);
+}
+
+void WaveletMatrix::ListMinRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos,
+				 uint64_t num, vector<ListResult>& res) const {
+  ListRange<ListMinComparator>(min_c, max_c, beg_pos, end_pos, num, res);
+}
+
+void WaveletMatrix::ListMaxRange(uint64_t min_c, uint64_t max_c, uint64_t beg_pos, uint64_t end_pos,
+				 uint64_t num, vector<ListResult>& res) const {
+  ListRange<ListMaxComparator>(min_c, max_c, beg_pos, end_pos, num, res);
+}
+
+bool WaveletMatrix::CheckPrefix(uint64_t prefix, uint64_t depth, uint64_t min_c, uint64_t max_c) const {
+  if (PrefixCode(min_c,   depth, alphabet_bit_num_) <= prefix &&
+      PrefixCode(max_c-1, depth, alphabet_bit_num_) >= prefix) return true;
+  else return false;
+}
+
+void WaveletMatrix::ExpandNode(uint64_t min_c, uint64_t max_c, 
+			       const QueryOnNode& qon, vector<QueryOnNode>& next) const{
+  const BitArray& ba = bit_arrays_[qon.depth];
+  
+  uint64_t beg_zero  = ba.Rank(0, qon.beg_pos);
+  uint64_t end_zero  = ba.Rank(0, qon.end_pos);
+  uint64_t beg_one   = qon.beg_pos - beg_zero;
+  uint64_t end_one   = qon.end_pos - end_zero;
+  if (end_zero - beg_zero > 0){ // child for zero 
+    uint64_t next_prefix = qon.prefix_char << 1;
+    if (CheckPrefix(next_prefix, qon.depth+1, min_c, max_c)) {
+      next.push_back(QueryOnNode(beg_zero,
+				 end_zero,
+				 qon.depth+1,
+				 next_prefix));
+    }
+  }
+  if (end_one - beg_one > 0){ // child for one
+    uint64_t next_prefix = (qon.prefix_char << 1) + 1;
+    if (CheckPrefix(next_prefix, qon.depth+1, min_c, max_c)) {
+      next.push_back(QueryOnNode(zero_nums_[qon.depth] + beg_one,
+				 zero_nums_[qon.depth] + end_one,
+				 qon.depth+1,
+				 next_prefix));
+    }
+  } 
+}
+
+uint64_t WaveletMatrix::Freq(uint64_t c) const {
+  if (c >= alphabet_num_) return NOTFOUND;
+  uint64_t beg_pos = 0;
+  uint64_t end_pos = length_;
+  Descend(c, beg_pos, end_pos);
+  return end_pos - beg_pos;
+}
+
+uint64_t WaveletMatrix::FreqSum(uint64_t min_c, uint64_t max_c) const {
+  if (max_c > alphabet_num_ || min_c > max_c ) return NOTFOUND;
+  if (min_c == max_c) return 0;
+  return RankLessThan(max_c, length_) - RankLessThan(min_c, length_);
+}
+
+uint64_t WaveletMatrix::alphabet_num() const{
+  return alphabet_num_;
+}
+
+uint64_t WaveletMatrix::length() const{
+  return length_;
+}
+
+uint64_t WaveletMatrix::GetUsageBytes() const{
+  uint64_t bytes = sizeof(*this) + sizeof(uint64_t) * zero_nums_.size();
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    bytes += bit_arrays_[i].GetUsageBytes();
+  }
+  return bytes;
+}
+
+void WaveletMatrix::set_layout(BitArray::Layout layout){
+  layout_ = layout;
+}
+
+BitArray::Layout WaveletMatrix::layout() const{
+  return layout_;
+}
+
+uint64_t WaveletMatrix::GetAlphabetNum(const std::vector<uint64_t>& array) const {
+  uint64_t alphabet_num = 0;
+  for (size_t i = 0; i < array.size(); ++i){
+    if (array[i] >= alphabet_num){
+      alphabet_num = array[i]+1;
+    }
+  }
+  return alphabet_num;
+}
+
+uint64_t WaveletMatrix::Log2(uint64_t x) const{
+  if (x == 0) return 0;
+  x--;
+  uint64_t bit_num = 0;
+  while (x >> bit_num){
+    ++bit_num;
+  }
+  return bit_num;
+}
+
+uint64_t WaveletMatrix::PrefixCode(uint64_t x, uint64_t len, uint64_t bit_num) const{
+  return x >> (bit_num - len);
+}
+
+uint64_t WaveletMatrix::GetMSB(uint64_t x, uint64_t pos, uint64_t len) {
+  return (x >> (len - (pos + 1))) & 1LLU;
+}
+
+void WaveletMatrix::Descend(uint64_t c, uint64_t& beg_pos, uint64_t& end_pos) const{
+  for (size_t i = 0; i < bit_arrays_.size() && beg_pos < end_pos; ++i){
+    const BitArray& ba = bit_arrays_[i];
+    if (!GetMSB(c, i, bit_arrays_.size())){
+      beg_pos = ba.Rank(0, beg_pos);
+      end_pos = ba.Rank(0, end_pos);
+    } else {
+      beg_pos = zero_nums_[i] + ba.Rank(1, beg_pos);
+      end_pos = zero_nums_[i] + ba.Rank(1, end_pos);
+    }
+  }
+}
+
+uint64_t WaveletMatrix::Ascend(uint64_t c, uint64_t pos) const{
+  for (size_t i = bit_arrays_.size(); i > 0; --i){
+    const BitArray& ba = bit_arrays_[i-1];
+    if (!GetMSB(c, i-1, bit_arrays_.size())){
+      pos = ba.Select(0, pos + 1);
+    } else {
+      pos = ba.Select(1, pos - zero_nums_[i-1] + 1);
+    }
+  }
+  return pos;
+}
+
+void WaveletMatrix::SetArray(const vector<uint64_t>& array) {
+  if (alphabet_num_ == 0) return;
+  bit_arrays_.resize(alphabet_bit_num_, BitArray(length_, layout_));
+  zero_nums_.resize(alphabet_bit_num_);
+
+  // each level stably moves the values having 0 at the bit 
+  // before those having 1 for the next level
+  vector<uint64_t> cur(array);
+  vector<uint64_t> next(length_);
+  for (uint64_t i = 0; i < alphabet_bit_num_; ++i){
+    BitArray& ba = bit_arrays_[i];
+    uint64_t zero_num = 0;
+    for (size_t j = 0; j < cur.size(); ++j){
+      if (GetMSB(cur[j], i, alphabet_bit_num_)){
+	ba.SetBit(1, j);
+      } else {
+	++zero_num;
+      }
+    }
+    ba.Build();
+    zero_nums_[i] = zero_num;
+
+    uint64_t zero_pos = 0;
+    uint64_t one_pos  = zero_num;
+    for (size_t j = 0; j < cur.size(); ++j){
+      if (GetMSB(cur[j], i, alphabet_bit_num_)){
+	next[one_pos++] = cur[j];
+      } else {
+	next[zero_pos++] = cur[j];
+      }
+    }
+    cur.swap(next);
+  }
+}
+
+void WaveletMatrix::Save(ostream& os) const{
+  uint64_t offset = 0;
+  WriteValue(os, FORMAT_MAGIC, offset);
+  WriteValue(os, FORMAT_VERSION, offset);
+  WriteValue(os, alphabet_num_, offset);
+  WriteValue(os, length_, offset);
+  WriteValue(os, bit_arrays_.size(), offset);
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    bit_arrays_[i].SaveAligned(os, offset);
+  }
+  WriteArray(os, zero_nums_.data(), zero_nums_.size(), offset);
+}
+
+void WaveletMatrix::Load(istream& is){
+  Clear();
+  uint64_t offset = 0;
+  uint64_t magic = 0;
+  uint64_t version = 0;
+  uint64_t level_num = 0;
+  ReadValue(is, magic, offset);
+  ReadValue(is, version, offset);
+  ReadValue(is, alphabet_num_, offset);
+  ReadValue(is, length_, offset);
+  ReadValue(is, level_num, offset);
+  alphabet_bit_num_ = Log2(alphabet_num_);
+  if (!is || magic != FORMAT_MAGIC || version != FORMAT_VERSION || 
+      level_num != alphabet_bit_num_){
+    Clear();
+    is.setstate(ios::failbit);
+    return;
+  }
+  bit_arrays_.resize(level_num);
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    bit_arrays_[i].LoadAligned(is, offset);
+  }
+  ReadArray(is, zero_nums_, offset);
+  if (!is || zero_nums_.size() != level_num){
+    Clear();
+    is.setstate(ios::failbit);
+  }
+}
+
+int WaveletMatrix::Map(const char* filename){
+  Clear();
+  std::shared_ptr<MappedFile> mapped_file(new MappedFile);
+  if (mapped_file->Open(filename) != 0) return -1;
+
+  MapCursor cursor(mapped_file->data(), mapped_file->size());
+  uint64_t magic = 0;
+  uint64_t version = 0;
+  uint64_t level_num = 0;
+  MapValue(cursor, magic);
+  MapValue(cursor, version);
+  MapValue(cursor, alphabet_num_);
+  MapValue(cursor, length_);
+  MapValue(cursor, level_num);
+  alphabet_bit_num_ = Log2(alphabet_num_);
+  if (magic != FORMAT_MAGIC || version != FORMAT_VERSION || 
+      level_num != alphabet_bit_num_){
+    Clear();
+    return -1;
+  }
+  bit_arrays_.resize(level_num);
+  for (size_t i = 0; i < bit_arrays_.size(); ++i){
+    bit_arrays_[i].Map(cursor);
+  }
+  MapArray(cursor, zero_nums_);
+  if (!cursor.ok || zero_nums_.size() != level_num){
+    Clear();
+    return -1;
+  }
+  mapped_file_ = mapped_file;
+  return 0;
+}
+
+}
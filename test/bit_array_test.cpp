@@ -114,3 +114,310 @@ TEST(bitvec, random){
     sum += B[i];
   }
 }
+
+TEST(bitvec, random_separate){
+  const int N = 100000;
+  BitArray ba(N, BitArray::SEPARATE_LAYOUT);
+  vector<int> B;
+  for (int i = 0; i < N; ++i){
+    int b = rand() % 2;
+    ba.SetBit(b, i);
+    B.push_back(b);
+  }
+  
+  ba.Build();
+  ASSERT_EQ(BitArray::SEPARATE_LAYOUT, ba.layout());
+  ASSERT_EQ(N, ba.length());
+  int sum = 0;
+  for (size_t i = 0; i < ba.length(); ++i){
+    ASSERT_EQ(B[i], ba.Lookup(i));
+    if (B[i]){
+      ASSERT_EQ(sum, ba.Rank(1, i));
+      EXPECT_EQ(i,   ba.Select(1, sum+1));
+    } else {
+      ASSERT_EQ(i - sum, ba.Rank(0, i));
+      EXPECT_EQ(i,       ba.Select(0, i-sum+1));
+    }
+    sum += B[i];
+  }
+  ASSERT_EQ(sum, ba.Rank(1, N));
+}
+
+TEST(bitvec, layout_save){
+  const int N = 10000;
+  BitArray ba(N, BitArray::INTERLEAVED_LAYOUT);
+  for (int i = 0; i < N; ++i){
+    if (rand() % 3 == 0) ba.SetBit(1, i);
+  }
+  ba.Build();
+
+  ostringstream oss;
+  ba.Save(oss);
+  istringstream iss(oss.str());
+  BitArray ba_load(0, BitArray::SEPARATE_LAYOUT);
+  ba_load.Load(iss);
+  ASSERT_EQ(false, !iss);
+
+  ASSERT_EQ(ba.length(),  ba_load.length());
+  ASSERT_EQ(ba.one_num(), ba_load.one_num());
+  for (int i = 0; i <= N; ++i){
+    ASSERT_EQ(ba.Rank(1, i), ba_load.Rank(1, i));
+  }
+  for (uint64_t i = 1; i <= ba.one_num(); ++i){
+    ASSERT_EQ(ba.Select(1, i), ba_load.Select(1, i));
+  }
+}
+
+TEST(bitvec, select_samples){
+  const uint64_t N = 1000000;
+  for (int layout = 0; layout < 2; ++layout){
+    BitArray ba(N, static_cast<BitArray::Layout>(layout));
+    vector<uint64_t> ones;
+    vector<uint64_t> zeros;
+    for (uint64_t i = 0; i < N; ++i){
+      if (rand() % 100 == 0){
+	ba.SetBit(1, i);
+	ones.push_back(i);
+      } else {
+	zeros.push_back(i);
+      }
+    }
+    ba.Build();
+    ASSERT_LT(ba.GetSelectIndexBytes(), ba.GetUsageBytes());
+    for (uint64_t i = 0; i < ones.size(); ++i){
+      ASSERT_EQ(ones[i], ba.Select(1, i+1));
+    }
+    for (uint64_t i = 0; i < zeros.size(); ++i){
+      ASSERT_EQ(zeros[i], ba.Select(0, i+1));
+    }
+    ASSERT_EQ(NOTFOUND, ba.Select(1, 0));
+    ASSERT_EQ(NOTFOUND, ba.Select(1, ones.size()+1));
+    ASSERT_EQ(NOTFOUND, ba.Select(0, zeros.size()+1));
+  }
+}
+
+TEST(bitvec, cpu_features){
+  uint64_t features = BitArray::cpu_features();
+  for (uint64_t i = 0; i < 100000; ++i){
+    uint64_t x = ((uint64_t)rand() << 32) ^ rand();
+    if (x == 0) continue;
+    uint64_t rank = rand() % BitArray::PopCount(x) + 1;
+    BitArray::set_cpu_features(0);
+    uint64_t portable_num = BitArray::PopCount(x);
+    uint64_t portable_pos = BitArray::SelectInBlock(x, rank);
+    BitArray::set_cpu_features(features);
+    ASSERT_EQ(portable_num, BitArray::PopCount(x));
+    ASSERT_EQ(portable_pos, BitArray::SelectInBlock(x, rank));
+  }
+
+  const uint64_t N = 100000;
+  BitArray ba(N);
+  for (uint64_t i = 0; i < N; ++i){
+    ba.SetBit(rand() % 2, i);
+  }
+  ba.Build();
+  vector<uint64_t> ranks;
+  for (uint64_t i = 0; i <= N; ++i){
+    ranks.push_back(ba.Rank(1, i));
+  }
+  BitArray::set_cpu_features(0);
+  ASSERT_EQ(0, BitArray::cpu_features());
+  for (uint64_t i = 0; i <= N; ++i){
+    ASSERT_EQ(ranks[i], ba.Rank(1, i));
+  }
+  BitArray::set_cpu_features(features);
+  ASSERT_EQ(features, BitArray::cpu_features());
+}
+
+TEST(bitvec, compressed_layouts){
+  const uint64_t N = 100000;
+  BitArray::Layout layouts[] = {BitArray::RRR_LAYOUT, BitArray::AUTO_LAYOUT};
+  for (int l = 0; l < 2; ++l){
+    for (int ratio = 2; ratio <= 2000; ratio *= 1000){
+      BitArray ba(N, layouts[l]);
+      vector<uint64_t> B;
+      for (uint64_t i = 0; i < N; ++i){
+	uint64_t b = (rand() % ratio == 0) ? 1 : 0;
+	ba.SetBit(b, i);
+	B.push_back(b);
+      }
+      ba.Build();
+      ba.Build();
+      ASSERT_EQ(layouts[l], ba.layout());
+      uint64_t sum = 0;
+      for (uint64_t i = 0; i < N; ++i){
+	ASSERT_EQ(B[i], ba.Lookup(i));
+	ASSERT_EQ(sum, ba.Rank(1, i));
+	if (B[i]){
+	  ASSERT_EQ(i, ba.Select(1, sum+1));
+	} else {
+	  ASSERT_EQ(i, ba.Select(0, i-sum+1));
+	}
+	sum += B[i];
+      }
+      ASSERT_EQ(sum, ba.one_num());
+
+      ostringstream oss;
+      ba.Save(oss);
+      istringstream iss(oss.str());
+      BitArray ba_load(0, BitArray::INTERLEAVED_LAYOUT);
+      ba_load.Load(iss);
+      ASSERT_EQ(sum, ba_load.one_num());
+      for (uint64_t i = 0; i <= N; i += 7){
+	ASSERT_EQ(ba.Rank(1, i), ba_load.Rank(1, i));
+      }
+    }
+  }
+
+  BitArray sparse(N, BitArray::AUTO_LAYOUT);
+  BitArray plain(N, BitArray::INTERLEAVED_LAYOUT);
+  for (uint64_t i = 0; i < N; i += 1000){
+    sparse.SetBit(1, i);
+    plain.SetBit(1, i);
+  }
+  sparse.Build();
+  plain.Build();
+  ASSERT_LT(sparse.GetUsageBytes() * 2, plain.GetUsageBytes());
+}
+
+TEST(bitvec, get_bits){
+  BitArray::Layout layouts[] = {BitArray::SEPARATE_LAYOUT, BitArray::INTERLEAVED_LAYOUT, 
+				BitArray::RRR_LAYOUT};
+  uint64_t n = 10000;
+  for (int l = 0; l < 3; ++l){
+    BitArray ba(n, layouts[l]);
+    vector<uint64_t> bits;
+    for (uint64_t i = 0; i < n; ++i){
+      uint64_t bit = rand() % 3 == 0;
+      bits.push_back(bit);
+      ba.SetBit(bit, i);
+    }
+    ba.Build();
+    for (uint64_t iter = 0; iter < 1000; ++iter){
+      uint64_t len = rand() % 65;
+      uint64_t pos = rand() % (n - len + 1);
+      uint64_t expected = 0;
+      for (uint64_t i = 0; i < len; ++i){
+	expected |= bits[pos + i] << i;
+      }
+      ASSERT_EQ(expected, ba.GetBits(pos, len));
+    }
+  }
+}
+
+TEST(bitvec, rank_batch){
+  const uint64_t N = 100000;
+  uint64_t features = BitArray::cpu_features();
+  for (int layout = 0; layout < 3; ++layout){
+    BitArray ba(N, static_cast<BitArray::Layout>(layout));
+    for (uint64_t i = 0; i < N; ++i){
+      if (rand() % 5 == 0) ba.SetBit(1, i);
+    }
+    ba.Build();
+
+    vector<uint64_t> poses;
+    for (uint64_t i = 0; i < 1003; ++i){
+      poses.push_back(rand() % (N + 1));
+    }
+    poses.push_back(N);
+    poses.push_back(N + 1);
+    for (uint64_t f = 0; f < 2; ++f){
+      BitArray::set_cpu_features(f ? features : 0);
+      for (uint64_t bit = 0; bit < 2; ++bit){
+	vector<uint64_t> ranks(poses.size());
+	ba.RankBatch(bit, &poses[0], poses.size(), &ranks[0]);
+	for (uint64_t i = 0; i < poses.size(); ++i){
+	  ASSERT_EQ(ba.Rank(bit, poses[i]), ranks[i]);
+	}
+      }
+    }
+    BitArray::set_cpu_features(features);
+  }
+}
+
+TEST(bitvec, save_aligned){
+  const uint64_t N = 100000;
+  for (int layout = 0; layout < 4; ++layout){
+    BitArray ba(N, static_cast<BitArray::Layout>(layout));
+    for (uint64_t i = 0; i < N; ++i){
+      if (rand() % 50 == 0) ba.SetBit(1, i);
+    }
+    ba.Build();
+
+    ostringstream oss;
+    uint64_t offset = 0;
+    ba.SaveAligned(oss, offset);
+    ASSERT_EQ(oss.str().size(), offset);
+
+    istringstream iss(oss.str());
+    uint64_t load_offset = 0;
+    BitArray ba_load;
+    ba_load.LoadAligned(iss, load_offset);
+    ASSERT_EQ(false, !iss);
+    ASSERT_EQ(offset, load_offset);
+
+    // map from a 64-byte aligned copy of the record
+    string record = oss.str();
+    vector<uint64_t> aligned((record.size() + 127) / 8);
+    char* base = (char*)(&aligned[0]);
+    base += GetPaddingBytes((uintptr_t)base);
+    copy(record.begin(), record.end(), base);
+    MapCursor cursor(base, record.size());
+    BitArray ba_map;
+    ba_map.Map(cursor);
+    ASSERT_TRUE(cursor.ok);
+    ASSERT_EQ(offset, cursor.offset);
+
+    ASSERT_EQ(ba.layout(),  ba_load.layout());
+    ASSERT_EQ(ba.one_num(), ba_map.one_num());
+    for (uint64_t i = 0; i <= N; i += 3){
+      ASSERT_EQ(ba.Rank(1, i), ba_load.Rank(1, i));
+      ASSERT_EQ(ba.Rank(1, i), ba_map.Rank(1, i));
+    }
+    for (uint64_t i = 1; i <= ba.one_num(); ++i){
+      ASSERT_EQ(ba.Select(1, i), ba_map.Select(1, i));
+    }
+
+    MapCursor short_cursor(base, record.size() - 1);
+    BitArray ba_short;
+    ba_short.Map(short_cursor);
+    ASSERT_FALSE(short_cursor.ok);
+  }
+}
+
+TEST(bitvec, load_legacy){
+  // older versions write the length and the raw blocks
+  const uint64_t N = 10000;
+  vector<uint64_t> blocks((N + 63) / 64);
+  for (uint64_t i = 0; i < N; ++i){
+    if (rand() % 3 == 0) blocks[i / 64] |= 1LLU << (i % 64);
+  }
+  ostringstream oss;
+  oss.write((const char*)(&N), sizeof(N));
+  oss.write((const char*)(&blocks[0]), sizeof(blocks[0]) * blocks.size());
+
+  for (int layout = 0; layout < 4; ++layout){
+    istringstream iss(oss.str());
+    BitArray ba(0, static_cast<BitArray::Layout>(layout));
+    ba.Load(iss);
+    ASSERT_EQ(false, !iss);
+    ASSERT_EQ(N, ba.length());
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < N; ++i){
+      uint64_t bit = (blocks[i / 64] >> (i % 64)) & 1LLU;
+      ASSERT_EQ(bit, ba.Lookup(i));
+      ASSERT_EQ(sum, ba.Rank(1, i));
+      sum += bit;
+    }
+
+    // the new format keeps the directories and the layout
+    ostringstream oss_new;
+    ba.Save(oss_new);
+    istringstream iss_new(oss_new.str());
+    BitArray ba_new;
+    ba_new.Load(iss_new, false);
+    ASSERT_EQ(ba.layout(), ba_new.layout());
+    ASSERT_EQ(sum, ba_new.one_num());
+    ASSERT_EQ(sum, ba_new.Rank(1, N));
+  }
+}
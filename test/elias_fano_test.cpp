@@ -0,0 +1,82 @@
+/* 
+ *  Copyright (c) 2010 Daisuke Okanohara
+  * 
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ * 
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <string>
+#include <sstream>
+#include "../src/elias_fano.hpp"
+
+using namespace std;
+using namespace wat_array;
+
+TEST(elias_fano, trivial){
+  EliasFano ef;
+  vector<uint64_t> vals;
+  ef.Init(vals);
+  ASSERT_EQ(0, ef.length());
+  ASSERT_EQ(NOTFOUND, ef.Lookup(0));
+
+  ostringstream oss;
+  ef.Save(oss);
+  istringstream iss(oss.str());
+  EliasFano ef_load;
+  ef_load.Load(iss);
+  ASSERT_EQ(false, !iss);
+  ASSERT_EQ(0, ef_load.length());
+}
+
+TEST(elias_fano, random){
+  uint64_t gaps[] = {1, 3, 100, 100000};
+  for (int g = 0; g < 4; ++g){
+    vector<uint64_t> vals;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < 10000; ++i){
+      sum += rand() % gaps[g];
+      vals.push_back(sum);
+    }
+    EliasFano ef;
+    ef.Init(vals);
+    ASSERT_EQ(vals.size(), ef.length());
+    for (uint64_t i = 0; i < vals.size(); ++i){
+      ASSERT_EQ(vals[i], ef.Lookup(i));
+    }
+    ASSERT_EQ(NOTFOUND, ef.Lookup(vals.size()));
+
+    ostringstream oss;
+    ef.Save(oss);
+    istringstream iss(oss.str());
+    EliasFano ef_load;
+    ef_load.Load(iss);
+    ASSERT_EQ(false, !iss);
+    for (uint64_t i = 0; i < vals.size(); ++i){
+      ASSERT_EQ(vals[i], ef_load.Lookup(i));
+    }
+  }
+}
+
+TEST(elias_fano, compress){
+  vector<uint64_t> vals;
+  for (uint64_t i = 0; i < 100000; ++i){
+    vals.push_back(i * 1000 + rand() % 1000);
+  }
+  EliasFano ef;
+  ef.Init(vals);
+  ASSERT_LT(ef.GetUsageBytes() * 2, sizeof(uint64_t) * vals.size());
+}
@@ -0,0 +1,155 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+#include <gtest/gtest.h>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include "../src/geo_index.hpp"
+
+using namespace std;
+using namespace wat_array;
+
+namespace {
+
+bool Inside(uint64_t x, uint64_t y, uint64_t min_x, uint64_t max_x, uint64_t min_y, uint64_t max_y){
+  return min_x <= x && x < max_x && min_y <= y && y < max_y;
+}
+
+// the ids of the points in the rectangle by scanning all of them
+void NaiveReport(const vector<uint64_t>& xs, const vector<uint64_t>& ys,
+		 uint64_t min_x, uint64_t max_x, uint64_t min_y, uint64_t max_y, 
+		 vector<uint64_t>& ids){
+  ids.clear();
+  for (uint64_t i = 0; i < xs.size(); ++i){
+    if (Inside(xs[i], ys[i], min_x, max_x, min_y, max_y)) ids.push_back(i);
+  }
+}
+
+void CheckReport(const GeoIndex& gi, const vector<uint64_t>& xs, const vector<uint64_t>& ys,
+		 uint64_t min_x, uint64_t max_x, uint64_t min_y, uint64_t max_y){
+  vector<uint64_t> expected;
+  NaiveReport(xs, ys, min_x, max_x, min_y, max_y, expected);
+  ASSERT_EQ(expected.size(), gi.Count(min_x, max_x, min_y, max_y));
+
+  vector<GeoPoint> res;
+  gi.Report(min_x, max_x, min_y, max_y, res);
+  ASSERT_EQ(expected.size(), res.size());
+  vector<uint64_t> ids;
+  for (size_t i = 0; i < res.size(); ++i){
+    ASSERT_EQ(xs[res[i].id], res[i].x);
+    ASSERT_EQ(ys[res[i].id], res[i].y);
+    if (i > 0){
+      ASSERT_TRUE(res[i-1].y < res[i].y || 
+		  (res[i-1].y == res[i].y && res[i-1].x <= res[i].x));
+    }
+    ids.push_back(res[i].id);
+  }
+  sort(ids.begin(), ids.end());
+  ASSERT_EQ(expected, ids);
+}
+
+}
+
+TEST(geo_index, trivial){
+  GeoIndex gi;
+  vector<uint64_t> xs;
+  vector<uint64_t> ys;
+  ASSERT_EQ(0, gi.Init(xs, ys));
+  ASSERT_EQ(0, gi.length());
+  ASSERT_EQ(0, gi.Count(0, 100, 0, 100));
+  vector<GeoPoint> res;
+  gi.Report(0, 100, 0, 100, res);
+  ASSERT_EQ(0, res.size());
+
+  xs.push_back(3);
+  ASSERT_EQ(-1, gi.Init(xs, ys));
+  ASSERT_EQ(0, gi.length());
+  ys.push_back(5);
+  ASSERT_EQ(0, gi.Init(xs, ys));
+  ASSERT_EQ(1, gi.length());
+  ASSERT_EQ(1, gi.Count(3, 4, 5, 6));
+  ASSERT_EQ(0, gi.Count(3, 4, 6, 7));
+  ASSERT_EQ(0, gi.Count(4, 3, 0, 10));
+  gi.Report(0, 10, 0, 10, res);
+  ASSERT_EQ(1, res.size());
+  ASSERT_EQ(3, res[0].x);
+  ASSERT_EQ(5, res[0].y);
+  ASSERT_EQ(0, res[0].id);
+}
+
+TEST(geo_index, random){
+  // small coordinates, so that many points share an x or a y
+  for (uint64_t iter = 0; iter < 10; ++iter){
+    uint64_t n = 1 + rand() % 1000;
+    uint64_t width = 2 + rand() % 100;
+    vector<uint64_t> xs;
+    vector<uint64_t> ys;
+    for (uint64_t i = 0; i < n; ++i){
+      xs.push_back(rand() % width);
+      ys.push_back(rand() % width * 1000);
+    }
+    GeoIndex gi;
+    ASSERT_EQ(0, gi.Init(xs, ys));
+    ASSERT_EQ(n, gi.length());
+    for (uint64_t q = 0; q < 200; ++q){
+      uint64_t min_x = rand() % (width + 1);
+      uint64_t max_x = rand() % (width + 1);
+      uint64_t min_y = rand() % (width * 1000 + 1);
+      uint64_t max_y = rand() % (width * 1000 + 1);
+      CheckReport(gi, xs, ys, min_x, max_x, min_y, max_y);
+      CheckReport(gi, xs, ys, min(min_x, max_x), max(min_x, max_x) + 1, 
+		  min(min_y, max_y), max(min_y, max_y) + 1);
+    }
+    CheckReport(gi, xs, ys, 0, NOTFOUND, 0, NOTFOUND);
+  }
+}
+
+TEST(geo_index, save_load){
+  vector<uint64_t> xs;
+  vector<uint64_t> ys;
+  for (uint64_t i = 0; i < 1000; ++i){
+    xs.push_back(rand() % 3600000000LLU);
+    ys.push_back(rand() % 1800000000LLU);
+  }
+  GeoIndex gi;
+  ASSERT_EQ(0, gi.Init(xs, ys));
+
+  ostringstream os;
+  gi.Save(os);
+  istringstream is(os.str());
+  GeoIndex gi_load;
+  gi_load.Load(is);
+  ASSERT_TRUE(is);
+  ASSERT_EQ(gi.length(), gi_load.length());
+  ASSERT_EQ(gi.GetUsageBytes(), gi_load.GetUsageBytes());
+  for (uint64_t q = 0; q < 100; ++q){
+    uint64_t min_x = rand() % 3600000000LLU;
+    uint64_t min_y = rand() % 1800000000LLU;
+    uint64_t max_x = min_x + rand() % 1000000000LLU;
+    uint64_t max_y = min_y + rand() % 500000000LLU;
+    CheckReport(gi_load, xs, ys, min_x, max_x, min_y, max_y);
+  }
+
+  istringstream is_bad(string("WATARRAY") + os.str());
+  GeoIndex gi_bad;
+  gi_bad.Load(is_bad);
+  ASSERT_FALSE(is_bad);
+  ASSERT_EQ(0, gi_bad.length());
+}
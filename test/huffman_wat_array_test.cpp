@@ -0,0 +1,262 @@
+/* 
+ *  Copyright (c) 2010 Daisuke Okanohara
+  * 
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ * 
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <unistd.h>
+#include "../src/huffman_wat_array.hpp"
+
+using namespace std;
+
+namespace {
+
+// log-uniform values, small ones are frequent
+void SkewedArray(uint64_t n, uint64_t alphabet_num, vector<uint64_t>& array){
+  array.clear();
+  for (uint64_t i = 0; i < n; ++i){
+    double r = (double)rand() / ((double)RAND_MAX + 1.0);
+    array.push_back((uint64_t)(pow((double)alphabet_num, r)) - 1);
+  }
+}
+
+}
+
+TEST(huffman_wat_array, trivial){
+  wat_array::HuffmanWatArray wa;
+  ASSERT_EQ(0, wa.alphabet_num());
+  ASSERT_EQ(0, wa.length());
+  ASSERT_EQ(wat_array::NOTFOUND, wa.Rank(0, 0));
+  ASSERT_EQ(wat_array::NOTFOUND, wa.Select(0, 0));
+  ASSERT_EQ(wat_array::NOTFOUND, wa.Lookup(0));
+  ASSERT_EQ(wat_array::NOTFOUND, wa.Freq(0));
+  ASSERT_EQ(wat_array::NOTFOUND, wa.FreqSum(0, 1));
+
+  ostringstream oss;
+  wa.Save(oss);
+  istringstream iss(oss.str());
+  wat_array::HuffmanWatArray wa_load;
+  wa_load.Load(iss);
+  ASSERT_EQ(false, !iss);
+  ASSERT_EQ(0, wa_load.length());
+}
+
+TEST(huffman_wat_array, alphanum_one){
+  vector<uint64_t> A(5, 3);
+  wat_array::HuffmanWatArray wa;
+  wa.Init(A);
+  ASSERT_EQ(5, wa.length());
+  ASSERT_EQ(4, wa.alphabet_num());
+  ASSERT_EQ(5, wa.Freq(3));
+  ASSERT_EQ(0, wa.Freq(0));
+  ASSERT_EQ(5, wa.FreqSum(0, 4));
+  for (uint64_t i = 0; i < wa.length(); ++i){
+    ASSERT_EQ(3, wa.Lookup(i));
+    ASSERT_EQ(i, wa.Rank(3, i));
+    ASSERT_EQ(0, wa.Rank(1, i));
+    ASSERT_EQ(i, wa.RankLessThan(4, i));
+    ASSERT_EQ(i, wa.Select(3, i+1));
+    uint64_t pos = 0;
+    uint64_t val = 0;
+    wa.MinRange(i, wa.length(), pos, val);
+    ASSERT_EQ(i, pos);
+    ASSERT_EQ(3, val);
+  }
+  ASSERT_EQ(wat_array::NOTFOUND, wa.Select(1, 1));
+}
+
+TEST(huffman_wat_array, entropy){
+  vector<uint64_t> A;
+  SkewedArray(100000, 1000, A);
+  wat_array::WatArray wa;
+  wa.Init(A);
+  wat_array::HuffmanWatArray hwa;
+  hwa.Init(A);
+
+  vector<uint64_t> counts(hwa.alphabet_num());
+  for (size_t i = 0; i < A.size(); ++i){
+    counts[A[i]]++;
+  }
+  double h0 = 0.0;
+  for (size_t c = 0; c < counts.size(); ++c){
+    if (counts[c] == 0) continue;
+    double p = (double)counts[c] / A.size();
+    h0 -= p * log2(p);
+  }
+  ASSERT_LT(hwa.GetUsageBytes(), wa.GetUsageBytes());
+  // the codes take less than n (H0 + 1) bits, plus the bit array 
+  // directories and the code tables of 17 bytes per distinct value
+  ASSERT_LT(hwa.GetUsageBytes() * 8, (h0 + 1.0) * A.size() * 1.5 + 17 * 8 * counts.size());
+}
+
+TEST(huffman_wat_array, same_as_wat_array){
+  wat_array::BitArray::Layout layouts[] = {wat_array::BitArray::INTERLEAVED_LAYOUT,
+					   wat_array::BitArray::SEPARATE_LAYOUT,
+					   wat_array::BitArray::RRR_LAYOUT};
+  for (int l = 0; l < 3; ++l){
+    uint64_t n = 3000;
+    vector<uint64_t> A;
+    SkewedArray(n, (l == 0) ? 100 : 1000, A);
+    wat_array::WatArray wa;
+    wa.Init(A);
+    wat_array::HuffmanWatArray hwa;
+    hwa.set_layout(layouts[l]);
+    hwa.Init(A);
+    ASSERT_EQ(wa.alphabet_num(), hwa.alphabet_num());
+    ASSERT_EQ(wa.length(), hwa.length());
+
+    for (uint64_t i = 0; i < n; ++i){
+      ASSERT_EQ(A[i], hwa.Lookup(i));
+    }
+    for (uint64_t c = 0; c < wa.alphabet_num(); ++c){
+      ASSERT_EQ(wa.Freq(c), hwa.Freq(c));
+      for (uint64_t rank = 1; rank <= wa.Freq(c) + 1; ++rank){
+	ASSERT_EQ(wa.Select(c, rank), hwa.Select(c, rank));
+      }
+    }
+
+    for (uint64_t iter = 0; iter < 300; ++iter){
+      uint64_t c   = rand() % (wa.alphabet_num() + 1);
+      uint64_t pos = rand() % (n + 1);
+      uint64_t rank, rank_less_than, rank_more_than;
+      uint64_t hwa_rank, hwa_rank_less_than, hwa_rank_more_than;
+      wa.RankAll(c, pos, rank, rank_less_than, rank_more_than);
+      hwa.RankAll(c, pos, hwa_rank, hwa_rank_less_than, hwa_rank_more_than);
+      ASSERT_EQ(rank, hwa_rank);
+      ASSERT_EQ(rank_less_than, hwa_rank_less_than);
+      ASSERT_EQ(rank_more_than, hwa_rank_more_than);
+      ASSERT_EQ(wa.RankLessThan(c, pos), hwa.RankLessThan(c, pos));
+
+      uint64_t beg = rand() % n;
+      uint64_t end = beg + 1 + rand() % (n - beg);
+      uint64_t min_c = rand() % wa.alphabet_num();
+      uint64_t max_c = min_c + 1 + rand() % (wa.alphabet_num() - min_c);
+      ASSERT_EQ(wa.FreqRange(min_c, max_c, beg, end), hwa.FreqRange(min_c, max_c, beg, end));
+      ASSERT_EQ(wa.FreqSum(min_c, max_c), hwa.FreqSum(min_c, max_c));
+
+      uint64_t k = rand() % (end - beg);
+      uint64_t wa_pos, wa_val, hwa_pos, hwa_val;
+      wa.QuantileRange(beg, end, k, wa_pos, wa_val);
+      hwa.QuantileRange(beg, end, k, hwa_pos, hwa_val);
+      ASSERT_EQ(wa_pos, hwa_pos);
+      ASSERT_EQ(wa_val, hwa_val);
+      wa.MaxRange(beg, end, wa_pos, wa_val);
+      hwa.MaxRange(beg, end, hwa_pos, hwa_val);
+      ASSERT_EQ(wa_pos, hwa_pos);
+      ASSERT_EQ(wa_val, hwa_val);
+
+      uint64_t num = rand() % 10 + 1;
+      vector<wat_array::ListResult> wa_lrs, hwa_lrs;
+      wa.ListMinRange(min_c, max_c, beg, end, num, wa_lrs);
+      hwa.ListMinRange(min_c, max_c, beg, end, num, hwa_lrs);
+      ASSERT_EQ(wa_lrs.size(), hwa_lrs.size());
+      for (size_t i = 0; i < wa_lrs.size(); ++i){
+	ASSERT_EQ(wa_lrs[i].c,    hwa_lrs[i].c);
+	ASSERT_EQ(wa_lrs[i].freq, hwa_lrs[i].freq);
+      }
+      wa.ListMaxRange(min_c, max_c, beg, end, num, wa_lrs);
+      hwa.ListMaxRange(min_c, max_c, beg, end, num, hwa_lrs);
+      ASSERT_EQ(wa_lrs.size(), hwa_lrs.size());
+      for (size_t i = 0; i < wa_lrs.size(); ++i){
+	ASSERT_EQ(wa_lrs[i].c,    hwa_lrs[i].c);
+	ASSERT_EQ(wa_lrs[i].freq, hwa_lrs[i].freq);
+      }
+      // the ties of the frequencies may be listed in another order
+      wa.ListModeRange(min_c, max_c, beg, end, num, wa_lrs);
+      hwa.ListModeRange(min_c, max_c, beg, end, num, hwa_lrs);
+      ASSERT_EQ(wa_lrs.size(), hwa_lrs.size());
+      for (size_t i = 0; i < hwa_lrs.size(); ++i){
+	ASSERT_EQ(wa_lrs[i].freq, hwa_lrs[i].freq);
+	ASSERT_LE(min_c, hwa_lrs[i].c);
+	ASSERT_GT(max_c, hwa_lrs[i].c);
+	ASSERT_EQ(hwa_lrs[i].freq, hwa.Rank(hwa_lrs[i].c, end) - hwa.Rank(hwa_lrs[i].c, beg));
+      }
+    }
+  }
+}
+
+TEST(huffman_wat_array, wide_alphabet){
+  // the code tables take memory of the distinct values, not of the alphabet
+  vector<uint64_t> A;
+  A.push_back(3);
+  A.push_back(1LLU << 40);
+  A.push_back(5);
+  for (uint64_t i = 0; i < 1000; ++i){
+    A.push_back((i % 3) ? 5 : ((uint64_t)rand() << 20 ^ rand()) % (1LLU << 40));
+  }
+  wat_array::WatArray wa;
+  wa.Init(A);
+  wat_array::HuffmanWatArray hwa;
+  hwa.Init(A);
+  ASSERT_EQ(wa.alphabet_num(), hwa.alphabet_num());
+  ASSERT_GT(20000, hwa.GetUsageBytes());
+  for (uint64_t i = 0; i < A.size(); ++i){
+    ASSERT_EQ(A[i], hwa.Lookup(i));
+    ASSERT_EQ(wa.Rank(A[i], i), hwa.Rank(A[i], i));
+    ASSERT_EQ(wa.Rank(A[i] + 1, i), hwa.Rank(A[i] + 1, i));
+    ASSERT_EQ(wa.RankLessThan(A[i], i), hwa.RankLessThan(A[i], i));
+    ASSERT_EQ(wa.Freq(A[i]), hwa.Freq(A[i]));
+    ASSERT_EQ(wa.Select(A[i], 1), hwa.Select(A[i], 1));
+    ASSERT_EQ(wa.Select(A[i] + 1, 1), hwa.Select(A[i] + 1, 1));
+  }
+}
+
+TEST(huffman_wat_array, map){
+  vector<uint64_t> A;
+  SkewedArray(10000, 1000, A);
+  wat_array::HuffmanWatArray wa;
+  wa.Init(A);
+
+  char filename[] = "/tmp/huffman_wat_array_test_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_LE(0, fd);
+  close(fd);
+  {
+    ofstream ofs(filename, ios::binary);
+    wa.Save(ofs);
+    ASSERT_EQ(false, !ofs);
+  }
+
+  wat_array::HuffmanWatArray wa_map;
+  ASSERT_EQ(0, wa_map.Map(filename));
+  ifstream ifs(filename, ios::binary);
+  wat_array::HuffmanWatArray wa_load;
+  wa_load.Load(ifs);
+  ASSERT_EQ(false, !ifs);
+  for (uint64_t iter = 0; iter < 1000; ++iter){
+    uint64_t c   = rand() % wa.alphabet_num();
+    uint64_t pos = rand() % A.size();
+    ASSERT_EQ(A[pos], wa_map.Lookup(pos));
+    ASSERT_EQ(A[pos], wa_load.Lookup(pos));
+    ASSERT_EQ(wa.Rank(c, pos), wa_map.Rank(c, pos));
+    ASSERT_EQ(wa.RankLessThan(c, pos), wa_load.RankLessThan(c, pos));
+  }
+
+  wat_array::WatArray other;
+  other.Init(A);
+  {
+    ofstream ofs(filename, ios::binary);
+    other.Save(ofs);
+  }
+  ASSERT_EQ(-1, wa_map.Map(filename));
+  ASSERT_EQ(0, wa_map.length());
+  remove(filename);
+}
@@ -0,0 +1,98 @@
+/* 
+ *  Copyright (c) 2010 Daisuke Okanohara
+  * 
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ * 
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+#include <gtest/gtest.h>
+#include <vector>
+#include <sstream>
+#include "../src/int_vector.hpp"
+
+using namespace std;
+using namespace wat_array;
+
+TEST(int_vector, trivial){
+  IntVector iv;
+  ASSERT_EQ(0, iv.width());
+  ASSERT_EQ(0, iv.length());
+  iv.Init(7, 0);
+  ASSERT_EQ(7, iv.width());
+  ASSERT_EQ(0, iv.length());
+}
+
+TEST(int_vector, random){
+  for (uint64_t width = 0; width <= 64; ++width){
+    uint64_t mask = (width < 64) ? (1LLU << width) - 1 : ~0LLU;
+    uint64_t n = 1000;
+    vector<uint64_t> vals;
+    IntVector iv(width, n);
+    IntVector iv_concurrent(width, n);
+    IntVector iv_zeroed(width, n);
+    for (uint64_t i = 0; i < n; ++i){
+      uint64_t val = ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand();
+      vals.push_back(val & mask);
+      iv.Set(i, val);
+      iv_concurrent.SetConcurrent(i, val);
+      iv_zeroed.SetZeroed(i, val);
+    }
+    ASSERT_EQ(width, iv.width());
+    ASSERT_EQ(n, iv.length());
+    ASSERT_LE(iv.GetUsageBytes(), sizeof(iv) + (width * n / 64 + 2) * sizeof(uint64_t));
+    for (uint64_t i = 0; i < n; ++i){
+      ASSERT_EQ(vals[i], iv.Get(i));
+      ASSERT_EQ(vals[i], iv_concurrent[i]);
+      ASSERT_EQ(vals[i], iv_zeroed[i]);
+    }
+
+    // overwrite every other integer
+    for (uint64_t i = 0; i < n; i += 2){
+      vals[i] = (vals[i] * 7 + 3) & mask;
+      iv.Set(i, vals[i]);
+    }
+    for (uint64_t i = 0; i < n; ++i){
+      ASSERT_EQ(vals[i], iv.Get(i));
+    }
+
+    iv.Init(width, n);
+    for (uint64_t i = 0; i < n; ++i){
+      ASSERT_EQ(0, iv.Get(i));
+    }
+  }
+}
+
+TEST(int_vector, save_load){
+  for (uint64_t width = 0; width <= 64; width += 7){
+    uint64_t n = 1000;
+    IntVector iv(width, n);
+    for (uint64_t i = 0; i < n; ++i){
+      iv.Set(i, ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand());
+    }
+    ostringstream oss;
+    uint64_t offset = 0;
+    iv.SaveAligned(oss, offset);
+    ASSERT_EQ(oss.str().size(), offset);
+    istringstream iss(oss.str());
+    IntVector iv_load;
+    offset = 0;
+    iv_load.LoadAligned(iss, offset);
+    ASSERT_EQ(false, !iss);
+    ASSERT_EQ(width, iv_load.width());
+    ASSERT_EQ(n, iv_load.length());
+    for (uint64_t i = 0; i < n; ++i){
+      ASSERT_EQ(iv.Get(i), iv_load.Get(i));
+    }
+  }
+}
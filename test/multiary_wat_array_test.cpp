@@ -0,0 +1,209 @@
+/* 
+ *  Copyright (c) 2010 Daisuke Okanohara
+  * 
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ * 
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <unistd.h>
+#include "../src/multiary_wat_array.hpp"
+
+using namespace std;
+
+TEST(multiary_wat_array, trivial){
+  wat_array::MultiaryWatArray wa;
+  ASSERT_EQ(0, wa.alphabet_num());
+  ASSERT_EQ(0, wa.length());
+  ASSERT_EQ(wat_array::NOTFOUND, wa.Rank(0, 0));
+  ASSERT_EQ(wat_array::NOTFOUND, wa.Select(0, 0));
+  ASSERT_EQ(wat_array::NOTFOUND, wa.Lookup(0));
+  ASSERT_EQ(wat_array::NOTFOUND, wa.Freq(0));
+  ASSERT_EQ(wat_array::NOTFOUND, wa.FreqSum(0, 1));
+
+  ostringstream oss;
+  wa.Save(oss);
+  istringstream iss(oss.str());
+  wat_array::MultiaryWatArray wa_load;
+  wa_load.Load(iss);
+  ASSERT_EQ(false, !iss);
+  ASSERT_EQ(0, wa_load.length());
+}
+
+TEST(multiary_wat_array, same_as_wat_array){
+  // alphabets whose bit numbers are and are not multiples of the digits
+  uint64_t alphabet_nums[] = {1, 5, 100, 1000, 70000};
+  uint64_t bit_nums[] = {2, 4};
+  for (int b = 0; b < 2; ++b){
+    for (int a = 0; a < 5; ++a){
+      uint64_t n = 3000;
+      vector<uint64_t> A;
+      for (uint64_t i = 0; i < n; ++i){
+	A.push_back(rand() % alphabet_nums[a]);
+      }
+      wat_array::WatArray wa;
+      wa.Init(A);
+      wat_array::MultiaryWatArray mwa;
+      mwa.set_symbol_bit_num(bit_nums[b]);
+      mwa.Init(A);
+      ASSERT_EQ(bit_nums[b], mwa.symbol_bit_num());
+      ASSERT_EQ(wa.alphabet_num(), mwa.alphabet_num());
+      ASSERT_EQ(wa.length(), mwa.length());
+
+      for (uint64_t i = 0; i < n; ++i){
+	ASSERT_EQ(A[i], mwa.Lookup(i));
+      }
+      for (uint64_t iter = 0; iter < 300; ++iter){
+	uint64_t c   = rand() % (wa.alphabet_num() + 1);
+	uint64_t pos = rand() % (n + 1);
+	uint64_t rank, rank_less_than, rank_more_than;
+	uint64_t mwa_rank, mwa_rank_less_than, mwa_rank_more_than;
+	wa.RankAll(c, pos, rank, rank_less_than, rank_more_than);
+	mwa.RankAll(c, pos, mwa_rank, mwa_rank_less_than, mwa_rank_more_than);
+	ASSERT_EQ(rank, mwa_rank);
+	ASSERT_EQ(rank_less_than, mwa_rank_less_than);
+	ASSERT_EQ(rank_more_than, mwa_rank_more_than);
+	ASSERT_EQ(wa.RankLessThan(c, pos), mwa.RankLessThan(c, pos));
+	if (c < wa.alphabet_num()){
+	  ASSERT_EQ(wa.Freq(c), mwa.Freq(c));
+	  uint64_t rank = rand() % (wa.Freq(c) + 1) + 1;
+	  ASSERT_EQ(wa.Select(c, rank), mwa.Select(c, rank));
+	}
+
+	uint64_t beg = rand() % n;
+	uint64_t end = beg + 1 + rand() % (n - beg);
+	uint64_t min_c = rand() % wa.alphabet_num();
+	uint64_t max_c = min_c + 1 + rand() % (wa.alphabet_num() - min_c);
+	// FreqRange also takes characters beyond the alphabet
+	uint64_t wide_max_c = min_c + 1 + rand() % (wa.alphabet_num() - min_c + 10);
+	ASSERT_EQ(wa.FreqRange(min_c, wide_max_c, beg, end), mwa.FreqRange(min_c, wide_max_c, beg, end));
+	ASSERT_EQ(wa.FreqRange(min_c, max_c, beg, end), mwa.FreqRange(min_c, max_c, beg, end));
+	ASSERT_EQ(wa.FreqSum(min_c, max_c), mwa.FreqSum(min_c, max_c));
+
+	uint64_t k = rand() % (end - beg);
+	uint64_t wa_pos, wa_val, mwa_pos, mwa_val;
+	wa.QuantileRange(beg, end, k, wa_pos, wa_val);
+	mwa.QuantileRange(beg, end, k, mwa_pos, mwa_val);
+	ASSERT_EQ(wa_pos, mwa_pos);
+	ASSERT_EQ(wa_val, mwa_val);
+	wa.MaxRange(beg, end, wa_pos, wa_val);
+	mwa.MaxRange(beg, end, mwa_pos, mwa_val);
+	ASSERT_EQ(wa_pos, mwa_pos);
+	ASSERT_EQ(wa_val, mwa_val);
+
+	uint64_t num = rand() % 10 + 1;
+	vector<wat_array::ListResult> wa_lrs, mwa_lrs;
+	wa.ListMinRange(min_c, max_c, beg, end, num, wa_lrs);
+	mwa.ListMinRange(min_c, max_c, beg, end, num, mwa_lrs);
+	ASSERT_EQ(wa_lrs.size(), mwa_lrs.size());
+	for (size_t i = 0; i < wa_lrs.size(); ++i){
+	  ASSERT_EQ(wa_lrs[i].c,    mwa_lrs[i].c);
+	  ASSERT_EQ(wa_lrs[i].freq, mwa_lrs[i].freq);
+	}
+	wa.ListMaxRange(min_c, max_c, beg, end, num, wa_lrs);
+	mwa.ListMaxRange(min_c, max_c, beg, end, num, mwa_lrs);
+	ASSERT_EQ(wa_lrs.size(), mwa_lrs.size());
+	for (size_t i = 0; i < wa_lrs.size(); ++i){
+	  ASSERT_EQ(wa_lrs[i].c,    mwa_lrs[i].c);
+	  ASSERT_EQ(wa_lrs[i].freq, mwa_lrs[i].freq);
+	}
+	// the ties of the frequencies may be listed in another order
+	wa.ListModeRange(min_c, max_c, beg, end, num, wa_lrs);
+	mwa.ListModeRange(min_c, max_c, beg, end, num, mwa_lrs);
+	ASSERT_EQ(wa_lrs.size(), mwa_lrs.size());
+	for (size_t i = 0; i < mwa_lrs.size(); ++i){
+	  ASSERT_EQ(wa_lrs[i].freq, mwa_lrs[i].freq);
+	  ASSERT_EQ(mwa_lrs[i].freq, mwa.Rank(mwa_lrs[i].c, end) - mwa.Rank(mwa_lrs[i].c, beg));
+	}
+      }
+    }
+  }
+}
+
+TEST(multiary_wat_array, wide_alphabet){
+  // the levels take memory of the array, not of the alphabet
+  vector<uint64_t> A;
+  A.push_back(3);
+  A.push_back(1LLU << 40);
+  A.push_back(5);
+  for (uint64_t i = 0; i < 1000; ++i){
+    A.push_back(((uint64_t)rand() << 20 ^ rand()) % (1LLU << 40));
+  }
+  uint64_t bit_nums[] = {2, 4};
+  for (int b = 0; b < 2; ++b){
+    wat_array::WatArray wa;
+    wa.Init(A);
+    wat_array::MultiaryWatArray mwa;
+    mwa.set_symbol_bit_num(bit_nums[b]);
+    mwa.Init(A);
+    ASSERT_EQ(wa.alphabet_num(), mwa.alphabet_num());
+    for (uint64_t i = 0; i < A.size(); ++i){
+      ASSERT_EQ(A[i], mwa.Lookup(i));
+      ASSERT_EQ(wa.Rank(A[i], i), mwa.Rank(A[i], i));
+      ASSERT_EQ(wa.RankLessThan(A[i], i), mwa.RankLessThan(A[i], i));
+      ASSERT_EQ(wa.Freq(A[i]), mwa.Freq(A[i]));
+      ASSERT_EQ(wa.Select(A[i], 1), mwa.Select(A[i], 1));
+    }
+  }
+}
+
+TEST(multiary_wat_array, map){
+  vector<uint64_t> A;
+  for (uint64_t i = 0; i < 10000; ++i){
+    A.push_back(rand() % 1000);
+  }
+  wat_array::MultiaryWatArray wa;
+  wa.set_symbol_bit_num(4);
+  wa.Init(A);
+
+  char filename[] = "/tmp/multiary_wat_array_test_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_LE(0, fd);
+  close(fd);
+  {
+    ofstream ofs(filename, ios::binary);
+    wa.Save(ofs);
+    ASSERT_EQ(false, !ofs);
+  }
+
+  wat_array::MultiaryWatArray wa_map;
+  ASSERT_EQ(0, wa_map.Map(filename));
+  ASSERT_EQ(4, wa_map.symbol_bit_num());
+  ifstream ifs(filename, ios::binary);
+  wat_array::MultiaryWatArray wa_load;
+  wa_load.Load(ifs);
+  ASSERT_EQ(false, !ifs);
+  for (uint64_t iter = 0; iter < 1000; ++iter){
+    uint64_t c   = rand() % 1000;
+    uint64_t pos = rand() % A.size();
+    ASSERT_EQ(A[pos], wa_map.Lookup(pos));
+    ASSERT_EQ(A[pos], wa_load.Lookup(pos));
+    ASSERT_EQ(wa.Rank(c, pos), wa_map.Rank(c, pos));
+    ASSERT_EQ(wa.RankLessThan(c, pos), wa_load.RankLessThan(c, pos));
+  }
+
+  wat_array::WatArray other;
+  other.Init(A);
+  {
+    ofstream ofs(filename, ios::binary);
+    other.Save(ofs);
+  }
+  ASSERT_EQ(-1, wa_map.Map(filename));
+  ASSERT_EQ(0, wa_map.length());
+  remove(filename);
+}
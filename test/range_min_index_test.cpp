@@ -0,0 +1,110 @@
+/* 
+ *  Copyright (c) 2010 Daisuke Okanohara
+  * 
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ * 
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+#include <gtest/gtest.h>
+#include <vector>
+#include <string>
+#include <sstream>
+#include "../src/range_min_index.hpp"
+
+using namespace std;
+using namespace wat_array;
+
+namespace {
+
+uint64_t NaiveFind(const vector<uint64_t>& vals, uint64_t beg_pos, uint64_t end_pos, bool max_query){
+  uint64_t pos = beg_pos;
+  for (uint64_t i = beg_pos; i < end_pos; ++i){
+    if (max_query ? vals[i] > vals[pos] : vals[i] < vals[pos]) pos = i;
+  }
+  return pos;
+}
+
+}
+
+TEST(range_min_index, trivial){
+  RangeMinIndex rmi;
+  vector<uint64_t> vals;
+  rmi.Init(vals, 0, false);
+  ASSERT_EQ(0, rmi.length());
+  ASSERT_EQ(NOTFOUND, rmi.Find(0, 0));
+  ASSERT_EQ(NOTFOUND, rmi.Find(0, 1));
+
+  vals.push_back(3);
+  rmi.Init(vals, 1, true);
+  ASSERT_EQ(1, rmi.length());
+  ASSERT_EQ(0, rmi.Find(0, 1));
+  ASSERT_EQ(NOTFOUND, rmi.Find(1, 1));
+  ASSERT_EQ(NOTFOUND, rmi.Find(0, 2));
+}
+
+TEST(range_min_index, small){
+  // all ranges of arrays with many equal values
+  for (uint64_t iter = 0; iter < 20; ++iter){
+    uint64_t n = 1 + rand() % 300;
+    vector<uint64_t> vals;
+    for (uint64_t i = 0; i < n; ++i){
+      vals.push_back(rand() % (iter + 2));
+    }
+    for (int max_query = 0; max_query < 2; ++max_query){
+      RangeMinIndex rmi;
+      rmi.Init(vals, n, max_query);
+      for (uint64_t beg_pos = 0; beg_pos < n; ++beg_pos){
+	for (uint64_t end_pos = beg_pos + 1; end_pos <= n; ++end_pos){
+	  ASSERT_EQ(NaiveFind(vals, beg_pos, end_pos, max_query), rmi.Find(beg_pos, end_pos));
+	}
+      }
+    }
+  }
+}
+
+TEST(range_min_index, random){
+  // random, increasing, decreasing and saw-tooth arrays spanning many 
+  // superblocks, so that both the blocks and the sparse table are used
+  uint64_t n = 100000;
+  for (int kind = 0; kind < 4; ++kind){
+    vector<uint64_t> vals;
+    for (uint64_t i = 0; i < n; ++i){
+      if (kind == 0) vals.push_back(rand() % 1000);
+      if (kind == 1) vals.push_back(i);
+      if (kind == 2) vals.push_back(n - i);
+      if (kind == 3) vals.push_back(i % 5000 + rand() % 3);
+    }
+    for (int max_query = 0; max_query < 2; ++max_query){
+      RangeMinIndex rmi;
+      rmi.Init(vals, n, max_query);
+      ASSERT_EQ(n, rmi.length());
+      ostringstream oss;
+      uint64_t offset = 0;
+      rmi.SaveAligned(oss, offset);
+      istringstream iss(oss.str());
+      RangeMinIndex rmi_load;
+      offset = 0;
+      rmi_load.LoadAligned(iss, offset);
+      ASSERT_EQ(false, !iss);
+      for (uint64_t iter = 0; iter < 1000; ++iter){
+	uint64_t beg_pos = rand() % n;
+	uint64_t end_pos = beg_pos + 1 + ((iter % 2) ? rand() % 1000 : rand() % (n - beg_pos));
+	if (end_pos > n) end_pos = n;
+	uint64_t pos = NaiveFind(vals, beg_pos, end_pos, max_query);
+	ASSERT_EQ(pos, rmi.Find(beg_pos, end_pos));
+	ASSERT_EQ(pos, rmi_load.Find(beg_pos, end_pos));
+      }
+    }
+  }
+}
@@ -0,0 +1,122 @@
+/* 
+ *  Copyright (c) 2010 Daisuke Okanohara
+  * 
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ * 
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <string>
+#include <sstream>
+#include "../src/rrr_bit_array.hpp"
+#include "../src/bit_array.hpp"
+
+using namespace std;
+using namespace wat_array;
+
+TEST(rrrbitvec, trivial){
+  RRRBitArray ba;
+  ba.Build();
+  ASSERT_EQ(0, ba.length());
+  ASSERT_EQ(0, ba.one_num());
+  ASSERT_EQ(0, ba.Rank(1, 0));
+  ASSERT_EQ(NOTFOUND, ba.Select(1, 1));
+
+  ostringstream oss;
+  ba.Save(oss);
+  ASSERT_EQ(false, !oss);
+
+  istringstream iss(oss.str());
+  RRRBitArray ba_load;
+  ba_load.Load(iss);
+  ASSERT_EQ(false, !iss);
+  ASSERT_EQ(0, ba_load.length());
+}
+
+TEST(rrrbitvec, random){
+  const uint64_t N = 100000;
+  int ratios[] = {2, 10, 1000};
+  for (int r = 0; r < 3; ++r){
+    RRRBitArray ba(N);
+    vector<uint64_t> B;
+    for (uint64_t i = 0; i < N; ++i){
+      uint64_t b = (rand() % ratios[r] == 0) ? 1 : 0;
+      ba.SetBit(b, i);
+      B.push_back(b);
+    }
+    ba.Build();
+    ASSERT_EQ(N, ba.length());
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < N; ++i){
+      ASSERT_EQ(B[i], ba.Lookup(i));
+      ASSERT_EQ(sum, ba.Rank(1, i));
+      ASSERT_EQ(i - sum, ba.Rank(0, i));
+      if (B[i]){
+	ASSERT_EQ(i, ba.Select(1, sum+1));
+      } else {
+	ASSERT_EQ(i, ba.Select(0, i-sum+1));
+      }
+      sum += B[i];
+    }
+    ASSERT_EQ(sum, ba.one_num());
+    ASSERT_EQ(sum, ba.Rank(1, N));
+    ASSERT_EQ(NOTFOUND, ba.Rank(1, N+1));
+    ASSERT_EQ(NOTFOUND, ba.Select(1, sum+1));
+    ASSERT_EQ(NOTFOUND, ba.Select(0, N-sum+1));
+  }
+}
+
+TEST(rrrbitvec, compress){
+  const uint64_t N = 1000000;
+  RRRBitArray sparse(N);
+  BitArray plain(N);
+  for (uint64_t i = 0; i < N; i += 1000){
+    sparse.SetBit(1, i);
+    plain.SetBit(1, i);
+  }
+  sparse.Build();
+  plain.Build();
+  ASSERT_LT(sparse.GetUsageBytes() * 2, plain.GetUsageBytes());
+}
+
+TEST(rrrbitvec, save_decode){
+  const uint64_t N = 12345;
+  vector<uint64_t> blocks((N + 63) / 64);
+  for (uint64_t i = 0; i < N; ++i){
+    if (rand() % 7 == 0) blocks[i / 64] |= 1LLU << (i % 64);
+  }
+  RRRBitArray ba;
+  ba.Build(&blocks[0], N);
+
+  vector<uint64_t> decoded;
+  ba.Decode(decoded);
+  ASSERT_EQ(blocks, decoded);
+
+  ostringstream oss;
+  ba.Save(oss);
+  istringstream iss(oss.str());
+  RRRBitArray ba_load;
+  ba_load.Load(iss);
+  ASSERT_EQ(false, !iss);
+  ASSERT_EQ(ba.length(),  ba_load.length());
+  ASSERT_EQ(ba.one_num(), ba_load.one_num());
+  for (uint64_t i = 0; i <= N; ++i){
+    ASSERT_EQ(ba.Rank(1, i), ba_load.Rank(1, i));
+  }
+  for (uint64_t i = 1; i <= ba.one_num(); ++i){
+    ASSERT_EQ(ba.Select(1, i), ba_load.Select(1, i));
+  }
+}
@@ -0,0 +1,102 @@
+/* 
+ *  Copyright (c) 2010 Daisuke Okanohara
+  * 
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ * 
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <sstream>
+#include "../src/symbol_array.hpp"
+#include "../src/bit_array.hpp"
+
+using namespace std;
+using namespace wat_array;
+
+TEST(symbol_array, trivial){
+  SymbolArray sa(0, 2);
+  sa.Build();
+  ASSERT_EQ(0, sa.length());
+  ASSERT_EQ(4, sa.symbol_num());
+  ASSERT_EQ(0, sa.Rank(0, 0));
+  ASSERT_EQ(0, sa.RankLessThan(3, 0));
+  ASSERT_EQ(NOTFOUND, sa.Select(0, 1));
+  ASSERT_EQ(NOTFOUND, sa.Lookup(0));
+}
+
+TEST(symbol_array, random){
+  // crosses superblocks, and ends inside a word
+  const uint64_t N = 200003;
+  uint64_t bit_nums[] = {2, 4};
+  for (int b = 0; b < 2; ++b){
+    SymbolArray sa(N, bit_nums[b]);
+    uint64_t symbol_num = sa.symbol_num();
+    vector<uint64_t> S;
+    for (uint64_t i = 0; i < N; ++i){
+      // skewed so that some symbols are rare
+      uint64_t sym = (rand() % 3 == 0) ? rand() % symbol_num : rand() % 2;
+      sa.SetSymbol(sym, i);
+      S.push_back(sym);
+    }
+    sa.Build();
+
+    vector<uint64_t> counts(symbol_num);
+    vector<vector<uint64_t> > poses(symbol_num);
+    for (uint64_t i = 0; i <= N; ++i){
+      if (i % 97 == 0 || i == N || i % 65536 < 3){
+	for (uint64_t sym = 0; sym <= symbol_num; ++sym){
+	  uint64_t less = 0;
+	  for (uint64_t s = 0; s < sym && s < symbol_num; ++s) less += counts[s];
+	  ASSERT_EQ(less, sa.RankLessThan(sym, i));
+	  if (sym == symbol_num) continue;
+	  ASSERT_EQ(counts[sym], sa.Rank(sym, i));
+	  uint64_t rank = 0;
+	  uint64_t rank_less_than = 0;
+	  sa.RankAll(sym, i, rank, rank_less_than);
+	  ASSERT_EQ(counts[sym], rank);
+	  ASSERT_EQ(less, rank_less_than);
+	}
+      }
+      if (i == N) break;
+      ASSERT_EQ(S[i], sa.Lookup(i));
+      counts[S[i]]++;
+      poses[S[i]].push_back(i);
+    }
+    for (uint64_t sym = 0; sym < symbol_num; ++sym){
+      for (uint64_t r = 0; r < poses[sym].size(); r += 1 + rand() % 50){
+	ASSERT_EQ(poses[sym][r], sa.Select(sym, r + 1));
+      }
+      ASSERT_EQ(poses[sym].back(), sa.Select(sym, poses[sym].size()));
+      ASSERT_EQ(NOTFOUND, sa.Select(sym, poses[sym].size() + 1));
+    }
+
+    ostringstream oss;
+    uint64_t offset = 0;
+    sa.SaveAligned(oss, offset);
+    istringstream iss(oss.str());
+    SymbolArray sa_load;
+    offset = 0;
+    sa_load.LoadAligned(iss, offset);
+    ASSERT_EQ(false, !iss);
+    ASSERT_EQ(sa.bit_num(), sa_load.bit_num());
+    for (uint64_t iter = 0; iter < 1000; ++iter){
+      uint64_t pos = rand() % (N + 1);
+      uint64_t sym = rand() % symbol_num;
+      ASSERT_EQ(sa.Rank(sym, pos), sa_load.Rank(sym, pos));
+      ASSERT_EQ(sa.RankLessThan(sym, pos), sa_load.RankLessThan(sym, pos));
+    }
+  }
+}
@@ -0,0 +1,132 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <sstream>
+#include <cstdlib>
+#include "../src/wat_array.hpp"
+#include "../src/wat_array_builder.hpp"
+
+using namespace std;
+using namespace wat_array;
+
+namespace {
+
+string SaveWatArray(const vector<uint64_t>& array){
+  WatArray wa;
+  wa.Init(array);
+  ostringstream os;
+  wa.Save(os);
+  return os.str();
+}
+
+string BuildWatArray(const vector<uint64_t>& array){
+  WatArrayBuilder builder;
+  for (size_t i = 0; i < array.size(); ++i){
+    EXPECT_EQ(0, builder.Add(array[i]));
+  }
+  EXPECT_EQ(array.size(), builder.length());
+  ostringstream os;
+  EXPECT_EQ(0, builder.Build(os));
+  EXPECT_EQ(0, builder.length());
+  return os.str();
+}
+
+}
+
+TEST(wat_array_builder, trivial){
+  vector<uint64_t> array;
+  ASSERT_EQ(SaveWatArray(array), BuildWatArray(array));
+  array.push_back(0);
+  ASSERT_EQ(SaveWatArray(array), BuildWatArray(array));
+
+  WatArrayBuilder builder;
+  ASSERT_EQ(-1, builder.Add(NOTFOUND));
+  ASSERT_EQ(0, builder.length());
+}
+
+TEST(wat_array_builder, random){
+  uint64_t alphabet_nums[] = {1, 2, 3, 100, 1000, 100000, 1LLU << 40};
+  for (size_t i = 0; i < sizeof(alphabet_nums) / sizeof(alphabet_nums[0]); ++i){
+    vector<uint64_t> array;
+    for (uint64_t j = 0; j < 10000; ++j){
+      array.push_back(((uint64_t)rand() * RAND_MAX + rand()) % alphabet_nums[i]);
+    }
+    string saved = SaveWatArray(array);
+    ASSERT_EQ(saved, BuildWatArray(array));
+
+    istringstream is(saved);
+    WatArray wa;
+    wa.Load(is);
+    ASSERT_EQ(array.size(), wa.length());
+    for (uint64_t j = 0; j < array.size(); j += 97){
+      ASSERT_EQ(array[j], wa.Lookup(j));
+    }
+  }
+}
+
+TEST(wat_array_builder, text_input){
+  vector<uint64_t> array;
+  ostringstream text;
+  for (uint64_t i = 0; i < 10000; ++i){
+    array.push_back(rand() % 1000);
+    text << array.back() << ((i % 10 == 9) ? "\n" : " ");
+  }
+  istringstream is(text.str());
+  ostringstream os;
+  WatArrayBuilder builder;
+  builder.set_layout(BitArray::RRR_LAYOUT);
+  ASSERT_EQ(0, builder.Build(is, os));
+
+  WatArray wa;
+  wa.set_layout(BitArray::RRR_LAYOUT);
+  wa.Init(array);
+  ostringstream expected;
+  wa.Save(expected);
+  ASSERT_EQ(expected.str(), os.str());
+}
+
+TEST(wat_array_builder, bad_text_input){
+  const char* inputs[] = {"1 -5 2", "1 1.5 2", "1 abc 2", "1,2", 
+                          "18446744073709551616", "99999999999999999999 1"};
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i){
+    istringstream is(inputs[i]);
+    ostringstream os;
+    WatArrayBuilder builder;
+    ASSERT_EQ(-1, builder.Build(is, os));
+    ASSERT_EQ(0, builder.length());
+  }
+
+  vector<uint64_t> array;
+  array.push_back(1);
+  array.push_back(18446744073709551614LLU);
+  array.push_back(0);
+  istringstream is(" 1\t18446744073709551614\r\n\n0 \n");
+  ostringstream os;
+  WatArrayBuilder builder;
+  ASSERT_EQ(0, builder.Build(is, os));
+  ASSERT_EQ(SaveWatArray(array), os.str());
+}
+
+TEST(wat_array_builder, bad_temp_dir){
+  WatArrayBuilder builder;
+  builder.set_temp_dir("/nonexistent/wat_array");
+  ASSERT_EQ(-1, builder.Add(1));
+}
@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <cstdlib>
+#include "../src/wat_array.hpp"
+#include "../src/wat_array_executor.hpp"
+
+using namespace std;
+using namespace wat_array;
+
+TEST(wat_array_executor, trivial){
+  WatArray wa;
+  vector<uint64_t> array;
+  wa.Init(array);
+  WatArrayExecutor executor(wa);
+  uint64_t val = 0;
+  uint64_t pos = 0;
+  executor.Lookup(0, &val);
+  ASSERT_EQ(NOTFOUND, val);
+  executor.QuantileRange(0, 0, 0, &pos, &val);
+  ASSERT_EQ(NOTFOUND, pos);
+  ASSERT_EQ(0, executor.query_num());
+  executor.Run();
+
+  array.push_back(0);
+  array.push_back(0);
+  wa.Init(array);
+  executor.Lookup(1, &val);
+  executor.QuantileRange(0, 2, 1, &pos, &val);
+  ASSERT_EQ(2, executor.query_num());
+  executor.Run();
+  ASSERT_EQ(0, executor.query_num());
+  ASSERT_EQ(0, pos); // the smallest position of the value
+  ASSERT_EQ(0, val);
+}
+
+TEST(wat_array_executor, random){
+  // mixed queries are compared with the single queries, including 
+  // arguments out of range and values that do not appear
+  for (int kind = 0; kind < 4; ++kind){
+    uint64_t n = 3000;
+    vector<uint64_t> array;
+    for (uint64_t i = 0; i < n; ++i){
+      array.push_back((kind == 2) ? (rand() % 50) * 1000003 : rand() % 300);
+    }
+    WatArray wa;
+    if (kind == 1) wa.set_layout(BitArray::RRR_LAYOUT);
+    if (kind == 2) wa.set_compact_alphabet(true);
+    wa.Init(array);
+    WatArrayExecutor executor(wa);
+    executor.set_interleave_num((kind == 3) ? 1 : 16);
+
+    uint64_t num = 1000;
+    uint64_t alphabet_num = wa.alphabet_num();
+    vector<uint64_t> poses, cs, min_cs, max_cs, beg_poses, end_poses, ks;
+    vector<uint64_t> vals(num), ranks(num), freqs(num), qposes(num), qvals(num);
+    for (uint64_t i = 0; i < num; ++i){
+      poses.push_back(rand() % (n + 3));
+      cs.push_back((i % 2) ? array[rand() % n] : rand() % (alphabet_num + 3));
+      min_cs.push_back(rand() % (alphabet_num + 3));
+      max_cs.push_back(rand() % (alphabet_num + 3));
+      beg_poses.push_back(rand() % (n + 3));
+      end_poses.push_back(rand() % (n + 3));
+      if (i % 3 && beg_poses.back() > end_poses.back()) swap(beg_poses.back(), end_poses.back());
+      ks.push_back(rand() % (end_poses.back() - min(beg_poses.back(), end_poses.back()) + 1));
+
+      executor.Lookup(poses[i], &vals[i]);
+      executor.Rank(cs[i], poses[i], &ranks[i]);
+      executor.FreqRange(min_cs[i], max_cs[i], beg_poses[i], end_poses[i], &freqs[i]);
+      executor.QuantileRange(beg_poses[i], end_poses[i], ks[i], &qposes[i], &qvals[i]);
+    }
+    executor.Run();
+
+    for (uint64_t i = 0; i < num; ++i){
+      ASSERT_EQ(wa.Lookup(poses[i]), vals[i]);
+      ASSERT_EQ(wa.Rank(cs[i], poses[i]), ranks[i]);
+      ASSERT_EQ(wa.FreqRange(min_cs[i], max_cs[i], beg_poses[i], end_poses[i]), freqs[i]);
+      if (ks[i] < end_poses[i] - beg_poses[i] || beg_poses[i] >= end_poses[i]){
+	uint64_t pos = 0;
+	uint64_t val = 0;
+	wa.QuantileRange(beg_poses[i], end_poses[i], ks[i], pos, val);
+	ASSERT_EQ(pos, qposes[i]);
+	ASSERT_EQ(val, qvals[i]);
+      }
+    }
+  }
+}
@@ -20,6 +20,9 @@
 #include <gtest/gtest.h>
 #include <sstream>
 #include <algorithm>
+#include <fstream>
+#include <cstdio>
+#include <unistd.h>
 #include "../src/wat_array.hpp"
 
 using namespace std;
@@ -153,6 +156,130 @@ TEST(wat_array, save){
   wa_load.Load(is);
   ASSERT_EQ(2, wa_load.Rank(3, 14));
 }
+
+TEST(wat_array, save_legacy){
+  // the format of older versions: alphabet_num, length, the raw levels
+  // and the unary frequencies
+  vector<uint64_t> A;
+  for (uint64_t i = 0; i < 1000; ++i){
+    A.push_back(rand() % 37);
+  }
+  wat_array::WatArray wa;
+  wa.Init(A);
+
+  uint64_t alphabet_num = 37;
+  uint64_t length = A.size();
+  uint64_t bit_num = 6;
+  ostringstream os;
+  os.write((const char*)(&alphabet_num), sizeof(alphabet_num));
+  os.write((const char*)(&length), sizeof(length));
+  vector<uint64_t> level(A);
+  for (uint64_t d = 0; d < bit_num; ++d){
+    vector<uint64_t> blocks((length + 63) / 64);
+    for (uint64_t i = 0; i < length; ++i){
+      blocks[i / 64] |= ((level[i] >> (bit_num - d - 1)) & 1LLU) << (i % 64);
+    }
+    os.write((const char*)(&length), sizeof(length));
+    os.write((const char*)(&blocks[0]), sizeof(blocks[0]) * blocks.size());
+    // the next level is sorted stably by the prefix
+    vector<uint64_t> next;
+    for (uint64_t i = 0; i < length; ){
+      uint64_t prefix = level[i] >> (bit_num - d);
+      uint64_t j = i;
+      while (j < length && (level[j] >> (bit_num - d)) == prefix) ++j;
+      for (uint64_t k = i; k < j; ++k) if (!((level[k] >> (bit_num - d - 1)) & 1LLU)) next.push_back(level[k]);
+      for (uint64_t k = i; k < j; ++k) if ( ((level[k] >> (bit_num - d - 1)) & 1LLU)) next.push_back(level[k]);
+      i = j;
+    }
+    level = next;
+  }
+  vector<uint64_t> freq(alphabet_num);
+  for (uint64_t i = 0; i < length; ++i) freq[A[i]]++;
+  uint64_t occs_length = length + alphabet_num + 1;
+  vector<uint64_t> occs((occs_length + 63) / 64);
+  uint64_t sum = 0;
+  for (uint64_t c = 0; c <= alphabet_num; ++c){
+    occs[sum / 64] |= 1LLU << (sum % 64);
+    if (c < alphabet_num) sum += freq[c] + 1;
+  }
+  os.write((const char*)(&occs_length), sizeof(occs_length));
+  os.write((const char*)(&occs[0]), sizeof(occs[0]) * occs.size());
+
+  istringstream is(os.str());
+  wat_array::WatArray wa_load;
+  wa_load.Load(is);
+  ASSERT_EQ(false, !is);
+  ASSERT_EQ(alphabet_num, wa_load.alphabet_num());
+  for (uint64_t i = 0; i < length; ++i){
+    ASSERT_EQ(A[i], wa_load.Lookup(i));
+  }
+  for (uint64_t c = 0; c < alphabet_num; ++c){
+    ASSERT_EQ(freq[c], wa_load.Freq(c));
+    ASSERT_EQ(wa.Rank(c, length / 2), wa_load.Rank(c, length / 2));
+  }
+}
+
+TEST(wat_array, map){
+  vector<uint64_t> A;
+  for (uint64_t i = 0; i < 10000; ++i){
+    A.push_back(rand() % 1000);
+  }
+  wat_array::BitArray::Layout layouts[] = {wat_array::BitArray::INTERLEAVED_LAYOUT,
+					   wat_array::BitArray::SEPARATE_LAYOUT,
+					   wat_array::BitArray::RRR_LAYOUT};
+  char filename[] = "/tmp/wat_array_test_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_LE(0, fd);
+  close(fd);
+  for (int l = 0; l < 3; ++l){
+    wat_array::WatArray wa;
+    wa.set_layout(layouts[l]);
+    wa.Init(A);
+    {
+      ofstream ofs(filename, ios::binary);
+      wa.Save(ofs);
+      ASSERT_EQ(false, !ofs);
+    }
+
+    wat_array::WatArray wa_map;
+    ASSERT_EQ(0, wa_map.Map(filename));
+    wat_array::WatArray wa_copy(wa_map);
+    ifstream ifs(filename, ios::binary);
+    wat_array::WatArray wa_load;
+    wa_load.Load(ifs);
+    ASSERT_EQ(false, !ifs);
+
+    ASSERT_EQ(wa.length(), wa_map.length());
+    ASSERT_EQ(wa.alphabet_num(), wa_map.alphabet_num());
+    for (uint64_t iter = 0; iter < 1000; ++iter){
+      uint64_t c   = rand() % 1000;
+      uint64_t pos = rand() % (A.size() + 1);
+      ASSERT_EQ(wa.Rank(c, pos), wa_map.Rank(c, pos));
+      ASSERT_EQ(wa.Rank(c, pos), wa_copy.Rank(c, pos));
+      ASSERT_EQ(wa.Rank(c, pos), wa_load.Rank(c, pos));
+      ASSERT_EQ(wa.Freq(c),      wa_map.Freq(c));
+      if (pos < A.size()){
+	ASSERT_EQ(A[pos], wa_map.Lookup(pos));
+      }
+      if (wa.Freq(c) > 0){
+	uint64_t rank = rand() % wa.Freq(c) + 1;
+	ASSERT_EQ(wa.Select(c, rank), wa_map.Select(c, rank));
+      }
+    }
+    wa_map.Clear();
+    ASSERT_EQ(0, wa_map.length());
+  }
+
+  {
+    ofstream ofs(filename, ios::binary);
+    ofs << "not an index";
+  }
+  wat_array::WatArray wa_map;
+  ASSERT_EQ(-1, wa_map.Map(filename));
+  ASSERT_EQ(0, wa_map.length());
+  remove(filename);
+  ASSERT_EQ(-1, wa_map.Map(filename));
+}
   
 TEST(wat_array, small){
 
@@ -224,6 +351,320 @@ TEST(wat_array, small){
   }
 }
 
+TEST(wat_array, separate_layout){
+  vector<uint64_t> array;
+  uint64_t alphabet_num = 100;
+  uint64_t n = 10000;
+  for (uint64_t i = 0; i < n; ++i){
+    array.push_back(rand() % alphabet_num);
+  }
+
+  wat_array::WatArray wa;
+  wat_array::WatArray wa_sep;
+  wa_sep.set_layout(wat_array::BitArray::SEPARATE_LAYOUT);
+  wa.Init(array);
+  wa_sep.Init(array);
+
+  for (uint64_t iter = 0; iter < 1000; ++iter){
+    uint64_t c   = rand() % alphabet_num;
+    uint64_t pos = rand() % (n + 1);
+    ASSERT_EQ(wa.Rank(c, pos),         wa_sep.Rank(c, pos));
+    ASSERT_EQ(wa.RankLessThan(c, pos), wa_sep.RankLessThan(c, pos));
+    if (pos < n){
+      ASSERT_EQ(wa.Lookup(pos), wa_sep.Lookup(pos));
+    }
+    if (wa.Freq(c) > 0){
+      uint64_t rank = rand() % wa.Freq(c) + 1;
+      ASSERT_EQ(wa.Select(c, rank), wa_sep.Select(c, rank));
+    }
+  }
+
+  ostringstream os;
+  wa_sep.Save(os);
+  istringstream is(os.str());
+  wat_array::WatArray wa_load;
+  wa_load.Load(is);
+  for (uint64_t i = 0; i < n; ++i){
+    ASSERT_EQ(array[i], wa_load.Lookup(i));
+  }
+}
+
+TEST(wat_array, wide_alphabet){
+  vector<uint64_t> array;
+  uint64_t alphabet_num = 100000;
+  uint64_t n = 1000;
+  vector<uint64_t> freq(alphabet_num);
+  for (uint64_t i = 0; i < n; ++i){
+    uint64_t c = rand() % alphabet_num;
+    array.push_back(c);
+    freq[c]++;
+  }
+  array.push_back(alphabet_num - 1);
+  freq[alphabet_num - 1]++;
+
+  wat_array::WatArray wa;
+  wa.Init(array);
+
+  ostringstream os;
+  wa.Save(os);
+  istringstream is(os.str());
+  wat_array::WatArray wa_load;
+  wa_load.Load(is);
+
+  uint64_t sum = 0;
+  for (uint64_t c = 0; c < alphabet_num; ++c){
+    ASSERT_EQ(freq[c], wa.Freq(c));
+    ASSERT_EQ(freq[c], wa_load.Freq(c));
+    ASSERT_EQ(sum, wa.FreqSum(0, c));
+    sum += freq[c];
+  }
+  ASSERT_EQ(array.size(), wa.FreqSum(0, alphabet_num));
+  vector<uint64_t> counts(alphabet_num);
+  for (uint64_t i = 0; i < array.size(); ++i){
+    uint64_t c = array[i];
+    counts[c]++;
+    ASSERT_EQ(i, wa.Select(c, counts[c]));
+    ASSERT_EQ(i, wa_load.Select(c, counts[c]));
+  }
+}
+
+TEST(wat_array, wide_values){
+  // 48 to 64-bit values with no compaction
+  for (uint64_t bit_num = 48; bit_num <= 64; bit_num += 16){
+    uint64_t n = 2000;
+    vector<uint64_t> values;
+    for (uint64_t i = 0; i < 50; ++i){
+      uint64_t val = ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand();
+      values.push_back(bit_num < 64 ? val & ((1LLU << bit_num) - 1) : val);
+    }
+    values.push_back(bit_num < 64 ? (1LLU << bit_num) - 1 : wat_array::NOTFOUND - 1);
+    vector<uint64_t> array;
+    for (uint64_t i = 0; i < n; ++i){
+      array.push_back(values[rand() % values.size()]);
+    }
+    array.push_back(values.back());
+    ++n;
+
+    wat_array::WatArray wa;
+    wa.Init(array);
+    ASSERT_EQ(values.back() + 1, wa.alphabet_num());
+
+    vector<uint64_t> sorted_array(array);
+    sort(sorted_array.begin(), sorted_array.end());
+    for (uint64_t i = 0; i < n; ++i){
+      ASSERT_EQ(array[i], wa.Lookup(i));
+    }
+    for (uint64_t iter = 0; iter < 200; ++iter){
+      uint64_t c = values[rand() % values.size()];
+      uint64_t pos = rand() % (n + 1);
+      uint64_t rank = 0;
+      uint64_t rank_less_than = 0;
+      for (uint64_t i = 0; i < pos; ++i){
+	if (array[i] == c) ++rank;
+	if (array[i] < c) ++rank_less_than;
+      }
+      ASSERT_EQ(rank, wa.Rank(c, pos));
+      ASSERT_EQ(rank_less_than, wa.RankLessThan(c, pos));
+      uint64_t freq = upper_bound(sorted_array.begin(), sorted_array.end(), c)
+	- lower_bound(sorted_array.begin(), sorted_array.end(), c);
+      ASSERT_EQ(freq, wa.Freq(c));
+      if (rank > 0){
+	uint64_t select_pos = wa.Select(c, rank);
+	ASSERT_EQ(c, array[select_pos]);
+	ASSERT_EQ(rank - 1, wa.Rank(c, select_pos));
+      }
+
+      RandomQuery rq(n);
+      vector<uint64_t> range(array.begin() + rq.beg, array.begin() + rq.end);
+      sort(range.begin(), range.end());
+      uint64_t k = rand() % range.size();
+      uint64_t k_pos = 0;
+      uint64_t k_val = 0;
+      wa.QuantileRange(rq.beg, rq.end, k, k_pos, k_val);
+      ASSERT_EQ(range[k], k_val);
+      ASSERT_EQ(range[k], array[k_pos]);
+      ASSERT_EQ((uint64_t)(range.end() - lower_bound(range.begin(), range.end(), c)),
+		wa.FreqRange(c, wa.alphabet_num(), rq.beg, rq.end));
+    }
+  }
+}
+
+TEST(wat_array, packed_input){
+  for (uint64_t alphabet_num = 1; alphabet_num <= 100000; alphabet_num *= 10){
+    uint64_t width = 0;
+    while ((1LLU << width) < alphabet_num) ++width;
+    // the larger arrays have several chunks of a level
+    uint64_t n = (alphabet_num == 1000) ? (1 << 21) + 12345 : 10000;
+    vector<uint64_t> array;
+    wat_array::IntVector packed(width, n);
+    wat_array::BitArray bits(width * n);
+    for (uint64_t i = 0; i < n; ++i){
+      uint64_t c = rand() % alphabet_num;
+      array.push_back(c);
+      packed.Set(i, c);
+      for (uint64_t j = 0; j < width; ++j){
+	bits.SetBit((c >> j) & 1LLU, i * width + j);
+      }
+    }
+    bits.Build();
+
+    wat_array::WatArray wa;
+    wa.Init(array);
+    ostringstream os;
+    wa.Save(os);
+    for (uint64_t thread_num = 1; thread_num <= 3; thread_num += 2){
+      wat_array::WatArray wa_packed;
+      wa_packed.set_thread_num(thread_num);
+      wa_packed.Init(packed);
+      ostringstream os_packed;
+      wa_packed.Save(os_packed);
+      ASSERT_TRUE(os.str() == os_packed.str());
+
+      wat_array::WatArray wa_bits;
+      wa_bits.set_thread_num(thread_num);
+      wa_bits.Init(bits, width, n);
+      ostringstream os_bits;
+      wa_bits.Save(os_bits);
+      ASSERT_TRUE(os.str() == os_bits.str());
+    }
+
+    // the compacted codes are built from the packed input directly
+    wat_array::WatArray wa_compact;
+    wa_compact.set_compact_alphabet(true);
+    wa_compact.Init(array);
+    ostringstream os_compact;
+    wa_compact.Save(os_compact);
+    wat_array::WatArray wa_packed_compact;
+    wa_packed_compact.set_compact_alphabet(true);
+    wa_packed_compact.Init(packed);
+    ostringstream os_packed_compact;
+    wa_packed_compact.Save(os_packed_compact);
+    ASSERT_TRUE(os_compact.str() == os_packed_compact.str());
+  }
+}
+
+TEST(wat_array, compact_alphabet){
+  // sparse 48-bit values are compared with the dense ranks of the values
+  uint64_t value_num = 300;
+  uint64_t n = 10000;
+  vector<uint64_t> values;
+  for (uint64_t i = 0; i < value_num; ++i){
+    values.push_back((((uint64_t)rand() << 24) ^ rand()) & ((1LLU << 48) - 1));
+  }
+  sort(values.begin(), values.end());
+  values.erase(unique(values.begin(), values.end()), values.end());
+  value_num = values.size();
+
+  vector<uint64_t> array;
+  vector<uint64_t> dense_array;
+  for (uint64_t i = 0; i < n; ++i){
+    uint64_t code = rand() % value_num;
+    array.push_back(values[code]);
+    dense_array.push_back(code);
+  }
+  dense_array.push_back(value_num - 1);
+  array.push_back(values.back());
+  ++n;
+
+  wat_array::WatArray wa;
+  wa.set_compact_alphabet(true);
+  ASSERT_TRUE(wa.compact_alphabet());
+  wa.Init(array);
+  wat_array::WatArray dense;
+  dense.Init(dense_array);
+
+  ASSERT_EQ(values.back() + 1, wa.alphabet_num());
+  ASSERT_EQ(n, wa.length());
+  ASSERT_LT(wa.GetUsageBytes(), dense.GetUsageBytes() + 2 * sizeof(uint64_t) * value_num);
+  for (uint64_t i = 0; i < n; ++i){
+    ASSERT_EQ(array[i], wa.Lookup(i));
+  }
+
+  for (uint64_t iter = 0; iter < 1000; ++iter){
+    // a value of the array or a value between them
+    uint64_t c = (rand() % 2) ? values[rand() % value_num] : rand() % wa.alphabet_num();
+    uint64_t code = lower_bound(values.begin(), values.end(), c) - values.begin();
+    bool found = values[code] == c;
+    uint64_t pos = rand() % (n + 1);
+    ASSERT_EQ(found ? dense.Rank(code, pos) : 0, wa.Rank(c, pos));
+    ASSERT_EQ(dense.RankLessThan(code, pos), wa.RankLessThan(c, pos));
+    ASSERT_EQ(pos - dense.RankLessThan(code, pos) - wa.Rank(c, pos), wa.RankMoreThan(c, pos));
+    ASSERT_EQ(found ? dense.Freq(code) : 0, wa.Freq(c));
+    if (found && dense.Freq(code) > 0){
+      uint64_t rank = rand() % dense.Freq(code) + 1;
+      ASSERT_EQ(dense.Select(code, rank), wa.Select(c, rank));
+    } else if (!found){
+      ASSERT_EQ(wat_array::NOTFOUND, wa.Select(c, 1));
+    }
+
+    RandomQuery rq(n);
+    uint64_t max_c = (rand() % 2) ? values[rand() % value_num] : rand() % wa.alphabet_num() + 1;
+    uint64_t max_code = lower_bound(values.begin(), values.end(), max_c) - values.begin();
+    ASSERT_EQ(dense.FreqRange(code, max_code, rq.beg, rq.end), wa.FreqRange(c, max_c, rq.beg, rq.end));
+    ASSERT_EQ(dense.FreqSum(min(code, max_code), max_code), wa.FreqSum(min(c, max_c), max_c));
+
+    uint64_t k = rand() % (rq.end - rq.beg);
+    uint64_t dense_pos = 0, dense_val = 0, pos_k = 0, val = 0;
+    dense.QuantileRange(rq.beg, rq.end, k, dense_pos, dense_val);
+    wa.QuantileRange(rq.beg, rq.end, k, pos_k, val);
+    ASSERT_EQ(dense_pos, pos_k);
+    ASSERT_EQ(values[dense_val], val);
+
+    vector<wat_array::ListResult> dense_res, res;
+    dense.ListMinRange(code, max_code, rq.beg, rq.end, 10, dense_res);
+    wa.ListMinRange(c, max_c, rq.beg, rq.end, 10, res);
+    ASSERT_EQ(dense_res.size(), res.size());
+    for (size_t i = 0; i < res.size(); ++i){
+      ASSERT_EQ(values[dense_res[i].c], res[i].c);
+      ASSERT_EQ(dense_res[i].freq, res[i].freq);
+    }
+  }
+
+  ostringstream os;
+  wa.Save(os);
+  istringstream is(os.str());
+  wat_array::WatArray wa_load;
+  wa_load.Load(is);
+  ASSERT_EQ(wa.alphabet_num(), wa_load.alphabet_num());
+  for (uint64_t i = 0; i < n; ++i){
+    ASSERT_EQ(array[i], wa_load.Lookup(i));
+  }
+
+  // an empty array has no values to compact
+  wat_array::WatArray wa_empty;
+  wa_empty.set_compact_alphabet(true);
+  wa_empty.Init(vector<uint64_t>());
+  ASSERT_EQ(0, wa_empty.length());
+  ASSERT_EQ(0, wa_empty.FreqRange(0, 10, 0, 0));
+  ASSERT_EQ(wat_array::NOTFOUND, wa_empty.Lookup(0));
+}
+
+TEST(wat_array, parallel_build){
+  for (uint64_t alphabet_num = 1; alphabet_num <= 100000; alphabet_num *= 10){
+    // the larger arrays have several chunks of a level
+    uint64_t n = (alphabet_num == 1000) ? (1 << 21) + 12345 : 10000;
+    vector<uint64_t> array;
+    for (uint64_t i = 0; i < n; ++i){
+      array.push_back(rand() % alphabet_num);
+    }
+    wat_array::WatArray wa;
+    wa.set_thread_num(1);
+    wa.Init(array);
+    ostringstream os;
+    wa.Save(os);
+
+    for (uint64_t thread_num = 0; thread_num <= 4; thread_num += 2){
+      wat_array::WatArray wa_par;
+      wa_par.set_thread_num(thread_num);
+      ASSERT_EQ(thread_num, wa_par.thread_num());
+      wa_par.Init(array);
+      ostringstream os_par;
+      wa_par.Save(os_par);
+      ASSERT_TRUE(os.str() == os_par.str());
+    }
+  }
+}
+
 TEST(wat_array, random){
   vector<uint64_t> array;
 
@@ -320,19 +761,51 @@ public:
   }
 };
 
+// alphabet_num of WatRandomInitialize() for 50 values 1000003 apart, 
+// and for values of 60 bits, which are both compacted
+const uint64_t SPARSE_VALUES = 0;
+const uint64_t WIDE_VALUES   = wat_array::NOTFOUND;
+
 void WatRandomInitialize(wat_array::WatArray& wa,
 			 vector<uint64_t>& array,
 			 uint64_t alphabet_num, 
 			 uint64_t n){
-  vector<uint64_t> freq(alphabet_num);
   for (uint64_t i = 0; i < n; ++i){
-    uint64_t c = rand() % alphabet_num;
+    uint64_t c = 0;
+    if (alphabet_num == SPARSE_VALUES){
+      c = (rand() % 50) * 1000003;
+    } else if (alphabet_num == WIDE_VALUES){
+      c = ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ rand();
+    } else {
+      c = rand() % alphabet_num;
+    }
     array.push_back(c);
-    freq[c]++;
+  }
+  if (alphabet_num == SPARSE_VALUES || alphabet_num == WIDE_VALUES){
+    wa.set_compact_alphabet(true);
   }
   wa.Init(array);
 }
 
+void SaveMapLoad(const wat_array::WatArray& wa, 
+		 wat_array::WatArray& map_wa, 
+		 wat_array::WatArray& load_wa){
+  char filename[] = "/tmp/wat_array_test_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_LE(0, fd);
+  close(fd);
+  {
+    ofstream ofs(filename, ios::binary);
+    wa.Save(ofs);
+    ASSERT_EQ(false, !ofs);
+  }
+  ASSERT_EQ(0, map_wa.Map(filename));
+  ifstream ifs(filename, ios::binary);
+  load_wa.Load(ifs);
+  ASSERT_EQ(false, !ifs);
+  remove(filename);
+}
+
 
 TEST(wat_array, min_range){
   wat_array::WatArray wa;
@@ -387,6 +860,51 @@ TEST(wat_array, max_range){
   }
 }
 
+TEST(wat_array, range_min_max){
+  // the range min and max indexes give the same answers as the 
+  // quantiles, also when loaded and mapped, and with compaction
+  uint64_t alphabet_nums[] = {10, 100000, SPARSE_VALUES};
+  for (size_t kind = 0; kind < sizeof(alphabet_nums) / sizeof(alphabet_nums[0]); ++kind){
+    uint64_t n = 20000;
+    vector<uint64_t> array;
+    wat_array::WatArray rmq_wa;
+    ASSERT_EQ(false, rmq_wa.range_min_max());
+    rmq_wa.set_range_min_max(true);
+    ASSERT_EQ(true, rmq_wa.range_min_max());
+    WatRandomInitialize(rmq_wa, array, alphabet_nums[kind], n);
+    wat_array::WatArray wa;
+    wa.Init(array);
+    if (alphabet_nums[kind] != SPARSE_VALUES){
+      ASSERT_LT(wa.GetUsageBytes(), rmq_wa.GetUsageBytes());
+    }
+    wat_array::WatArray map_wa;
+    wat_array::WatArray load_wa;
+    ASSERT_NO_FATAL_FAILURE(SaveMapLoad(rmq_wa, map_wa, load_wa));
+
+    const wat_array::WatArray* was[] = {&rmq_wa, &map_wa, &load_wa};
+    for (uint64_t iter = 0; iter < 1000; ++iter){
+      RandomQuery rq(n);
+      uint64_t pos = 0, val = 0, rmq_pos = 0, rmq_val = 0;
+      for (int w = 0; w < 3; ++w){
+	wa.MinRange(rq.beg, rq.end, pos, val);
+	was[w]->MinRange(rq.beg, rq.end, rmq_pos, rmq_val);
+	ASSERT_EQ(pos, rmq_pos);
+	ASSERT_EQ(val, rmq_val);
+	wa.MaxRange(rq.beg, rq.end, pos, val);
+	was[w]->MaxRange(rq.beg, rq.end, rmq_pos, rmq_val);
+	ASSERT_EQ(pos, rmq_pos);
+	ASSERT_EQ(val, rmq_val);
+      }
+    }
+    uint64_t pos = 0, val = 0;
+    rmq_wa.MinRange(3, 3, pos, val);
+    ASSERT_EQ(wat_array::NOTFOUND, pos);
+    rmq_wa.MaxRange(0, n + 1, pos, val);
+    ASSERT_EQ(wat_array::NOTFOUND, pos);
+    ASSERT_EQ(wat_array::NOTFOUND, val);
+  }
+}
+
 TEST(wat_array, freq_range){
   wat_array::WatArray wa;
   vector<uint64_t> array;
@@ -407,6 +925,226 @@ TEST(wat_array, freq_range){
 }
 
 
+TEST(wat_array, freq_range_random){
+  // alphabets of a power of two, of other sizes and compacted, 
+  // with ranges of characters out of the alphabet
+  uint64_t alphabet_nums[] = {1, 2, 7, 64, 1000, SPARSE_VALUES};
+  for (size_t kind = 0; kind < sizeof(alphabet_nums) / sizeof(alphabet_nums[0]); ++kind){
+    uint64_t n = 3000;
+    vector<uint64_t> array;
+    wat_array::WatArray wa;
+    WatRandomInitialize(wa, array, alphabet_nums[kind], n);
+    for (uint64_t iter = 0; iter < 1000; ++iter){
+      RandomQuery rq(n);
+      uint64_t min_c = 0;
+      uint64_t max_c = 0;
+      if (alphabet_nums[kind] == SPARSE_VALUES){
+	min_c = array[rand() % n] + rand() % 3;
+	max_c = array[rand() % n] + rand() % 3;
+      } else {
+	min_c = rand() % (wa.alphabet_num() + 2);
+	max_c = rand() % (wa.alphabet_num() + 2);
+      }
+      if (iter % 4) swap(min_c, max_c);
+      uint64_t count = 0;
+      for (uint64_t i = rq.beg; i < rq.end; ++i){
+	if (min_c <= array[i] && array[i] < max_c) ++count;
+      }
+      ASSERT_EQ(count, wa.FreqRange(min_c, max_c, rq.beg, rq.end));
+    }
+  }
+}
+
+TEST(wat_array, moment_range){
+  // sums and sums of squares modulo 2^64 for alphabets of one value, of 
+  // a power of two, compacted and of 64-bit values, also when loaded
+  // and mapped
+  uint64_t alphabet_nums[] = {1, 256, 1000, SPARSE_VALUES, WIDE_VALUES};
+  for (size_t kind = 0; kind < sizeof(alphabet_nums) / sizeof(alphabet_nums[0]); ++kind){
+    uint64_t n = 3000;
+    vector<uint64_t> array;
+    wat_array::WatArray wa;
+    wa.set_moment_num(2);
+    ASSERT_EQ(2, wa.moment_num());
+    WatRandomInitialize(wa, array, alphabet_nums[kind], n);
+    ASSERT_LT(0, wa.GetMomentUsageBytes());
+    ASSERT_EQ(wat_array::NOTFOUND, wa.MomentRange(0, wa.alphabet_num(), 0, n, 3));
+    wat_array::WatArray map_wa;
+    wat_array::WatArray load_wa;
+    ASSERT_NO_FATAL_FAILURE(SaveMapLoad(wa, map_wa, load_wa));
+
+    const wat_array::WatArray* was[] = {&wa, &map_wa, &load_wa};
+    for (uint64_t iter = 0; iter < 300; ++iter){
+      RandomQuery rq(n);
+      uint64_t min_c = (iter % 3) ? array[rand() % n] : 0;
+      uint64_t max_c = (iter % 3) ? array[rand() % n] + rand() % 2 : wat_array::NOTFOUND;
+      uint64_t moments[3] = {0, 0, 0};
+      for (uint64_t i = rq.beg; i < rq.end; ++i){
+	if (min_c <= array[i] && array[i] < max_c){
+	  moments[0] += 1;
+	  moments[1] += array[i];
+	  moments[2] += array[i] * array[i];
+	}
+      }
+      for (int w = 0; w < 3; ++w){
+	ASSERT_EQ(moments[1], was[w]->SumRange(min_c, max_c, rq.beg, rq.end));
+	for (uint64_t moment = 0; moment < 3; ++moment){
+	  ASSERT_EQ(moments[moment], was[w]->MomentRange(min_c, max_c, rq.beg, rq.end, moment));
+	}
+      }
+    }
+  }
+
+  wat_array::WatArray wa;
+  vector<uint64_t> array(100, 3);
+  wa.Init(array);
+  ASSERT_EQ(0, wa.GetMomentUsageBytes());
+  ASSERT_EQ(wat_array::NOTFOUND, wa.SumRange(0, 4, 0, 100));
+  ASSERT_EQ(100, wa.MomentRange(0, 4, 0, 100, 0));
+}
+
+TEST(wat_array, range_next_prev_value){
+  // values at least x and less than x, with bounds out of the alphabet
+  uint64_t alphabet_nums[] = {1, 64, 1000, SPARSE_VALUES};
+  for (size_t kind = 0; kind < sizeof(alphabet_nums) / sizeof(alphabet_nums[0]); ++kind){
+    uint64_t n = (kind == 0) ? 1 : 3000;
+    vector<uint64_t> array;
+    wat_array::WatArray wa;
+    WatRandomInitialize(wa, array, alphabet_nums[kind], n);
+    for (uint64_t iter = 0; iter < 1000; ++iter){
+      uint64_t beg_pos = rand() % n;
+      uint64_t end_pos = beg_pos + 1 + rand() % ((iter % 2) ? 10 : n - beg_pos);
+      if (end_pos > n) end_pos = n;
+      uint64_t x = (iter % 3) ? array[rand() % n] + rand() % 3 - 1 : rand() % (wa.alphabet_num() + 2);
+      uint64_t next_val = wat_array::NOTFOUND;
+      uint64_t next_pos = wat_array::NOTFOUND;
+      uint64_t prev_val = wat_array::NOTFOUND;
+      uint64_t prev_pos = wat_array::NOTFOUND;
+      for (uint64_t i = beg_pos; i < end_pos; ++i){
+	if (array[i] >= x && (next_val == wat_array::NOTFOUND || array[i] < next_val)){
+	  next_val = array[i];
+	  next_pos = i;
+	}
+	if (array[i] < x && (prev_val == wat_array::NOTFOUND || array[i] > prev_val)){
+	  prev_val = array[i];
+	  prev_pos = i;
+	}
+      }
+      uint64_t pos = 0;
+      uint64_t val = 0;
+      wa.RangeNextValue(beg_pos, end_pos, x, pos, val);
+      ASSERT_EQ(next_val, val);
+      ASSERT_EQ(next_pos, pos);
+      ASSERT_EQ(next_val, wa.RangeNextValue(beg_pos, end_pos, x));
+      wa.RangePrevValue(beg_pos, end_pos, x, pos, val);
+      ASSERT_EQ(prev_val, val);
+      ASSERT_EQ(prev_pos, pos);
+      ASSERT_EQ(prev_val, wa.RangePrevValue(beg_pos, end_pos, x));
+    }
+    uint64_t pos = 0;
+    uint64_t val = 0;
+    wa.RangeNextValue(0, n + 1, 0, pos, val);
+    ASSERT_EQ(wat_array::NOTFOUND, pos);
+    ASSERT_EQ(wat_array::NOTFOUND, val);
+    ASSERT_EQ(wat_array::NOTFOUND, wa.RangePrevValue(0, 0, 1000));
+  }
+}
+
+TEST(wat_array, batch){
+  // each batch query is compared with the single query, including 
+  // arguments out of range and values that do not appear
+  uint64_t alphabet_nums[] = {300, 300, SPARSE_VALUES};
+  for (size_t kind = 0; kind < sizeof(alphabet_nums) / sizeof(alphabet_nums[0]); ++kind){
+    uint64_t n = 3000;
+    vector<uint64_t> array;
+    wat_array::WatArray wa;
+    if (kind == 1) wa.set_layout(wat_array::BitArray::RRR_LAYOUT);
+    WatRandomInitialize(wa, array, alphabet_nums[kind], n);
+
+    uint64_t num = 1000;
+    uint64_t alphabet_num = wa.alphabet_num();
+    vector<uint64_t> poses, cs, min_cs, max_cs, beg_poses, end_poses, ks;
+    for (uint64_t i = 0; i < num; ++i){
+      poses.push_back(rand() % (n + 3));
+      cs.push_back((i % 2) ? array[rand() % n] : rand() % (alphabet_num + 3));
+      min_cs.push_back(rand() % (alphabet_num + 3));
+      max_cs.push_back(rand() % (alphabet_num + 3));
+      beg_poses.push_back(rand() % (n + 3));
+      end_poses.push_back(rand() % (n + 3));
+      if (i % 3 && beg_poses.back() > end_poses.back()) swap(beg_poses.back(), end_poses.back());
+      ks.push_back(rand() % (end_poses.back() - min(beg_poses.back(), end_poses.back()) + 1));
+    }
+
+    vector<uint64_t> vals(num), ranks(num), freqs(num), qposes(num), qvals(num);
+    wa.LookupBatch(&poses[0], num, &vals[0]);
+    wa.RankBatch(&cs[0], &poses[0], num, &ranks[0]);
+    wa.FreqRangeBatch(&min_cs[0], &max_cs[0], &beg_poses[0], &end_poses[0], num, &freqs[0]);
+    wa.QuantileRangeBatch(&beg_poses[0], &end_poses[0], &ks[0], num, &qposes[0], &qvals[0]);
+    for (uint64_t i = 0; i < num; ++i){
+      ASSERT_EQ(wa.Lookup(poses[i]), vals[i]);
+      ASSERT_EQ(wa.Rank(cs[i], poses[i]), ranks[i]);
+      ASSERT_EQ(wa.FreqRange(min_cs[i], max_cs[i], beg_poses[i], end_poses[i]), freqs[i]);
+      if (ks[i] < end_poses[i] - beg_poses[i] || beg_poses[i] >= end_poses[i]){
+	uint64_t pos = 0;
+	uint64_t val = 0;
+	wa.QuantileRange(beg_poses[i], end_poses[i], ks[i], pos, val);
+	ASSERT_EQ(pos, qposes[i]);
+	ASSERT_EQ(val, qvals[i]);
+      }
+    }
+  }
+}
+
+TEST(wat_array, node_cache){
+  // the answers do not depend on how many levels are cached; the 
+  // alphabet of the last kind is larger than the array
+  for (int kind = 0; kind < 3; ++kind){
+    uint64_t n = 2000;
+    vector<uint64_t> array;
+    for (uint64_t i = 0; i < n; ++i){
+      array.push_back((kind == 2) ? rand() % 1000000 : rand() % 300);
+    }
+    wat_array::WatArray wa;
+    if (kind == 1) wa.set_layout(wat_array::BitArray::RRR_LAYOUT);
+    wa.set_node_cache_bytes(0);
+    wa.Init(array);
+    ASSERT_EQ(0, wa.node_cache_bytes());
+    uint64_t usage_bytes = wa.GetUsageBytes();
+
+    wat_array::WatArray cached_wa;
+    cached_wa.Init(array);
+    for (int bytes = 0; bytes < 3; ++bytes){
+      if (bytes == 1) cached_wa.set_node_cache_bytes(1 << 30);
+      if (bytes == 2) cached_wa.set_node_cache_bytes(100);
+      ASSERT_LT(usage_bytes, cached_wa.GetUsageBytes());
+      for (uint64_t i = 0; i < 300; ++i){
+	uint64_t pos = rand() % (n + 1);
+	uint64_t c = (i % 2) ? array[rand() % n] : rand() % wa.alphabet_num();
+	ASSERT_EQ(wa.Lookup(pos), cached_wa.Lookup(pos));
+	ASSERT_EQ(wa.Rank(c, pos), cached_wa.Rank(c, pos));
+	uint64_t rank = rand() % (wa.Freq(c) + 1) + 1;
+	ASSERT_EQ(wa.Select(c, rank), cached_wa.Select(c, rank));
+	uint64_t beg_pos = rand() % n;
+	uint64_t end_pos = beg_pos + 1 + rand() % (n - beg_pos);
+	uint64_t k = rand() % (end_pos - beg_pos);
+	uint64_t qpos = 0, qval = 0, cached_qpos = 0, cached_qval = 0;
+	wa.QuantileRange(beg_pos, end_pos, k, qpos, qval);
+	cached_wa.QuantileRange(beg_pos, end_pos, k, cached_qpos, cached_qval);
+	ASSERT_EQ(qpos, cached_qpos);
+	ASSERT_EQ(qval, cached_qval);
+	vector<wat_array::ListResult> res, cached_res;
+	wa.ListModeRange(0, wa.alphabet_num(), beg_pos, end_pos, 5, res);
+	cached_wa.ListModeRange(0, wa.alphabet_num(), beg_pos, end_pos, 5, cached_res);
+	ASSERT_EQ(res.size(), cached_res.size());
+	for (size_t j = 0; j < res.size(); ++j){
+	  ASSERT_EQ(res[j].c, cached_res[j].c);
+	  ASSERT_EQ(res[j].freq, cached_res[j].freq);
+	}
+      }
+    }
+  }
+}
+
 TEST(wat_array, list_mode_range){
   wat_array::WatArray wa;
   vector<uint64_t> array;
@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <cstdlib>
+#include "../src/wat_array.hpp"
+#include "../src/wat_array_thread_pool.hpp"
+
+using namespace std;
+using namespace wat_array;
+
+TEST(wat_array_thread_pool, trivial){
+  WatArray wa;
+  vector<uint64_t> array;
+  wa.Init(array);
+  WatArrayThreadPool pool(wa, 2);
+  ASSERT_EQ(2, pool.thread_num());
+  vector<RangeQuery> queries;
+  vector<RangeResult> results(3);
+  pool.Run(queries, results);
+  ASSERT_EQ(0, results.size());
+}
+
+TEST(wat_array_thread_pool, random){
+  uint64_t n = 5000;
+  vector<uint64_t> array;
+  for (uint64_t i = 0; i < n; ++i){
+    array.push_back(rand() % 200);
+  }
+  WatArray wa;
+  wa.Init(array);
+
+  for (uint64_t thread_num = 1; thread_num <= 4; thread_num *= 2){
+    WatArrayThreadPool pool(wa, thread_num);
+    // the same pool runs batches of several sizes
+    for (uint64_t query_num = 1; query_num <= 3000; query_num *= 7){
+      vector<RangeQuery> queries;
+      for (uint64_t i = 0; i < query_num; ++i){
+	uint64_t beg_pos = rand() % (n + 1);
+	uint64_t end_pos = rand() % (n + 1);
+	if (beg_pos > end_pos) swap(beg_pos, end_pos);
+	uint64_t min_c = rand() % 210;
+	uint64_t max_c = rand() % 210;
+	uint64_t k = (end_pos > beg_pos) ? rand() % (end_pos - beg_pos) : 0;
+	queries.push_back(RangeQuery((RangeQuery::Type)(i % 3), min_c, max_c, beg_pos, end_pos, 
+				     (i % 3 == 2) ? 5 : k));
+      }
+      vector<RangeResult> results;
+      pool.Run(queries, results);
+      ASSERT_EQ(query_num, results.size());
+
+      for (uint64_t i = 0; i < query_num; ++i){
+	const RangeQuery& q = queries[i];
+	if (q.type == RangeQuery::FREQ_RANGE){
+	  ASSERT_EQ(wa.FreqRange(q.min_c, q.max_c, q.beg_pos, q.end_pos), results[i].val);
+	} else if (q.type == RangeQuery::QUANTILE_RANGE){
+	  uint64_t pos = 0;
+	  uint64_t val = 0;
+	  wa.QuantileRange(q.beg_pos, q.end_pos, q.k, pos, val);
+	  ASSERT_EQ(pos, results[i].pos);
+	  ASSERT_EQ(val, results[i].val);
+	} else {
+	  vector<ListResult> list;
+	  wa.ListModeRange(q.min_c, q.max_c, q.beg_pos, q.end_pos, q.k, list);
+	  ASSERT_EQ(list.size(), results[i].list.size());
+	  for (size_t j = 0; j < list.size(); ++j){
+	    ASSERT_EQ(list[j].c, results[i].list[j].c);
+	    ASSERT_EQ(list[j].freq, results[i].list[j].freq);
+	  }
+	}
+      }
+    }
+  }
+}
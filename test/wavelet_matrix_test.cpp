@@ -0,0 +1,210 @@
+/* 
+ *  Copyright (c) 2010 Daisuke Okanohara
+  * 
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ * 
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <unistd.h>
+#include "../src/wavelet_matrix.hpp"
+
+using namespace std;
+
+TEST(wavelet_matrix, trivial){
+  wat_array::WaveletMatrix wm;
+  ASSERT_EQ(0, wm.alphabet_num());
+  ASSERT_EQ(0, wm.length());
+  ASSERT_EQ(wat_array::NOTFOUND, wm.Rank(0, 0));
+  ASSERT_EQ(wat_array::NOTFOUND, wm.Select(0, 0));
+  ASSERT_EQ(wat_array::NOTFOUND, wm.Lookup(0));
+  ASSERT_EQ(wat_array::NOTFOUND, wm.Freq(0));
+  ASSERT_EQ(wat_array::NOTFOUND, wm.FreqSum(0, 1));
+
+  uint64_t pos = 0;
+  uint64_t val = 0;
+  wm.MinRange(0, 0, pos, val);
+  ASSERT_EQ(wat_array::NOTFOUND, pos);
+
+  ostringstream oss;
+  wm.Save(oss);
+  istringstream iss(oss.str());
+  wat_array::WaveletMatrix wm_load;
+  wm_load.Load(iss);
+  ASSERT_EQ(false, !iss);
+  ASSERT_EQ(0, wm_load.length());
+}
+
+TEST(wavelet_matrix, alphanum_one){
+  vector<uint64_t> A(5, 0);
+  wat_array::WaveletMatrix wm;
+  wm.Init(A);
+  ASSERT_EQ(5, wm.length());
+  ASSERT_EQ(1, wm.alphabet_num());
+  ASSERT_EQ(5, wm.Freq(0));
+  ASSERT_EQ(5, wm.FreqSum(0, 1));
+  for (uint64_t i = 0; i < wm.length(); ++i){
+    ASSERT_EQ(0, wm.Lookup(i));
+    ASSERT_EQ(i, wm.Rank(0, i));
+    ASSERT_EQ(i, wm.Select(0, i+1));
+    uint64_t pos = 0;
+    uint64_t val = 0;
+    wm.MaxRange(i, wm.length(), pos, val);
+    ASSERT_EQ(i, pos);
+    ASSERT_EQ(0, val);
+  }
+}
+
+TEST(wavelet_matrix, same_as_wat_array){
+  wat_array::BitArray::Layout layouts[] = {wat_array::BitArray::INTERLEAVED_LAYOUT,
+					   wat_array::BitArray::SEPARATE_LAYOUT,
+					   wat_array::BitArray::RRR_LAYOUT};
+  for (int l = 0; l < 3; ++l){
+    uint64_t n = 3000;
+    uint64_t alphabet_num = (l == 0) ? 100 : 1000;
+    vector<uint64_t> A;
+    for (uint64_t i = 0; i < n; ++i){
+      A.push_back(rand() % alphabet_num);
+    }
+    wat_array::WatArray wa;
+    wa.set_layout(layouts[l]);
+    wa.Init(A);
+    wat_array::WaveletMatrix wm;
+    wm.set_layout(layouts[l]);
+    wm.Init(A);
+    ASSERT_EQ(wa.alphabet_num(), wm.alphabet_num());
+    ASSERT_EQ(wa.length(), wm.length());
+
+    for (uint64_t i = 0; i < n; ++i){
+      ASSERT_EQ(A[i], wm.Lookup(i));
+    }
+    for (uint64_t c = 0; c < wa.alphabet_num(); ++c){
+      ASSERT_EQ(wa.Freq(c), wm.Freq(c));
+      for (uint64_t rank = 1; rank <= wa.Freq(c) + 1; ++rank){
+	ASSERT_EQ(wa.Select(c, rank), wm.Select(c, rank));
+      }
+    }
+
+    for (uint64_t iter = 0; iter < 1000; ++iter){
+      uint64_t c   = rand() % (wa.alphabet_num() + 1);
+      uint64_t pos = rand() % (n + 1);
+      uint64_t rank, rank_less_than, rank_more_than;
+      uint64_t wm_rank, wm_rank_less_than, wm_rank_more_than;
+      wa.RankAll(c, pos, rank, rank_less_than, rank_more_than);
+      wm.RankAll(c, pos, wm_rank, wm_rank_less_than, wm_rank_more_than);
+      ASSERT_EQ(rank, wm_rank);
+      ASSERT_EQ(rank_less_than, wm_rank_less_than);
+      ASSERT_EQ(rank_more_than, wm_rank_more_than);
+      ASSERT_EQ(wa.RankLessThan(c, pos), wm.RankLessThan(c, pos));
+
+      uint64_t beg = rand() % n;
+      uint64_t end = beg + 1 + rand() % (n - beg);
+      uint64_t min_c = rand() % wa.alphabet_num();
+      uint64_t max_c = min_c + 1 + rand() % (wa.alphabet_num() - min_c);
+      // FreqRange also takes characters beyond the alphabet
+      uint64_t wide_max_c = min_c + 1 + rand() % (wa.alphabet_num() - min_c + 10);
+      ASSERT_EQ(wa.FreqRange(min_c, wide_max_c, beg, end), wm.FreqRange(min_c, wide_max_c, beg, end));
+      ASSERT_EQ(wa.FreqRange(min_c, max_c, beg, end), wm.FreqRange(min_c, max_c, beg, end));
+      ASSERT_EQ(wa.FreqSum(min_c, max_c), wm.FreqSum(min_c, max_c));
+
+      uint64_t k = rand() % (end - beg);
+      uint64_t wa_pos, wa_val, wm_pos, wm_val;
+      wa.QuantileRange(beg, end, k, wa_pos, wa_val);
+      wm.QuantileRange(beg, end, k, wm_pos, wm_val);
+      ASSERT_EQ(wa_pos, wm_pos);
+      ASSERT_EQ(wa_val, wm_val);
+      wa.MaxRange(beg, end, wa_pos, wa_val);
+      wm.MaxRange(beg, end, wm_pos, wm_val);
+      ASSERT_EQ(wa_pos, wm_pos);
+      ASSERT_EQ(wa_val, wm_val);
+      wa.MinRange(beg, end, wa_pos, wa_val);
+      wm.MinRange(beg, end, wm_pos, wm_val);
+      ASSERT_EQ(wa_pos, wm_pos);
+      ASSERT_EQ(wa_val, wm_val);
+
+      uint64_t num = rand() % 10 + 1;
+      vector<wat_array::ListResult> wa_lrs, wm_lrs;
+      wa.ListModeRange(min_c, max_c, beg, end, num, wa_lrs);
+      wm.ListModeRange(min_c, max_c, beg, end, num, wm_lrs);
+      ASSERT_EQ(wa_lrs.size(), wm_lrs.size());
+      for (size_t i = 0; i < wa_lrs.size(); ++i){
+	ASSERT_EQ(wa_lrs[i].c,    wm_lrs[i].c);
+	ASSERT_EQ(wa_lrs[i].freq, wm_lrs[i].freq);
+      }
+      wa.ListMinRange(min_c, max_c, beg, end, num, wa_lrs);
+      wm.ListMinRange(min_c, max_c, beg, end, num, wm_lrs);
+      ASSERT_EQ(wa_lrs.size(), wm_lrs.size());
+      for (size_t i = 0; i < wa_lrs.size(); ++i){
+	ASSERT_EQ(wa_lrs[i].c,    wm_lrs[i].c);
+	ASSERT_EQ(wa_lrs[i].freq, wm_lrs[i].freq);
+      }
+      wa.ListMaxRange(min_c, max_c, beg, end, num, wa_lrs);
+      wm.ListMaxRange(min_c, max_c, beg, end, num, wm_lrs);
+      ASSERT_EQ(wa_lrs.size(), wm_lrs.size());
+      for (size_t i = 0; i < wa_lrs.size(); ++i){
+	ASSERT_EQ(wa_lrs[i].c,    wm_lrs[i].c);
+	ASSERT_EQ(wa_lrs[i].freq, wm_lrs[i].freq);
+      }
+    }
+  }
+}
+
+TEST(wavelet_matrix, map){
+  vector<uint64_t> A;
+  for (uint64_t i = 0; i < 10000; ++i){
+    A.push_back(rand() % 1000);
+  }
+  wat_array::WaveletMatrix wm;
+  wm.Init(A);
+
+  char filename[] = "/tmp/wavelet_matrix_test_XXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_LE(0, fd);
+  close(fd);
+  {
+    ofstream ofs(filename, ios::binary);
+    wm.Save(ofs);
+    ASSERT_EQ(false, !ofs);
+  }
+
+  wat_array::WaveletMatrix wm_map;
+  ASSERT_EQ(0, wm_map.Map(filename));
+  ifstream ifs(filename, ios::binary);
+  wat_array::WaveletMatrix wm_load;
+  wm_load.Load(ifs);
+  ASSERT_EQ(false, !ifs);
+  for (uint64_t iter = 0; iter < 1000; ++iter){
+    uint64_t c   = rand() % 1000;
+    uint64_t pos = rand() % A.size();
+    ASSERT_EQ(A[pos], wm_map.Lookup(pos));
+    ASSERT_EQ(A[pos], wm_load.Lookup(pos));
+    ASSERT_EQ(wm.Rank(c, pos), wm_map.Rank(c, pos));
+    ASSERT_EQ(wm.Rank(c, pos), wm_load.Rank(c, pos));
+  }
+
+  // a WatArray file is not a wavelet matrix
+  wat_array::WatArray wa;
+  wa.Init(A);
+  {
+    ofstream ofs(filename, ios::binary);
+    wa.Save(ofs);
+  }
+  ASSERT_EQ(-1, wm_map.Map(filename));
+  ASSERT_EQ(0, wm_map.length());
+  remove(filename);
+}
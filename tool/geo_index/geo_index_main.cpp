@@ -0,0 +1,174 @@
+/*
+ *  Copyright (c) 2010 Daisuke Okanohara
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above Copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above Copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <iomanip>
+#include <math.h>
+#include <wat_array/geo_index.hpp>
+#include "../cmdline.h"
+
+using namespace std;
+
+// degrees are stored as integers in units of 1e-7 degrees,
+// with lon as x and lat as y
+const double SCALE = 10000000.0;
+
+bool ToCoord(double deg, double max_deg, uint64_t& coord){
+  if (!(-max_deg <= deg && deg <= max_deg)) return false;
+  coord = (uint64_t)llround((deg + max_deg) * SCALE);
+  return true;
+}
+
+double ToDegree(uint64_t coord, double max_deg){
+  return coord / SCALE - max_deg;
+}
+
+int ReadPointsFromFile(const string& file_name, vector<uint64_t>& xs, vector<uint64_t>& ys){
+  xs.clear();
+  ys.clear();
+  ifstream ifs;
+  if (file_name != "-"){
+    ifs.open(file_name.c_str());
+    if (!ifs){
+      cerr << "Unable to open [" << file_name << "]" << endl;
+      return -1;
+    }
+  }
+  istream& is = (file_name == "-") ? cin : ifs;
+  double lat = 0.0;
+  double lon = 0.0;
+  while (is >> lat >> lon){
+    uint64_t x = 0;
+    uint64_t y = 0;
+    if (!ToCoord(lon, 180.0, x) || !ToCoord(lat, 90.0, y)){
+      cerr << "Invalid point [" << lat << " " << lon << "] at line " << xs.size() + 1 << endl;
+      return -1;
+    }
+    xs.push_back(x);
+    ys.push_back(y);
+  }
+  return 0;
+}
+
+int BuildIndex(const string& input_file_name, const string& index_name){
+  vector<uint64_t> xs;
+  vector<uint64_t> ys;
+  if (ReadPointsFromFile(input_file_name, xs, ys) == -1){
+    return -1;
+  }
+
+  wat_array::GeoIndex gi;
+  gi.Init(xs, ys);
+
+  ofstream ofs(index_name.c_str());
+  if (!ofs){
+    cerr << "Unable to open [" << index_name << "]" << endl;
+    return -1;
+  }
+  gi.Save(ofs);
+  if (!ofs){
+    cerr << "Save failed [" << index_name << "]" << endl;
+    return -1;
+  }
+  return 0;
+}
+
+int SearchIndex(const string& index_name, const string& query_file_name, bool report){
+  ifstream ifs(index_name.c_str());
+  if (!ifs){
+    cerr << "Unable to open [" << index_name << "]" << endl;
+    return -1;
+  }
+  wat_array::GeoIndex gi;
+  gi.Load(ifs);
+  if (!ifs){
+    cerr << "Load failed [" << index_name << "]" << endl;
+    return -1;
+  }
+
+  ifstream qfs;
+  if (query_file_name != "-"){
+    qfs.open(query_file_name.c_str());
+    if (!qfs){
+      cerr << "Unable to open [" << query_file_name << "]" << endl;
+      return -1;
+    }
+  }
+  istream& is = (query_file_name == "-") ? cin : qfs;
+
+  // each query is min_lat min_lon max_lat max_lon, all inclusive
+  double min_lat = 0.0;
+  double min_lon = 0.0;
+  double max_lat = 0.0;
+  double max_lon = 0.0;
+  vector<wat_array::GeoPoint> res;
+  cout << fixed << setprecision(7);
+  while (is >> min_lat >> min_lon >> max_lat >> max_lon){
+    uint64_t min_x = 0;
+    uint64_t min_y = 0;
+    uint64_t max_x = 0;
+    uint64_t max_y = 0;
+    if (!ToCoord(min_lon, 180.0, min_x) || !ToCoord(max_lon, 180.0, max_x) ||
+	!ToCoord(min_lat, 90.0, min_y)  || !ToCoord(max_lat, 90.0, max_y)){
+      cerr << "Invalid query [" << min_lat << " " << min_lon << " " 
+	   << max_lat << " " << max_lon << "]" << endl;
+      return -1;
+    }
+    if (!report){
+      cout << gi.Count(min_x, max_x + 1, min_y, max_y + 1) << endl;
+      continue;
+    }
+    gi.Report(min_x, max_x + 1, min_y, max_y + 1, res);
+    cout << res.size() << endl;
+    for (size_t i = 0; i < res.size(); ++i){
+      cout << res[i].id << "\t" 
+	   << ToDegree(res[i].y, 90.0)  << "\t"
+	   << ToDegree(res[i].x, 180.0) << endl;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]){
+  cmdline::parser p;
+  p.add<string>("input",     'i', "points, one \"lat lon\" per line, - for stdin", false);
+  p.add<string>("geo_index", 'g', "geo index data", true);
+  p.add<string>("query",     'q', "queries, one \"min_lat min_lon max_lat max_lon\" per line, - for stdin", false);
+  p.add        ("report",    'r', "report the ids and the coordinates of the points, not only the count");
+  p.add        ("help",      'h', "print help");
+  p.set_program_name("wat_geo_index");
+  if (!p.parse(argc, argv) || p.exist("help") || 
+      p.exist("input") == p.exist("query")){
+    cerr << p.error_full() << p.usage();
+    return -1;
+  }
+
+  if (p.exist("input")){
+    if (BuildIndex(p.get<string>("input"), p.get<string>("geo_index")) == -1){
+      return -1;
+    }
+  } else if (SearchIndex(p.get<string>("geo_index"), p.get<string>("query"), 
+			 p.exist("report")) == -1){
+    return -1;
+  }
+
+  return 0;
+}
@@ -21,6 +21,7 @@
 #include <fstream>
 #include <vector>
 #include <wat_array/wat_array.hpp>
+#include <wat_array/wat_array_builder.hpp>
 #include "../cmdline.h"
 
 using namespace std;
@@ -39,14 +40,42 @@ int ReadArrayFromFile(const std::string& file_name, vector<uint64_t>& array){
   return 0;
 }
 
+int StreamIndex(const string& input_file_name,
+		const string& index_name,
+		const string& temp_dir){
+  ifstream ifs;
+  if (input_file_name != "-"){
+    ifs.open(input_file_name.c_str());
+    if (!ifs){
+      cerr << "Unable to open [" << input_file_name << "]" << endl;
+      return -1;
+    }
+  }
+  ofstream ofs(index_name.c_str());
+  if (!ofs){
+    cerr << "Unable to open [" << index_name << "]" << endl;
+    return -1;
+  }
+
+  wat_array::WatArrayBuilder builder;
+  builder.set_temp_dir(temp_dir);
+  if (builder.Build((input_file_name == "-") ? cin : ifs, ofs) == -1){
+    cerr << "Build failed [" << index_name << "]" << endl;
+    return -1;
+  }
+  return 0;
+}
+
 int BuildIndex(const string& input_file_name,
-	       const string& index_name){
+	       const string& index_name,
+	       bool compact_alphabet){
   vector<uint64_t> array;
   if (ReadArrayFromFile(input_file_name, array) == -1){
     return -1;
   }
 
   wat_array::WatArray wa;
+  wa.set_compact_alphabet(compact_alphabet);
   wa.Init(array);
   
   ofstream ofs(index_name.c_str());
@@ -67,20 +96,26 @@ int BuildIndex(const string& input_file_name,
 
 int main(int argc, char* argv[]){
   cmdline::parser p;
-  p.add<string>("input",     'i', "input data",          true);
+  p.add<string>("input",     'i', "input data, - for stdin", true);
   p.add<string>("wat_index", 'w', "watarray index data", true);
   p.add<string>("format",    'f', "format type",         false);
+  p.add<string>("temp_dir",  't', "directory of the temporary files", false, "/tmp");
+  p.add        ("compact",   'c', "compact the alphabet to the distinct values (builds in memory)");
   p.add        ("help",      'h', "print help");
   p.set_program_name("wat_array_cmdtool");
-  bool parse_error = p.parse(argc, argv);
-  if (parse_error || p.exist("help")){
-    p.usage();
+  if (!p.parse(argc, argv) || p.exist("help")){
+    cerr << p.error_full() << p.usage();
     return -1;
   }
 
-  if (BuildIndex(p.get<string>("input"), p.get<string>("wat_index")) == -1){
+  if (p.exist("compact")){
+    if (BuildIndex(p.get<string>("input"), p.get<string>("wat_index"), true) == -1){
+      return -1;
+    }
+  } else if (StreamIndex(p.get<string>("input"), p.get<string>("wat_index"), 
+			 p.get<string>("temp_dir")) == -1){
     return -1;
-  }  
+  }
   
   return 0;
 }